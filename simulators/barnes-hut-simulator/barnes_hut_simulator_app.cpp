@@ -11,6 +11,8 @@
 #include "bounding_box.h"
 #include "loader.h"
 #include "persistence.h"
+#include "quadtree_refit.h"  // QuadtreeRefitter
+#include "simulation_state.h"
 #include "src/barnes_hut_simulator.h"
 #include "step_format.h"
 
@@ -35,6 +37,56 @@ int main(int argc, char* argv[]) {
       .scan<'g', double>()
       .default_value(0.5)
       .help("specify the barnes–hut theta");
+  app.add_argument("--leaf-size")
+      .scan<'d', int>()
+      .default_value(bh::LinearQuadtree::DEFAULT_LEAF_SIZE)
+      .help("specify the maximum number of bodies in a leaf of the quadtree");
+  app.add_argument("--rebuild-interval")
+      .scan<'d', int>()
+      .default_value(1)
+      .help("specify every how many steps the quadtree is rebuilt from scratch, rather than refitted to the moved bodies");
+  app.add_argument("--max-imbalance")
+      .scan<'g', double>()
+      .default_value(bh::QuadtreeRefitter::DEFAULT_MAX_IMBALANCE)
+      .help("specify the fraction of bodies in overfull leaves above which a refitted quadtree is rebuilt");
+  app.add_argument("--quadrupoles")
+      .default_value(false)
+      .implicit_value(true)
+      .help("enables the quadrupole moments of the quadtree nodes, for more accurate forces at the same theta");
+  app.add_argument("--group-size")
+      .scan<'d', int>()
+      .default_value(1)
+      .help("specify the maximum number of nearby bodies sharing a traversal of the quadtree");
+  app.add_argument("--opening-criterion")
+      .default_value(std::string{"geometric"})
+      .help("specify the criterion opening the quadtree nodes: geometric (length / distance < theta), "
+            "bmax (farthest corner from the center of mass / distance < theta) or relative (force error < tolerance)");
+  app.add_argument("--force-tolerance")
+      .scan<'g', double>()
+      .default_value(bh::DEFAULT_FORCE_TOLERANCE)
+      .help("specify the fraction of the acceleration of a body allowed as the error of a node, for the relative criterion");
+  app.add_argument("--solver")
+      .default_value(std::string{"barnes-hut"})
+      .help("specify the force solver: barnes-hut, dual-tree (node-node interactions) or fmm (fast multipole method)");
+  app.add_argument("--fmm-order")
+      .scan<'d', int>()
+      .default_value(bh::FmmSolver::DEFAULT_ORDER)
+      .help("specify the order of the expansions of the fast multipole method");
+  app.add_argument("--integrator")
+      .default_value(std::string{"euler"})
+      .help("specify the integrator: euler (first-order) or leapfrog (kick-drift-kick, second-order)");
+  app.add_argument("--max-timestep-level")
+      .scan<'d', int>()
+      .default_value(0)
+      .help("specify the highest level of the power-of-two block timesteps dt / 2^level (leapfrog only); 0 disables them");
+  app.add_argument("--timestep-accuracy")
+      .scan<'g', double>()
+      .default_value(bh::DEFAULT_TIMESTEP_ACCURACY)
+      .help("specify the fraction of the free-fall time of a body used as its block timestep");
+  app.add_argument("--reorder-interval")
+      .scan<'d', int>()
+      .default_value(0)
+      .help("specify the number of steps between two reorderings of the bodies in Morton order; 0 never reorders them");
   app.add_argument("--sampling-rate")
       .scan<'d', int>()
       .default_value(1)
@@ -48,6 +100,21 @@ int main(int argc, char* argv[]) {
 
   try {
     app.parse_args(argc, argv);
+    if (const auto solver = app.get("--solver"); solver != "barnes-hut" && solver != "dual-tree" && solver != "fmm") {
+      throw std::runtime_error("Invalid solver: " + solver);
+    }
+    if (const auto criterion = app.get("--opening-criterion"); criterion != "geometric" && criterion != "bmax" && criterion != "relative") {
+      throw std::runtime_error("Invalid opening criterion: " + criterion);
+    }
+    if (const auto integrator = app.get("--integrator"); integrator != "euler" && integrator != "leapfrog") {
+      throw std::runtime_error("Invalid integrator: " + integrator);
+    }
+    if (app.get<int>("--max-timestep-level") > 0 && app.get("--integrator") != "leapfrog") {
+      throw std::runtime_error("The block timesteps need the leapfrog integrator");
+    }
+    if (app.get<int>("--reorder-interval") < 0) {
+      throw std::runtime_error("The reordering interval must be non-negative");
+    }
   } catch (const std::runtime_error& err) {
     std::cerr << app;
     std::exit(1);
@@ -58,15 +125,39 @@ int main(int argc, char* argv[]) {
   const auto dt = app.get<double>("dt");
   const auto G = app.get<double>("-G");
   const auto theta = app.get<double>("--theta");
+  bh::StepOptions options;
+  options.leaf_size = app.get<int>("--leaf-size");
+  options.rebuild_interval = app.get<int>("--rebuild-interval");
+  options.max_imbalance = app.get<double>("--max-imbalance");
+  options.quadrupoles = app.get<bool>("--quadrupoles");
+  options.group_size = app.get<int>("--group-size");
+  if (const auto solver = app.get("--solver"); solver == "dual-tree") {
+    options.solver = bh::Solver::DUAL_TREE;
+  } else if (solver == "fmm") {
+    options.solver = bh::Solver::FMM;
+  }
+  options.fmm_order = app.get<int>("--fmm-order");
+  if (const auto criterion = app.get("--opening-criterion"); criterion == "bmax") {
+    options.opening_criterion = bh::OpeningCriterion::BMAX;
+  } else if (criterion == "relative") {
+    options.opening_criterion = bh::OpeningCriterion::RELATIVE_FORCE;
+  }
+  options.force_tolerance = app.get<double>("--force-tolerance");
+  if (app.get("--integrator") == "leapfrog") {
+    options.integrator = bh::Integrator::LEAPFROG;
+  }
+  options.max_timestep_level = app.get<int>("--max-timestep-level");
+  options.timestep_accuracy = app.get<double>("--timestep-accuracy");
+  options.reorder_interval = app.get<int>("--reorder-interval");
   const auto sampling_rate = app.get<int>("--sampling-rate");
   const auto no_output = app.get<bool>("--no-output");
   const auto timings = app.present("--timings");
 
   auto initial_bodies = bh::load_bodies(input);
 
-  auto last_step = bh::BarnesHutSimulationStep(std::move(initial_bodies), bh::compute_square_bounding_box(initial_bodies));
+  bh::SimulationState state{bh::BarnesHutSimulationStep(std::move(initial_bodies), bh::compute_square_bounding_box(initial_bodies))};
   if (!no_output) {
-    bh::write_to_file(last_step, "step" + bh::format_step_n(0, steps) + ".json");
+    bh::write_to_file(state.last_step(), "step" + bh::format_step_n(0, steps) + ".json");
   }
 
   spdlog::cfg::load_env_levels();
@@ -75,10 +166,10 @@ int main(int argc, char* argv[]) {
   for (int i = 1; i <= steps; i++) {
     spdlog::info("Step {}", i);
 
-    last_step = bh::step(last_step, dt, G, theta);
+    bh::step(state, dt, G, theta, options);
 
     if (!no_output && i % sampling_rate == 0) {
-      bh::write_to_file(last_step, "step" + bh::format_step_n(i, steps) + ".json");
+      bh::write_to_file(state.last_step(), "step" + bh::format_step_n(i, steps) + ".json");
     }
   }
 
@@ -3,30 +3,76 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/stopwatch.h>
 
-#include "body_update.h"   // update_body
-#include "bounding_box.h"  // compute_square_bounding_box
-#include "quadtree.h"      // construct_quadtree
+#include "body_update.h"      // update_body, kick_and_drift, kick, drift, compute_timestep_level
+#include "bounding_box.h"     // compute_square_bounding_box
+#include "dual_tree.h"        // compute_dual_tree_net_forces
+#include "fmm.h"
+#include "force.h"            // compute_approximate_net_forces
+#include "linear_quadtree.h"  // compute_quadrupoles, compute_opening_radii, compute_cells, find_leaf
+#include "morton.h"           // compute_morton_keys, radix_sort
+#include "quadtree_arena.h"
+#include "quadtree_refit.h"
 
+#include <algorithm>  // fill, max, transform
+#include <cmath>      // sqrt
+#include <cstdint>    // uint32_t
+#include <memory>     // shared_ptr
+#include <numeric>    // iota
 #ifdef WITH_TBB
-#include <algorithm>  // transform
 #include <execution>  // par_unseq
 #endif
-#include <utility>  // move
+#include <stdexcept>  // invalid_argument
+#include <string>     // to_string
+#include <utility>    // move, swap
 
 namespace bh {
 
 Timings m_timings;
+// The quadtree of each step is allocated from the storage of the one of the step before the last
+QuadtreeArena m_arena;
+QuadtreeRefitter m_refitter;
+// Forces acting on the bodies, and scratch memory to compute them, reused across steps
+std::vector<Eigen::Vector2d> m_forces;
+GroupWalkBuffers m_group_walk_buffers;
+DualTreeBuffers m_dual_tree_buffers;
+// Opening scale of each body for the relative force criterion, from its acceleration at the last step
+std::vector<double> m_opening_scales;
+FmmSolver m_fmm_solver;
+// Bodies whose block timestep ends in a substep, with their indices and opening scales
+std::vector<std::uint32_t> m_active;
+std::vector<Body> m_active_bodies;
+std::vector<double> m_active_opening_scales;
+std::vector<int> m_timestep_levels;
+std::vector<Eigen::AlignedBox2d> m_cells;
+// Slot of each body among the bodies of a drifted quadtree, and its leaf
+std::vector<LinearQuadtree::Index> m_slots;
+std::vector<LinearQuadtree::Index> m_leaves;
+std::vector<LinearQuadtree::Index> m_next_slots;
+// Velocity of the center of mass of each node of a drifted quadtree, and the largest speed of its bodies relative to it
+std::vector<Eigen::Vector2d> m_node_velocities;
+std::vector<double> m_node_spreads;
+// Steps computed since the bodies were last reordered, and scratch memory to reorder them
+int m_n_steps_since_reorder = 0;
+std::vector<MortonKey> m_reorder_keys;
+std::vector<std::uint32_t> m_reorder_order;
+RadixSortBuffers m_reorder_radix_sort_buffers;
+std::vector<Body> m_reordered_bodies;
+std::vector<Eigen::Vector2d> m_reordered_accelerations;
+std::vector<std::uint32_t> m_reordered_ids;
+std::vector<double> m_reordered_opening_scales;
 
 std::chrono::duration<double> Timings::total() const {
   return construct_quadtree +
          update_body +
-         compute_square_bounding_box;
+         compute_square_bounding_box +
+         reorder_bodies;
 }
 
 std::ostream& operator<<(std::ostream& os, const Timings& timings) {
   os << "Quadtree construction: " << timings.construct_quadtree.count() << " s\n";
   os << "Bodies update: " << timings.update_body.count() << " s\n";
   os << "Bounding box computation: " << timings.compute_square_bounding_box.count() << " s\n";
+  os << "Bodies reordering: " << timings.reorder_bodies.count() << " s\n";
   os << "Total: " << timings.total().count() << " s\n";
   return os;
 }
@@ -35,46 +81,551 @@ const Timings& timings() {
   return m_timings;
 }
 
-BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta) {
-  spdlog::stopwatch sw;
+/**
+ * Whether the relative force criterion can be used, i.e., the accelerations of the bodies are known from the last step:
+ * without them, bmax is used instead.
+ */
+bool use_relative_force_impl(const std::vector<Body>& bodies, const StepOptions& options) {
+  return options.opening_criterion == OpeningCriterion::RELATIVE_FORCE && m_opening_scales.size() == bodies.size();
+}
+
+/**
+ * Updates the opening scales of the bodies for the relative force criterion, from their forces in m_forces.
+ */
+void update_opening_scales_impl(const std::vector<Body>& bodies, const StepOptions& options) {
+  if (options.opening_criterion == OpeningCriterion::RELATIVE_FORCE) {
+    m_opening_scales.resize(bodies.size());
+    for (std::size_t i = 0; i < m_opening_scales.size(); i++) {
+      m_opening_scales[i] = compute_relative_opening_scale(m_forces[i] / bodies[i].m_mass);
+    }
+  }
+}
 
+/**
+ * Constructs the quadtree containing some bodies, with the moments and the opening radii needed by the options.
+ */
+std::shared_ptr<LinearQuadtree> construct_quadtree_impl(const std::vector<Body>& bodies, const Eigen::AlignedBox2d& bbox,
+                                                        double G, double theta, const StepOptions& options) {
   spdlog::debug("Constructing quadtree...");
-  auto quadtree = construct_quadtree(last_step.bodies(), last_step.bbox());
+  auto quadtree = m_refitter.construct(bodies, bbox, m_arena, options.leaf_size, options.rebuild_interval, options.max_imbalance);
+  spdlog::debug(m_refitter.refitted() ? "Quadtree refitted" : "Quadtree rebuilt");
+  if (options.quadrupoles && options.solver == Solver::BARNES_HUT) {
+    spdlog::debug("Computing quadrupole moments...");
+    compute_quadrupoles(*quadtree);
+  }
+  if (options.opening_criterion != OpeningCriterion::GEOMETRIC && options.solver == Solver::BARNES_HUT) {
+    spdlog::debug("Computing opening radii...");
+    compute_opening_radii(*quadtree, use_relative_force_impl(bodies, options) ? OpeningCriterion::RELATIVE_FORCE : OpeningCriterion::BMAX,
+                          theta, G, options.force_tolerance);
+  }
+  return quadtree;
+}
+
+/**
+ * Computes the net force acting on each body in m_forces, with the solver of the options.
+ * @param opening_scales of the bodies for the relative force criterion, or empty for bmax
+ */
+void compute_net_forces_impl(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G, double theta,
+                             const StepOptions& options, const std::vector<double>& opening_scales) {
+  if (options.solver == Solver::DUAL_TREE) {
+    spdlog::debug("Computing forces with the dual-tree walk...");
+    const auto counts = compute_dual_tree_net_forces(quadtree, bodies, G, theta, m_forces, m_dual_tree_buffers);
+    spdlog::debug("{} node-node and {} body-body interactions", counts.m_approximated, counts.m_exact);
+  } else if (options.solver == Solver::FMM) {
+    spdlog::debug("Computing forces with the FMM...");
+    if (m_fmm_solver.order() != options.fmm_order) {
+      m_fmm_solver = FmmSolver{options.fmm_order};
+    }
+    m_fmm_solver.compute_net_forces(quadtree, bodies, G, theta, m_forces);
+  } else {
+    spdlog::debug("Computing forces by groups of bodies...");
+    compute_approximate_net_forces(quadtree, bodies, G, theta, options.group_size, m_forces, m_group_walk_buffers, opening_scales);
+  }
+}
+
+/**
+ * Computes the net force acting on each of all the bodies in m_forces, and updates their opening scales.
+ */
+void compute_all_net_forces_impl(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G, double theta,
+                                 const StepOptions& options) {
+  if (use_relative_force_impl(bodies, options)) {
+    compute_net_forces_impl(quadtree, bodies, G, theta, options, m_opening_scales);
+  } else {
+    compute_net_forces_impl(quadtree, bodies, G, theta, options, {});
+  }
+  update_opening_scales_impl(bodies, options);
+}
+
+/**
+ * Computes the accelerations of the bodies of the last step, unless the step carries them.
+ * @param accelerations vector in which to write the accelerations; it is resized to the number of bodies
+ * @param quadtree set to the quadtree of the bodies of the last step, if it is constructed to compute the accelerations
+ */
+void initial_accelerations_impl(const BarnesHutSimulationStep& last_step, double G, double theta, const StepOptions& options,
+                                std::vector<Eigen::Vector2d>& accelerations, std::shared_ptr<LinearQuadtree>& quadtree) {
+  const auto& bodies = last_step.bodies();
+  if (last_step.accelerations().size() == bodies.size()) {
+    accelerations = last_step.accelerations();
+    return;
+  }
+
+  spdlog::debug("Computing initial accelerations...");
+  quadtree = construct_quadtree_impl(bodies, last_step.bbox(), G, theta, options);
+  compute_all_net_forces_impl(*quadtree, bodies, G, theta, options);
+  accelerations.resize(bodies.size());
+  std::transform(bodies.begin(), bodies.end(), m_forces.begin(), accelerations.begin(),
+                 [](const Body& body, const Eigen::Vector2d& force) -> Eigen::Vector2d {
+                   return force / body.m_mass;
+                 });
+}
+
+/**
+ * Computes the level of the block timestep of each body in m_timestep_levels.
+ * @details The timestep of a body is computed over the mean distance between the bodies in its leaf, so that it is
+ * shorter in denser regions, and does not depend on the bodies far away.
+ * @param quadtree containing the bodies at their current positions
+ * @return the highest level
+ */
+int compute_timestep_levels_impl(const LinearQuadtree& quadtree, const std::vector<Body>& bodies,
+                                 const std::vector<Eigen::Vector2d>& accelerations, double dt, const StepOptions& options) {
+  compute_cells(quadtree, m_cells);
+  m_timestep_levels.resize(bodies.size());
+  int max_level = 0;
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    const auto& leaf = quadtree.nodes()[find_leaf(quadtree, m_cells, bodies[i].m_position)];
+    const double length = leaf.m_length / std::sqrt(std::max<double>(leaf.m_n_bodies, 1));
+    m_timestep_levels[i] = compute_timestep_level(accelerations[i], dt, length, options.timestep_accuracy,
+                                                  options.max_timestep_level);
+    max_level = std::max(max_level, m_timestep_levels[i]);
+  }
+  return max_level;
+}
+
+/**
+ * Computes the next step of the simulation with the kick-drift-kick leapfrog integrator.
+ * @details The quadtree is constructed on the drifted bodies, whose bounding box is the one of the new step.
+ */
+void step_leapfrog_impl(const BarnesHutSimulationStep& last_step, BarnesHutSimulationStep& new_step, double dt, double G,
+                        double theta, const StepOptions& options) {
+  spdlog::stopwatch sw;
+
+  const auto& bodies = last_step.bodies();
+  auto& accelerations = new_step.accelerations();
+  std::shared_ptr<LinearQuadtree> initial_quadtree;
+  initial_accelerations_impl(last_step, G, theta, options, accelerations, initial_quadtree);
+
+  spdlog::debug("Kicking and drifting bodies...");
+  auto& new_bodies = new_step.bodies();
+  new_bodies.resize(bodies.size());
+  std::transform(bodies.begin(), bodies.end(), accelerations.begin(), new_bodies.begin(), [&](const Body& body, const Eigen::Vector2d& acceleration) {
+    return kick_and_drift(body, acceleration, dt);
+  });
+
+  m_timings.update_body += sw.elapsed();
+  sw.reset();
+
+  spdlog::debug("Computing new bounding box...");
+  const auto new_bbox = compute_square_bounding_box(new_bodies);
+
+  m_timings.compute_square_bounding_box += sw.elapsed();
+  sw.reset();
+
+  auto quadtree = construct_quadtree_impl(new_bodies, new_bbox, G, theta, options);
 
   m_timings.construct_quadtree += sw.elapsed();
   sw.reset();
 
-  std::vector<Body> new_bodies{last_step.bodies().size()};
-#ifdef WITH_TBB
-  spdlog::debug("Computing new bodies (TBB)...");
+  compute_all_net_forces_impl(*quadtree, new_bodies, G, theta, options);
 
-  std::transform(std::execution::par_unseq,
-                 last_step.bodies().begin(), last_step.bodies().end(),
-                 new_bodies.begin(),
-                 [&](const Body& body) {
-                   return update_body(body, *quadtree, dt, G, theta);
+  spdlog::debug("Kicking bodies...");
+  std::transform(new_bodies.begin(), new_bodies.end(), m_forces.begin(), accelerations.begin(),
+                 [](const Body& body, const Eigen::Vector2d& force) -> Eigen::Vector2d {
+                   return force / body.m_mass;
                  });
+  std::transform(new_bodies.begin(), new_bodies.end(), accelerations.begin(), new_bodies.begin(), [&](const Body& body, const Eigen::Vector2d& acceleration) {
+    return kick(body, acceleration, dt);
+  });
+
+  m_timings.update_body += sw.elapsed();
+
+  new_step.bbox() = new_bbox;
+  new_step.set_quadtree(std::move(quadtree));
+}
+
+/**
+ * Prepares a quadtree to be drifted with its bodies, assigning each body a slot among the bodies of its leaf.
+ * @param bodies contained in the quadtree, at the positions it has been constructed with
+ * @return false if the bodies cannot be assigned a slot, since some coinciding ones have been merged
+ */
+bool prepare_drift_impl(LinearQuadtree& quadtree, const std::vector<Body>& bodies) {
+  const auto& nodes = quadtree.nodes();
+  compute_cells(quadtree, m_cells);
+  m_leaves.resize(bodies.size());
+  // The number of bodies in each leaf, then the next free slot of each leaf
+  m_next_slots.resize(nodes.size());
+  std::fill(m_next_slots.begin(), m_next_slots.end(), 0);
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    m_leaves[i] = find_leaf(quadtree, m_cells, bodies[i].m_position);
+    m_next_slots[m_leaves[i]]++;
+  }
+  for (LinearQuadtree::Index idx = 0; idx < nodes.size(); idx++) {
+    if (quadtree.is_leaf(idx) && m_next_slots[idx] != nodes[idx].m_n_bodies) {
+      return false;
+    }
+    m_next_slots[idx] = nodes[idx].m_first_body;
+  }
+  auto& leaf_bodies = quadtree.bodies();
+  m_slots.resize(bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    m_slots[i] = m_next_slots[m_leaves[i]]++;
+    leaf_bodies[m_slots[i]] = bodies[i];
+  }
+  return true;
+}
+
+/**
+ * Drifts the bodies of a quadtree, and the centers of mass of its nodes with them.
+ * @details The structure of the quadtree is the one it has been constructed with, and its bodies may leave the cells
+ * of their leaves: the length of each node grows by twice the distance its bodies may have moved away from its center
+ * of mass, so that the opening criterion stays as strict as in the constructed quadtree.
+ */
+void drift_quadtree_impl(LinearQuadtree& quadtree, double dt) {
+  auto& nodes = quadtree.nodes();
+  auto& leaf_bodies = quadtree.bodies();
+  m_node_velocities.resize(nodes.size());
+  m_node_spreads.resize(nodes.size());
+  // Visiting the nodes backwards, children are aggregated before their parents
+  for (auto idx = static_cast<LinearQuadtree::Index>(nodes.size()); idx-- > 0;) {
+    const auto& node = nodes[idx];
+    if (node.m_total_mass == 0) {
+      m_node_velocities[idx] = {0, 0};
+      m_node_spreads[idx] = 0;
+      continue;
+    }
+    Eigen::Vector2d momentum{0, 0};
+    double spread = 0;
+    if (quadtree.is_leaf(idx)) {
+      for (auto i = node.m_first_body; i < node.m_first_body + node.m_n_bodies; i++) {
+        momentum += leaf_bodies[i].m_mass * leaf_bodies[i].m_velocity;
+      }
+      // The center of mass of a leaf with a single body is the body, and moves exactly as it does
+      m_node_velocities[idx] = node.m_n_bodies == 1 ? leaf_bodies[node.m_first_body].m_velocity
+                                                    : Eigen::Vector2d{momentum / node.m_total_mass};
+      for (auto i = node.m_first_body; i < node.m_first_body + node.m_n_bodies; i++) {
+        spread = std::max(spread, (leaf_bodies[i].m_velocity - m_node_velocities[idx]).norm());
+      }
+    } else {
+      for (const auto child : quadtree.children(idx)) {
+        momentum += nodes[child].m_total_mass * m_node_velocities[child];
+      }
+      m_node_velocities[idx] = momentum / node.m_total_mass;
+      for (const auto child : quadtree.children(idx)) {
+        if (nodes[child].m_total_mass > 0) {
+          spread = std::max(spread, (m_node_velocities[child] - m_node_velocities[idx]).norm() + m_node_spreads[child]);
+        }
+      }
+    }
+    m_node_spreads[idx] = spread;
+  }
+
+  for (auto& body : leaf_bodies) {
+    body.m_position += body.m_velocity * dt;
+  }
+  for (std::size_t idx = 0; idx < nodes.size(); idx++) {
+    nodes[idx].m_center_of_mass += m_node_velocities[idx] * dt;
+    nodes[idx].m_length += 2 * m_node_spreads[idx] * dt;
+  }
+}
+
+/**
+ * Computes the next step of the simulation with hierarchical power-of-two block timesteps.
+ * @details At the start of the step, each body is assigned the level l of its timestep dt / 2^l, from its acceleration
+ * (see compute_timestep_levels_impl). The step is divided into 2^L substeps, L being the highest level: in each substep
+ * all the bodies drift, while each body is kicked (kick-drift-kick leapfrog) only at the start and at the end of its
+ * own timestep, and only the forces of the bodies whose timestep ends are computed.
+ * With the Barnes–Hut solver and the geometric opening criterion without quadrupoles, the quadtree is constructed at
+ * the start of the step, and its bodies and their centers of mass are drifted in each substep (see
+ * drift_quadtree_impl); the quadtree of the new step is constructed at its end. Otherwise, the quadtree is constructed
+ * (or refitted, see StepOptions::rebuild_interval) at the end of each substep in which some body is active.
+ * All the timesteps end at the end of the step, where all the bodies are synchronized.
+ */
+void step_block_impl(const BarnesHutSimulationStep& last_step, BarnesHutSimulationStep& new_step, double dt, double G,
+                     double theta, const StepOptions& options) {
+  spdlog::stopwatch sw;
+
+  auto& new_bodies = new_step.bodies();
+  new_bodies = last_step.bodies();
+  auto& accelerations = new_step.accelerations();
+  std::shared_ptr<LinearQuadtree> quadtree;
+  initial_accelerations_impl(last_step, G, theta, options, accelerations, quadtree);
+  const int n_bodies = static_cast<int>(new_bodies.size());
+
+  // The quadtree of the last step contains the bodies at their current positions, if it has not been constructed now
+  const int max_level = compute_timestep_levels_impl(quadtree ? *quadtree : last_step.quadtree(), new_bodies, accelerations,
+                                                     dt, options);
+  const int n_substeps = 1 << max_level;
+  const double substep = dt / n_substeps;
+  spdlog::debug("{} substeps", n_substeps);
+
+  m_timings.update_body += sw.elapsed();
+  sw.reset();
+
+  bool drifted = false;
+  // The quadrupole moments and the opening radii would not follow the drift
+  if (options.solver == Solver::BARNES_HUT && !options.quadrupoles && options.opening_criterion == OpeningCriterion::GEOMETRIC) {
+    // Not shared with the last step nor kept by the refitter, since its nodes are modified
+    auto drifted_quadtree = construct_linear_quadtree(new_bodies, last_step.bbox(), m_arena, options.leaf_size);
+    drifted = prepare_drift_impl(*drifted_quadtree, new_bodies);
+    if (drifted) {
+      quadtree = std::move(drifted_quadtree);
+    }
+    spdlog::debug(drifted ? "Drifting the quadtree" : "Coinciding bodies: constructing the quadtree in each substep");
+  }
+
+  m_timings.construct_quadtree += sw.elapsed();
+
+  for (int s = 0; s < n_substeps; s++) {
+    sw.reset();
+
+    // A body of level l is kicked every 2^(max_level - l) substeps, for half of its timestep
+    for (int i = 0; i < n_bodies; i++) {
+      const int period_mask = (1 << (max_level - m_timestep_levels[i])) - 1;
+      if ((s & period_mask) == 0) {
+        const double timestep = dt / (1 << m_timestep_levels[i]);
+        auto& body = drifted ? quadtree->bodies()[m_slots[i]] : new_bodies[i];
+        body = kick(body, accelerations[i], timestep);
+      }
+      if (!drifted) {
+        new_bodies[i] = drift(new_bodies[i], substep);
+      }
+    }
+    if (drifted) {
+      drift_quadtree_impl(*quadtree, substep);
+    }
+
+    m_active.clear();
+    m_active_bodies.clear();
+    for (int i = 0; i < n_bodies; i++) {
+      if (((s + 1) & ((1 << (max_level - m_timestep_levels[i])) - 1)) == 0) {
+        m_active.push_back(i);
+        m_active_bodies.push_back(drifted ? quadtree->bodies()[m_slots[i]] : new_bodies[i]);
+      }
+    }
+
+    m_timings.update_body += sw.elapsed();
+    sw.reset();
+
+    if (m_active.empty()) {
+      continue;
+    }
+    spdlog::debug("Substep {}: {} active bodies", s, m_active.size());
+
+    if (!drifted) {
+      quadtree = construct_quadtree_impl(new_bodies, compute_square_bounding_box(new_bodies), G, theta, options);
+
+      m_timings.construct_quadtree += sw.elapsed();
+      sw.reset();
+    }
+
+    if (use_relative_force_impl(new_bodies, options)) {
+      m_active_opening_scales.clear();
+      for (const auto i : m_active) {
+        m_active_opening_scales.push_back(m_opening_scales[i]);
+      }
+      compute_net_forces_impl(*quadtree, m_active_bodies, G, theta, options, m_active_opening_scales);
+    } else {
+      compute_net_forces_impl(*quadtree, m_active_bodies, G, theta, options, {});
+    }
+
+    for (std::size_t k = 0; k < m_active.size(); k++) {
+      const auto i = m_active[k];
+      const double timestep = dt / (1 << m_timestep_levels[i]);
+      accelerations[i] = m_forces[k] / new_bodies[i].m_mass;
+      auto& body = drifted ? quadtree->bodies()[m_slots[i]] : new_bodies[i];
+      body = kick(body, accelerations[i], timestep);
+      if (options.opening_criterion == OpeningCriterion::RELATIVE_FORCE) {
+        m_opening_scales[i] = compute_relative_opening_scale(accelerations[i]);
+      }
+    }
+
+    m_timings.update_body += sw.elapsed();
+  }
+
+  sw.reset();
+
+  if (drifted) {
+    for (int i = 0; i < n_bodies; i++) {
+      new_bodies[i] = quadtree->bodies()[m_slots[i]];
+    }
+  }
+  const auto new_bbox = compute_square_bounding_box(new_bodies);
+
+  m_timings.compute_square_bounding_box += sw.elapsed();
+
+  if (drifted) {
+    // The bodies of the step have to be contained in the cells of the leaves of its quadtree
+    sw.reset();
+    quadtree = construct_quadtree_impl(new_bodies, new_bbox, G, theta, options);
+    m_timings.construct_quadtree += sw.elapsed();
+  }
+
+  new_step.bbox() = new_bbox;
+  new_step.set_quadtree(std::move(quadtree));
+}
+
+/**
+ * Computes the next step of the simulation with the Euler integrator.
+ */
+void step_euler_impl(const BarnesHutSimulationStep& last_step, BarnesHutSimulationStep& new_step, double dt, double G,
+                     double theta, const StepOptions& options) {
+  spdlog::stopwatch sw;
+
+  auto quadtree = construct_quadtree_impl(last_step.bodies(), last_step.bbox(), G, theta, options);
+
+  m_timings.construct_quadtree += sw.elapsed();
+  sw.reset();
+
+  auto& new_bodies = new_step.bodies();
+  new_bodies.resize(last_step.bodies().size());
+  // The Euler integrator does not carry the accelerations
+  new_step.accelerations().clear();
+  if (options.solver != Solver::BARNES_HUT || options.group_size > 1 ||
+      options.opening_criterion == OpeningCriterion::RELATIVE_FORCE) {
+    compute_all_net_forces_impl(*quadtree, last_step.bodies(), G, theta, options);
+
+    spdlog::debug("Computing new bodies...");
+    std::transform(last_step.bodies().begin(), last_step.bodies().end(),
+                   m_forces.begin(),
+                   new_bodies.begin(),
+                   [&](const Body& body, const Eigen::Vector2d& force) {
+                     return update_body(body, force, dt);
+                   });
+  } else {
+#ifdef WITH_TBB
+    spdlog::debug("Computing new bodies (TBB)...");
+
+    std::transform(std::execution::par_unseq,
+                   last_step.bodies().begin(), last_step.bodies().end(),
+                   new_bodies.begin(),
+                   [&](const Body& body) {
+                     return update_body(body, *quadtree, dt, G, theta);
+                   });
 #else
-  spdlog::debug("Computing new bodies (OpenMP)...");
+    spdlog::debug("Computing new bodies (OpenMP)...");
 
 #pragma omp parallel for default(none) shared(last_step, new_bodies, quadtree, dt, G, theta)
-  for (size_t i = 0; i < last_step.bodies().size(); i++) {
+    for (size_t i = 0; i < last_step.bodies().size(); i++) {
 #ifdef DEBUG_OPENMP_BODY_UPDATE_FOR_LOOP
-    spdlog::trace("Updating body {}", i);
+      spdlog::trace("Updating body {}", i);
 #endif
-    new_bodies[i] = update_body(last_step.bodies()[i], *quadtree, dt, G, theta);
-  }
+      new_bodies[i] = update_body(last_step.bodies()[i], *quadtree, dt, G, theta);
+    }
 #endif
+  }
 
   m_timings.update_body += sw.elapsed();
   sw.reset();
 
   spdlog::debug("Computing new bounding box...");
-  auto new_bbox = compute_square_bounding_box(new_bodies);
+  new_step.bbox() = compute_square_bounding_box(new_bodies);
 
   m_timings.compute_square_bounding_box += sw.elapsed();
 
-  return {std::move(new_bodies), new_bbox, std::move(quadtree)};
+  new_step.set_quadtree(std::move(quadtree));
+}
+
+/**
+ * Permutes some values in place.
+ * @param order permutation: the i-th value becomes the order[i]-th one
+ * @param scratch memory into which the values are permuted; it is exchanged with the values
+ */
+template <typename T>
+void permute_impl(std::vector<T>& values, const std::vector<std::uint32_t>& order, std::vector<T>& scratch) {
+  scratch.resize(order.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    scratch[i] = values[order[i]];
+  }
+  std::swap(values, scratch);
+}
+
+/**
+ * Reorders the bodies of a step along the Morton curve, so that the bodies close in space are close in memory too.
+ * @details Their accelerations, opening scales and leaves in the refitter follow them, and so do the ids of the step,
+ * which must map them to their initial order. The quadtree of the step keeps its own copy of the bodies, and is not affected.
+ */
+void reorder_bodies_impl(BarnesHutSimulationStep& step) {
+  auto& bodies = step.bodies();
+  spdlog::debug("Reordering bodies...");
+  compute_morton_keys(bodies, step.bbox(), m_reorder_keys);
+  m_reorder_order.resize(bodies.size());
+  std::iota(m_reorder_order.begin(), m_reorder_order.end(), 0);
+  radix_sort(m_reorder_keys, m_reorder_order, m_reorder_radix_sort_buffers);
+
+  permute_impl(bodies, m_reorder_order, m_reordered_bodies);
+  permute_impl(step.ids(), m_reorder_order, m_reordered_ids);
+  if (step.accelerations().size() == bodies.size()) {
+    permute_impl(step.accelerations(), m_reorder_order, m_reordered_accelerations);
+  }
+  if (m_opening_scales.size() == bodies.size()) {
+    permute_impl(m_opening_scales, m_reorder_order, m_reordered_opening_scales);
+  }
+  m_refitter.permute(m_reorder_order);
+}
+
+/**
+ * Computes the next step of the simulation in the storage of another step.
+ * @param new_step step whose storage is reused; its quadtree is released first, so that the arena can reuse it
+ */
+void step_impl(const BarnesHutSimulationStep& last_step, BarnesHutSimulationStep& new_step, double dt, double G, double theta,
+               const StepOptions& options) {
+  if (options.integrator == Integrator::EULER && options.max_timestep_level > 0) {
+    throw std::invalid_argument("The block timesteps need the leapfrog integrator");
+  }
+  if (options.reorder_interval < 0) {
+    throw std::invalid_argument("The reordering interval must be non-negative (reorder_interval: " +
+                                std::to_string(options.reorder_interval) + ")");
+  }
+
+  new_step.set_quadtree(nullptr);
+  if (options.integrator == Integrator::LEAPFROG) {
+    if (options.max_timestep_level > 0) {
+      step_block_impl(last_step, new_step, dt, G, theta, options);
+    } else {
+      step_leapfrog_impl(last_step, new_step, dt, G, theta, options);
+    }
+  } else {
+    step_euler_impl(last_step, new_step, dt, G, theta, options);
+  }
+
+  // The bodies of the new step are in the order of the ones of the last step
+  new_step.ids() = last_step.ids();
+  if (options.reorder_interval <= 0) {
+    return;
+  }
+  // Every step of a simulation reordering its bodies carries ids, so a step without them starts a new simulation
+  if (new_step.ids().size() != new_step.bodies().size()) {
+    new_step.ids().resize(new_step.bodies().size());
+    std::iota(new_step.ids().begin(), new_step.ids().end(), 0);
+    m_n_steps_since_reorder = 0;
+  }
+  if (++m_n_steps_since_reorder >= options.reorder_interval) {
+    spdlog::stopwatch sw;
+    reorder_bodies_impl(new_step);
+    m_timings.reorder_bodies += sw.elapsed();
+    m_n_steps_since_reorder = 0;
+  }
+}
+
+BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta,
+                             const StepOptions& options) {
+  BarnesHutSimulationStep new_step{std::vector<Body>{}, Eigen::AlignedBox2d{}};
+  step_impl(last_step, new_step, dt, G, theta, options);
+  return new_step;
+}
+
+void step(SimulationState<BarnesHutSimulationStep>& state, double dt, double G, double theta, const StepOptions& options) {
+  step_impl(state.last_step(), state.next_step(), dt, G, theta, options);
+  state.advance();
 }
 
 }  // namespace bh
@@ -5,6 +5,11 @@
 #include <ostream>
 
 #include "barnes_hut_simulation_step.h"
+#include "body_update.h"  // Integrator
+#include "fmm.h"
+#include "linear_quadtree.h"
+#include "quadtree_refit.h"
+#include "simulation_state.h"
 
 namespace bh {
 
@@ -12,6 +17,7 @@ struct Timings final {
   std::chrono::duration<double> construct_quadtree;
   std::chrono::duration<double> update_body;
   std::chrono::duration<double> compute_square_bounding_box;
+  std::chrono::duration<double> reorder_bodies;
 
   [[nodiscard]] std::chrono::duration<double> total() const;
 
@@ -20,7 +26,68 @@ struct Timings final {
 
 const Timings& timings();
 
-BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta);
+enum class Solver {
+  // Walk of the quadtree per body, or per group of nearby bodies
+  BARNES_HUT,
+  // Walk of the quadtree against itself, letting well-separated nodes interact as a whole
+  // (see compute_dual_tree_net_forces)
+  DUAL_TREE,
+  // Fast Multipole Method (see FmmSolver)
+  FMM
+};
+
+struct StepOptions final {
+  // Maximum number of bodies in a leaf of the quadtree
+  int leaf_size = LinearQuadtree::DEFAULT_LEAF_SIZE;
+  // Number of steps between two full rebuilds of the quadtree;
+  // in the steps in between, the quadtree of the last step is refitted (see QuadtreeRefitter)
+  int rebuild_interval = 1;
+  // Fraction of the bodies in overfull leaves above which a refitted quadtree is rebuilt
+  double max_imbalance = QuadtreeRefitter::DEFAULT_MAX_IMBALANCE;
+  // Whether the forces of the approximated nodes include their quadrupole moments (Barnes–Hut only)
+  bool quadrupoles = false;
+  // Maximum number of nearby bodies sharing a traversal of the quadtree (see compute_approximate_net_forces);
+  // 1 walks the quadtree once per body (Barnes–Hut only)
+  int group_size = 1;
+  // Criterion deciding which nodes are opened (Barnes–Hut only); the relative force criterion uses bmax
+  // in the first step, before the accelerations of the bodies are known
+  OpeningCriterion opening_criterion = OpeningCriterion::GEOMETRIC;
+  // Fraction of the acceleration of a body allowed as the error of a node (relative force criterion only)
+  double force_tolerance = DEFAULT_FORCE_TOLERANCE;
+  Solver solver = Solver::BARNES_HUT;
+  // Order of the expansions (FMM only)
+  int fmm_order = FmmSolver::DEFAULT_ORDER;
+  // The leapfrog integrator carries the accelerations of the bodies in the steps,
+  // and computes them from the last step if it does not carry them
+  Integrator integrator = Integrator::EULER;
+  // Highest level of the power-of-two block timesteps dt / 2^level of the bodies; 0 moves all the bodies with dt
+  // (leapfrog only)
+  int max_timestep_level = 0;
+  // Fraction of the free-fall time of a body used as its block timestep (see compute_timestep_level)
+  double timestep_accuracy = DEFAULT_TIMESTEP_ACCURACY;
+  // Number of steps between two reorderings of the bodies in Morton order, which keeps the bodies close in space close
+  // in memory; 0 never reorders them. The ids of the steps map the bodies back to their initial order
+  int reorder_interval = 0;
+};
+
+/**
+ * Computes the next step of the simulation.
+ * @param dt timestep of the simulation; with block timesteps, the bodies are moved in substeps of it,
+ * and are all synchronized at its end
+ * @param theta opening parameter of the Barnes–Hut walk, or separation parameter of the FMM
+ * @throw invalid_argument if block timesteps are requested without the leapfrog integrator,
+ * or if the reordering interval is negative
+ */
+BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta,
+                             const StepOptions& options);
+
+/**
+ * Computes the next step of the simulation in the storage of the step before the last, and makes it the last step.
+ * @details The bodies, their accelerations and the quadtree of the new step reuse the storage of the step before
+ * the last, and the scratch memory of the simulator is kept across steps: once the number of bodies and the shape
+ * of the quadtree are stable, a step does not allocate heap memory.
+ */
+void step(SimulationState<BarnesHutSimulationStep>& state, double dt, double G, double theta, const StepOptions& options);
 
 }  // namespace bh
 
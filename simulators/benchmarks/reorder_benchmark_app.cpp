@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "barnes_hut_simulator.h"
+#include "bounding_box.h"
+#include "loader.h"
+#include "simulation_state.h"
+
+/**
+ * Hardware counter of the cache misses of the process, including the ones of the threads it creates after the counter
+ * is opened: it has to be opened before the first parallel region, so that it follows the threads of the pool.
+ * The misses are unavailable if the kernel does not give access to the counter (e.g. in containers).
+ */
+class CacheMissCounter {
+ public:
+  CacheMissCounter() {
+#ifdef __linux__
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+  }
+
+  ~CacheMissCounter() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+      close(m_fd);
+    }
+#endif
+  }
+
+  CacheMissCounter(const CacheMissCounter&) = delete;
+  CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+  void start() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  /**
+   * @return the cache misses since the counter was started, or nothing if they are unavailable
+   */
+  std::optional<std::uint64_t> stop() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+      std::uint64_t misses = 0;
+      if (read(m_fd, &misses, sizeof(misses)) == sizeof(misses)) {
+        return misses;
+      }
+    }
+#endif
+    return std::nullopt;
+  }
+
+ private:
+  int m_fd = -1;
+};
+
+/**
+ * Runs a simulation, and prints its time and cache misses.
+ * @return the time of the simulation
+ */
+std::chrono::duration<double> run(const std::string& name, const std::vector<bh::Body>& bodies, int steps, double dt,
+                                  double G, double theta, const bh::StepOptions& options, CacheMissCounter& counter) {
+  bh::SimulationState<bh::BarnesHutSimulationStep> state{
+      bh::BarnesHutSimulationStep{bodies, bh::compute_square_bounding_box(bodies)}};
+
+  counter.start();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < steps; i++) {
+    bh::step(state, dt, G, theta, options);
+  }
+  const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  const auto misses = counter.stop();
+
+  std::cout << name << ": " << time.count() << " s, " << time.count() / steps << " s per step, cache misses ";
+  if (misses) {
+    std::cout << *misses;
+  } else {
+    std::cout << "unavailable";
+  }
+  std::cout << "\n";
+  return time;
+}
+
+int main(int argc, char* argv[]) {
+  // Opened before any thread is created
+  CacheMissCounter unordered_counter;
+  CacheMissCounter reordered_counter;
+
+  argparse::ArgumentParser app("Barnes–Hut reordering benchmark");
+  app.add_argument("input")
+      .required()
+      .help("specify the input file");
+  app.add_argument("steps")
+      .scan<'d', int>()
+      .required()
+      .help("specify the number of steps");
+  app.add_argument("dt")
+      .scan<'g', double>()
+      .required()
+      .help("specify the time step");
+  app.add_argument("-G")
+      .scan<'g', double>()
+      .default_value(0.000000000066743)
+      .help("specify the gravitational constant");
+  app.add_argument("-t", "--theta")
+      .scan<'g', double>()
+      .default_value(0.5)
+      .help("specify the barnes–hut theta");
+  app.add_argument("--reorder-interval")
+      .scan<'d', int>()
+      .default_value(5)
+      .help("specify the number of steps between two reorderings of the bodies");
+  app.add_argument("--no-shuffle")
+      .default_value(false)
+      .implicit_value(true)
+      .help("keeps the bodies in the order of the input file, instead of shuffling them");
+
+  try {
+    app.parse_args(argc, argv);
+    if (app.get<int>("--reorder-interval") < 1) {
+      throw std::runtime_error("The reordering interval must be positive");
+    }
+  } catch (const std::runtime_error& err) {
+    std::cerr << app;
+    std::exit(1);
+  }
+
+  const auto steps = app.get<int>("steps");
+  const auto dt = app.get<double>("dt");
+  const auto G = app.get<double>("-G");
+  const auto theta = app.get<double>("--theta");
+
+  auto bodies = bh::load_bodies(app.get("input"));
+  // Generated inputs are often already ordered in space, which hides the benefit of the reordering
+  if (!app.get<bool>("--no-shuffle")) {
+    std::shuffle(bodies.begin(), bodies.end(), std::mt19937{42});
+  }
+
+  bh::StepOptions options;
+  const auto unordered_time = run("Input order", bodies, steps, dt, G, theta, options, unordered_counter);
+  options.reorder_interval = app.get<int>("--reorder-interval");
+  const auto reordered_time = run("Morton order every " + std::to_string(options.reorder_interval) + " steps", bodies,
+                                  steps, dt, G, theta, options, reordered_counter);
+  std::cout << "Speedup: " << unordered_time / reordered_time << "\n";
+
+  return 0;
+}
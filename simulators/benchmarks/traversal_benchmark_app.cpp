@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+#ifdef WITH_TBB
+#include <execution>
+#endif
+
+#include "bounding_box.h"
+#include "dual_tree.h"
+#include "force.h"
+#include "linear_quadtree.h"
+#include "loader.h"
+
+/**
+ * Computes the mean error of the forces acting on the first bodies, relative to their exact forces.
+ */
+double compute_mean_relative_error(const std::vector<bh::Body>& bodies, const std::vector<Eigen::Vector2d>& forces,
+                                   std::size_t n_samples, double G) {
+  n_samples = std::min(n_samples, bodies.size());
+  double error = 0;
+  for (std::size_t i = 0; i < n_samples; i++) {
+    const auto exact_force = bh::compute_exact_net_force_on_body_serial(bodies, bodies[i], G);
+    error += (forces[i] - exact_force).norm() / exact_force.norm();
+  }
+  return n_samples > 0 ? error / n_samples : 0;
+}
+
+void print_result(const std::string& name, const bh::InteractionCounts& counts, std::chrono::duration<double> time, double error) {
+  std::cout << name << ": " << counts.m_approximated << " approximated, " << counts.m_exact << " exact interactions, "
+            << time.count() << " s, mean relative error " << error << "\n";
+}
+
+int main(int argc, char* argv[]) {
+  argparse::ArgumentParser app("Barnes–Hut traversal benchmark");
+  app.add_argument("input")
+      .required()
+      .help("specify the input file");
+  app.add_argument("-G")
+      .scan<'g', double>()
+      .default_value(0.000000000066743)
+      .help("specify the gravitational constant");
+  app.add_argument("-t", "--theta")
+      .scan<'g', double>()
+      .default_value(0.5)
+      .help("specify the barnes–hut theta, the same for both walks");
+  app.add_argument("--leaf-size")
+      .scan<'d', int>()
+      .default_value(bh::LinearQuadtree::DEFAULT_LEAF_SIZE)
+      .help("specify the maximum number of bodies in a leaf of the quadtree");
+  app.add_argument("--repetitions")
+      .scan<'d', int>()
+      .default_value(5)
+      .help("specify how many times the forces are computed; the fastest time is reported");
+  app.add_argument("--samples")
+      .scan<'d', int>()
+      .default_value(1000)
+      .help("specify the number of bodies whose forces are compared with the exact ones");
+
+  try {
+    app.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << app;
+    std::exit(1);
+  }
+
+  const auto input = app.get("input");
+  const auto G = app.get<double>("-G");
+  const auto theta = app.get<double>("--theta");
+  const auto leaf_size = app.get<int>("--leaf-size");
+  const auto repetitions = app.get<int>("--repetitions");
+  const auto n_samples = static_cast<std::size_t>(app.get<int>("--samples"));
+
+  const auto bodies = bh::load_bodies(input);
+  const auto quadtree = bh::construct_linear_quadtree(bodies, bh::compute_square_bounding_box(bodies), 0, leaf_size);
+  std::vector<Eigen::Vector2d> forces(bodies.size());
+
+  // Fastest of the repetitions of a computation
+  const auto time = [&](const auto& compute) {
+    auto best = std::chrono::duration<double>::max();
+    for (int i = 0; i < repetitions; i++) {
+      const auto start = std::chrono::steady_clock::now();
+      compute();
+      best = std::min<std::chrono::duration<double>>(best, std::chrono::steady_clock::now() - start);
+    }
+    return best;
+  };
+
+  const auto walk_time = time([&] {
+#ifdef WITH_TBB
+    std::transform(std::execution::par_unseq, bodies.begin(), bodies.end(), forces.begin(), [&](const bh::Body& body) {
+      return bh::compute_approximate_net_force_on_body(quadtree, body, G, theta);
+    });
+#else
+#pragma omp parallel for default(none) shared(bodies, forces, quadtree, G, theta)
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      forces[i] = bh::compute_approximate_net_force_on_body(quadtree, bodies[i], G, theta);
+    }
+#endif
+  });
+  print_result("Per-body walk", bh::count_interactions(quadtree, bodies, theta), walk_time,
+               compute_mean_relative_error(bodies, forces, n_samples, G));
+
+  bh::DualTreeBuffers buffers;
+  bh::InteractionCounts dual_tree_counts;
+  const auto dual_tree_time = time([&] {
+    dual_tree_counts = bh::compute_dual_tree_net_forces(quadtree, bodies, G, theta, forces, buffers);
+  });
+  print_result("Dual-tree walk", dual_tree_counts, dual_tree_time, compute_mean_relative_error(bodies, forces, n_samples, G));
+
+  return 0;
+}
@@ -4,6 +4,7 @@
 #include <spdlog/cfg/env.h>
 #include <string>
 #include <utility>
+#include <vector>
 #include <fstream>
 #include <iostream>
 
@@ -30,6 +31,9 @@ int main(int argc, char* argv[]) {
       .scan<'g', double>()
       .default_value(0.000000000066743)
       .help("specify the simulation dt");
+  app.add_argument("--integrator")
+      .default_value(std::string{"euler"})
+      .help("specify the integrator: euler (first-order) or leapfrog (kick-drift-kick, second-order)");
   app.add_argument("--sampling-rate")
       .scan<'d', int>()
       .default_value(1)
@@ -43,6 +47,9 @@ int main(int argc, char* argv[]) {
 
   try {
     app.parse_args(argc, argv);
+    if (const auto integrator = app.get("--integrator"); integrator != "euler" && integrator != "leapfrog") {
+      throw std::runtime_error("Invalid integrator: " + integrator);
+    }
   } catch (const std::runtime_error& err) {
     std::cerr << app;
     std::exit(1);
@@ -52,15 +59,17 @@ int main(int argc, char* argv[]) {
   const auto steps = app.get<int>("steps");
   const auto dt = app.get<double>("dt");
   const auto G = app.get<double>("-G");
+  const auto integrator = app.get("--integrator") == "leapfrog" ? bh::Integrator::LEAPFROG : bh::Integrator::EULER;
   const auto sampling_rate = app.get<int>("--sampling-rate");
   const auto no_output = app.get<bool>("--no-output");
   const auto timings = app.present("--timings");
 
-  auto initial_bodies = bh::load_bodies(input);
-
-  auto last_step = bh::SimulationStep(std::move(initial_bodies), bh::compute_square_bounding_box(initial_bodies));
+  // The bodies are kept as structure of arrays across the steps, and only converted to the steps written
+  auto bodies = bh::load_soa_bodies(input);
+  std::vector<Eigen::Vector2d> accelerations;
+  auto bbox = bh::compute_square_bounding_box(bodies);
   if (!no_output) {
-    bh::write_to_file(last_step, "step" + bh::format_step_n(0, steps) + ".json");
+    bh::write_to_file(bh::SimulationStep(bh::to_aos(bodies), bbox), "step" + bh::format_step_n(0, steps) + ".json");
   }
 
   spdlog::cfg::load_env_levels();
@@ -69,10 +78,10 @@ int main(int argc, char* argv[]) {
   for (int i = 1; i <= steps; i++) {
     spdlog::info("Step {}", i);
 
-    last_step = bh::step(last_step, dt, G);
+    bbox = bh::step(bodies, accelerations, dt, G, integrator);
 
     if (!no_output && i % sampling_rate == 0) {
-      bh::write_to_file(last_step, "step" + bh::format_step_n(i, steps) + ".json");
+      bh::write_to_file(bh::SimulationStep(bh::to_aos(bodies), bbox), "step" + bh::format_step_n(i, steps) + ".json");
     }
   }
 
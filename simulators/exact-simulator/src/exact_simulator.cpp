@@ -4,15 +4,22 @@
 #include <spdlog/stopwatch.h>
 
 #include <algorithm>  // transform
-#include <execution>  // par_unseq
 #include <utility>    // move
 
-#include "body_update.h"   // update_body
+#include "all_pairs.h"     // compute_exact_net_forces
+#include "body_update.h"   // update_bodies, kick_and_drift_bodies, kick_bodies
 #include "bounding_box.h"  // compute_square_bounding_box
+#include "soa_bodies.h"    // to_soa, to_aos
 
 namespace bh {
 
 Timings m_timings;
+// The bodies of the step being computed from a SimulationStep, as structure of arrays: the forces, updates and
+// bounding box read only the arrays they need
+SoaBodies m_bodies;
+// Forces acting on the bodies, and scratch memory to compute them, reused across steps
+std::vector<Eigen::Vector2d> m_forces;
+AllPairsBuffers m_all_pairs_buffers;
 
 std::chrono::duration<double> Timings::total() const {
   return update_body +
@@ -30,60 +37,79 @@ const Timings& timings() {
   return m_timings;
 }
 
-SimulationStep step(const SimulationStep& last_step, double dt, double G) {
+/**
+ * Computes the acceleration of each body, through the forces acting on them.
+ */
+void compute_accelerations_impl(const SoaBodies& bodies, double G, std::vector<Eigen::Vector2d>& accelerations) {
+  compute_exact_net_forces(bodies, G, m_forces, m_all_pairs_buffers);
+  accelerations.resize(bodies.size());
+  std::transform(bodies.m_mass.begin(), bodies.m_mass.end(), m_forces.begin(), accelerations.begin(),
+                 [](double mass, const Eigen::Vector2d& force) -> Eigen::Vector2d {
+                   return force / mass;
+                 });
+}
+
+/**
+ * Computes the next step of the simulation with the kick-drift-kick leapfrog integrator, in place.
+ */
+Eigen::AlignedBox2d step_leapfrog_impl(SoaBodies& bodies, std::vector<Eigen::Vector2d>& accelerations, double dt, double G) {
   spdlog::stopwatch sw;
 
-  std::vector<Body> new_bodies{last_step.bodies().size()};
+  if (accelerations.size() != bodies.size()) {
+    spdlog::debug("Computing initial accelerations...");
+    compute_accelerations_impl(bodies, G, accelerations);
+  }
 
-#if defined(WITH_TBB) and defined(PARALLEL_BODIES_UPDATE)
-  spdlog::debug("Computing new bodies in parallel (TBB) (update of each single body is serial)...");
+  spdlog::debug("Kicking and drifting bodies...");
+  kick_and_drift_bodies(bodies, accelerations, dt);
 
-  std::transform(std::execution::par_unseq,
-                 last_step.bodies().begin(), last_step.bodies().end(),
-                 new_bodies.begin(),
-                 [&](const Body& body) {
-                   return update_body_serial(body, last_step.bodies(), dt, G);
-                 });
+  spdlog::debug("Computing exact forces (symmetric blocked all-pairs)...");
+  compute_accelerations_impl(bodies, G, accelerations);
 
-#elif defined(WITH_TBB) and not defined(PARALLEL_BODIES_UPDATE)
-  spdlog::debug("Computing new bodies serially (update of each single body is parallel (TBB))...");
+  spdlog::debug("Kicking bodies...");
+  kick_bodies(bodies, accelerations, dt);
 
-  std::transform(last_step.bodies().begin(), last_step.bodies().end(),
-                 new_bodies.begin(),
-                 [&](const Body& body) {
-                   return update_body_parallel(body, last_step.bodies(), dt, G);
-                 });
+  m_timings.update_body += sw.elapsed();
+  sw.reset();
+
+  spdlog::debug("Computing new bounding box...");
+  auto new_bbox = compute_square_bounding_box(bodies);
 
-#elif not defined(WITH_TBB) and defined(PARALLEL_BODIES_UPDATE)
-  spdlog::debug("Computing new bodies in parallel (OpenMP) (update of each single body is serial)...");
+  m_timings.compute_square_bounding_box += sw.elapsed();
 
-#pragma omp parallel for default(none) shared(last_step, new_bodies, dt, G)
-  for (size_t i = 0; i < last_step.bodies().size(); i++) {
-#ifdef DEBUG_OPENMP_BODY_UPDATE_FOR_LOOP
-    spdlog::trace("Updating body {}", i);
-#endif
-    new_bodies[i] = update_body_serial(last_step.bodies()[i], last_step.bodies(), dt, G);
+  return new_bbox;
+}
+
+Eigen::AlignedBox2d step(SoaBodies& bodies, std::vector<Eigen::Vector2d>& accelerations, double dt, double G, Integrator integrator) {
+  if (integrator == Integrator::LEAPFROG) {
+    return step_leapfrog_impl(bodies, accelerations, dt, G);
   }
 
-#elif not defined(WITH_TBB) and not defined(PARALLEL_BODIES_UPDATE)
-  spdlog::debug("Computing new bodies serially (update of each single body is parallel (OpenMP))...");
+  spdlog::stopwatch sw;
 
-  std::transform(last_step.bodies().begin(), last_step.bodies().end(),
-                 new_bodies.begin(),
-                 [&](const Body& body) {
-                   return update_body_parallel(body, last_step.bodies(), dt, G);
-                 });
-#endif
+  spdlog::debug("Computing exact forces (symmetric blocked all-pairs)...");
+  compute_exact_net_forces(bodies, G, m_forces, m_all_pairs_buffers);
+
+  spdlog::debug("Computing new bodies...");
+  update_bodies(bodies, m_forces, dt);
+  accelerations.clear();
 
   m_timings.update_body += sw.elapsed();
   sw.reset();
 
   spdlog::debug("Computing new bounding box...");
-  auto new_bbox = compute_square_bounding_box(new_bodies);
+  auto new_bbox = compute_square_bounding_box(bodies);
 
   m_timings.compute_square_bounding_box += sw.elapsed();
 
-  return {std::move(new_bodies), new_bbox};
+  return new_bbox;
+}
+
+SimulationStep step(const SimulationStep& last_step, double dt, double G, Integrator integrator) {
+  to_soa(last_step.bodies(), m_bodies);
+  std::vector<Eigen::Vector2d> accelerations = last_step.accelerations();
+  const auto new_bbox = step(m_bodies, accelerations, dt, G, integrator);
+  return {to_aos(m_bodies), new_bbox, std::move(accelerations)};
 }
 
 }  // namespace bh
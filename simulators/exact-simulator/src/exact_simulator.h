@@ -1,9 +1,13 @@
 #ifndef EXACT_SIMULATOR_H
 #define EXACT_SIMULATOR_H
 
+#include <Eigen/Eigen>
 #include <chrono>
+#include <vector>
 
+#include "body_update.h"  // Integrator
 #include "simulation_step.h"
+#include "soa_bodies.h"
 
 namespace bh {
 
@@ -18,7 +22,23 @@ struct Timings final {
 
 const Timings& timings();
 
-SimulationStep step(const SimulationStep& last_step, double dt, double G);
+/**
+ * Computes the next step of the simulation.
+ * @param integrator with which the bodies are moved; the leapfrog integrator carries the accelerations of the bodies
+ * in the steps, and computes them from the last step if it does not carry them
+ */
+SimulationStep step(const SimulationStep& last_step, double dt, double G, Integrator integrator = Integrator::EULER);
+
+/**
+ * Computes the next step of a simulation whose bodies are kept as structure of arrays across the steps, in place,
+ * without converting them from and to a SimulationStep.
+ * @param bodies of the last step, overwritten with the ones of the next step
+ * @param accelerations of the bodies, carried across the steps by the leapfrog integrator, which computes them if
+ * they do not match the bodies; cleared by the Euler integrator
+ * @return square bounding box of the new bodies
+ */
+Eigen::AlignedBox2d step(SoaBodies& bodies, std::vector<Eigen::Vector2d>& accelerations, double dt, double G,
+                         Integrator integrator = Integrator::EULER);
 
 std::chrono::duration<double> update_body_cumulative_time();
 std::chrono::duration<double> compute_square_bounding_box_cumulative_time();
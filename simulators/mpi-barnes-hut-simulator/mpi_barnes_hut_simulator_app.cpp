@@ -12,7 +12,7 @@
 #include "bounding_box.h"
 #include "loader.h"
 #include "persistence.h"
-#include "power_of_four.h"
+#include "simulation_state.h"
 #include "src/mpi_barnes_hut_simulator.h"
 #include "step_format.h"
 
@@ -37,6 +37,21 @@ int main(int argc, char* argv[]) {
       .scan<'g', double>()
       .default_value(0.5)
       .help("specify the barnes–hut theta");
+  app.add_argument("--integrator")
+      .default_value(std::string{"euler"})
+      .help("specify the integrator: euler (first-order) or leapfrog (kick-drift-kick, second-order)");
+  app.add_argument("--distributed")
+      .default_value(false)
+      .implicit_value(true)
+      .help("keeps on each process only the bodies of its zone, instead of all the bodies");
+  app.add_argument("--overlap")
+      .default_value(false)
+      .implicit_value(true)
+      .help("computes the forces of the quadtree of each process as soon as it arrives, instead of once all have arrived");
+  app.add_argument("--float-quadtree")
+      .default_value(false)
+      .implicit_value(true)
+      .help("exchanges the bodies of the quadtrees in single precision, instead of double precision");
   app.add_argument("--sampling-rate")
       .scan<'d', int>()
       .default_value(1)
@@ -50,6 +65,9 @@ int main(int argc, char* argv[]) {
 
   try {
     app.parse_args(argc, argv);
+    if (const auto integrator = app.get("--integrator"); integrator != "euler" && integrator != "leapfrog") {
+      throw std::runtime_error("Invalid integrator: " + integrator);
+    }
   } catch (const std::runtime_error& err) {
     std::cerr << app;
     std::exit(1);
@@ -60,6 +78,10 @@ int main(int argc, char* argv[]) {
   const auto dt = app.get<double>("dt");
   const auto G = app.get<double>("-G");
   const auto theta = app.get<double>("--theta");
+  const auto integrator = app.get("--integrator") == "leapfrog" ? bh::Integrator::LEAPFROG : bh::Integrator::EULER;
+  const auto distribution = app.get<bool>("--distributed") ? bh::Distribution::DISTRIBUTED : bh::Distribution::REPLICATED;
+  const auto exchange = app.get<bool>("--overlap") ? bh::Exchange::OVERLAPPED : bh::Exchange::BLOCKING;
+  const auto precision = app.get<bool>("--float-quadtree") ? bh::mpi::Precision::FLOAT : bh::mpi::Precision::DOUBLE;
   const auto sampling_rate = app.get<int>("--sampling-rate");
   const auto no_output = app.get<bool>("--no-output");
   const auto timings = app.present("--timings");
@@ -70,16 +92,19 @@ int main(int argc, char* argv[]) {
   MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
   MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
 
-  if (!is_power_of_four(n_procs)) {
-    throw std::runtime_error("The number of processors of the MPI communicator must be a power of 4 (found: " + std::to_string(n_procs) + ')');
-  }
-
   auto initial_bodies = bh::load_bodies(input);
+  const auto initial_bbox = bh::compute_square_bounding_box(initial_bodies);
 
-  auto last_step = bh::BarnesHutSimulationStep(std::move(initial_bodies), bh::compute_square_bounding_box(initial_bodies));
-  if (!no_output) {
-    bh::write_to_file(last_step, "step" + bh::format_step_n(0, steps) + ".json");
+  bh::BarnesHutSimulationStep initial_step{std::move(initial_bodies), initial_bbox};
+  if (!no_output && proc_id == 0) {
+    bh::write_to_file(initial_step, "step" + bh::format_step_n(0, steps) + ".json");
+  }
+  if (distribution == bh::Distribution::DISTRIBUTED) {
+    bh::distribute_bodies(initial_step, proc_id, n_procs);
   }
+  bh::SimulationState state{std::move(initial_step)};
+  // The bodies of the distributed steps are gathered on process 0 to write them
+  bh::BarnesHutSimulationStep gathered_step{std::vector<bh::Body>{}, initial_bbox};
 
   spdlog::cfg::load_env_levels();
   spdlog::set_pattern("proc %P/thread %t elapsed: %i μs  [%l] %v");
@@ -87,10 +112,16 @@ int main(int argc, char* argv[]) {
   for (int i = 1; i <= steps; i++) {
     spdlog::info("Step {}", i);
 
-    last_step = bh::step(last_step, dt, G, theta, proc_id, n_procs);
+    bh::step(state, dt, G, theta, proc_id, n_procs, integrator, distribution, exchange, precision);
 
-    if (!no_output && proc_id == 0 && i % sampling_rate == 0) {
-      bh::write_to_file(last_step, "step" + bh::format_step_n(i, steps) + ".json");
+    if (!no_output && i % sampling_rate == 0) {
+      if (distribution == bh::Distribution::DISTRIBUTED) {
+        bh::gather_step(state.last_step(), proc_id, n_procs, gathered_step);
+      }
+      if (proc_id == 0) {
+        bh::write_to_file(distribution == bh::Distribution::DISTRIBUTED ? gathered_step : state.last_step(),
+                          "step" + bh::format_step_n(i, steps) + ".json");
+      }
     }
   }
 
@@ -6,40 +6,85 @@
 #include <Eigen/Eigen>
 
 #include "bodies_gathering.h"
-#include "body_update.h"   // update_body
-#include "bounding_box.h"  // compute_square_bounding_box
-#include "quadtree.h"
+#include "bodies_migration.h"  // exchange_n_bodies, migrate_bodies, reduce_bounding_box
+#include "body_update.h"   // update_body, kick_and_drift, kick
+#include "bounding_box.h"  // compute_square_bounding_box, compute_minimum_bounding_box
+#include "force.h"         // compute_approximate_net_force_on_body
+#include "linear_quadtree.h"
+#include "morton.h"  // compute_morton_keys, radix_sort, cover_key_range
+#include "quadtree_arena.h"
 #include "quadtree_gathering.h"
+#include <algorithm>  // lower_bound, upper_bound, min, fill, for_each
+#include <cstdint>    // uint32_t, uint64_t
 #ifdef WITH_TBB
-#include <algorithm>  // transform
 #include <execution>  // par_unseq
 #endif
-#include <iterator>  // back_inserter
-#include <utility>   // move
+#include <memory>    // shared_ptr
+#include <numeric>   // iota
+#include <utility>   // move, swap
 
 namespace bh {
 
 Timings m_timings;
+// The quadtrees of each step are allocated from the storage of the ones of the steps before
+QuadtreeArena m_arena;
+// Reused across steps, so that their storage is allocated only once
+std::vector<Body> m_filtered_bodies;
+std::vector<Body> m_my_new_bodies;
+std::vector<Eigen::Vector2d> m_my_forces;
+std::vector<Eigen::Vector2d> m_my_accelerations;
+std::vector<std::shared_ptr<LinearQuadtree>> m_my_quadtrees;
+std::vector<MortonCell> m_my_cells;
+std::vector<MortonCell> m_cells;
+// Boxes containing the bodies of each process, to which the branches of the quadtrees that they open are sent
+std::vector<std::vector<Eigen::AlignedBox2d>> m_domains;
+std::vector<Eigen::AlignedBox2d> m_my_domain;
+#ifdef WITH_TBB
+std::vector<int> m_indices;
+#endif
+// Cost of each body of the last step: the number of interactions evaluated to compute its force
+std::vector<std::uint32_t> m_costs;
+std::vector<std::uint32_t> m_sorted_costs;
+std::vector<std::uint32_t> m_my_costs;
+// The bodies sorted in Morton order, their keys, and the first key of the zone of each process but the first
+std::vector<Body> m_sorted_bodies;
+std::vector<std::uint32_t> m_sorted_ids;
+std::vector<MortonKey> m_keys;
+std::vector<std::uint32_t> m_order;
+RadixSortBuffers m_radix_sort_buffers;
+std::vector<MortonKey> m_splits;
+// Number of bodies in the zone of each process
+std::vector<int> m_zone_n_bodies;
+// The bodies of this process sorted in Morton order, before migrating to their zones, and the ones received
+std::vector<Body> m_migrating_bodies;
+std::vector<std::uint32_t> m_migrating_ids;
+std::vector<int> m_recv_n_bodies;
+std::vector<Body> m_received_bodies;
+std::vector<std::uint32_t> m_received_ids;
+// The state of the bisection of the distributed costzones
+std::vector<std::uint64_t> m_cost_prefix;
+std::vector<std::uint64_t> m_global_costs;
+std::vector<std::uint64_t> m_first_cells;
+std::vector<std::uint64_t> m_last_cells;
 
 std::chrono::duration<double> Timings::total() const {
-  return compute_bounding_box_for_processor +
-         filter_bodies_by_subquadrant +
+  return decompose_domain +
          construct_quadtree +
-         gather_quadtree +
+         exchange_quadtree +
          update_body +
          gather_bodies +
          compute_square_bounding_box;
 }
 
 std::ostream& operator<<(std::ostream& os, const Timings& timings) {
-  os << "Own bounding box computation: " << timings.compute_bounding_box_for_processor.count() << " s\n";
-  os << "Bodies filtering by subquadrant: " << timings.filter_bodies_by_subquadrant.count() << " s\n";
+  os << "Domain decomposition: " << timings.decompose_domain.count() << " s\n";
   os << "Quadtree construction: " << timings.construct_quadtree.count() << " s\n";
-  os << "Bodies gathering: " << timings.gather_quadtree.count() << " s\n";
+  os << "Quadtree exchange: " << timings.exchange_quadtree.count() << " s\n";
   os << "Bodies update: " << timings.update_body.count() << " s\n";
   os << "Bodies gathering: " << timings.gather_bodies.count() << " s\n";
   os << "Bounding box computation: " << timings.compute_square_bounding_box.count() << " s\n";
   os << "Total: " << timings.total().count() << " s\n";
+  os << "Hidden communication: " << timings.hidden_communication.count() << " s\n";
   return os;
 }
 
@@ -47,118 +92,566 @@ const Timings& timings() {
   return m_timings;
 }
 
-BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta, int proc_id, int n_procs) {
+/**
+ * Sorts some bodies in Morton order, with their ids and their costs in m_costs, writing their keys in m_keys.
+ * @param bbox square bounding box of the complete quadtree; must contain the bodies
+ * @param ids of the bodies; if empty, the bodies are in their initial order
+ * @param sorted_bodies vector in which to write the sorted bodies
+ * @param sorted_ids vector in which to write the ids of the sorted bodies
+ */
+void sort_bodies_impl(const std::vector<Body>& bodies, const std::vector<std::uint32_t>& ids, const Eigen::AlignedBox2d& bbox,
+                      std::vector<Body>& sorted_bodies, std::vector<std::uint32_t>& sorted_ids) {
+  compute_morton_keys(bodies, bbox, m_keys);
+  m_order.resize(bodies.size());
+  std::iota(m_order.begin(), m_order.end(), 0);
+  radix_sort(m_keys, m_order, m_radix_sort_buffers);
+
+  sorted_bodies.resize(bodies.size());
+  sorted_ids.resize(bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    sorted_bodies[i] = bodies[m_order[i]];
+    sorted_ids[i] = ids.empty() ? m_order[i] : ids[m_order[i]];
+  }
+  // Without the costs of the last step, every body costs the same
+  if (m_costs.size() == bodies.size()) {
+    m_sorted_costs.resize(bodies.size());
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      m_sorted_costs[i] = m_costs[m_order[i]];
+    }
+    std::swap(m_costs, m_sorted_costs);
+  } else {
+    m_costs.assign(bodies.size(), 1);
+  }
+}
+
+void compute_distributed_costzones(const std::vector<MortonKey>& keys, const std::vector<std::uint32_t>& costs, int n_procs,
+                                   std::vector<MortonKey>& splits) {
+  constexpr int CELL_SHIFT = 2 * (MORTON_KEY_DEPTH - COSTZONES_LEVEL);
+  constexpr std::uint64_t N_CELLS = std::uint64_t{1} << (2 * COSTZONES_LEVEL);
+
+  // cost_prefix[i] is the cost of the bodies before the i-th one
+  m_cost_prefix.resize(keys.size() + 1);
+  m_cost_prefix[0] = 0;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    m_cost_prefix[i + 1] = m_cost_prefix[i] + (costs.empty() ? 1 : costs[i]);
+  }
+  const auto cost_before = [&](std::uint64_t cell) {
+    return m_cost_prefix[std::lower_bound(keys.begin(), keys.end(), static_cast<MortonKey>(cell << CELL_SHIFT)) - keys.begin()];
+  };
+
+  m_global_costs.assign(1, m_cost_prefix.back());
+  reduce_sum(m_global_costs);
+  const std::uint64_t total_cost = m_global_costs[0];
+
+  // The split of each process is searched in [m_first_cells[proc], m_last_cells[proc]], N_CELLS meaning after the last cell
+  m_first_cells.assign(n_procs - 1, 0);
+  m_last_cells.assign(n_procs - 1, N_CELLS);
+  for (std::uint64_t range = N_CELLS + 1; range > 1; range = (range + 1) / 2) {
+    m_global_costs.resize(n_procs - 1);
+    for (int proc = 1; proc < n_procs; proc++) {
+      m_global_costs[proc - 1] = cost_before((m_first_cells[proc - 1] + m_last_cells[proc - 1]) / 2);
+    }
+    reduce_sum(m_global_costs);
+    for (int proc = 1; proc < n_procs; proc++) {
+      auto& first_cell = m_first_cells[proc - 1];
+      auto& last_cell = m_last_cells[proc - 1];
+      if (first_cell == last_cell) {
+        continue;
+      }
+      if (const auto middle_cell = (first_cell + last_cell) / 2; m_global_costs[proc - 1] * n_procs >= proc * total_cost) {
+        last_cell = middle_cell;
+      } else {
+        first_cell = middle_cell + 1;
+      }
+    }
+  }
+
+  splits.resize(n_procs - 1);
+  for (int proc = 1; proc < n_procs; proc++) {
+    splits[proc - 1] = static_cast<MortonKey>(std::min(m_first_cells[proc - 1], N_CELLS - 1) << CELL_SHIFT);
+  }
+}
+
+/**
+ * Sorts some bodies in Morton order, with their ids and their costs in m_costs, and splits them into the zones
+ * of the processes (see compute_costzones), in m_splits and m_zone_n_bodies.
+ * @details If the bodies are replicated, every process sorts and splits all the bodies, in the same way. Otherwise,
+ * each process sorts its own bodies, and sends the ones outside its zone to the processes of their zones: its
+ * sorted bodies are then the ones of its zone, and only its own entry of m_zone_n_bodies is known.
+ * @param bbox square bounding box of the complete quadtree; must contain the bodies
+ * @param ids of the bodies; if empty, the bodies are in their initial order
+ * @param sorted_bodies vector in which to write the sorted bodies
+ * @param sorted_ids vector in which to write the ids of the sorted bodies
+ * @return index of the first body of the zone of this process
+ */
+int decompose_domain_impl(const std::vector<Body>& bodies, const std::vector<std::uint32_t>& ids, const Eigen::AlignedBox2d& bbox,
+                          int proc_id, int n_procs, Distribution distribution, std::vector<Body>& sorted_bodies, std::vector<std::uint32_t>& sorted_ids) {
   spdlog::stopwatch sw;
 
-  spdlog::debug("Computing bounding box for processor...");
-  auto my_bbox = compute_bounding_box_for_processor(last_step.bbox(), proc_id, n_procs);
+  spdlog::debug("Sorting bodies...");
+  if (distribution == Distribution::REPLICATED) {
+    sort_bodies_impl(bodies, ids, bbox, sorted_bodies, sorted_ids);
+    spdlog::debug("Computing costzones...");
+    compute_costzones(m_keys, m_costs, n_procs, m_splits);
+  } else {
+    sort_bodies_impl(bodies, ids, bbox, m_migrating_bodies, m_migrating_ids);
+    spdlog::debug("Computing distributed costzones...");
+    compute_distributed_costzones(m_keys, m_costs, n_procs, m_splits);
+  }
 
-  m_timings.compute_bounding_box_for_processor += sw.elapsed();
-  sw.reset();
+  m_zone_n_bodies.resize(n_procs);
+  int my_first_body = 0;
+  auto zone_begin = m_keys.begin();
+  for (int proc = 0; proc < n_procs; proc++) {
+    const auto zone_end = proc + 1 < n_procs ? std::lower_bound(zone_begin, m_keys.end(), m_splits[proc]) : m_keys.end();
+    m_zone_n_bodies[proc] = static_cast<int>(zone_end - zone_begin);
+    if (proc == proc_id) {
+      my_first_body = static_cast<int>(zone_begin - m_keys.begin());
+    }
+    zone_begin = zone_end;
+  }
 
-  spdlog::debug("Filtering bodies...");
-  const auto filtered_bodies = filter_bodies_by_subquadrant(last_step.bodies(), last_step.bbox(), my_bbox);
+  if (distribution == Distribution::DISTRIBUTED) {
+    spdlog::debug("Migrating bodies...");
+    // The bodies of this process in the zone of each process are consecutive
+    exchange_n_bodies(n_procs, m_zone_n_bodies, m_recv_n_bodies);
+    migrate_bodies(n_procs, m_zone_n_bodies, m_recv_n_bodies, m_migrating_bodies, m_received_bodies);
+    migrate_values(n_procs, m_zone_n_bodies, m_recv_n_bodies, m_migrating_ids, m_received_ids);
+    migrate_values(n_procs, m_zone_n_bodies, m_recv_n_bodies, m_costs, m_sorted_costs);
+    std::swap(m_costs, m_sorted_costs);
+    // The bodies received from each process are sorted, but not the ones received from all of them
+    sort_bodies_impl(m_received_bodies, m_received_ids, bbox, sorted_bodies, sorted_ids);
+    std::fill(m_zone_n_bodies.begin(), m_zone_n_bodies.end(), 0);
+    m_zone_n_bodies[proc_id] = static_cast<int>(sorted_bodies.size());
+    my_first_body = 0;
+  }
 
-  m_timings.filter_bodies_by_subquadrant += sw.elapsed();
-  sw.reset();
+  m_timings.decompose_domain += sw.elapsed();
+  spdlog::debug("{} bodies in my zone", m_zone_n_bodies[proc_id]);
 
-  spdlog::debug("Constructing quadtree...");
-  auto my_quadtree = construct_quadtree(filtered_bodies, my_bbox);
+  return my_first_body;
+}
 
-  m_timings.construct_quadtree += sw.elapsed();
-  sw.reset();
+/**
+ * Covers the zone of a process with the largest cells in it (see cover_key_range).
+ * @param cells vector in which to write the cells, in Morton order
+ */
+void cover_zone_impl(int proc, int n_procs, std::vector<MortonCell>& cells) {
+  const MortonKey first_key = proc == 0 ? 0 : m_splits[proc - 1];
+  if (proc + 1 == n_procs) {
+    cover_key_range(first_key, ~MortonKey{0}, cells);
+  } else if (m_splits[proc] > first_key) {
+    cover_key_range(first_key, m_splits[proc] - 1, cells);
+  } else {
+    cells.clear();
+  }
+}
 
-  spdlog::debug("Gathering complete quadtree...");
-  auto complete_quadtree = gather_quadtree(proc_id, n_procs, *my_quadtree);
+/**
+ * Computes the bounding boxes of the bodies of the non-empty cells among some cells.
+ * @param cell_begin iterator to the key of the first body of the first cell in m_keys
+ * @param domain vector to which to append the boxes
+ * @return iterator to the key of the first body after the last cell
+ */
+std::vector<MortonKey>::const_iterator compute_domain_impl(const std::vector<Body>& bodies, const std::vector<MortonCell>& cells,
+                                                           std::vector<MortonKey>::const_iterator cell_begin,
+                                                           std::vector<Eigen::AlignedBox2d>& domain) {
+  const std::vector<MortonKey>& keys = m_keys;
+  for (const auto& cell : cells) {
+    const auto cell_end = std::upper_bound(cell_begin, keys.end(), cell.last_key());
+    if (cell_end != cell_begin) {
+      Eigen::AlignedBox2d box;
+      for (auto i = cell_begin - keys.begin(); i < cell_end - keys.begin(); i++) {
+        box.extend(bodies[i].m_position);
+      }
+      domain.push_back(box);
+    }
+    cell_begin = cell_end;
+  }
+  return cell_begin;
+}
 
-  m_timings.gather_quadtree += sw.elapsed();
-  sw.reset();
+/**
+ * Covers the zone of each process with the largest cells in it, into m_my_cells for this process, and computes the
+ * domain of each process in m_domains: the bounding boxes of the bodies of its non-empty cells.
+ * @details If the bodies are replicated, every process covers all the zones, in the same way. Otherwise, each process
+ * covers its own zone, and the domains are gathered.
+ * @param bodies sorted and split into zones by decompose_domain_impl
+ */
+void compute_domains_impl(const std::vector<Body>& bodies, int proc_id, int n_procs, Distribution distribution) {
+  if (distribution == Distribution::DISTRIBUTED) {
+    cover_zone_impl(proc_id, n_procs, m_my_cells);
+    m_my_domain.clear();
+    compute_domain_impl(bodies, m_my_cells, m_keys.begin(), m_my_domain);
+    gather_domains(n_procs, m_my_domain, m_domains);
+    return;
+  }
 
-  // If the number of processors does not evenly divide the number of bodies,
-  // the processors are assigned different number of bodies to compute.
-  // For example, with 6 bodies and 4 processors, the first 2 processors are assigned 2 bodies each,
-  // and the other 2 processors are assigned 1 body each.
-  // With 4 processors and 3 bodies, the first 3 processors are assigned 1 bodies each,
-  // and the last processor is assigned none.
-  const int total_n_bodies = static_cast<int>(last_step.bodies().size());
-  const int n_remaining_bodies = total_n_bodies % n_procs;
-  const int n_bodies_to_compute = (total_n_bodies / n_procs) + (proc_id < n_remaining_bodies);
-
-  std::vector<Body> my_new_bodies(n_bodies_to_compute);
-  const int idx_from = (proc_id) * (total_n_bodies / n_procs) + std::min(proc_id, n_remaining_bodies);
+  m_domains.resize(n_procs);
+  std::vector<MortonKey>::const_iterator cell_begin = m_keys.begin();
+  for (int proc = 0; proc < n_procs; proc++) {
+    auto& cells = proc == proc_id ? m_my_cells : m_cells;
+    cover_zone_impl(proc, n_procs, cells);
+    m_domains[proc].clear();
+    cell_begin = compute_domain_impl(bodies, cells, cell_begin, m_domains[proc]);
+  }
+}
+
+/**
+ * Calls a function with the index of each of some bodies, in parallel.
+ */
+template <typename F>
+void for_each_body_impl(int n_bodies, const F& f) {
 #ifdef WITH_TBB
-  spdlog::debug("Computing my new bodies (TBB)...");
-
-  std::transform(std::execution::par_unseq,
-                 last_step.bodies().begin() + idx_from, last_step.bodies().begin() + idx_from + n_bodies_to_compute,
-                 my_new_bodies.begin(),
-                 [&](const Body& body) {
-                   return update_body(body, *complete_quadtree, dt, G, theta);
-                 });
+  m_indices.resize(n_bodies);
+  std::iota(m_indices.begin(), m_indices.end(), 0);
+  std::for_each(std::execution::par_unseq, m_indices.begin(), m_indices.end(), f);
 #else
-  spdlog::debug("Computing new bodies (OpenMP)...");
-
-#pragma omp parallel for default(none) shared(n_bodies_to_compute, my_new_bodies, last_step, idx_from, complete_quadtree, dt, G, theta)
-  for (int i = 0; i < n_bodies_to_compute; i++) {
+#pragma omp parallel for default(none) shared(n_bodies, f)
+  for (int i = 0; i < n_bodies; i++) {
 #ifdef DEBUG_OPENMP_BODY_UPDATE_FOR_LOOP
     spdlog::trace("Updating body {}", i);
 #endif
-    my_new_bodies[i] = update_body(last_step.bodies()[i + idx_from], *complete_quadtree, dt, G, theta);
+    f(i);
   }
 #endif
+}
 
-  m_timings.update_body += sw.elapsed();
+/**
+ * Adds the force of a quadtree on each of the bodies assigned to this process to m_my_forces, and its cost to
+ * m_my_costs.
+ * @param my_first_body index of the first body assigned to this process
+ * @param accumulate whether to add to the forces and costs, or to overwrite them
+ */
+void add_my_forces_impl(const std::vector<Body>& bodies, int my_first_body, int n_bodies_to_compute, const LinearQuadtree& quadtree,
+                        double G, double theta, bool accumulate) {
+  const auto add_force = [&](int i) {
+    const auto& body = bodies[i + my_first_body];
+    InteractionCounts counts;
+    const Eigen::Vector2d force = compute_approximate_net_force_on_body(quadtree, body, G, theta, counts);
+    const auto cost = static_cast<std::uint32_t>(counts.m_approximated + counts.m_exact);
+    if (accumulate) {
+      m_my_forces[i] += force;
+      m_my_costs[i] += cost;
+    } else {
+      m_my_forces[i] = force;
+      m_my_costs[i] = cost;
+    }
+  };
+  for_each_body_impl(n_bodies_to_compute, add_force);
+}
+
+/**
+ * Constructs the quadtrees of the largest cells in the zone of this process, exchanges their essential branches
+ * with all processes, and computes with them the force on each of the bodies of the zone, into m_my_forces, and its
+ * cost, into m_my_costs.
+ * @param bodies sorted and split into zones by decompose_domain_impl
+ * @param my_first_body index of the first body of the zone of this process
+ * @return the locally essential quadtree of this process if the exchange is blocking, or the quadtree of its cells
+ * if it is overlapped
+ */
+std::shared_ptr<const LinearQuadtree> compute_my_forces_impl(const std::vector<Body>& bodies, const Eigen::AlignedBox2d& bbox, double G,
+                                                             double theta, int proc_id, int n_procs, Distribution distribution,
+                                                             Exchange exchange, mpi::Precision precision, int my_first_body) {
+  spdlog::stopwatch sw;
+
+  spdlog::debug("Constructing quadtrees of my cells...");
+  compute_domains_impl(bodies, proc_id, n_procs, distribution);
+
+  auto cell_begin = m_keys.begin() + my_first_body;
+  for (const auto& cell : m_my_cells) {
+    const auto cell_end = std::upper_bound(cell_begin, m_keys.end(), cell.last_key());
+    m_filtered_bodies.assign(bodies.begin() + (cell_begin - m_keys.begin()), bodies.begin() + (cell_end - m_keys.begin()));
+    m_my_quadtrees.push_back(construct_linear_quadtree(m_filtered_bodies, compute_cell_bbox(bbox, cell), m_arena));
+    cell_begin = cell_end;
+  }
+
+  m_timings.construct_quadtree += sw.elapsed();
   sw.reset();
 
-  spdlog::debug("Gathering all bodies...");
-  auto all_bodies = gather_bodies(proc_id, n_procs, total_n_bodies, my_new_bodies);
+  const int n_bodies_to_compute = m_zone_n_bodies[proc_id];
+  m_my_forces.resize(n_bodies_to_compute);
+  m_my_costs.resize(n_bodies_to_compute);
+
+  std::shared_ptr<const LinearQuadtree> quadtree;
+  if (exchange == Exchange::BLOCKING) {
+    spdlog::debug("Exchanging locally essential quadtree...");
+    quadtree = exchange_quadtree(proc_id, n_procs, m_my_quadtrees, m_domains, theta, precision, m_splits, bbox, m_arena);
+    // Released, so that the arena can reuse their storage
+    m_my_quadtrees.clear();
+
+    m_timings.exchange_quadtree += sw.elapsed();
+    sw.reset();
+
+    spdlog::debug("Computing my forces...");
+    add_my_forces_impl(bodies, my_first_body, n_bodies_to_compute, *quadtree, G, theta, false);
+
+    m_timings.update_body += sw.elapsed();
+    return quadtree;
+  }
+
+  spdlog::debug("Exchanging locally essential quadtree while computing my forces...");
+  std::chrono::duration<double> forces_time{0};
+  const auto hidden = exchange_quadtree(proc_id, n_procs, m_my_quadtrees, m_domains, theta, precision, m_splits, bbox, m_arena,
+                                        [&](std::shared_ptr<const LinearQuadtree> received) {
+                                          spdlog::stopwatch forces_sw;
+                                          // The quadtree of the cells of this process comes first
+                                          add_my_forces_impl(bodies, my_first_body, n_bodies_to_compute, *received, G, theta, quadtree != nullptr);
+                                          forces_time += forces_sw.elapsed();
+                                          if (quadtree == nullptr) {
+                                            quadtree = std::move(received);
+                                          }
+                                        });
+  m_my_quadtrees.clear();
+
+  m_timings.exchange_quadtree += sw.elapsed() - forces_time;
+  m_timings.update_body += forces_time;
+  m_timings.hidden_communication += hidden;
+  return quadtree;
+}
+
+/**
+ * Computes the acceleration of each of the bodies assigned to this process from its force in m_my_forces.
+ * @param my_accelerations vector in which to write the accelerations, resized to the number of bodies assigned
+ */
+void compute_my_accelerations_impl(const std::vector<Body>& bodies, int my_first_body, std::vector<Eigen::Vector2d>& my_accelerations) {
+  my_accelerations.resize(m_my_forces.size());
+  for_each_body_impl(static_cast<int>(m_my_forces.size()), [&](int i) {
+    my_accelerations[i] = m_my_forces[i] / bodies[i + my_first_body].m_mass;
+  });
+}
+
+/**
+ * Computes the square bounding box of all the bodies.
+ * @param bodies all the bodies if replicated, or the ones of this process if distributed
+ */
+Eigen::AlignedBox2d compute_complete_bounding_box_impl(const std::vector<Body>& bodies, Distribution distribution) {
+  if (distribution == Distribution::REPLICATED) {
+    return compute_square_bounding_box(bodies);
+  }
+  // A process without bodies does not extend the bounding box of the others
+  return compute_square_bounding_box(reduce_bounding_box(bodies.empty() ? Eigen::AlignedBox2d{} : compute_minimum_bounding_box(bodies)));
+}
+
+/**
+ * Collects the bodies computed by each process into a new step, with their accelerations, and their costs into
+ * m_costs: the ones of all the processes if replicated, or the ones of this process if distributed.
+ * @details If replicated, the accelerations and the costs are gathered, and the bounding box computed from the bodies
+ * of each process, while the bodies are in flight.
+ * @param my_accelerations of the bodies computed by this process, or nullptr if the step does not carry them
+ * @param bbox in which to compute the square bounding box of all the bodies, or nullptr if it is not needed
+ */
+void collect_bodies_impl(int proc_id, int n_procs, Distribution distribution, const std::vector<Body>& my_new_bodies,
+                         const std::vector<Eigen::Vector2d>* my_accelerations, Eigen::AlignedBox2d* bbox, BarnesHutSimulationStep& new_step) {
+  spdlog::stopwatch sw;
+  std::chrono::duration<double> bbox_time{0};
+  const auto compute_bbox = [&] {
+    if (bbox != nullptr) {
+      spdlog::stopwatch bbox_sw;
+      spdlog::debug("Computing complete bounding box...");
+      // The bounding box of the bodies of each process is the one of all the bodies once gathered
+      *bbox = compute_complete_bounding_box_impl(my_new_bodies, Distribution::DISTRIBUTED);
+      bbox_time = bbox_sw.elapsed();
+    }
+  };
+
+  if (distribution == Distribution::DISTRIBUTED) {
+    new_step.bodies() = my_new_bodies;
+    if (my_accelerations != nullptr) {
+      new_step.accelerations() = *my_accelerations;
+    }
+    m_costs = m_my_costs;
+    compute_bbox();
+  } else {
+    start_gather_bodies(proc_id, n_procs, m_zone_n_bodies, my_new_bodies);
+    if (my_accelerations != nullptr) {
+      gather_accelerations(proc_id, n_procs, m_zone_n_bodies, *my_accelerations, new_step.accelerations());
+    }
+    gather_costs(proc_id, n_procs, m_zone_n_bodies, m_my_costs, m_costs);
+    compute_bbox();
+    finish_gather_bodies(new_step.bodies());
+  }
 
-  m_timings.gather_bodies += sw.elapsed();
+  m_timings.gather_bodies += sw.elapsed() - bbox_time;
+  m_timings.compute_square_bounding_box += bbox_time;
+}
+
+/**
+ * Computes the next step of the simulation with the kick-drift-kick leapfrog integrator.
+ * @details Every process kicks and drifts all its bodies, with all their accelerations, so that it can sort them and
+ * construct the quadtrees of its cells at their new positions; then the bodies in its zone are kicked,
+ * and both the bodies and their accelerations are collected.
+ * @param new_step in which to write the next step; the bodies are drifted in its storage before being collected into it
+ */
+void step_leapfrog_impl(const BarnesHutSimulationStep& last_step, BarnesHutSimulationStep& new_step, double dt, double G,
+                        double theta, int proc_id, int n_procs, Distribution distribution, Exchange exchange, mpi::Precision precision) {
+  const auto* bodies = &last_step.bodies();
+  const auto* ids = &last_step.ids();
+  auto& my_accelerations = m_my_accelerations;
+
+  // The distributed processes agree, even those without bodies
+  const bool has_accelerations = last_step.accelerations().size() == bodies->size();
+  if (distribution == Distribution::DISTRIBUTED ? reduce_any(!has_accelerations) : !has_accelerations) {
+    spdlog::debug("Computing initial accelerations...");
+    const int my_first_body = decompose_domain_impl(*bodies, *ids, last_step.bbox(), proc_id, n_procs, distribution, m_sorted_bodies, m_sorted_ids);
+    compute_my_forces_impl(m_sorted_bodies, last_step.bbox(), G, theta, proc_id, n_procs, distribution, exchange, precision, my_first_body);
+    compute_my_accelerations_impl(m_sorted_bodies, my_first_body, my_accelerations);
+    if (distribution == Distribution::DISTRIBUTED) {
+      new_step.accelerations() = my_accelerations;
+      m_costs = m_my_costs;
+    } else {
+      gather_accelerations(proc_id, n_procs, m_zone_n_bodies, my_accelerations, new_step.accelerations());
+      gather_costs(proc_id, n_procs, m_zone_n_bodies, m_my_costs, m_costs);
+    }
+    // The accelerations are in the order of the sorted bodies
+    bodies = &m_sorted_bodies;
+    ids = &m_sorted_ids;
+  } else {
+    new_step.accelerations() = last_step.accelerations();
+  }
+
+  spdlog::stopwatch sw;
+
+  spdlog::debug("Kicking and drifting bodies...");
+  auto& drifted_bodies = new_step.bodies();
+  drifted_bodies.resize(bodies->size());
+  const auto& accelerations = new_step.accelerations();
+  for_each_body_impl(static_cast<int>(bodies->size()), [&](int i) {
+    drifted_bodies[i] = kick_and_drift((*bodies)[i], accelerations[i], dt);
+  });
+
+  m_timings.update_body += sw.elapsed();
   sw.reset();
 
   spdlog::debug("Computing complete bounding box...");
-  const auto complete_bbox = compute_square_bounding_box(all_bodies);
+  const auto complete_bbox = compute_complete_bounding_box_impl(drifted_bodies, distribution);
 
   m_timings.compute_square_bounding_box += sw.elapsed();
+
+  const int my_first_body = decompose_domain_impl(drifted_bodies, *ids, complete_bbox, proc_id, n_procs, distribution, m_sorted_bodies, new_step.ids());
+  const int n_bodies_to_compute = m_zone_n_bodies[proc_id];
+  auto quadtree = compute_my_forces_impl(m_sorted_bodies, complete_bbox, G, theta, proc_id, n_procs, distribution, exchange, precision, my_first_body);
+
   sw.reset();
 
-  return {std::move(all_bodies), complete_bbox, std::move(complete_quadtree)};
-}
+  spdlog::debug("Computing my new bodies...");
+  compute_my_accelerations_impl(m_sorted_bodies, my_first_body, my_accelerations);
+  m_my_new_bodies.resize(n_bodies_to_compute);
+  for_each_body_impl(n_bodies_to_compute, [&](int i) {
+    m_my_new_bodies[i] = kick(m_sorted_bodies[i + my_first_body], my_accelerations[i], dt);
+  });
 
-std::vector<Body> filter_bodies_by_subquadrant(const std::vector<Body>& bodies, const Eigen::AlignedBox2d& outer_bbox, const Eigen::AlignedBox2d& own_bbox) {
-  std::vector<Body> filtered;
-  std::copy_if(bodies.begin(), bodies.end(), std::back_inserter(filtered), [&](const Body& body) {
-    const bool body_at_right_of_own_bbox_left_side_inclusive = body.m_position.x() >= own_bbox.min().x();
+  m_timings.update_body += sw.elapsed();
 
-    const bool body_at_left_of_own_bbox_right_side_exclusive = body.m_position.x() < own_bbox.max().x();
+  spdlog::debug("Collecting all bodies...");
+  collect_bodies_impl(proc_id, n_procs, distribution, m_my_new_bodies, &my_accelerations, nullptr, new_step);
 
-    const bool body_above_of_own_bbox_bottom_side_inclusive = body.m_position.y() >= own_bbox.min().y();
+  new_step.bbox() = complete_bbox;
+  new_step.set_quadtree(std::move(quadtree));
+}
 
-    const bool body_below_of_own_bbox_top_side_exclusive = body.m_position.y() < own_bbox.max().y();
+/**
+ * Computes the next step of the simulation into the storage of another step.
+ * @details The bodies of the new step are sorted in Morton order, and their ids map them to their initial order.
+ */
+void step_impl(const BarnesHutSimulationStep& last_step, BarnesHutSimulationStep& new_step, double dt, double G, double theta,
+               int proc_id, int n_procs, Integrator integrator, Distribution distribution, Exchange exchange, mpi::Precision precision) {
+  // The quadtree of the step being overwritten is released, so that the arena can reuse its storage
+  new_step.set_quadtree(nullptr);
+
+  if (integrator == Integrator::LEAPFROG) {
+    step_leapfrog_impl(last_step, new_step, dt, G, theta, proc_id, n_procs, distribution, exchange, precision);
+    return;
+  }
 
-    const bool own_bbox_top_side_lies_on_outer_bbox_top_side = own_bbox.max().y() == outer_bbox.max().y();
+  // Each process builds the quadtree of, and computes, the bodies of its zone
+  const int my_first_body = decompose_domain_impl(last_step.bodies(), last_step.ids(), last_step.bbox(), proc_id, n_procs, distribution,
+                                                  m_sorted_bodies, new_step.ids());
+  const int n_bodies_to_compute = m_zone_n_bodies[proc_id];
+  auto quadtree = compute_my_forces_impl(m_sorted_bodies, last_step.bbox(), G, theta, proc_id, n_procs, distribution, exchange, precision, my_first_body);
 
-    const bool own_bbox_right_side_lies_on_outer_bbox_right_side = own_bbox.max().x() == outer_bbox.max().x();
+  spdlog::stopwatch sw;
 
-    return body_at_right_of_own_bbox_left_side_inclusive &&
-           (body_at_left_of_own_bbox_right_side_exclusive || own_bbox_right_side_lies_on_outer_bbox_right_side) &&
-           body_above_of_own_bbox_bottom_side_inclusive &&
-           (body_below_of_own_bbox_top_side_exclusive || own_bbox_top_side_lies_on_outer_bbox_top_side);
+  spdlog::debug("Computing my new bodies...");
+  auto& my_new_bodies = m_my_new_bodies;
+  my_new_bodies.resize(n_bodies_to_compute);
+  for_each_body_impl(n_bodies_to_compute, [&](int i) {
+    my_new_bodies[i] = update_body(m_sorted_bodies[i + my_first_body], m_my_forces[i], dt);
   });
-  return filtered;
+
+  m_timings.update_body += sw.elapsed();
+
+  spdlog::debug("Collecting all bodies...");
+  collect_bodies_impl(proc_id, n_procs, distribution, my_new_bodies, nullptr, &new_step.bbox(), new_step);
+
+  new_step.accelerations().clear();
+  new_step.set_quadtree(std::move(quadtree));
+}
+
+BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta, int proc_id, int n_procs,
+                             Integrator integrator, Distribution distribution, Exchange exchange, mpi::Precision precision) {
+  BarnesHutSimulationStep new_step{std::vector<Body>{}, Eigen::AlignedBox2d{}};
+  step_impl(last_step, new_step, dt, G, theta, proc_id, n_procs, integrator, distribution, exchange, precision);
+  return new_step;
+}
+
+void step(SimulationState<BarnesHutSimulationStep>& state, double dt, double G, double theta, int proc_id, int n_procs,
+          Integrator integrator, Distribution distribution, Exchange exchange, mpi::Precision precision) {
+  step_impl(state.last_step(), state.next_step(), dt, G, theta, proc_id, n_procs, integrator, distribution, exchange, precision);
+  state.advance();
 }
 
-Eigen::AlignedBox2d compute_bounding_box_for_processor(const Eigen::AlignedBox2d& outer_bbox, int proc_id, int n_procs) {
-  const int N_ROWS = static_cast<int>(std::sqrt(n_procs));
-  const int N_COLS = N_ROWS;
+void distribute_bodies(BarnesHutSimulationStep& step, int proc_id, int n_procs) {
+  // The first processes hold one more body, as in gather_bodies
+  const auto n_bodies = static_cast<int>(step.bodies().size());
+  const int my_n_bodies = n_bodies / n_procs + (proc_id < n_bodies % n_procs ? 1 : 0);
+  const int my_first_body = proc_id * (n_bodies / n_procs) + std::min(proc_id, n_bodies % n_procs);
 
-  double min_x = outer_bbox.min().x() + (proc_id % N_COLS) * (outer_bbox.sizes().x() / N_COLS);
-  double max_x = min_x + (outer_bbox.sizes().x() / N_COLS);
+  if (step.ids().empty()) {
+    step.ids().resize(n_bodies);
+    std::iota(step.ids().begin(), step.ids().end(), 0);
+  }
+  const auto keep_mine = [&](auto& values) {
+    if (static_cast<int>(values.size()) == n_bodies) {
+      values.erase(values.begin() + my_first_body + my_n_bodies, values.end());
+      values.erase(values.begin(), values.begin() + my_first_body);
+    }
+  };
+  keep_mine(step.bodies());
+  keep_mine(step.ids());
+  keep_mine(step.accelerations());
+}
 
-  double max_y = outer_bbox.max().y() - std::floor(proc_id / N_ROWS) * (outer_bbox.sizes().y() / N_ROWS);
-  double min_y = max_y - (outer_bbox.sizes().y() / N_ROWS);
+void gather_step(const BarnesHutSimulationStep& step, int proc_id, int n_procs, BarnesHutSimulationStep& gathered) {
+  gather_bodies(proc_id, n_procs, 0, step.bodies(), step.ids(), gathered.bodies(), gathered.ids());
+  gathered.bbox() = step.bbox();
+}
 
-  return {Eigen::Vector2d{min_x, min_y}, Eigen::Vector2d{max_x, max_y}};
+void compute_costzones(const std::vector<MortonKey>& keys, const std::vector<std::uint32_t>& costs, int n_procs, std::vector<MortonKey>& splits) {
+  splits.resize(n_procs - 1);
+  if (keys.empty()) {
+    std::fill(splits.begin(), splits.end(), 0);
+    return;
+  }
+
+  const auto cost = [&](std::size_t i) -> std::uint64_t { return costs.empty() ? 1 : costs[i]; };
+  std::uint64_t total_cost = 0;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    total_cost += cost(i);
+  }
+
+  // The zones start at cells of COSTZONES_LEVEL, so that each process covers its zone with few large cells
+  constexpr MortonKey CELL_MASK = ~((MortonKey{1} << (2 * (MORTON_KEY_DEPTH - COSTZONES_LEVEL))) - 1);
+  std::uint64_t cost_before = 0;
+  std::size_t i = 0;
+  for (int proc = 1; proc < n_procs; proc++) {
+    // The zone of a process starts at the first body preceded by proc / n_procs of the total cost
+    while (i + 1 < keys.size() && cost_before * n_procs < proc * total_cost) {
+      cost_before += cost(i);
+      i++;
+    }
+    splits[proc - 1] = keys[i] & CELL_MASK;
+  }
 }
 
 }  // namespace bh
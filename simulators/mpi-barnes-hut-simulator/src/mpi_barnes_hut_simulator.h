@@ -3,20 +3,26 @@
 
 #include <Eigen/Geometry>  // AlignedBox2d
 #include <chrono>
+#include <cstdint>  // uint32_t
 #include <vector>
 
 #include "barnes_hut_simulation_step.h"
+#include "body_update.h"    // Integrator
+#include "morton.h"         // MortonKey
+#include "mpi_datatypes.h"  // Precision
+#include "simulation_state.h"
 
 namespace bh {
 
 struct Timings final {
-  std::chrono::duration<double> compute_bounding_box_for_processor;
-  std::chrono::duration<double> filter_bodies_by_subquadrant;
+  std::chrono::duration<double> decompose_domain;
   std::chrono::duration<double> construct_quadtree;
-  std::chrono::duration<double> gather_quadtree;
+  std::chrono::duration<double> exchange_quadtree;
   std::chrono::duration<double> update_body;
   std::chrono::duration<double> gather_bodies;
   std::chrono::duration<double> compute_square_bounding_box;
+  // Part of the quadtree exchange during which forces were computed, so that it is not counted in the total
+  std::chrono::duration<double> hidden_communication;
 
   [[nodiscard]] std::chrono::duration<double> total() const;
 
@@ -25,11 +31,100 @@ struct Timings final {
 
 const Timings& timings();
 
-BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta, int proc_id, int n_procs);
+/**
+ * How the bodies are distributed among the processes between two steps.
+ */
+enum class Distribution {
+  // Every process holds all the bodies: the ones computed by each process are gathered by all the others
+  REPLICATED,
+  // Each process only holds the bodies of its zone, and only the bodies leaving a zone migrate, to the process of their
+  // new zone: the bodies of a step are the ones of this process, while its bounding box is the one of all the bodies
+  DISTRIBUTED,
+};
+
+/**
+ * How the locally essential quadtree is exchanged with the computation of the forces.
+ */
+enum class Exchange {
+  // The forces are computed once the complete locally essential quadtree has been received
+  BLOCKING,
+  // The forces of the cells of this process are computed while the branches of the others are in flight, and the ones
+  // of each other process as soon as they arrive: the force on a body is summed tree by tree, so it differs from the
+  // blocking one by approximation and rounding. Above the cells, the forks of each tree only aggregate the bodies of
+  // its process, so that they are opened, and approximate the bodies, unlike the forks of the blocking quadtree. The
+  // quadtree of a step is the one of the cells of this process
+  OVERLAPPED,
+};
+
+// Level of the cells at which the zones of the processes start: the bodies in a cell of this level are in the same zone
+constexpr int COSTZONES_LEVEL = 16;
+
+/**
+ * Computes the next step of the simulation.
+ * @details The domain is decomposed with costzones (see compute_costzones): the bodies are sorted in Morton order,
+ * and each process constructs the quadtree of, and computes, the bodies of its zone. Each process computes its bodies
+ * with its locally essential quadtree: its own cells, and the branches of the cells of the others that its bodies open
+ * (see exchange_quadtree), which is the quadtree of the new step. The bodies of the new step are in Morton order,
+ * and its ids map them to their initial order.
+ * @param integrator with which the bodies are moved; the leapfrog integrator carries the accelerations of the bodies
+ * in the steps, and computes them from the last step if it does not carry them
+ * @param distribution of the bodies among the processes; a distributed step must start from the bodies of this process
+ * (see distribute_bodies)
+ * @param exchange of the locally essential quadtree; the communication that an overlapped exchange hides is reported
+ * in timings
+ * @param precision of the bodies of the quadtrees exchanged; single precision halves their size, but rounds the
+ * bodies of the other processes' branches
+ */
+BarnesHutSimulationStep step(const BarnesHutSimulationStep& last_step, double dt, double G, double theta, int proc_id, int n_procs,
+                             Integrator integrator = Integrator::EULER, Distribution distribution = Distribution::REPLICATED,
+                             Exchange exchange = Exchange::BLOCKING, mpi::Precision precision = mpi::Precision::DOUBLE);
+
+/**
+ * Computes the next step of the simulation in the storage of the step before the last one of a state.
+ * @details The exchange, gathering, serialization and filtering buffers are reused across steps too.
+ */
+void step(SimulationState<BarnesHutSimulationStep>& state, double dt, double G, double theta, int proc_id, int n_procs,
+          Integrator integrator = Integrator::EULER, Distribution distribution = Distribution::REPLICATED,
+          Exchange exchange = Exchange::BLOCKING, mpi::Precision precision = mpi::Precision::DOUBLE);
+
+/**
+ * Keeps the bodies of a step that this process holds before the first distributed step: the bodies are split into
+ * consecutive ranges of about the same size, and their ids are their indices. The first step then migrates them to
+ * the zones of the processes.
+ */
+void distribute_bodies(BarnesHutSimulationStep& step, int proc_id, int n_procs);
+
+/**
+ * Gathers on process 0 the bodies of a distributed step, with their ids (e.g. to write it).
+ * @param gathered step in which to write all the bodies, their ids and the bounding box, on process 0 only;
+ * its quadtree is left untouched
+ */
+void gather_step(const BarnesHutSimulationStep& step, int proc_id, int n_procs, BarnesHutSimulationStep& gathered);
 
-std::vector<Body> filter_bodies_by_subquadrant(const std::vector<Body>& bodies, const Eigen::AlignedBox2d& outer_bbox, const Eigen::AlignedBox2d& own_bbox);
+/**
+ * Splits some bodies sorted in Morton order into zones of consecutive bodies of about equal costs, one per process.
+ * @details Costzones: the cost of a body is the number of interactions evaluated to compute its force at the last
+ * step, so that each process constructs the quadtree of, and computes, the same share of the work. The zone of each
+ * process is the range of keys from its split to the next one, and starts at a cell of COSTZONES_LEVEL.
+ * @param keys of the bodies, in ascending order
+ * @param costs of the bodies; if empty, every body costs the same
+ * @param splits vector in which to write the first key of the zone of each process but the first, in ascending order;
+ * the zone of the first process starts at key 0, and the one of the last process ends at the last key
+ */
+void compute_costzones(const std::vector<MortonKey>& keys, const std::vector<std::uint32_t>& costs, int n_procs, std::vector<MortonKey>& splits);
 
-Eigen::AlignedBox2d compute_bounding_box_for_processor(const Eigen::AlignedBox2d& outer_bbox, int proc_id, int n_procs);
+/**
+ * Computes costzones (see compute_costzones) of some bodies distributed among the processes, as if they were sorted
+ * together; it must be called by every process.
+ * @details The zone of each process but the first starts at the first cell of COSTZONES_LEVEL preceded by its share
+ * of the total cost. The cells are searched by bisection, all at once: at each round, the cost of the bodies
+ * preceding the middle cell of the range searched for each process is summed over all the processes.
+ * @param keys of the bodies of this process, in ascending order
+ * @param costs of the bodies of this process; if empty, every body costs the same
+ * @param splits vector in which to write the first key of the zone of each process but the first, in ascending order
+ */
+void compute_distributed_costzones(const std::vector<MortonKey>& keys, const std::vector<std::uint32_t>& costs, int n_procs,
+                                   std::vector<MortonKey>& splits);
 
 }  // namespace bh
 
@@ -10,8 +10,11 @@
 
 namespace bh {
 
-std::vector<Body> load_bodies(const std::string &filename) {
-  std::ifstream file(filename);
+/**
+ * Opens a file of bodies, and reads the number of bodies at its beginning.
+ */
+int open_bodies_file_impl(const std::string &filename, std::ifstream &file) {
+  file.open(filename);
   if (!file.is_open()) {
     throw std::runtime_error("Could not open file " + filename);
   }
@@ -23,6 +26,12 @@ std::vector<Body> load_bodies(const std::string &filename) {
   }
 
   std::cout << "Reading " << n_bodies << " from " << filename << "...\n";
+  return n_bodies;
+}
+
+std::vector<Body> load_bodies(const std::string &filename) {
+  std::ifstream file;
+  const int n_bodies = open_bodies_file_impl(filename, file);
 
   std::vector<Body> bodies;
   bodies.reserve(n_bodies);
@@ -32,4 +41,20 @@ std::vector<Body> load_bodies(const std::string &filename) {
   return bodies;
 }
 
+SoaBodies load_soa_bodies(const std::string &filename) {
+  std::ifstream file;
+  const int n_bodies = open_bodies_file_impl(filename, file);
+
+  SoaBodies bodies;
+  bodies.resize(n_bodies);
+  Body body;
+  for (int i = 0; i < n_bodies; i++) {
+    file >> body;
+    bodies.set_body(i, body);
+  }
+
+  std::cout << "Read " << n_bodies << " bodies\n";
+  return bodies;
+}
+
 }  // namespace bh
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "body.h"
+#include "soa_bodies.h"
 
 namespace bh {
 
@@ -15,6 +16,13 @@ namespace bh {
  */
 std::vector<Body> load_bodies(const std::string& filename);
 
+/**
+ * Loads some bodies from the specified file, as structure of arrays.
+ * @param filename file containing the bodies' data
+ * @return bodies corresponding to the data in the file
+ */
+SoaBodies load_soa_bodies(const std::string& filename);
+
 }  // namespace bh
 
 #endif  // BARNES_HUT_FILE_READER_H
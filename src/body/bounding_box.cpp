@@ -1,6 +1,8 @@
 #include "bounding_box.h"
 
 #include <Eigen/Eigen>
+#include <algorithm>  // min, max, minmax_element
+#include <limits>     // numeric_limits
 #ifdef WITH_TBB
 #include <execution>  // par_unseq
 #include <numeric>    // transform_reduce
@@ -71,8 +73,39 @@ Eigen::AlignedBox2d compute_minimum_bounding_box(const std::vector<Body> &bodies
   }
 }
 
-Eigen::AlignedBox2d compute_square_bounding_box(const std::vector<Body> &bodies) {
-  Eigen::AlignedBox2d min_bbox = compute_minimum_bounding_box(bodies);
+Eigen::AlignedBox2d compute_minimum_bounding_box(const SoaBodies &bodies) {
+  if (bodies.empty()) {
+    return {Vector2d{0, 0}, Vector2d{0, 0}};
+  }
+  // Each coordinate is reduced on its own array, with vector instructions
+#ifdef WITH_TBB
+  const auto [min_x, max_x] = std::minmax_element(std::execution::par_unseq, bodies.m_x.begin(), bodies.m_x.end());
+  const auto [min_y, max_y] = std::minmax_element(std::execution::par_unseq, bodies.m_y.begin(), bodies.m_y.end());
+  return {Vector2d{*min_x, *min_y}, Vector2d{*max_x, *max_y}};
+#else
+  const double *x = bodies.m_x.data();
+  const double *y = bodies.m_y.data();
+  const std::size_t n = bodies.size();
+  double min_x = std::numeric_limits<double>::max();
+  double min_y = std::numeric_limits<double>::max();
+  double max_x = std::numeric_limits<double>::lowest();
+  double max_y = std::numeric_limits<double>::lowest();
+
+#pragma omp parallel for simd default(none) shared(x, y, n) reduction(min : min_x, min_y) reduction(max : max_x, max_y)
+  for (std::size_t i = 0; i < n; i++) {
+    min_x = std::min(min_x, x[i]);
+    min_y = std::min(min_y, y[i]);
+    max_x = std::max(max_x, x[i]);
+    max_y = std::max(max_y, y[i]);
+  }
+  return {Vector2d{min_x, min_y}, Vector2d{max_x, max_y}};
+#endif
+}
+
+/**
+ * Extends a minimum bounding box into a square one, whose corners are snapped to the grid of integers.
+ */
+Eigen::AlignedBox2d square_bounding_box_impl(Eigen::AlignedBox2d min_bbox) {
 
   if (double diff = min_bbox.sizes().x() > min_bbox.sizes().y(); diff > 0) {
     // width > height
@@ -102,4 +135,16 @@ Eigen::AlignedBox2d compute_square_bounding_box(const std::vector<Body> &bodies)
   return min_bbox;
 }
 
+Eigen::AlignedBox2d compute_square_bounding_box(const std::vector<Body> &bodies) {
+  return square_bounding_box_impl(compute_minimum_bounding_box(bodies));
+}
+
+Eigen::AlignedBox2d compute_square_bounding_box(const SoaBodies &bodies) {
+  return square_bounding_box_impl(compute_minimum_bounding_box(bodies));
+}
+
+Eigen::AlignedBox2d compute_square_bounding_box(const Eigen::AlignedBox2d &min_bbox) {
+  return square_bounding_box_impl(min_bbox);
+}
+
 }  // namespace bh
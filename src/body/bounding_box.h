@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "body.h"
+#include "soa_bodies.h"
 
 namespace bh {
 
@@ -28,6 +29,8 @@ namespace bh {
  */
 Eigen::AlignedBox2d compute_minimum_bounding_box(const std::vector<Body> &bodies);
 
+Eigen::AlignedBox2d compute_minimum_bounding_box(const SoaBodies &bodies);
+
 /**
  * Computes an axis-aligned square bounding box containing some bodies.
  * @details The bounding box is defined by its bottom-left and top-right corners.
@@ -37,6 +40,14 @@ Eigen::AlignedBox2d compute_minimum_bounding_box(const std::vector<Body> &bodies
  */
 Eigen::AlignedBox2d compute_square_bounding_box(const std::vector<Body> &bodies);
 
+Eigen::AlignedBox2d compute_square_bounding_box(const SoaBodies &bodies);
+
+/**
+ * Extends a minimum bounding box (e.g. the union of the ones of several sets of bodies) into the square bounding box
+ * that compute_square_bounding_box computes for the bodies it bounds.
+ */
+Eigen::AlignedBox2d compute_square_bounding_box(const Eigen::AlignedBox2d &min_bbox);
+
 }  // namespace bh
 
 #endif  // BARNES_HUT_BOUNDING_BOX_H
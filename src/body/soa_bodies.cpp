@@ -0,0 +1,51 @@
+#include "soa_bodies.h"
+
+namespace bh {
+
+void SoaBodies::resize(std::size_t n) {
+  m_x.resize(n);
+  m_y.resize(n);
+  m_mass.resize(n);
+  m_vx.resize(n);
+  m_vy.resize(n);
+}
+
+Body SoaBodies::body(std::size_t i) const {
+  return {Eigen::Vector2d{m_x[i], m_y[i]}, m_mass[i], Eigen::Vector2d{m_vx[i], m_vy[i]}};
+}
+
+void SoaBodies::set_body(std::size_t i, const Body& body) {
+  m_x[i] = body.m_position.x();
+  m_y[i] = body.m_position.y();
+  m_mass[i] = body.m_mass;
+  m_vx[i] = body.m_velocity.x();
+  m_vy[i] = body.m_velocity.y();
+}
+
+void to_soa(const std::vector<Body>& bodies, SoaBodies& soa_bodies) {
+  soa_bodies.resize(bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    soa_bodies.set_body(i, bodies[i]);
+  }
+}
+
+SoaBodies to_soa(const std::vector<Body>& bodies) {
+  SoaBodies soa_bodies;
+  to_soa(bodies, soa_bodies);
+  return soa_bodies;
+}
+
+void to_aos(const SoaBodies& soa_bodies, std::vector<Body>& bodies) {
+  bodies.resize(soa_bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    bodies[i] = soa_bodies.body(i);
+  }
+}
+
+std::vector<Body> to_aos(const SoaBodies& soa_bodies) {
+  std::vector<Body> bodies;
+  to_aos(soa_bodies, bodies);
+  return bodies;
+}
+
+}  // namespace bh
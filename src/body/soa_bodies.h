@@ -0,0 +1,95 @@
+#ifndef BARNES_HUT_SOA_BODIES_H
+#define BARNES_HUT_SOA_BODIES_H
+
+#include <cstddef>  // size_t
+#include <new>      // align_val_t, bad_array_new_length
+#include <limits>   // numeric_limits
+#include <vector>
+
+#include "body.h"
+
+namespace bh {
+
+// Alignment of the arrays of SoaBodies: a cache line, and the width of the widest SIMD registers
+constexpr std::size_t SOA_BODIES_ALIGNMENT = 64;
+
+/**
+ * Allocator whose storage is aligned to SOA_BODIES_ALIGNMENT bytes.
+ */
+template <typename T>
+struct CacheAlignedAllocator {
+  using value_type = T;
+
+  CacheAlignedAllocator() = default;
+  template <typename U>
+  CacheAlignedAllocator(const CacheAlignedAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{SOA_BODIES_ALIGNMENT}));
+  }
+
+  void deallocate(T* p, std::size_t) noexcept {
+    ::operator delete(p, std::align_val_t{SOA_BODIES_ALIGNMENT});
+  }
+
+  template <typename U>
+  bool operator==(const CacheAlignedAllocator<U>&) const noexcept { return true; }
+  template <typename U>
+  bool operator!=(const CacheAlignedAllocator<U>&) const noexcept { return false; }
+};
+
+using AlignedDoubles = std::vector<double, CacheAlignedAllocator<double>>;
+
+/**
+ * Some bodies stored as structure of arrays: the i-th body is made of the i-th entry of each array.
+ * @details Loops that only read positions and masses, such as the force and bounding box computations,
+ * do not load velocities into the cache, and load consecutive bodies with single vector instructions.
+ */
+struct SoaBodies {
+  AlignedDoubles m_x;
+  AlignedDoubles m_y;
+  AlignedDoubles m_mass;
+  AlignedDoubles m_vx;
+  AlignedDoubles m_vy;
+
+  [[nodiscard]] std::size_t size() const { return m_x.size(); }
+  [[nodiscard]] bool empty() const { return m_x.empty(); }
+
+  /**
+   * Resizes every array to n bodies.
+   */
+  void resize(std::size_t n);
+
+  /**
+   * @return a copy of the i-th body
+   */
+  [[nodiscard]] Body body(std::size_t i) const;
+
+  /**
+   * Overwrites the i-th body.
+   */
+  void set_body(std::size_t i, const Body& body);
+};
+
+/**
+ * Converts some bodies to a structure of arrays, reusing the storage of the arrays.
+ * @param soa_bodies into which the bodies are written; it is resized to the number of bodies
+ */
+void to_soa(const std::vector<Body>& bodies, SoaBodies& soa_bodies);
+
+SoaBodies to_soa(const std::vector<Body>& bodies);
+
+/**
+ * Converts some bodies stored as structure of arrays to a vector of bodies, reusing the storage of the vector.
+ * @param bodies into which the bodies are written; it is resized to the number of bodies
+ */
+void to_aos(const SoaBodies& soa_bodies, std::vector<Body>& bodies);
+
+std::vector<Body> to_aos(const SoaBodies& soa_bodies);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_SOA_BODIES_H
@@ -13,7 +13,13 @@ Body deserialize_body(const mpi::Body &body) {
 }
 
 std::vector<Body> deserialize_bodies(const std::vector<mpi::Body> &bodies) {
-  std::vector<Body> deserialized(bodies.size());
+  std::vector<Body> deserialized;
+  deserialize_bodies(bodies, deserialized);
+  return deserialized;
+}
+
+void deserialize_bodies(const std::vector<mpi::Body> &bodies, std::vector<Body> &deserialized) {
+  deserialized.resize(bodies.size());
 #ifdef WITH_TBB
   std::transform(std::execution::par_unseq,
                  bodies.begin(), bodies.end(),
@@ -27,7 +33,6 @@ std::vector<Body> deserialize_bodies(const std::vector<mpi::Body> &bodies) {
     deserialized[i] = deserialize_body(bodies[i]);
   }
 #endif
-  return deserialized;
 }
 
 }  // namespace bh
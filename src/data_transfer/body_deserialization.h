@@ -12,6 +12,12 @@ Body deserialize_body(const mpi::Body &body);
 
 std::vector<Body> deserialize_bodies(const std::vector<mpi::Body> &bodies);
 
+/**
+ * Deserializes some bodies, reusing the storage of a vector.
+ * @param deserialized vector in which to write the deserialized bodies; it is resized to the number of bodies
+ */
+void deserialize_bodies(const std::vector<mpi::Body> &bodies, std::vector<Body> &deserialized);
+
 }  // namespace bh
 
 #endif  // BARNES_HUT_BODY_DESERIALIZATION_H
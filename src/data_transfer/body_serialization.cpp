@@ -12,7 +12,13 @@ mpi::Body serialize_body(const Body& body) {
 }
 
 std::vector<mpi::Body> serialize_bodies(const std::vector<Body>& bodies) {
-  std::vector<mpi::Body> serialized(bodies.size());
+  std::vector<mpi::Body> serialized;
+  serialize_bodies(bodies, serialized);
+  return serialized;
+}
+
+void serialize_bodies(const std::vector<Body>& bodies, std::vector<mpi::Body>& serialized) {
+  serialized.resize(bodies.size());
 #ifdef WITH_TBB
   std::transform(std::execution::par_unseq,
                  bodies.begin(), bodies.end(),
@@ -26,7 +32,6 @@ std::vector<mpi::Body> serialize_bodies(const std::vector<Body>& bodies) {
     serialized[i] = serialize_body(bodies[i]);
   }
 #endif
-  return serialized;
 }
 
-}  // namespace bh
\ No newline at end of file
+}  // namespace bh
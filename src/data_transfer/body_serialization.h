@@ -12,6 +12,12 @@ mpi::Body serialize_body(const Body& body);
 
 std::vector<mpi::Body> serialize_bodies(const std::vector<Body>& bodies);
 
+/**
+ * Serializes some bodies, reusing the storage of a vector.
+ * @param serialized vector in which to write the serialized bodies; it is resized to the number of bodies
+ */
+void serialize_bodies(const std::vector<Body>& bodies, std::vector<mpi::Body>& serialized);
+
 }  // namespace bh
 
 #endif  // BARNES_HUT_BODY_SERIALIZATION_H
@@ -1,6 +1,7 @@
 #ifndef BARNES_HUT_MPI_DATATYPES_H
 #define BARNES_HUT_MPI_DATATYPES_H
 
+#include <cstdint>  // uint8_t
 #include <vector>
 
 #include "node.h"
@@ -69,6 +70,37 @@ struct Node final {
   } data;
 };
 
+/**
+ * Compact encoding of a quadtree, as a stream of bytes in depth-first order: a byte holding the type of the root and
+ * the precision of the encoding (see COMPACT_FLOAT_FLAG), followed by the root.
+ * @details Nothing that can be derived from the position of a node is sent: the geometry of a node is the one of its
+ * quadrant of its parent, and the aggregate body of a fork is computed from its children.
+ * - a fork is a byte packing the types of its children, 2 bits each from the lowest ones, in the order NW, NE, SE, SW,
+ *   followed by its children
+ * - a leaf holding a body is the position and the mass of the body, as three numbers of the precision of the encoding
+ * - an empty leaf takes no byte
+ */
+enum CompactNodeType : std::uint8_t {
+  EmptyLeafType = 0,
+  BodyLeafType = 1,
+  CompactForkType = 2,
+};
+
+// Number of bits holding the type of a node in a compactly encoded fork
+constexpr int COMPACT_NODE_TYPE_BITS = 2;
+// Set in the first byte of a compactly encoded quadtree whose bodies are in single precision
+constexpr std::uint8_t COMPACT_FLOAT_FLAG = 1 << COMPACT_NODE_TYPE_BITS;
+
+/**
+ * Precision of the bodies of a compactly encoded quadtree.
+ */
+enum class Precision {
+  // Bitwise the bodies of the quadtree
+  DOUBLE,
+  // The bodies rounded to single precision, which halves their size
+  FLOAT,
+};
+
 }  // namespace bh::mpi
 
 #endif  // BARNES_HUT_MPI_DATATYPES_H
@@ -1,7 +1,9 @@
 #include "quadtree_deserialization.h"
 
 #include <Eigen/Eigen>
+#include <algorithm>  // for_each, upper_bound
 #include <array>
+#include <cstring>  // memcpy
 #include <functional>
 #include <memory>
 #include <stdexcept>  // runtime_error
@@ -51,30 +53,228 @@ std::unique_ptr<Node> deserialize_quadtree(const std::vector<mpi::Node> &quadtre
   return deserialize_quadtree_impl(quadtree_nodes, 0);
 }
 
-QuadtreeGrid deserialize_quadtrees(int n_procs, const std::vector<mpi::Node> &quadtrees, const std::vector<int> &n_nodes) {
-  const int N_ROWS = static_cast<int>(std::sqrt(n_procs));
-  const int N_COLS = N_ROWS;
+/**
+ * Computes the aggregate body of a fork from the ones of its children, which must have already been emitted after it
+ * (as well as the number of nodes in its subtree).
+ */
+void aggregate_fork_impl(LinearQuadtree::Index idx, std::vector<LinearQuadtree::Node> &nodes) {
+  // Same operations, in the same order, as compute_aggregate_body.
+  auto &node = nodes[idx];
+  const auto nw_idx = idx + 1;
+  const auto ne_idx = nw_idx + nodes[nw_idx].m_n_nodes;
+  const auto se_idx = ne_idx + nodes[ne_idx].m_n_nodes;
+  const auto sw_idx = se_idx + nodes[se_idx].m_n_nodes;
+  const auto &nw = nodes[nw_idx];
+  const auto &ne = nodes[ne_idx];
+  const auto &se = nodes[se_idx];
+  const auto &sw = nodes[sw_idx];
+  Eigen::Vector2d center_of_mass = nw.m_center_of_mass * nw.m_total_mass +
+                                   ne.m_center_of_mass * ne.m_total_mass +
+                                   se.m_center_of_mass * se.m_total_mass +
+                                   sw.m_center_of_mass * sw.m_total_mass;
+  double total_mass = nw.m_total_mass + ne.m_total_mass + se.m_total_mass + sw.m_total_mass;
+  node.m_center_of_mass = center_of_mass / total_mass;
+  node.m_total_mass = total_mass;
+}
+
+/**
+ * Completes a fork of a merged quadtree, once its children have been emitted after it, with the same rules as
+ * merge_quadtrees: a fork of leaves holding at most one body is replaced by a leaf.
+ * @param idx index of the fork
+ * @param first_body index of the first body of the fork
+ */
+void finish_merged_fork_impl(LinearQuadtree::Index idx, LinearQuadtree::Index first_body,
+                             std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &bodies) {
+  auto &node = nodes[idx];
+  if (nodes.size() - idx == 5) {
+    // if all children are leaves, we can attempt some optimizations
+    const auto n_bodies = bodies.size() - first_body;
+    if (n_bodies == 0) {
+      // if all leaves are empty, we can return an empty leaf node instead of a fork
+      nodes.resize(idx + 1);
+      return;
+    }
+    if (n_bodies == 1) {
+      // if there is only one body, we can return a leaf node containing that body instead of a fork
+      nodes.resize(idx + 1);
+      node.m_center_of_mass = bodies.back().m_position;
+      node.m_total_mass = bodies.back().m_mass;
+      node.m_n_bodies = 1;
+      return;
+    }
+  }
+
+  node.m_n_nodes = static_cast<LinearQuadtree::Index>(nodes.size() - idx);
+  aggregate_fork_impl(idx, nodes);
+}
+
+/**
+ * Emits in depth-first order the quadtree of a cell obtained by merging the quadtrees of the cells covering the key
+ * ranges of the processes, with the same rules as merge_quadtrees.
+ * @param splits first key of the range of each process but the first
+ * @param proc process whose cells are merged, the ranges of the others being empty; if negative, all of them
+ * @param cell visited by the recursion
+ * @param box bounding box of the cell
+ * @param deserialize_next called with the bounding box of each largest cell in the range of a process and with the
+ * process, in Morton order, to deserialize the next quadtree of the process
+ */
+template <typename DeserializeNext>
+void merge_cells_linear_impl(const std::vector<MortonKey> &splits, int proc, const MortonCell &cell, const Eigen::AlignedBox2d &box,
+                             DeserializeNext &deserialize_next, std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &bodies) {
+  // The processes' ranges that the cell overlaps, as the number of splits up to its first and its last key
+  const auto first_range = std::upper_bound(splits.begin(), splits.end(), cell.m_first_key);
+  const auto last_range = std::upper_bound(first_range, splits.end(), cell.last_key());
+  if (proc >= 0 && (last_range - splits.begin() < proc || first_range - splits.begin() > proc)) {
+    // Outside the range of the process: an empty leaf
+    nodes.push_back({{0, 0}, 0, box.max().x() - box.min().x(), 1, static_cast<LinearQuadtree::Index>(bodies.size()), 0});
+    return;
+  }
+  if (first_range == last_range) {
+    // The largest cell in the range of a process
+    deserialize_next(box, static_cast<int>(first_range - splits.begin()));
+    return;
+  }
+
+  const auto idx = static_cast<LinearQuadtree::Index>(nodes.size());
+  const auto first_body = static_cast<LinearQuadtree::Index>(bodies.size());
+  nodes.push_back({{0, 0}, 0, box.max().x() - box.min().x(), 1, first_body, 0});
 
-  QuadtreeGrid matrix(N_ROWS);
-  for (int i = 0; i < N_ROWS; i++) {
-    matrix[i].resize(N_COLS);
+  for (const auto sq : {Node::NW, Node::NE, Node::SE, Node::SW}) {
+    merge_cells_linear_impl(splits, proc, cell.child(sq), Node::get_subquadrant_bbox(box, sq), deserialize_next, nodes, bodies);
   }
 
-  std::vector<int> displacements(n_procs);
-  std::partial_sum(n_nodes.begin(), n_nodes.end(),
-                   displacements.begin() + 1,  // first displacement will be 0
-                   std::plus<>());
-
-  for (auto i = 0; i < N_ROWS; i++) {
-    for (auto j = 0; j < N_COLS; j++) {
-      const int idx_from = displacements[i * N_COLS + j];
-      const int n_nodes_in_branch = n_nodes[i * N_COLS + j];
-      const std::vector<mpi::Node> branch{quadtrees.begin() + idx_from, quadtrees.begin() + idx_from + n_nodes_in_branch};
-      matrix[i][j] = deserialize_quadtree(branch);
+  finish_merged_fork_impl(idx, first_body, nodes, bodies);
+}
+
+/**
+ * Reads the position and the mass of a body of a compactly encoded quadtree, as numbers of type T.
+ * @param bytes at which the body starts; moved past it
+ */
+template <typename T>
+Body read_compact_body_impl(const std::byte *&bytes) {
+  T values[3];
+  std::memcpy(values, bytes, sizeof(values));
+  bytes += sizeof(values);
+  return {{values[0], values[1]}, values[2]};
+}
+
+/**
+ * @param type of the node that the recursion is currently visiting, held by its parent
+ * @param bytes at which the visited node starts; moved past it
+ * @param box bounding box of the visited node, from which its geometry is derived
+ * @param nodes vector in which to append the deserialized nodes, in depth-first order
+ * @param bodies vector in which to append the bodies contained in the deserialized leaves
+ */
+void deserialize_compact_impl(mpi::CompactNodeType type, const std::byte *&bytes, mpi::Precision precision, const Eigen::AlignedBox2d &box,
+                              std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &bodies) {
+  const auto idx = static_cast<LinearQuadtree::Index>(nodes.size());
+  nodes.push_back({{0, 0}, 0, box.max().x() - box.min().x(), 1, static_cast<LinearQuadtree::Index>(bodies.size()), 0});
+
+  switch (type) {
+    case mpi::EmptyLeafType:
+      return;
+    case mpi::BodyLeafType: {
+      bodies.push_back(precision == mpi::Precision::FLOAT ? read_compact_body_impl<float>(bytes) : read_compact_body_impl<double>(bytes));
+      nodes[idx].m_center_of_mass = bodies.back().m_position;
+      nodes[idx].m_total_mass = bodies.back().m_mass;
+      nodes[idx].m_n_bodies = 1;
+      return;
+    }
+    case mpi::CompactForkType: {
+      const auto types = std::to_integer<unsigned>(*bytes++);
+      int shift = 0;
+      for (const auto sq : {Node::NW, Node::NE, Node::SE, Node::SW}) {
+        const auto child_type = static_cast<mpi::CompactNodeType>(types >> shift & ((1u << mpi::COMPACT_NODE_TYPE_BITS) - 1));
+        deserialize_compact_impl(child_type, bytes, precision, Node::get_subquadrant_bbox(box, sq), nodes, bodies);
+        shift += mpi::COMPACT_NODE_TYPE_BITS;
+      }
+      nodes[idx].m_n_nodes = static_cast<LinearQuadtree::Index>(nodes.size() - idx);
+      aggregate_fork_impl(idx, nodes);
+      return;
     }
+    default:
+      throw std::runtime_error("reached default case");
   }
+}
+
+/**
+ * Deserializes a compactly encoded quadtree, starting with the type of its root and the precision of the encoding.
+ * @param bytes at which the quadtree starts; moved past it
+ */
+void deserialize_compact_root_impl(const std::byte *&bytes, const Eigen::AlignedBox2d &box,
+                                   std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &bodies) {
+  const auto first_byte = std::to_integer<unsigned>(*bytes++);
+  const auto type = static_cast<mpi::CompactNodeType>(first_byte & ~unsigned{mpi::COMPACT_FLOAT_FLAG});
+  const auto precision = first_byte & mpi::COMPACT_FLOAT_FLAG ? mpi::Precision::FLOAT : mpi::Precision::DOUBLE;
+  deserialize_compact_impl(type, bytes, precision, box, nodes, bodies);
+}
+
+LinearQuadtree deserialize_linear_quadtree(const std::vector<std::byte> &bytes, const Eigen::AlignedBox2d &bbox) {
+  std::vector<LinearQuadtree::Node> nodes;
+  std::vector<Body> bodies;
+  const std::byte *next = bytes.data();
+  deserialize_compact_root_impl(next, bbox, nodes, bodies);
+  return {bbox, std::move(nodes), std::move(bodies)};
+}
+
+/**
+ * Appends the nodes and the bodies of a linear quadtree to the ones of another, as they are.
+ */
+void splice_linear_quadtree_impl(const LinearQuadtree &quadtree, std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &bodies) {
+  const auto first_body = static_cast<LinearQuadtree::Index>(bodies.size());
+  const auto first_node = nodes.size();
+  nodes.insert(nodes.end(), quadtree.nodes().begin(), quadtree.nodes().end());
+  std::for_each(nodes.begin() + first_node, nodes.end(), [&](LinearQuadtree::Node &node) {
+    node.m_first_body += first_body;
+  });
+  bodies.insert(bodies.end(), quadtree.bodies().begin(), quadtree.bodies().end());
+}
+
+/**
+ * Merges the compactly encoded quadtrees of the cells of some processes, and the linear quadtrees of the cells of one
+ * of them, into a linear quadtree.
+ * @param quadtrees compactly encoded quadtrees of the cells, one after the other, in Morton order
+ * @param proc process whose cells are merged; if negative, all of them
+ * @param my_proc process whose cells are the linear quadtrees instead of encoded ones; if negative, none
+ * @param my_quadtrees linear quadtrees of the cells of my_proc, in Morton order
+ */
+void merge_compact_cells_impl(const std::byte *quadtrees, const std::vector<MortonKey> &splits, int proc, int my_proc,
+                              const std::vector<std::shared_ptr<LinearQuadtree>> &my_quadtrees,
+                              const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree) {
+  quadtree.clear(bbox);
+  auto &nodes = quadtree.nodes();
+  auto &bodies = quadtree.bodies();
+  const std::byte *next = quadtrees;
+  auto my_next = my_quadtrees.begin();
+  const auto deserialize_next = [&](const Eigen::AlignedBox2d &box, int cell_proc) {
+    if (cell_proc == my_proc) {
+      splice_linear_quadtree_impl(**my_next++, nodes, bodies);
+    } else {
+      deserialize_compact_root_impl(next, box, nodes, bodies);
+    }
+  };
+  merge_cells_linear_impl(splits, proc, MortonCell{}, bbox, deserialize_next, nodes, bodies);
+}
+
+void deserialize_quadtrees(const std::vector<std::byte> &quadtrees, const std::vector<MortonKey> &splits,
+                           const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree) {
+  merge_compact_cells_impl(quadtrees.data(), splits, -1, -1, {}, bbox, quadtree);
+}
+
+void deserialize_quadtrees(const std::byte *quadtrees, const std::vector<MortonKey> &splits, int proc,
+                           const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree) {
+  merge_compact_cells_impl(quadtrees, splits, proc, -1, {}, bbox, quadtree);
+}
+
+void deserialize_quadtrees(const std::vector<std::byte> &quadtrees, const std::vector<MortonKey> &splits, int my_proc,
+                           const std::vector<std::shared_ptr<LinearQuadtree>> &my_quadtrees,
+                           const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree) {
+  merge_compact_cells_impl(quadtrees.data(), splits, -1, my_proc, my_quadtrees, bbox, quadtree);
+}
 
-  return matrix;
+void merge_cell_quadtrees(const std::vector<MortonKey> &splits, int proc, const std::vector<std::shared_ptr<LinearQuadtree>> &quadtrees,
+                          const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree) {
+  merge_compact_cells_impl(nullptr, splits, proc, proc, quadtrees, bbox, quadtree);
 }
 
 }  // namespace bh
@@ -1,22 +1,76 @@
 #ifndef BARNES_HUT_QUADTREE_DESERIALIZATION_H
 #define BARNES_HUT_QUADTREE_DESERIALIZATION_H
 
+#include <cstddef>  // byte
 #include <memory>
 #include <vector>
 
+#include "linear_quadtree.h"
+#include "morton.h"
 #include "mpi_datatypes.h"
 #include "node.h"
 
 namespace bh {
 
-using QuadtreeGrid = std::vector<std::vector<std::unique_ptr<Node>>>;
-
-QuadtreeGrid deserialize_quadtrees(int n_procs, const std::vector<mpi::Node> &quadtrees, const std::vector<int> &n_nodes);
-
 std::unique_ptr<Node> deserialize_quadtree_node(const mpi::Node &quadtree_node);
 
 std::unique_ptr<Node> deserialize_quadtree(const std::vector<mpi::Node> &quadtree_nodes);
 
+/**
+ * Deserializes a compactly encoded quadtree (see mpi::CompactNodeType), in the precision of its encoding.
+ * @param bbox bounding box of the root of the quadtree, from which the geometry of its nodes is derived
+ */
+LinearQuadtree deserialize_linear_quadtree(const std::vector<std::byte> &bytes, const Eigen::AlignedBox2d &bbox);
+
+/**
+ * Deserializes the compactly encoded quadtrees of the cells covering the ranges of Morton keys of the processes, and
+ * merges them into a single linear quadtree.
+ * @details Each process covers its range with the largest cells in it (see cover_key_range), so that a cell is in the
+ * range of a single process if and only if its parent is not; the cells above are the forks of the merged quadtree.
+ * The aggregate bodies of the forks are computed with the same operations as the ones of the quadtrees that were
+ * encoded: in double precision, the result is the same as the one of the quadtree constructed from all the bodies at
+ * once. Each quadtree is decoded in the precision of its encoding.
+ * @param quadtrees compactly encoded quadtrees of the cells of all the processes, one after the other, in Morton order
+ * @param splits first key of the range of each process but the first, in ascending order;
+ * the range of a process ends where the one of the next process begins
+ * @param bbox square bounding box of the merged quadtree
+ * @param quadtree into which the merged quadtree is written
+ */
+void deserialize_quadtrees(const std::vector<std::byte> &quadtrees, const std::vector<MortonKey> &splits,
+                           const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree);
+
+/**
+ * Deserializes the compactly encoded quadtrees of the cells covering the range of Morton keys of a single process, and
+ * merges them into a linear quadtree in which the ranges of the other processes are empty (see the overload merging
+ * all the processes).
+ * @param quadtrees compactly encoded quadtrees of the cells of the process, one after the other, in Morton order
+ * @param proc process whose cells are merged
+ */
+void deserialize_quadtrees(const std::byte *quadtrees, const std::vector<MortonKey> &splits, int proc,
+                           const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree);
+
+/**
+ * Merges the quadtrees of the cells of a process, as they are, and the compactly encoded quadtrees of the cells of
+ * the other processes into a single linear quadtree, as the overload merging encoded quadtrees only.
+ * @details The quadtrees of the process are not encoded and decoded, but their nodes and bodies are copied into the
+ * merged quadtree: only the quadtrees received from the other processes are decoded.
+ * @param quadtrees compactly encoded quadtrees of the cells of the other processes, one after the other, in Morton order
+ * @param my_proc process whose cells are the linear quadtrees
+ * @param my_quadtrees quadtrees of the cells of my_proc, in Morton order
+ */
+void deserialize_quadtrees(const std::vector<std::byte> &quadtrees, const std::vector<MortonKey> &splits, int my_proc,
+                           const std::vector<std::shared_ptr<LinearQuadtree>> &my_quadtrees,
+                           const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree);
+
+/**
+ * Merges the quadtrees of the cells covering the range of Morton keys of a single process into a linear quadtree in
+ * which the ranges of the other processes are empty, copying their nodes and bodies as they are.
+ * @param proc process whose cells are merged
+ * @param quadtrees of the cells of the process, in Morton order
+ */
+void merge_cell_quadtrees(const std::vector<MortonKey> &splits, int proc, const std::vector<std::shared_ptr<LinearQuadtree>> &quadtrees,
+                          const Eigen::AlignedBox2d &bbox, LinearQuadtree &quadtree);
+
 }  // namespace bh
 
 #endif  // BARNES_HUT_QUADTREE_DESERIALIZATION_H
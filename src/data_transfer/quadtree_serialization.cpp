@@ -1,6 +1,12 @@
 #include "quadtree_serialization.h"
 #include "body_serialization.h"
 
+#include <algorithm>  // all_of, max
+#include <cstdint>    // uint8_t
+#include <cstring>    // memcpy
+#include <stdexcept>  // invalid_argument
+#include <string>     // to_string
+
 namespace bh {
 
 // https://en.cppreference.com/w/cpp/utility/variant/visit
@@ -52,4 +58,89 @@ std::vector<mpi::Node> serialize_quadtree(const Node& node) {
   return nodes;
 }
 
+/**
+ * Whether a node is far enough from all the bodies of a domain to be approximated, with the criterion of
+ * compute_approximate_net_force_on_body.
+ * @details The distance of the center of mass from a box is computed with the same operations as its distance from
+ * a body, which rounding cannot make shorter: no body of the box is closer.
+ */
+bool is_far_from_domain_impl(const LinearQuadtree::Node& node, const std::vector<Eigen::AlignedBox2d>& domain, double squared_theta) {
+  return std::all_of(domain.begin(), domain.end(), [&](const Eigen::AlignedBox2d& box) {
+    const double dx = std::max({box.min().x() - node.m_center_of_mass.x(), 0.0, node.m_center_of_mass.x() - box.max().x()});
+    const double dy = std::max({box.min().y() - node.m_center_of_mass.y(), 0.0, node.m_center_of_mass.y() - box.max().y()});
+    return node.m_length * node.m_length < squared_theta * (dx * dx + dy * dy);
+  });
+}
+
+/**
+ * Appends the position and the mass of a body to a compactly encoded quadtree, as numbers of type T.
+ */
+template <typename T>
+void append_compact_body_impl(const Body& body, std::vector<std::byte>& bytes) {
+  const T values[] = {static_cast<T>(body.m_position.x()), static_cast<T>(body.m_position.y()), static_cast<T>(body.m_mass)};
+  const auto size = bytes.size();
+  bytes.resize(size + sizeof(values));
+  std::memcpy(bytes.data() + size, values, sizeof(values));
+}
+
+/**
+ * @param idx index of the node that the recursion is currently visiting
+ * @param domain boxes containing the bodies of the domain to which the quadtree is pruned, or nullptr not to prune it
+ * @param bytes vector to which the visited node is appended
+ * @return the type of the visited node, which its parent holds
+ */
+mpi::CompactNodeType serialize_compact_impl(const LinearQuadtree& quadtree, LinearQuadtree::Index idx, const std::vector<Eigen::AlignedBox2d>* domain,
+                                            double squared_theta, mpi::Precision precision, std::vector<std::byte>& bytes) {
+  const auto& node = quadtree.nodes()[idx];
+  const auto append_body = [&](const Body& body) {
+    if (precision == mpi::Precision::FLOAT) {
+      append_compact_body_impl<float>(body, bytes);
+    } else {
+      append_compact_body_impl<double>(body, bytes);
+    }
+  };
+
+  if (quadtree.is_leaf(idx)) {
+    if (node.m_n_bodies > 1) {
+      throw std::invalid_argument("Cannot serialize a leaf holding more than one body (bodies: " + std::to_string(node.m_n_bodies) + ")");
+    }
+    if (node.m_n_bodies == 0) {
+      return mpi::EmptyLeafType;
+    }
+    append_body(quadtree.bodies()[node.m_first_body]);
+    return mpi::BodyLeafType;
+  }
+
+  if (domain != nullptr && is_far_from_domain_impl(node, *domain, squared_theta)) {
+    append_body({node.m_center_of_mass, node.m_total_mass});
+    return mpi::BodyLeafType;
+  }
+
+  // The types of the children are known once they are serialized
+  const auto types_idx = bytes.size();
+  bytes.emplace_back();
+  std::uint8_t types = 0;
+  int shift = 0;
+  for (const auto child : quadtree.children(idx)) {
+    const auto type = serialize_compact_impl(quadtree, child, domain, squared_theta, precision, bytes);
+    types = static_cast<std::uint8_t>(types | type << shift);
+    shift += mpi::COMPACT_NODE_TYPE_BITS;
+  }
+  bytes[types_idx] = std::byte{types};
+  return mpi::CompactForkType;
+}
+
+void serialize_quadtree(const LinearQuadtree& quadtree, mpi::Precision precision, std::vector<std::byte>& bytes) {
+  bytes.assign(1, std::byte{});
+  const auto root_type = serialize_compact_impl(quadtree, LinearQuadtree::ROOT, nullptr, 0, precision, bytes);
+  bytes[0] = std::byte{static_cast<std::uint8_t>(root_type | (precision == mpi::Precision::FLOAT ? mpi::COMPACT_FLOAT_FLAG : 0))};
 }
+
+void serialize_quadtree(const LinearQuadtree& quadtree, const std::vector<Eigen::AlignedBox2d>& domain, double theta,
+                        mpi::Precision precision, std::vector<std::byte>& bytes) {
+  bytes.assign(1, std::byte{});
+  const auto root_type = serialize_compact_impl(quadtree, LinearQuadtree::ROOT, &domain, theta * theta, precision, bytes);
+  bytes[0] = std::byte{static_cast<std::uint8_t>(root_type | (precision == mpi::Precision::FLOAT ? mpi::COMPACT_FLOAT_FLAG : 0))};
+}
+
+}  // namespace bh
@@ -1,8 +1,11 @@
 #ifndef BARNES_HUT_QUADTREE_SERIALIZATION_H
 #define BARNES_HUT_QUADTREE_SERIALIZATION_H
 
+#include <Eigen/Eigen>
+#include <cstddef>  // byte
 #include <vector>
 
+#include "linear_quadtree.h"
 #include "mpi_datatypes.h"
 #include "node.h"
 
@@ -10,6 +13,29 @@ namespace bh {
 
 std::vector<mpi::Node> serialize_quadtree(const Node& node);
 
+/**
+ * Serializes a linear quadtree in the compact encoding (see mpi::CompactNodeType), reusing the storage of a vector.
+ * @param precision of the bodies of the encoding
+ * @param bytes vector in which to write the encoding; it is resized to its number of bytes
+ * @throw invalid_argument if a leaf of the quadtree holds more than one body
+ */
+void serialize_quadtree(const LinearQuadtree& quadtree, mpi::Precision precision, std::vector<std::byte>& bytes);
+
+/**
+ * Serializes the part of a linear quadtree that is essential to compute the forces on the bodies of a domain, in the
+ * compact encoding (see mpi::CompactNodeType), reusing the storage of a vector.
+ * @details A fork that compute_approximate_net_force_on_body would approximate for any body of the domain is
+ * serialized as a leaf holding its aggregate body, whose exact force is the same approximation: its subtree
+ * is not serialized.
+ * @param domain boxes containing the bodies of the domain; without boxes, the domain has no bodies and the root is approximated
+ * @param theta barnes–hut theta with which the forces are computed
+ * @param precision of the bodies of the encoding
+ * @param bytes vector in which to write the encoding; it is resized to its number of bytes
+ * @throw invalid_argument if a leaf of the quadtree holds more than one body
+ */
+void serialize_quadtree(const LinearQuadtree& quadtree, const std::vector<Eigen::AlignedBox2d>& domain, double theta,
+                        mpi::Precision precision, std::vector<std::byte>& bytes);
+
 }
 
 #endif  // BARNES_HUT_QUADTREE_SERIALIZATION_H
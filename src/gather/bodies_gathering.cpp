@@ -1,6 +1,9 @@
+#include "bodies_gathering.h"
+
 #include <mpi.h>
 
-#include <algorithm>   // transform
+#include <Eigen/Eigen>
+#include <algorithm>   // fill, transform
 #include <functional>  // plus
 #include <numeric>     // partial_sum
 
@@ -10,26 +13,162 @@
 
 namespace bh {
 
+// Reused across calls, so that their storage is allocated only once
+std::vector<int> m_recv_counts;
+std::vector<int> m_recv_displacements;
+std::vector<mpi::Body> m_my_serialized_bodies;
+std::vector<mpi::Body> m_all_serialized_bodies;
+std::vector<int> m_n_bodies;
+// The gathering of bodies started by start_gather_bodies, whose buffers must outlive the call
+std::vector<int> m_gather_n_bytes;
+std::vector<int> m_gather_displacements;
+MPI_Request m_gather_request = MPI_REQUEST_NULL;
+
 std::vector<Body> gather_bodies(int proc_id, int n_procs, int total_n_bodies, const std::vector<Body>& my_bodies) {
-  // contains the number of bodies that are to be received from each process
-  std::vector<int> recv_n_bodies(n_procs, total_n_bodies / n_procs);
-  std::transform(recv_n_bodies.begin(), recv_n_bodies.begin() + (total_n_bodies % n_procs), recv_n_bodies.begin(), [](const auto val) { return val + 1; });
+  std::vector<Body> all_bodies;
+  gather_bodies(proc_id, n_procs, total_n_bodies, my_bodies, all_bodies);
+  return all_bodies;
+}
 
+void gather_bodies(int proc_id, int n_procs, int total_n_bodies, const std::vector<Body>& my_bodies, std::vector<Body>& all_bodies) {
   // contains the number of bytes that are to be received from each process
-  std::vector<int> recv_n_bytes(n_procs);
-  std::transform(recv_n_bodies.begin(), recv_n_bodies.end(), recv_n_bytes.begin(), [](const auto n_nodes) { return n_nodes * sizeof(mpi::Body); });
+  constexpr int n_body_bytes = sizeof(mpi::Body);
+  auto& recv_n_bytes = m_recv_counts;
+  recv_n_bytes.resize(n_procs);
+  std::fill(recv_n_bytes.begin(), recv_n_bytes.end(), (total_n_bodies / n_procs) * n_body_bytes);
+  std::transform(recv_n_bytes.begin(), recv_n_bytes.begin() + (total_n_bodies % n_procs), recv_n_bytes.begin(), [](const auto val) { return val + n_body_bytes; });
 
   // entry i specifies the displacement (relative to all_serialized_bodies) at which to place the incoming data from process i
-  std::vector<int> displacements(n_procs);
-  std::partial_sum(recv_n_bytes.begin(), recv_n_bytes.end(), displacements.begin() + 1, std::plus<>());
+  auto& displacements = m_recv_displacements;
+  displacements.resize(n_procs);
+  displacements[0] = 0;
+  std::partial_sum(recv_n_bytes.begin(), recv_n_bytes.end() - 1, displacements.begin() + 1, std::plus<>());
+
+  serialize_bodies(my_bodies, m_my_serialized_bodies);
+
+  m_all_serialized_bodies.resize(total_n_bodies);  // note: here we must resize, and not reserve
+
+  MPI_Allgatherv(m_my_serialized_bodies.data(), recv_n_bytes[proc_id], MPI_BYTE, m_all_serialized_bodies.data(), recv_n_bytes.data(), displacements.data(), MPI_BYTE, MPI_COMM_WORLD);
+
+  deserialize_bodies(m_all_serialized_bodies, all_bodies);
+}
+
+std::vector<Eigen::Vector2d> gather_accelerations(int proc_id, int n_procs, int total_n_bodies, const std::vector<Eigen::Vector2d>& my_accelerations) {
+  std::vector<Eigen::Vector2d> all_accelerations;
+  gather_accelerations(proc_id, n_procs, total_n_bodies, my_accelerations, all_accelerations);
+  return all_accelerations;
+}
+
+void gather_accelerations(int proc_id, int n_procs, int total_n_bodies, const std::vector<Eigen::Vector2d>& my_accelerations,
+                          std::vector<Eigen::Vector2d>& all_accelerations) {
+  // contains the number of coordinates that are to be received from each process
+  auto& recv_n_coordinates = m_recv_counts;
+  recv_n_coordinates.resize(n_procs);
+  std::fill(recv_n_coordinates.begin(), recv_n_coordinates.end(), 2 * (total_n_bodies / n_procs));
+  std::transform(recv_n_coordinates.begin(), recv_n_coordinates.begin() + (total_n_bodies % n_procs), recv_n_coordinates.begin(), [](const auto val) { return val + 2; });
+
+  // entry i specifies the displacement (relative to all_accelerations) at which to place the incoming data from process i
+  auto& displacements = m_recv_displacements;
+  displacements.resize(n_procs);
+  displacements[0] = 0;
+  std::partial_sum(recv_n_coordinates.begin(), recv_n_coordinates.end() - 1, displacements.begin() + 1, std::plus<>());
+
+  all_accelerations.resize(total_n_bodies);  // note: here we must resize, and not reserve
+
+  // The coordinates of each Eigen::Vector2d are contiguous, and so are the vectors
+  MPI_Allgatherv(my_accelerations.data(), recv_n_coordinates[proc_id], MPI_DOUBLE, all_accelerations.data(), recv_n_coordinates.data(), displacements.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+}
+
+/**
+ * Computes the number of elements to receive from each process, and where to place them.
+ * @param n_bodies number of bodies computed by each process
+ * @param n_elements_per_body number of elements that each body is made of
+ * @param recv_counts vector in which to write the number of elements to receive from each process
+ * @param recv_displacements vector in which to write the displacement at which to place the elements of each process
+ * @return total number of elements
+ */
+int compute_recv_counts_impl(int n_procs, const std::vector<int>& n_bodies, int n_elements_per_body, std::vector<int>& recv_counts,
+                             std::vector<int>& recv_displacements) {
+  recv_counts.resize(n_procs);
+  std::transform(n_bodies.begin(), n_bodies.end(), recv_counts.begin(), [&](const auto n) { return n * n_elements_per_body; });
+  recv_displacements.resize(n_procs);
+  recv_displacements[0] = 0;
+  std::partial_sum(recv_counts.begin(), recv_counts.end() - 1, recv_displacements.begin() + 1, std::plus<>());
+  return recv_displacements.back() + recv_counts.back();
+}
+
+/**
+ * Computes the number of elements to receive from each process, and where to place them, in m_recv_counts and
+ * m_recv_displacements.
+ */
+int compute_recv_counts_impl(int n_procs, const std::vector<int>& n_bodies, int n_elements_per_body) {
+  return compute_recv_counts_impl(n_procs, n_bodies, n_elements_per_body, m_recv_counts, m_recv_displacements);
+}
+
+void gather_bodies(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<Body>& my_bodies, std::vector<Body>& all_bodies) {
+  start_gather_bodies(proc_id, n_procs, n_bodies, my_bodies);
+  finish_gather_bodies(all_bodies);
+}
+
+void start_gather_bodies(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<Body>& my_bodies) {
+  const int total_n_bytes = compute_recv_counts_impl(n_procs, n_bodies, sizeof(mpi::Body), m_gather_n_bytes, m_gather_displacements);
+
+  serialize_bodies(my_bodies, m_my_serialized_bodies);
+
+  m_all_serialized_bodies.resize(total_n_bytes / sizeof(mpi::Body));
+
+  MPI_Iallgatherv(m_my_serialized_bodies.data(), m_gather_n_bytes[proc_id], MPI_BYTE, m_all_serialized_bodies.data(), m_gather_n_bytes.data(),
+                  m_gather_displacements.data(), MPI_BYTE, MPI_COMM_WORLD, &m_gather_request);
+}
+
+void finish_gather_bodies(std::vector<Body>& all_bodies) {
+  MPI_Wait(&m_gather_request, MPI_STATUS_IGNORE);
+
+  deserialize_bodies(m_all_serialized_bodies, all_bodies);
+}
+
+void gather_accelerations(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<Eigen::Vector2d>& my_accelerations,
+                          std::vector<Eigen::Vector2d>& all_accelerations) {
+  const int total_n_coordinates = compute_recv_counts_impl(n_procs, n_bodies, 2);
+
+  all_accelerations.resize(total_n_coordinates / 2);
+
+  // The coordinates of each Eigen::Vector2d are contiguous, and so are the vectors
+  MPI_Allgatherv(my_accelerations.data(), m_recv_counts[proc_id], MPI_DOUBLE, all_accelerations.data(), m_recv_counts.data(), m_recv_displacements.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+}
+
+void gather_costs(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<std::uint32_t>& my_costs,
+                  std::vector<std::uint32_t>& all_costs) {
+  all_costs.resize(compute_recv_counts_impl(n_procs, n_bodies, 1));
+
+  MPI_Allgatherv(my_costs.data(), m_recv_counts[proc_id], MPI_UINT32_T, all_costs.data(), m_recv_counts.data(), m_recv_displacements.data(), MPI_UINT32_T, MPI_COMM_WORLD);
+}
+
+void gather_bodies(int proc_id, int n_procs, int root, const std::vector<Body>& my_bodies, const std::vector<std::uint32_t>& my_ids,
+                   std::vector<Body>& all_bodies, std::vector<std::uint32_t>& all_ids) {
+  // contains the number of bodies that are to be received from each process
+  auto& n_bodies = m_n_bodies;
+  n_bodies.resize(n_procs);
+  int my_n_bodies = static_cast<int>(my_bodies.size());
+  MPI_Gather(&my_n_bodies, 1, MPI_INT, n_bodies.data(), 1, MPI_INT, root, MPI_COMM_WORLD);
 
-  std::vector<mpi::Body> my_serialized_bodies = serialize_bodies(my_bodies);
+  serialize_bodies(my_bodies, m_my_serialized_bodies);
 
-  std::vector<mpi::Body> all_serialized_bodies(total_n_bodies);  // note: here we must resize, and not reserve
+  if (proc_id == root) {
+    m_all_serialized_bodies.resize(compute_recv_counts_impl(n_procs, n_bodies, sizeof(mpi::Body)) / sizeof(mpi::Body));
+  }
+  MPI_Gatherv(m_my_serialized_bodies.data(), my_n_bodies * static_cast<int>(sizeof(mpi::Body)), MPI_BYTE,
+              m_all_serialized_bodies.data(), m_recv_counts.data(), m_recv_displacements.data(), MPI_BYTE, root, MPI_COMM_WORLD);
 
-  MPI_Allgatherv(&my_serialized_bodies[0], recv_n_bytes[proc_id], MPI_BYTE, &all_serialized_bodies[0], &recv_n_bytes[0], &displacements[0], MPI_BYTE, MPI_COMM_WORLD);
+  if (proc_id == root) {
+    all_ids.resize(compute_recv_counts_impl(n_procs, n_bodies, 1));
+  }
+  MPI_Gatherv(my_ids.data(), my_n_bodies, MPI_UINT32_T, all_ids.data(), m_recv_counts.data(), m_recv_displacements.data(), MPI_UINT32_T,
+              root, MPI_COMM_WORLD);
 
-  return deserialize_bodies(all_serialized_bodies);
+  if (proc_id == root) {
+    deserialize_bodies(m_all_serialized_bodies, all_bodies);
+  }
 }
 
 }  // namespace bh
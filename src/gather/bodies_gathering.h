@@ -1,6 +1,8 @@
 #ifndef BARNES_HUT_BODIES_GATHERING_H
 #define BARNES_HUT_BODIES_GATHERING_H
 
+#include <Eigen/Eigen>
+#include <cstdint>  // uint32_t
 #include <vector>
 #include "body.h"
 
@@ -8,6 +10,72 @@ namespace bh {
 
 std::vector<Body> gather_bodies(int proc_id, int n_procs, int total_n_bodies, const std::vector<Body>& my_bodies);
 
+/**
+ * Gathers the bodies computed by each process, reusing the storage of a vector.
+ * @param all_bodies vector in which to write the bodies of all the processes; it is resized to total_n_bodies
+ */
+void gather_bodies(int proc_id, int n_procs, int total_n_bodies, const std::vector<Body>& my_bodies, std::vector<Body>& all_bodies);
+
+/**
+ * Gathers the accelerations of the bodies computed by each process, distributed as the bodies of gather_bodies.
+ */
+std::vector<Eigen::Vector2d> gather_accelerations(int proc_id, int n_procs, int total_n_bodies, const std::vector<Eigen::Vector2d>& my_accelerations);
+
+/**
+ * Gathers the accelerations of the bodies computed by each process, reusing the storage of a vector.
+ * @param all_accelerations vector in which to write the accelerations of all the bodies; it is resized to total_n_bodies
+ */
+void gather_accelerations(int proc_id, int n_procs, int total_n_bodies, const std::vector<Eigen::Vector2d>& my_accelerations,
+                          std::vector<Eigen::Vector2d>& all_accelerations);
+
+/**
+ * Gathers the bodies computed by each process, each one computing a given number of consecutive bodies.
+ * @param n_bodies number of bodies computed by each process
+ * @param all_bodies vector in which to write the bodies of all the processes, in the order of the processes;
+ * it is resized to the total number of bodies
+ */
+void gather_bodies(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<Body>& my_bodies, std::vector<Body>& all_bodies);
+
+/**
+ * Starts gathering the bodies computed by each process, as the gather_bodies overload taking the number of bodies of
+ * each process, without waiting for them, so that the caller can compute while they are in flight.
+ * @details my_bodies are serialized before returning, so they can be modified in the meantime. Other collective
+ * communications may run before finish_gather_bodies, but not another gathering of bodies.
+ */
+void start_gather_bodies(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<Body>& my_bodies);
+
+/**
+ * Waits for the bodies whose gathering was started by start_gather_bodies.
+ * @param all_bodies vector in which to write the bodies of all the processes, in the order of the processes;
+ * it is resized to the total number of bodies
+ */
+void finish_gather_bodies(std::vector<Body>& all_bodies);
+
+/**
+ * Gathers the accelerations of the bodies computed by each process, distributed as the bodies of the gather_bodies
+ * overload taking the number of bodies of each process.
+ */
+void gather_accelerations(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<Eigen::Vector2d>& my_accelerations,
+                          std::vector<Eigen::Vector2d>& all_accelerations);
+
+/**
+ * Gathers the costs of the bodies computed by each process (e.g. the number of interactions evaluated to compute
+ * their forces), distributed as the bodies of the gather_bodies overload taking the number of bodies of each process.
+ */
+void gather_costs(int proc_id, int n_procs, const std::vector<int>& n_bodies, const std::vector<std::uint32_t>& my_costs,
+                  std::vector<std::uint32_t>& all_costs);
+
+/**
+ * Gathers on a single process the bodies of all the processes, each one holding a different number of them, with their
+ * ids (see SimulationStep::ids).
+ * @param root process on which to gather the bodies
+ * @param all_bodies vector in which to write the bodies of all the processes, in the order of the processes;
+ * it is only written on the root
+ * @param all_ids vector in which to write their ids; it is only written on the root
+ */
+void gather_bodies(int proc_id, int n_procs, int root, const std::vector<Body>& my_bodies, const std::vector<std::uint32_t>& my_ids,
+                   std::vector<Body>& all_bodies, std::vector<std::uint32_t>& all_ids);
+
 }
 
 #endif  // BARNES_HUT_BODIES_GATHERING_H
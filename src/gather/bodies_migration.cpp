@@ -0,0 +1,87 @@
+#include "bodies_migration.h"
+
+#include <mpi.h>
+
+#include <functional>  // plus
+#include <numeric>     // partial_sum
+
+#include "body_deserialization.h"
+#include "body_serialization.h"
+#include "mpi_datatypes.h"
+
+namespace bh {
+
+// Reused across calls, so that their storage is allocated only once
+std::vector<int> m_migration_send_counts;
+std::vector<int> m_migration_send_displacements;
+std::vector<int> m_migration_recv_counts;
+std::vector<int> m_migration_recv_displacements;
+std::vector<mpi::Body> m_serialized_bodies;
+std::vector<mpi::Body> m_received_serialized_bodies;
+
+/**
+ * Computes the number of elements to send to and receive from each process, and where they are, in m_migration_send_counts,
+ * m_migration_send_displacements, m_migration_recv_counts and m_migration_recv_displacements.
+ * @param n_elements_per_body number of elements that each body is made of
+ * @return total number of elements to receive
+ */
+int compute_migration_counts_impl(int n_procs, const std::vector<int>& send_n_bodies, const std::vector<int>& recv_n_bodies,
+                                  int n_elements_per_body) {
+  const auto compute_counts = [&](const std::vector<int>& n_bodies, std::vector<int>& counts, std::vector<int>& displacements) {
+    counts.resize(n_procs);
+    for (int proc = 0; proc < n_procs; proc++) {
+      counts[proc] = n_bodies[proc] * n_elements_per_body;
+    }
+    displacements.assign(n_procs, 0);
+    std::partial_sum(counts.begin(), counts.end() - 1, displacements.begin() + 1, std::plus<>());
+  };
+  compute_counts(send_n_bodies, m_migration_send_counts, m_migration_send_displacements);
+  compute_counts(recv_n_bodies, m_migration_recv_counts, m_migration_recv_displacements);
+  return m_migration_recv_displacements.back() + m_migration_recv_counts.back();
+}
+
+void exchange_n_bodies(int n_procs, const std::vector<int>& send_n_bodies, std::vector<int>& recv_n_bodies) {
+  recv_n_bodies.resize(n_procs);
+  MPI_Alltoall(send_n_bodies.data(), 1, MPI_INT, recv_n_bodies.data(), 1, MPI_INT, MPI_COMM_WORLD);
+}
+
+void migrate_bodies(int n_procs, const std::vector<int>& send_n_bodies, const std::vector<int>& recv_n_bodies,
+                    const std::vector<Body>& bodies, std::vector<Body>& received) {
+  const int total_n_bytes = compute_migration_counts_impl(n_procs, send_n_bodies, recv_n_bodies, sizeof(mpi::Body));
+
+  serialize_bodies(bodies, m_serialized_bodies);
+
+  m_received_serialized_bodies.resize(total_n_bytes / sizeof(mpi::Body));
+
+  MPI_Alltoallv(m_serialized_bodies.data(), m_migration_send_counts.data(), m_migration_send_displacements.data(), MPI_BYTE,
+                m_received_serialized_bodies.data(), m_migration_recv_counts.data(), m_migration_recv_displacements.data(), MPI_BYTE, MPI_COMM_WORLD);
+
+  deserialize_bodies(m_received_serialized_bodies, received);
+}
+
+void migrate_values(int n_procs, const std::vector<int>& send_n_bodies, const std::vector<int>& recv_n_bodies,
+                    const std::vector<std::uint32_t>& values, std::vector<std::uint32_t>& received) {
+  received.resize(compute_migration_counts_impl(n_procs, send_n_bodies, recv_n_bodies, 1));
+
+  MPI_Alltoallv(values.data(), m_migration_send_counts.data(), m_migration_send_displacements.data(), MPI_UINT32_T,
+                received.data(), m_migration_recv_counts.data(), m_migration_recv_displacements.data(), MPI_UINT32_T, MPI_COMM_WORLD);
+}
+
+Eigen::AlignedBox2d reduce_bounding_box(const Eigen::AlignedBox2d& my_bbox) {
+  Eigen::AlignedBox2d bbox;
+  MPI_Allreduce(my_bbox.min().data(), bbox.min().data(), 2, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+  MPI_Allreduce(my_bbox.max().data(), bbox.max().data(), 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  return bbox;
+}
+
+void reduce_sum(std::vector<std::uint64_t>& values) {
+  MPI_Allreduce(MPI_IN_PLACE, values.data(), static_cast<int>(values.size()), MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+}
+
+bool reduce_any(bool my_condition) {
+  int condition = my_condition;
+  MPI_Allreduce(MPI_IN_PLACE, &condition, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+  return condition != 0;
+}
+
+}  // namespace bh
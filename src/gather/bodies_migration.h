@@ -0,0 +1,53 @@
+#ifndef BARNES_HUT_BODIES_MIGRATION_H
+#define BARNES_HUT_BODIES_MIGRATION_H
+
+#include <Eigen/Eigen>
+#include <cstdint>  // uint32_t, uint64_t
+#include <vector>
+
+#include "body.h"
+
+namespace bh {
+
+/**
+ * Tells every process how many bodies this process sends it, and receives how many bodies each process sends this one.
+ * @param send_n_bodies number of bodies to send to each process
+ * @param recv_n_bodies vector in which to write the number of bodies to receive from each process
+ */
+void exchange_n_bodies(int n_procs, const std::vector<int>& send_n_bodies, std::vector<int>& recv_n_bodies);
+
+/**
+ * Sends some bodies to the processes whose domain they have entered, and receives the ones entering the domain of this
+ * process.
+ * @param send_n_bodies number of bodies to send to each process; the bodies to send to a process are consecutive,
+ * and follow the ones sent to the processes before it
+ * @param recv_n_bodies number of bodies to receive from each process (see exchange_n_bodies)
+ * @param received vector in which to write the bodies received, in the order of the processes
+ */
+void migrate_bodies(int n_procs, const std::vector<int>& send_n_bodies, const std::vector<int>& recv_n_bodies,
+                    const std::vector<Body>& bodies, std::vector<Body>& received);
+
+/**
+ * Sends some values carried by the bodies (e.g. their ids or their costs) along with them (see migrate_bodies).
+ */
+void migrate_values(int n_procs, const std::vector<int>& send_n_bodies, const std::vector<int>& recv_n_bodies,
+                    const std::vector<std::uint32_t>& values, std::vector<std::uint32_t>& received);
+
+/**
+ * @return the union of the bounding boxes of all the processes
+ */
+Eigen::AlignedBox2d reduce_bounding_box(const Eigen::AlignedBox2d& my_bbox);
+
+/**
+ * Sums some values over all the processes, in place.
+ */
+void reduce_sum(std::vector<std::uint64_t>& values);
+
+/**
+ * @return whether a condition holds on any process
+ */
+bool reduce_any(bool my_condition);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_BODIES_MIGRATION_H
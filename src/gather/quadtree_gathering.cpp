@@ -2,42 +2,167 @@
 
 #include <mpi.h>
 
-#include <algorithm>   // transform
+#include <chrono>      // steady_clock
 #include <functional>  // plus
-#include <numeric>     // accumulate, partial_sum
+#include <numeric>     // partial_sum
+#include <utility>     // move
 
 #include "mpi_datatypes.h"
-#include "quadtree.h"                  // QuadtreeMatrix, reconstruct_quadtree
-#include "quadtree_deserialization.h"  // deserialize_quadtrees
+#include "quadtree_deserialization.h"  // deserialize_quadtrees, merge_cell_quadtrees
 #include "quadtree_serialization.h"    // serialize_quadtree
 
 namespace bh {
 
-std::unique_ptr<Node> gather_quadtree(int proc_id, int n_procs, const Node& my_quadtree) {
-  // contains the number of nodes that are to be received from each process
-  std::vector<int> recv_n_nodes(n_procs);
-  auto my_n_nodes = my_quadtree.n_nodes();
-  MPI_Allgather(&my_n_nodes, 1, MPI_INT, &recv_n_nodes[0], 1, MPI_INT, MPI_COMM_WORLD);
+// Reused across calls, so that their storage is allocated only once
+std::vector<int> m_recv_n_bytes;
+std::vector<int> m_displacements;
+std::vector<int> m_send_n_bytes;
+std::vector<int> m_send_displacements;
+std::vector<MPI_Request> m_recv_requests;
+std::vector<MPI_Request> m_send_requests;
+// The quadtrees of the cells of this process and of the other processes, compactly encoded
+std::vector<std::byte> m_my_compact_quadtrees;
+std::vector<std::byte> m_all_compact_quadtrees;
+std::vector<std::byte> m_compact_cell_quadtree;
+std::vector<int> m_domain_n_coordinates;
+std::vector<Eigen::AlignedBox2d> m_all_boxes;
 
-  int total_n_nodes = std::accumulate(recv_n_nodes.begin(), recv_n_nodes.end(), 0, std::plus<>());
+void gather_domains(int n_procs, const std::vector<Eigen::AlignedBox2d>& my_domain, std::vector<std::vector<Eigen::AlignedBox2d>>& domains) {
+  // The corners of each box are contiguous, and so are the boxes
+  static_assert(sizeof(Eigen::AlignedBox2d) == 4 * sizeof(double));
+  constexpr int n_box_coordinates = 4;
+
+  auto& recv_n_coordinates = m_domain_n_coordinates;
+  recv_n_coordinates.resize(n_procs);
+  int my_n_coordinates = static_cast<int>(my_domain.size()) * n_box_coordinates;
+  MPI_Allgather(&my_n_coordinates, 1, MPI_INT, recv_n_coordinates.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+  auto& displacements = m_displacements;
+  displacements.assign(n_procs, 0);
+  std::partial_sum(recv_n_coordinates.begin(), recv_n_coordinates.end() - 1, displacements.begin() + 1, std::plus<>());
+
+  m_all_boxes.resize((displacements.back() + recv_n_coordinates.back()) / n_box_coordinates);
+
+  MPI_Allgatherv(my_domain.data(), my_n_coordinates, MPI_DOUBLE, m_all_boxes.data(), recv_n_coordinates.data(), displacements.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+
+  domains.resize(n_procs);
+  for (int proc = 0; proc < n_procs; proc++) {
+    const auto boxes_begin = m_all_boxes.begin() + displacements[proc] / n_box_coordinates;
+    domains[proc].assign(boxes_begin, boxes_begin + recv_n_coordinates[proc] / n_box_coordinates);
+  }
+}
+
+/**
+ * Encodes compactly the quadtrees of the cells of this process, pruned for each other process, one after the other,
+ * into m_my_compact_quadtrees, and exchanges their sizes: the bytes to send to and receive from each process, and
+ * where they are, are written in m_send_n_bytes, m_send_displacements, m_recv_n_bytes and m_displacements.
+ * @details This process merges its quadtrees as they are, so nothing is encoded for it.
+ */
+void prepare_exchange_impl(int proc_id, int n_procs, const std::vector<std::shared_ptr<LinearQuadtree>>& my_quadtrees,
+                           const std::vector<std::vector<Eigen::AlignedBox2d>>& domains, double theta, mpi::Precision precision) {
+  auto& send_n_bytes = m_send_n_bytes;
+  send_n_bytes.resize(n_procs);
+  m_my_compact_quadtrees.clear();
+  for (int proc = 0; proc < n_procs; proc++) {
+    const auto n_bytes_before = m_my_compact_quadtrees.size();
+    for (const auto& quadtree : my_quadtrees) {
+      if (proc != proc_id) {
+        serialize_quadtree(*quadtree, domains[proc], theta, precision, m_compact_cell_quadtree);
+        m_my_compact_quadtrees.insert(m_my_compact_quadtrees.end(), m_compact_cell_quadtree.begin(), m_compact_cell_quadtree.end());
+      }
+    }
+    send_n_bytes[proc] = static_cast<int>(m_my_compact_quadtrees.size() - n_bytes_before);
+  }
 
   // contains the number of bytes that are to be received from each process
-  std::vector<int> recv_n_bytes(recv_n_nodes);
-  std::transform(recv_n_nodes.begin(), recv_n_nodes.end(), recv_n_bytes.begin(), [](const auto n_nodes) { return n_nodes * sizeof(mpi::Node); });
+  auto& recv_n_bytes = m_recv_n_bytes;
+  recv_n_bytes.resize(n_procs);
+  MPI_Alltoall(send_n_bytes.data(), 1, MPI_INT, recv_n_bytes.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+  // entry i specifies the displacement at which to take the outgoing data to (place the incoming data from) process i
+  auto& send_displacements = m_send_displacements;
+  send_displacements.assign(n_procs, 0);
+  std::partial_sum(send_n_bytes.begin(), send_n_bytes.end() - 1, send_displacements.begin() + 1, std::plus<>());
+  auto& displacements = m_displacements;
+  displacements.assign(n_procs, 0);
+  std::partial_sum(recv_n_bytes.begin(), recv_n_bytes.end() - 1, displacements.begin() + 1, std::plus<>());
+
+  m_all_compact_quadtrees.resize(displacements.back() + recv_n_bytes.back());
+}
+
+std::shared_ptr<const LinearQuadtree> exchange_quadtree(int proc_id, int n_procs, const std::vector<std::shared_ptr<LinearQuadtree>>& my_quadtrees,
+                                                        const std::vector<std::vector<Eigen::AlignedBox2d>>& domains, double theta,
+                                                        mpi::Precision precision, const std::vector<MortonKey>& splits,
+                                                        const Eigen::AlignedBox2d& bbox, QuadtreeArena& arena) {
+  prepare_exchange_impl(proc_id, n_procs, my_quadtrees, domains, theta, precision);
+  auto& send_n_bytes = m_send_n_bytes;
+  auto& send_displacements = m_send_displacements;
+  auto& recv_n_bytes = m_recv_n_bytes;
+  auto& displacements = m_displacements;
+
+  MPI_Alltoallv(m_my_compact_quadtrees.data(), send_n_bytes.data(), send_displacements.data(), MPI_BYTE,
+                m_all_compact_quadtrees.data(), recv_n_bytes.data(), displacements.data(), MPI_BYTE, MPI_COMM_WORLD);
+
+  // The cells of the processes follow each other in Morton order
+  auto quadtree = arena.allocate(bbox);
+  deserialize_quadtrees(m_all_compact_quadtrees, splits, proc_id, my_quadtrees, bbox, *quadtree);
+
+  return quadtree;
+}
 
-  // entry i specifies the displacement (relative to recvbuf) at which to place the incoming data from process i
-  std::vector<int> displacements(n_procs);
-  std::partial_sum(recv_n_bytes.begin(), recv_n_bytes.end(), displacements.begin() + 1, std::plus<>());
+std::chrono::duration<double> exchange_quadtree(int proc_id, int n_procs, const std::vector<std::shared_ptr<LinearQuadtree>>& my_quadtrees,
+                                                const std::vector<std::vector<Eigen::AlignedBox2d>>& domains, double theta,
+                                                mpi::Precision precision, const std::vector<MortonKey>& splits,
+                                                const Eigen::AlignedBox2d& bbox, QuadtreeArena& arena,
+                                                const std::function<void(std::shared_ptr<const LinearQuadtree>)>& use) {
+  prepare_exchange_impl(proc_id, n_procs, my_quadtrees, domains, theta, precision);
 
-  std::vector<mpi::Node> my_serialized_quadtree = serialize_quadtree(my_quadtree);
+  // The bytes of each process are received and sent on their own, so that each quadtree can be used once arrived
+  auto& recv_requests = m_recv_requests;
+  recv_requests.assign(n_procs, MPI_REQUEST_NULL);
+  auto& send_requests = m_send_requests;
+  send_requests.assign(n_procs, MPI_REQUEST_NULL);
+  auto* recv_buffer = m_all_compact_quadtrees.data();
+  auto* send_buffer = m_my_compact_quadtrees.data();
+  for (int proc = 0; proc < n_procs; proc++) {
+    if (proc != proc_id && m_recv_n_bytes[proc] > 0) {
+      MPI_Irecv(recv_buffer + m_displacements[proc], m_recv_n_bytes[proc], MPI_BYTE, proc, 0, MPI_COMM_WORLD, &recv_requests[proc]);
+    }
+  }
+  for (int proc = 0; proc < n_procs; proc++) {
+    if (proc != proc_id && m_send_n_bytes[proc] > 0) {
+      MPI_Isend(send_buffer + m_send_displacements[proc], m_send_n_bytes[proc], MPI_BYTE, proc, 0, MPI_COMM_WORLD, &send_requests[proc]);
+    }
+  }
 
-  std::vector<mpi::Node> all_serialized_quadtrees(total_n_nodes);
+  std::chrono::duration<double> hidden{0};
+  for (int i = 0; i < n_procs; i++) {
+    // This process first, whose quadtrees are already here
+    const int proc = (proc_id + i) % n_procs;
+    if (proc != proc_id) {
+      MPI_Wait(&recv_requests[proc], MPI_STATUS_IGNORE);
+    }
+    int all_arrived;
+    MPI_Testall(n_procs, recv_requests.data(), &all_arrived, MPI_STATUSES_IGNORE);
 
-  MPI_Allgatherv(&my_serialized_quadtree[0], recv_n_bytes[proc_id], MPI_BYTE, &all_serialized_quadtrees[0], &recv_n_bytes[0], &displacements[0], MPI_BYTE, MPI_COMM_WORLD);
+    const auto start = std::chrono::steady_clock::now();
+    {
+      auto quadtree = arena.allocate(bbox);
+      if (proc == proc_id) {
+        merge_cell_quadtrees(splits, proc, my_quadtrees, bbox, *quadtree);
+      } else {
+        deserialize_quadtrees(recv_buffer + m_displacements[proc], splits, proc, bbox, *quadtree);
+      }
+      use(std::move(quadtree));
+    }
+    if (!all_arrived) {
+      hidden += std::chrono::steady_clock::now() - start;
+    }
+  }
 
-  auto grid = deserialize_quadtrees(n_procs, all_serialized_quadtrees, recv_n_nodes);
+  MPI_Waitall(n_procs, send_requests.data(), MPI_STATUSES_IGNORE);
 
-  return reconstruct_quadtree(grid);
+  return hidden;
 }
 
 }  // namespace bh
@@ -1,13 +1,64 @@
 #ifndef BARNES_HUT_QUADTREE_GATHERING_H
 #define BARNES_HUT_QUADTREE_GATHERING_H
 
+#include <chrono>      // duration
+#include <functional>  // function
+#include <memory>      // shared_ptr
 #include <vector>
 
-#include "node.h"
+#include "linear_quadtree.h"
+#include "morton.h"
+#include "mpi_datatypes.h"  // Precision
+#include "quadtree_arena.h"
 
 namespace bh {
 
-std::unique_ptr<Node> gather_quadtree(int proc_id, int n_procs, const Node& my_quadtree);
+/**
+ * Gathers the domain of each process: the boxes containing its bodies.
+ * @param domains vector in which to write the boxes of each process
+ */
+void gather_domains(int n_procs, const std::vector<Eigen::AlignedBox2d>& my_domain, std::vector<std::vector<Eigen::AlignedBox2d>>& domains);
+
+/**
+ * Exchanges with every other process the part of the quadtrees of its cells that is essential to the bodies of
+ * the other's domain (see serialize_quadtree), and merges the ones received into the locally essential quadtree
+ * of this process (see deserialize_quadtrees).
+ * @details Each process only receives the branches that its bodies open, so that neither the data exchanged nor the
+ * quadtree merged grow with the number of bodies of the other processes, as they would by gathering all the quadtrees.
+ * The branches are compactly encoded (see mpi::CompactNodeType), which is several times smaller than serialized nodes,
+ * while the quadtrees of this process are merged as they are, without being encoded and decoded.
+ * @param my_quadtrees quadtrees of the largest cells in the range of this process, in Morton order (see cover_key_range)
+ * @param domains boxes containing the bodies of each process
+ * @param theta barnes–hut theta with which the forces are computed
+ * @param precision of the bodies of the branches sent to the other processes; in single precision, the bodies of the
+ * branches received, and so the aggregate bodies of the forks above them, are rounded, while the ones of the cells of
+ * this process are not
+ * @param splits first key of the range of each process but the first, in ascending order
+ * @param bbox square bounding box of the complete quadtree
+ * @param arena from which the locally essential quadtree is allocated
+ */
+std::shared_ptr<const LinearQuadtree> exchange_quadtree(int proc_id, int n_procs, const std::vector<std::shared_ptr<LinearQuadtree>>& my_quadtrees,
+                                                        const std::vector<std::vector<Eigen::AlignedBox2d>>& domains, double theta,
+                                                        mpi::Precision precision, const std::vector<MortonKey>& splits,
+                                                        const Eigen::AlignedBox2d& bbox, QuadtreeArena& arena);
+
+/**
+ * Exchanges with every other process the essential part of the quadtrees of its cells, as exchange_quadtree, but
+ * hands over the quadtree of the cells of each process on its own, as soon as it has arrived, so that it can be used
+ * while the others are still in flight.
+ * @details The quadtree of the cells of this process is handed over first, then the ones of the others, in the order
+ * of the processes following this one, whatever the order in which they arrive: the quadtrees are used in the same
+ * order at every step.
+ * @param use called with the quadtree of the cells of each process, whose ranges of the other processes are empty
+ * (see deserialize_quadtrees); unless use keeps it, the quadtree is released once used, so that the arena can reuse
+ * its storage
+ * @return the time spent in use while some quadtrees were still in flight, i.e. the time of the exchange that was hidden
+ */
+std::chrono::duration<double> exchange_quadtree(int proc_id, int n_procs, const std::vector<std::shared_ptr<LinearQuadtree>>& my_quadtrees,
+                                                const std::vector<std::vector<Eigen::AlignedBox2d>>& domains, double theta,
+                                                mpi::Precision precision, const std::vector<MortonKey>& splits,
+                                                const Eigen::AlignedBox2d& bbox, QuadtreeArena& arena,
+                                                const std::function<void(std::shared_ptr<const LinearQuadtree>)>& use);
 
 }
 
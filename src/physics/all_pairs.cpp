@@ -0,0 +1,131 @@
+#include "all_pairs.h"
+
+#include <algorithm>  // min, max, fill
+#include <numeric>    // iota
+#ifdef WITH_TBB
+#include <execution>  // par_unseq
+#endif
+
+#include "force_kernel.h"
+
+namespace bh {
+
+/**
+ * Adds the forces between the bodies of two tiles, or between the bodies of a single tile, to both of them.
+ */
+void interact_tiles(std::size_t first_tile, std::size_t second_tile, const double* x, const double* y, const double* mass,
+                    std::size_t n, double G, SimdIsa isa, AllPairsBuffers& buffers) {
+  const std::size_t first_begin = first_tile * ALL_PAIRS_TILE_SIZE;
+  const std::size_t first_end = std::min(n, first_begin + ALL_PAIRS_TILE_SIZE);
+  const std::size_t second_begin = second_tile * ALL_PAIRS_TILE_SIZE;
+  const std::size_t second_end = std::min(n, second_begin + ALL_PAIRS_TILE_SIZE);
+
+  auto* fx = buffers.m_fx.data();
+  auto* fy = buffers.m_fy.data();
+  for (std::size_t i = first_begin; i < first_end; i++) {
+    // Within a single tile, each body only interacts with the ones after it
+    const std::size_t from = first_tile == second_tile ? i + 1 : second_begin;
+    const auto force = compute_mutual_forces_kernel(x[i], y[i], mass[i], x + from, y + from, mass + from, second_end - from,
+                                                    G, fx + from, fy + from, isa);
+    fx[i] += force.x();
+    fy[i] += force.y();
+  }
+}
+
+/**
+ * Computes the tiles that play a game in a round of a round-robin tournament (circle method): one player sits still,
+ * while the others rotate around it, facing each other in pairs.
+ * @param n_players even number of players
+ * @param round in [0, n_players - 1)
+ * @param game in [0, n_players / 2)
+ */
+std::pair<std::size_t, std::size_t> schedule_game(std::size_t n_players, std::size_t round, std::size_t game) {
+  const std::size_t n_rotating = n_players - 1;
+  if (game == 0) {
+    return {n_rotating, round};
+  }
+  return {(round + game) % n_rotating, (round + n_rotating - game) % n_rotating};
+}
+
+/**
+ * Computes the exact net gravitational force acting on each of n bodies, given their positions and masses.
+ */
+void compute_exact_net_forces_impl(const double* x, const double* y, const double* mass, std::size_t n, double G,
+                                   std::vector<Eigen::Vector2d>& forces, AllPairsBuffers& buffers) {
+  buffers.m_fx.assign(n, 0);
+  buffers.m_fy.assign(n, 0);
+
+  const std::size_t n_tiles = (n + ALL_PAIRS_TILE_SIZE - 1) / ALL_PAIRS_TILE_SIZE;
+  // With an odd number of tiles, a dummy one is added: the tile facing it sits the round out
+  const std::size_t n_players = n_tiles + n_tiles % 2;
+  const std::size_t n_games = n_players / 2;
+  const SimdIsa isa = detect_simd_isa();
+
+  const auto play = [&](std::size_t round, std::size_t game) {
+    const auto [first_tile, second_tile] = schedule_game(n_players, round, game);
+    if (first_tile < n_tiles && second_tile < n_tiles) {
+      interact_tiles(first_tile, second_tile, x, y, mass, n, G, isa, buffers);
+    }
+  };
+  const auto interact_tile_with_itself = [&](std::size_t tile) {
+    interact_tiles(tile, tile, x, y, mass, n, G, isa, buffers);
+  };
+
+#ifdef WITH_TBB
+  auto& indices = buffers.m_pairs;
+  indices.resize(std::max(n_tiles, n_games));
+  std::iota(indices.begin(), indices.end(), 0);
+
+  std::for_each(std::execution::par_unseq, indices.begin(), indices.begin() + n_tiles, interact_tile_with_itself);
+  for (std::size_t round = 0; round + 1 < n_players; round++) {
+    std::for_each(std::execution::par_unseq, indices.begin(), indices.begin() + n_games, [&](std::size_t game) {
+      play(round, game);
+    });
+  }
+#else
+#pragma omp parallel default(none) shared(n_tiles, n_players, n_games, play, interact_tile_with_itself)
+  {
+#pragma omp for
+    for (std::size_t tile = 0; tile < n_tiles; tile++) {
+      interact_tile_with_itself(tile);
+    }
+    // The implicit barrier at the end of each round keeps the games of different rounds apart
+    for (std::size_t round = 0; round + 1 < n_players; round++) {
+#pragma omp for
+      for (std::size_t game = 0; game < n_games; game++) {
+        play(round, game);
+      }
+    }
+  }
+#endif
+
+  forces.resize(n);
+  for (std::size_t i = 0; i < n; i++) {
+    forces[i] = {buffers.m_fx[i], buffers.m_fy[i]};
+  }
+}
+
+void compute_exact_net_forces(const std::vector<Body>& bodies, double G, std::vector<Eigen::Vector2d>& forces,
+                              AllPairsBuffers& buffers) {
+  const std::size_t n = bodies.size();
+  buffers.m_x.resize(n);
+  buffers.m_y.resize(n);
+  buffers.m_mass.resize(n);
+  for (std::size_t i = 0; i < n; i++) {
+    buffers.m_x[i] = bodies[i].m_position.x();
+    buffers.m_y[i] = bodies[i].m_position.y();
+    buffers.m_mass[i] = bodies[i].m_mass;
+  }
+  compute_exact_net_forces_impl(buffers.m_x.data(), buffers.m_y.data(), buffers.m_mass.data(), n, G, forces, buffers);
+}
+
+void compute_exact_net_forces(const SoaBodies& bodies, double G, std::vector<Eigen::Vector2d>& forces, AllPairsBuffers& buffers) {
+  compute_exact_net_forces_impl(bodies.m_x.data(), bodies.m_y.data(), bodies.m_mass.data(), bodies.size(), G, forces, buffers);
+}
+
+void compute_exact_net_forces(const std::vector<Body>& bodies, double G, std::vector<Eigen::Vector2d>& forces) {
+  AllPairsBuffers buffers;
+  compute_exact_net_forces(bodies, G, forces, buffers);
+}
+
+}  // namespace bh
@@ -0,0 +1,53 @@
+#ifndef BARNES_HUT_ALL_PAIRS_H
+#define BARNES_HUT_ALL_PAIRS_H
+
+#include <Eigen/Eigen>
+#include <cstddef>  // size_t
+#include <vector>
+
+#include "body.h"
+#include "soa_bodies.h"
+
+namespace bh {
+
+// Number of bodies in a tile: the positions, masses and forces of two tiles fit in the L1 cache
+constexpr std::size_t ALL_PAIRS_TILE_SIZE = 256;
+
+/**
+ * Scratch memory of compute_exact_net_forces, which can be reused by subsequent computations.
+ */
+struct AllPairsBuffers {
+  // The bodies as structure of arrays (unless they are already stored so), and the forces acting on them
+  std::vector<double> m_x;
+  std::vector<double> m_y;
+  std::vector<double> m_mass;
+  std::vector<double> m_fx;
+  std::vector<double> m_fy;
+  // Indices of the pairs of tiles of a round, processed in parallel
+  std::vector<std::size_t> m_pairs;
+};
+
+/**
+ * Computes the exact net gravitational force acting on each of some bodies, evaluating each pair of bodies once.
+ * @details The bodies are split into tiles of ALL_PAIRS_TILE_SIZE bodies, and every pair of tiles is processed
+ * at once, adding the forces between their bodies to both of them (Newton's third law).
+ * The pairs of tiles are scheduled in rounds, as in a round-robin tournament: since the pairs of a round
+ * have no tile in common, they are processed in parallel without races, and without per-thread copies of the forces.
+ * @param bodies that exert a gravitational force on each other
+ * @param forces vector in which to write the force acting on each body; it is resized to the number of bodies
+ * @param buffers scratch memory
+ */
+void compute_exact_net_forces(const std::vector<Body>& bodies, double G, std::vector<Eigen::Vector2d>& forces,
+                              AllPairsBuffers& buffers);
+
+void compute_exact_net_forces(const std::vector<Body>& bodies, double G, std::vector<Eigen::Vector2d>& forces);
+
+/**
+ * Computes the exact net gravitational force acting on each of some bodies stored as structure of arrays,
+ * reading their positions and masses in place instead of copying them into the buffers.
+ */
+void compute_exact_net_forces(const SoaBodies& bodies, double G, std::vector<Eigen::Vector2d>& forces, AllPairsBuffers& buffers);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_ALL_PAIRS_H
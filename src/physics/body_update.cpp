@@ -1,6 +1,10 @@
 #include "body_update.h"
 
 #include <Eigen/Eigen>
+#include <algorithm>  // clamp
+#include <cmath>      // ceil, log2, sqrt
+#include <stdexcept>  // invalid_argument
+#include <string>     // to_string
 
 #include "force.h"
 
@@ -32,6 +36,16 @@ Body update_body_serial(const Body& body, const std::vector<Body>& bodies, doubl
   return {position, body.m_mass, velocity};
 }
 
+Body update_body(const Body& body, const Eigen::Vector2d& force, double dt) {
+  // The body's position is updated according to its current velocity
+  Eigen::Vector2d position(body.m_position + body.m_velocity * dt);
+
+  // The body's velocity is updated according to the net force on that particle.
+  Eigen::Vector2d velocity(body.m_velocity + force / body.m_mass * dt);
+
+  return {position, body.m_mass, velocity};
+}
+
 Body update_body(const Body& body, const Node& quadtree, double dt, double G, double omega) {
   // The body's position is updated according to its current velocity
   Eigen::Vector2d position(body.m_position + body.m_velocity * dt);
@@ -45,4 +59,79 @@ Body update_body(const Body& body, const Node& quadtree, double dt, double G, do
   return {position, body.m_mass, velocity};
 }
 
+Body update_body(const Body& body, const LinearQuadtree& quadtree, double dt, double G, double omega) {
+  // The body's position is updated according to its current velocity
+  Eigen::Vector2d position(body.m_position + body.m_velocity * dt);
+
+  // The net force on the particle is computed by adding the individual forces from all the other particles.
+  Eigen::Vector2d force = compute_approximate_net_force_on_body(quadtree, body, G, omega);
+
+  // The body's velocity is updated according to the net force on that particle.
+  Eigen::Vector2d velocity(body.m_velocity + force / body.m_mass * dt);
+
+  return {position, body.m_mass, velocity};
+}
+
+Body kick_and_drift(const Body& body, const Eigen::Vector2d& acceleration, double dt) {
+  Eigen::Vector2d velocity(body.m_velocity + acceleration * (dt / 2));
+
+  // The position is updated with the velocity at half the timestep, which makes the scheme second-order
+  Eigen::Vector2d position(body.m_position + velocity * dt);
+
+  return {position, body.m_mass, velocity};
+}
+
+Body kick(const Body& body, const Eigen::Vector2d& acceleration, double dt) {
+  Eigen::Vector2d velocity(body.m_velocity + acceleration * (dt / 2));
+
+  return {body.m_position, body.m_mass, velocity};
+}
+
+Body drift(const Body& body, double dt) {
+  Eigen::Vector2d position(body.m_position + body.m_velocity * dt);
+
+  return {position, body.m_mass, body.m_velocity};
+}
+
+void update_bodies(SoaBodies& bodies, const std::vector<Eigen::Vector2d>& forces, double dt) {
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    bodies.m_x[i] += bodies.m_vx[i] * dt;
+    bodies.m_y[i] += bodies.m_vy[i] * dt;
+    bodies.m_vx[i] += forces[i].x() / bodies.m_mass[i] * dt;
+    bodies.m_vy[i] += forces[i].y() / bodies.m_mass[i] * dt;
+  }
+}
+
+void kick_and_drift_bodies(SoaBodies& bodies, const std::vector<Eigen::Vector2d>& accelerations, double dt) {
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    bodies.m_vx[i] += accelerations[i].x() * (dt / 2);
+    bodies.m_vy[i] += accelerations[i].y() * (dt / 2);
+    bodies.m_x[i] += bodies.m_vx[i] * dt;
+    bodies.m_y[i] += bodies.m_vy[i] * dt;
+  }
+}
+
+void kick_bodies(SoaBodies& bodies, const std::vector<Eigen::Vector2d>& accelerations, double dt) {
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    bodies.m_vx[i] += accelerations[i].x() * (dt / 2);
+    bodies.m_vy[i] += accelerations[i].y() * (dt / 2);
+  }
+}
+
+int compute_timestep_level(const Eigen::Vector2d& acceleration, double dt, double length, double accuracy, int max_level) {
+  if (length <= 0 || accuracy <= 0) {
+    throw std::invalid_argument("The length and the accuracy of the timestep must be positive");
+  }
+  if (max_level < 0 || max_level > MAX_TIMESTEP_LEVEL) {
+    throw std::invalid_argument("The maximum timestep level must be between 0 and " + std::to_string(MAX_TIMESTEP_LEVEL));
+  }
+
+  const double norm = acceleration.norm();
+  if (norm == 0) {
+    return 0;
+  }
+  const double timestep = accuracy * std::sqrt(length / norm);
+  return std::clamp(static_cast<int>(std::ceil(std::log2(dt / timestep))), 0, max_level);
+}
+
 }  // namespace bh
\ No newline at end of file
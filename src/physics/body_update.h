@@ -1,13 +1,29 @@
 #ifndef BARNES_HUT_BODY_UPDATE_H
 #define BARNES_HUT_BODY_UPDATE_H
 
+#include <Eigen/Eigen>
 #include <vector>
 
 #include "body.h"
+#include "linear_quadtree.h"
 #include "node.h"
+#include "soa_bodies.h"
 
 namespace bh {
 
+enum class Integrator {
+  // First-order scheme: the position is updated with the old velocity, then the velocity with the force at the old position
+  EULER,
+  // Kick-drift-kick leapfrog: symplectic and second-order, it allows larger timesteps at equal accuracy.
+  // Its steps need the accelerations of the bodies at the start of the step, i.e., the ones computed at the last step
+  LEAPFROG
+};
+
+// Fraction of the free-fall time of a body, over the mean distance between the bodies, used as its timestep
+constexpr double DEFAULT_TIMESTEP_ACCURACY = 0.1;
+// Highest level of a block timestep, whose 2^level substeps fit in an int
+constexpr int MAX_TIMESTEP_LEVEL = 30;
+
 /**
  * Computes the new and exact position and velocity vectors of the body after a simulation step_impl.
  * @param bodies that exert a gravitational force on this body
@@ -18,6 +34,15 @@ Body update_body_parallel(const Body& body, const std::vector<Body>& bodies, dou
 
 Body update_body_serial(const Body& body, const std::vector<Body>& bodies, double dt, double G);
 
+/**
+ * Computes the new position and velocity vectors of the body after a simulation step_impl,
+ * given the net force acting on it.
+ * @param force net force acting on the body, e.g. computed by compute_exact_net_forces
+ * @param dt simulation timestep; defines the accuracy of the computation: the smaller, the more accurate
+ * @return a new body containing the updated position and velocity vectors
+ */
+Body update_body(const Body& body, const Eigen::Vector2d& force, double dt);
+
 /**
  * Computes the new, approximated position and velocity vectors of the body after a simulation step_impl,
  * using the Barnes–Hut approximation algorithm.
@@ -27,6 +52,67 @@ Body update_body_serial(const Body& body, const std::vector<Body>& bodies, doubl
  */
 Body update_body(const Body& body, const Node& quadtree, double dt, double G, double omega);
 
+Body update_body(const Body& body, const LinearQuadtree& quadtree, double dt, double G, double omega);
+
+/**
+ * Computes the first half of a kick-drift-kick leapfrog step: the velocity of the body is kicked for half a timestep,
+ * then its position drifts for a whole timestep with the new velocity.
+ * @param acceleration of the body at its current position
+ * @param dt simulation timestep
+ * @return a new body at the drifted position, with the velocity at half the timestep
+ */
+Body kick_and_drift(const Body& body, const Eigen::Vector2d& acceleration, double dt);
+
+/**
+ * Computes the second half of a kick-drift-kick leapfrog step: the velocity of the drifted body is kicked
+ * for half a timestep.
+ * @param body returned by kick_and_drift
+ * @param acceleration of the body at its drifted position
+ * @param dt simulation timestep
+ * @return a new body containing the velocity at the end of the timestep
+ */
+Body kick(const Body& body, const Eigen::Vector2d& acceleration, double dt);
+
+/**
+ * Drifts the position of the body with its current velocity.
+ * @return a new body at the drifted position
+ */
+Body drift(const Body& body, double dt);
+
+/**
+ * Updates in place the positions and velocities of some bodies stored as structure of arrays, as update_body does
+ * for each of them.
+ * @param forces net force acting on each body
+ */
+void update_bodies(SoaBodies& bodies, const std::vector<Eigen::Vector2d>& forces, double dt);
+
+/**
+ * Computes in place the first half of a kick-drift-kick leapfrog step of some bodies, as kick_and_drift does
+ * for each of them.
+ * @param accelerations acceleration of each body at its current position
+ */
+void kick_and_drift_bodies(SoaBodies& bodies, const std::vector<Eigen::Vector2d>& accelerations, double dt);
+
+/**
+ * Computes in place the second half of a kick-drift-kick leapfrog step of some bodies, as kick does
+ * for each of them.
+ * @param accelerations acceleration of each body at its drifted position
+ */
+void kick_bodies(SoaBodies& bodies, const std::vector<Eigen::Vector2d>& accelerations, double dt);
+
+/**
+ * Computes the level of the power-of-two block timestep of a body, i.e., the smallest l such that dt / 2^l
+ * is not longer than accuracy * sqrt(length / |acceleration|).
+ * @param dt timestep of level 0
+ * @param length over which the body should not move faster than allowed, e.g. the mean distance between the bodies
+ * @param accuracy fraction of the free-fall time over length used as the timestep
+ * @param max_level level of the shortest timestep allowed, at most MAX_TIMESTEP_LEVEL
+ * @return level between 0 and max_level
+ * @throw invalid_argument if the length or the accuracy are not positive, or max_level is out of range
+ */
+int compute_timestep_level(const Eigen::Vector2d& acceleration, double dt, double length,
+                           double accuracy = DEFAULT_TIMESTEP_ACCURACY, int max_level = 0);
+
 }  // namespace bh
 
 #endif  // BARNES_HUT_BODY_UPDATE_H
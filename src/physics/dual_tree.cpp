@@ -0,0 +1,108 @@
+#include "dual_tree.h"
+
+#include <algorithm>  // fill, for_each
+#include <cmath>      // sqrt
+#include <numeric>    // iota
+#include <stdexcept>  // invalid_argument
+#ifdef WITH_TBB
+#include <execution>  // par_unseq
+#endif
+
+#include "force_kernel.h"
+
+namespace bh {
+
+InteractionCounts compute_dual_tree_net_forces(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G,
+                                               double omega, std::vector<Eigen::Vector2d>& forces, DualTreeBuffers& buffers) {
+  for (const auto& body : bodies) {
+    if (Node::get_subquadrant(quadtree.bbox(), body.m_position) == Node::OUTSIDE) {
+      throw std::invalid_argument("Attempted to compute the force on a body outside of the quadtree's bounding box");
+    }
+  }
+
+  const auto& nodes = quadtree.nodes();
+  compute_cells(quadtree, buffers.m_cells);
+  buffers.m_fields.resize(nodes.size());
+  std::fill(buffers.m_fields.begin(), buffers.m_fields.end(), Eigen::Vector2d{0, 0});
+  buffers.m_tidal_tensors.resize(nodes.size());
+  std::fill(buffers.m_tidal_tensors.begin(), buffers.m_tidal_tensors.end(), Eigen::Vector3d{0, 0, 0});
+  buffers.m_leaf_pairs.clear();
+
+  InteractionCounts counts;
+  const double squared_omega = omega * omega;
+  const auto length = [&](LinearQuadtree::Index idx) { return nodes[idx].m_length; };
+  const auto is_well_separated = [&](LinearQuadtree::Index a, LinearQuadtree::Index b) {
+    const double length = nodes[a].m_length + nodes[b].m_length;
+    return length * length < squared_omega * (nodes[b].m_center_of_mass - nodes[a].m_center_of_mass).squaredNorm();
+  };
+  const auto interact_nodes = [&](LinearQuadtree::Index a, LinearQuadtree::Index b) {
+    // The field of b at the center of mass of a is G m_b r / |r|^3, and its gradient G m_b (3 r r^T / |r|^5 - I / |r|^3);
+    // the ones of a at the center of mass of b are the same, with r reversed
+    const Eigen::Vector2d r = nodes[b].m_center_of_mass - nodes[a].m_center_of_mass;
+    const double squared_distance = r.squaredNorm();
+    const double inv_distance_3 = 1 / (squared_distance * std::sqrt(squared_distance));
+    const double inv_distance_5 = inv_distance_3 / squared_distance;
+    const Eigen::Vector3d tidal_tensor{3 * r.x() * r.x() * inv_distance_5 - inv_distance_3,
+                                       3 * r.x() * r.y() * inv_distance_5,
+                                       3 * r.y() * r.y() * inv_distance_5 - inv_distance_3};
+    buffers.m_fields[a] += G * nodes[b].m_total_mass * inv_distance_3 * r;
+    buffers.m_fields[b] -= G * nodes[a].m_total_mass * inv_distance_3 * r;
+    buffers.m_tidal_tensors[a] += G * nodes[b].m_total_mass * tidal_tensor;
+    buffers.m_tidal_tensors[b] += G * nodes[a].m_total_mass * tidal_tensor;
+    counts.m_approximated++;
+  };
+  const auto interact_leaves = [&](LinearQuadtree::Index a, LinearQuadtree::Index b) {
+    buffers.m_leaf_pairs.emplace_back(a, b);
+    if (a != b) {
+      buffers.m_leaf_pairs.emplace_back(b, a);
+    }
+    counts.m_exact += (a == b ? 1 : 2) * static_cast<std::size_t>(nodes[a].m_n_bodies) * nodes[b].m_n_bodies;
+  };
+  walk_dual_tree(quadtree, LinearQuadtree::ROOT, LinearQuadtree::ROOT, length, is_well_separated, interact_nodes, interact_leaves);
+
+  // The field of each fork, expanded to first order, and its gradient are added to the ones of its children
+  push_down_dual_tree(quadtree, [&](LinearQuadtree::Index parent, LinearQuadtree::Index child) {
+    const Eigen::Vector2d h = nodes[child].m_center_of_mass - nodes[parent].m_center_of_mass;
+    const Eigen::Vector3d& tidal_tensor = buffers.m_tidal_tensors[parent];
+    buffers.m_fields[child] += buffers.m_fields[parent] + Eigen::Vector2d{tidal_tensor.x() * h.x() + tidal_tensor.y() * h.y(),
+                                                                          tidal_tensor.y() * h.x() + tidal_tensor.z() * h.y()};
+    buffers.m_tidal_tensors[child] += tidal_tensor;
+  });
+
+  sort_pairs_by_target(buffers.m_leaf_pairs, nodes.size(), buffers.m_sorted_leaf_pairs, buffers.m_offsets);
+
+  // The bodies are visited in Morton order, so that consecutive ones share their leaf and its neighbours
+  compute_morton_keys(bodies, quadtree.bbox(), buffers.m_keys);
+  buffers.m_order.resize(bodies.size());
+  std::iota(buffers.m_order.begin(), buffers.m_order.end(), 0);
+  radix_sort(buffers.m_keys, buffers.m_order, buffers.m_radix_sort_buffers);
+
+  forces.resize(bodies.size());
+  const auto compute_force = [&](std::uint32_t i) {
+    const auto& body = bodies[i];
+    const auto leaf = find_leaf(quadtree, buffers.m_cells, body.m_position);
+
+    const Eigen::Vector2d h = body.m_position - nodes[leaf].m_center_of_mass;
+    const Eigen::Vector3d& tidal_tensor = buffers.m_tidal_tensors[leaf];
+    const Eigen::Vector2d field = buffers.m_fields[leaf] + Eigen::Vector2d{tidal_tensor.x() * h.x() + tidal_tensor.y() * h.y(),
+                                                                           tidal_tensor.y() * h.x() + tidal_tensor.z() * h.y()};
+    Eigen::Vector2d force = body.m_mass * field;
+    for (auto pair = buffers.m_offsets[leaf]; pair < buffers.m_offsets[leaf + 1]; pair++) {
+      const auto& source = nodes[buffers.m_sorted_leaf_pairs[pair].second];
+      force += compute_net_force_kernel(quadtree.bodies().data() + source.m_first_body, source.m_n_bodies, body, G);
+    }
+    forces[i] = force;
+  };
+
+#ifdef WITH_TBB
+  std::for_each(std::execution::par_unseq, buffers.m_order.begin(), buffers.m_order.end(), compute_force);
+#else
+#pragma omp parallel for default(none) shared(bodies, buffers, compute_force)
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    compute_force(buffers.m_order[i]);
+  }
+#endif
+  return counts;
+}
+
+}  // namespace bh
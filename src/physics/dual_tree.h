@@ -0,0 +1,60 @@
+#ifndef BARNES_HUT_DUAL_TREE_H
+#define BARNES_HUT_DUAL_TREE_H
+
+#include <Eigen/Eigen>
+#include <Eigen/Geometry>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t
+#include <vector>
+
+#include "body.h"
+#include "dual_tree_walk.h"  // NodePair
+#include "force.h"
+#include "linear_quadtree.h"
+#include "morton.h"
+
+namespace bh {
+
+/**
+ * Scratch memory of compute_dual_tree_net_forces, which can be reused by subsequent computations.
+ */
+struct DualTreeBuffers {
+  std::vector<Eigen::AlignedBox2d> m_cells;
+  // Gravitational field at the center of mass of each node, and its gradient (tidal tensor: xx, xy, yy)
+  std::vector<Eigen::Vector2d> m_fields;
+  std::vector<Eigen::Vector3d> m_tidal_tensors;
+  // (target, source) pairs of leaves interacting body by body, sorted by target, and where the pairs of each target start
+  std::vector<NodePair> m_leaf_pairs;
+  std::vector<NodePair> m_sorted_leaf_pairs;
+  std::vector<std::size_t> m_offsets;
+  // The bodies sorted by Morton key, in the order in which their forces are computed
+  std::vector<MortonKey> m_keys;
+  std::vector<std::uint32_t> m_order;
+  RadixSortBuffers m_radix_sort_buffers;
+};
+
+/**
+ * Computes the net gravitational force that the bodies contained in a linear quadtree exert on each of some bodies,
+ * walking the quadtree against itself (dual-tree walk) and letting well-separated nodes interact as a whole.
+ * @details Two nodes are well separated if the sum of their lengths is less than omega times the distance between
+ * their centers of mass. Each pair of well-separated nodes interacts once, through their total masses and centers of
+ * mass: the gravitational field that each one exerts at the center of mass of the other, and its gradient,
+ * are accumulated in the nodes, and pushed down to the leaves. The force acting on a body is then obtained from the
+ * field of its leaf, expanded to first order around the center of mass of the leaf, plus the forces of the bodies
+ * of the leaves that are not well separated from it.
+ * Since the pairs of nodes are unordered, the walk visits half of the pairs that the walk of a node per target would.
+ * The walk is serial, while the forces of the bodies are computed in parallel, in Morton order.
+ * @param quadtree containing the bodies that exert a gravitational force
+ * @param bodies that are subject to the gravitational force of the bodies in the quadtree;
+ * must be contained in the bounding box of the quadtree
+ * @param forces vector in which to write the force acting on each body; it is resized to the number of bodies
+ * @param buffers scratch memory
+ * @return number of pairs of well-separated nodes, and of pairs of bodies, that interacted
+ * @throw invalid_argument if a body is located outside of the bounding box of the quadtree
+ */
+InteractionCounts compute_dual_tree_net_forces(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G,
+                                               double omega, std::vector<Eigen::Vector2d>& forces, DualTreeBuffers& buffers);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_DUAL_TREE_H
@@ -0,0 +1,25 @@
+#include "dual_tree_walk.h"
+
+#include <algorithm>  // fill
+#include <numeric>    // partial_sum
+
+namespace bh {
+
+void sort_pairs_by_target(const std::vector<NodePair>& pairs, std::size_t n_nodes, std::vector<NodePair>& sorted,
+                          std::vector<std::size_t>& offsets) {
+  // offsets[target] is first moved to the end of the pairs of the target, then back to their beginning
+  offsets.resize(n_nodes + 1);
+  std::fill(offsets.begin(), offsets.end(), 0);
+  for (const auto& pair : pairs) {
+    offsets[pair.first]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  sorted.resize(pairs.size());
+  // Visiting the pairs backwards, the ones of a target keep their order
+  for (auto pair = pairs.rbegin(); pair != pairs.rend(); ++pair) {
+    sorted[--offsets[pair->first]] = *pair;
+  }
+}
+
+}  // namespace bh
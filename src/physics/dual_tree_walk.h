@@ -0,0 +1,103 @@
+#ifndef BARNES_HUT_DUAL_TREE_WALK_H
+#define BARNES_HUT_DUAL_TREE_WALK_H
+
+#include <cstddef>  // size_t
+#include <utility>  // pair
+#include <vector>
+
+#include "linear_quadtree.h"
+
+namespace bh {
+
+using NodePair = std::pair<LinearQuadtree::Index, LinearQuadtree::Index>;
+
+/**
+ * Walks a linear quadtree against itself (dual-tree walk), letting the pairs of well-separated nodes interact as a
+ * whole, and the pairs of leaves that are not well separated body by body.
+ * @details Each unordered pair of nodes is visited once: a node paired with itself splits into the pairs of its
+ * children, each pair of distinct children being visited once too; otherwise, the larger node of a pair that is not
+ * well separated is split. Empty nodes are skipped.
+ * @param a, b nodes to pair; the walk of the whole quadtree starts from the root paired with itself
+ * @param size of a node, which decides which node of a pair is split
+ * @param is_well_separated whether two distinct nodes can interact as a whole
+ * @param interact_nodes lets two well-separated nodes interact
+ * @param interact_leaves lets two leaves interact body by body; a leaf is also paired with itself
+ */
+template <typename Size, typename IsWellSeparated, typename InteractNodes, typename InteractLeaves>
+void walk_dual_tree(const LinearQuadtree& quadtree, LinearQuadtree::Index a, LinearQuadtree::Index b, const Size& size,
+                    const IsWellSeparated& is_well_separated, const InteractNodes& interact_nodes,
+                    const InteractLeaves& interact_leaves) {
+  const auto& nodes = quadtree.nodes();
+  if (nodes[a].m_total_mass == 0 || nodes[b].m_total_mass == 0) {
+    return;
+  }
+
+  if (a == b) {
+    if (quadtree.is_leaf(a)) {
+      interact_leaves(a, a);
+      return;
+    }
+    const auto children = quadtree.children(a);
+    for (std::size_t i = 0; i < children.size(); i++) {
+      for (std::size_t j = i; j < children.size(); j++) {
+        walk_dual_tree(quadtree, children[i], children[j], size, is_well_separated, interact_nodes, interact_leaves);
+      }
+    }
+    return;
+  }
+
+  if (is_well_separated(a, b)) {
+    interact_nodes(a, b);
+    return;
+  }
+
+  const bool a_is_leaf = quadtree.is_leaf(a);
+  const bool b_is_leaf = quadtree.is_leaf(b);
+  if (a_is_leaf && b_is_leaf) {
+    interact_leaves(a, b);
+    return;
+  }
+
+  // The larger node is split
+  if (b_is_leaf || (!a_is_leaf && size(a) >= size(b))) {
+    for (const auto child : quadtree.children(a)) {
+      walk_dual_tree(quadtree, child, b, size, is_well_separated, interact_nodes, interact_leaves);
+    }
+  } else {
+    for (const auto child : quadtree.children(b)) {
+      walk_dual_tree(quadtree, a, child, size, is_well_separated, interact_nodes, interact_leaves);
+    }
+  }
+}
+
+/**
+ * Visits the non-empty forks of a linear quadtree top-down, pushing what they accumulated down to their children.
+ * @details In depth-first order, a parent is visited before its children: what it pushes is complete, since its own
+ * parent has already pushed to it.
+ * @param push_down called with each non-empty fork and each of its children
+ */
+template <typename PushDown>
+void push_down_dual_tree(const LinearQuadtree& quadtree, const PushDown& push_down) {
+  const auto& nodes = quadtree.nodes();
+  for (LinearQuadtree::Index idx = 0; idx < static_cast<LinearQuadtree::Index>(nodes.size()); idx++) {
+    if (quadtree.is_leaf(idx) || nodes[idx].m_total_mass == 0) {
+      continue;
+    }
+    for (const auto child : quadtree.children(idx)) {
+      push_down(idx, child);
+    }
+  }
+}
+
+/**
+ * Sorts (target, source) pairs of nodes by target, with a counting sort that keeps the order of the pairs of a target.
+ * @param sorted vector in which to write the sorted pairs
+ * @param offsets vector in which to write where the pairs of each target start in sorted, one per node,
+ * followed by the number of pairs
+ */
+void sort_pairs_by_target(const std::vector<NodePair>& pairs, std::size_t n_nodes, std::vector<NodePair>& sorted,
+                          std::vector<std::size_t>& offsets);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_DUAL_TREE_WALK_H
@@ -0,0 +1,320 @@
+#include "fmm.h"
+
+#include <algorithm>  // max, fill
+#include <cmath>      // sqrt
+#include <numeric>    // iota
+#include <stdexcept>  // invalid_argument
+#include <string>     // to_string
+#include <utility>    // swap
+#ifdef WITH_TBB
+#include <execution>  // par_unseq
+#endif
+
+#include "force_kernel.h"
+
+namespace bh {
+
+/**
+ * Index of the coefficient of multi-index (kx, ky) in an expansion.
+ */
+inline std::size_t coefficient_index(int kx, int ky) {
+  const int n = kx + ky;
+  return static_cast<std::size_t>(n * (n + 1) / 2 + ky);
+}
+
+/**
+ * Computes the powers of the components of a vector, from 0 up to some order.
+ */
+void compute_powers(const Eigen::Vector2d& d, int order, double* x_powers, double* y_powers) {
+  x_powers[0] = 1;
+  y_powers[0] = 1;
+  for (int i = 1; i <= order; i++) {
+    x_powers[i] = x_powers[i - 1] * d.x();
+    y_powers[i] = y_powers[i - 1] * d.y();
+  }
+}
+
+/**
+ * Computes the Taylor coefficients of 1/|r|, i.e. its derivatives of multi-index k divided by k!, up to some order.
+ * @details With n = kx + ky, the coefficients satisfy the recurrence
+ * n |r|^2 b_k + (2n - 1) (x b_{k - ex} + y b_{k - ey}) + (n - 1) (b_{k - 2ex} + b_{k - 2ey}) = 0.
+ */
+void compute_derivatives(const Eigen::Vector2d& r, int order, double* b) {
+  const double squared_norm = r.squaredNorm();
+  b[0] = 1 / std::sqrt(squared_norm);
+  for (int n = 1; n <= order; n++) {
+    for (int ky = 0; ky <= n; ky++) {
+      const int kx = n - ky;
+      double sum = 0;
+      if (kx >= 1) {
+        sum += (2 * n - 1) * r.x() * b[coefficient_index(kx - 1, ky)];
+      }
+      if (ky >= 1) {
+        sum += (2 * n - 1) * r.y() * b[coefficient_index(kx, ky - 1)];
+      }
+      if (kx >= 2) {
+        sum += (n - 1) * b[coefficient_index(kx - 2, ky)];
+      }
+      if (ky >= 2) {
+        sum += (n - 1) * b[coefficient_index(kx, ky - 2)];
+      }
+      b[coefficient_index(kx, ky)] = -sum / (n * squared_norm);
+    }
+  }
+}
+
+FmmSolver::FmmSolver(int order) : m_order{order} {
+  if (order < 1 || order > MAX_ORDER) {
+    throw std::invalid_argument("The order of the expansions must be in [1, " + std::to_string(MAX_ORDER) + "] (order: " + std::to_string(order) + ")");
+  }
+  m_n_coefficients = coefficient_index(0, order) + 1;
+
+  m_binomials.resize(order + 1);
+  for (int n = 0; n <= order; n++) {
+    m_binomials[n].resize(n + 1);
+    m_binomials[n][0] = m_binomials[n][n] = 1;
+    for (int k = 1; k < n; k++) {
+      m_binomials[n][k] = m_binomials[n - 1][k - 1] + m_binomials[n - 1][k];
+    }
+  }
+}
+
+int FmmSolver::order() const {
+  return m_order;
+}
+
+std::size_t FmmSolver::n_m2l() const {
+  return m_m2l.size();
+}
+
+std::size_t FmmSolver::n_p2p() const {
+  return m_p2p.size();
+}
+
+void FmmSolver::compute_net_forces(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G, double theta,
+                                   std::vector<Eigen::Vector2d>& forces) {
+  for (const auto& body : bodies) {
+    if (Node::get_subquadrant(quadtree.bbox(), body.m_position) == Node::OUTSIDE) {
+      throw std::invalid_argument("Attempted to compute the force on a body outside of the quadtree's bounding box");
+    }
+  }
+
+  compute_cells(quadtree);
+  upward_pass(quadtree);
+
+  interact(quadtree, theta);
+  sort_by_target(m_m2l, quadtree.nodes().size(), m_m2l_offsets);
+  sort_by_target(m_p2p, quadtree.nodes().size(), m_p2p_offsets);
+
+  downward_pass(quadtree, G);
+
+  forces.resize(bodies.size());
+  const auto compute_force = [&](std::size_t i) {
+    const auto& body = bodies[i];
+    const Index leaf = find_leaf(quadtree, m_cells, body.m_position);
+
+    // L2P: the force is minus the gradient of the local expansion of the potential
+    double x_powers[MAX_ORDER + 1];
+    double y_powers[MAX_ORDER + 1];
+    compute_powers(body.m_position - quadtree.nodes()[leaf].m_center_of_mass, m_order, x_powers, y_powers);
+    const double* local = m_locals.data() + leaf * m_n_coefficients;
+    Eigen::Vector2d gradient{0, 0};
+    for (int n = 1; n <= m_order; n++) {
+      for (int ny = 0; ny <= n; ny++) {
+        const int nx = n - ny;
+        const double coefficient = local[coefficient_index(nx, ny)];
+        if (nx >= 1) {
+          gradient.x() += coefficient * nx * x_powers[nx - 1] * y_powers[ny];
+        }
+        if (ny >= 1) {
+          gradient.y() += coefficient * ny * x_powers[nx] * y_powers[ny - 1];
+        }
+      }
+    }
+    Eigen::Vector2d force = -body.m_mass * gradient;
+
+    // P2P: the bodies of the leaves that are too close are summed one by one
+    for (auto pair = m_p2p_offsets[leaf]; pair < m_p2p_offsets[leaf + 1]; pair++) {
+      const auto& source = quadtree.nodes()[m_p2p[pair].second];
+      force += compute_net_force_kernel(quadtree.bodies().data() + source.m_first_body, source.m_n_bodies, body, G);
+    }
+    forces[i] = force;
+  };
+
+#ifdef WITH_TBB
+  m_indices.resize(bodies.size());
+  std::iota(m_indices.begin(), m_indices.end(), 0);
+  std::for_each(std::execution::par_unseq, m_indices.begin(), m_indices.end(), compute_force);
+#else
+#pragma omp parallel for default(none) shared(bodies, compute_force)
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    compute_force(i);
+  }
+#endif
+}
+
+void FmmSolver::compute_cells(const LinearQuadtree& quadtree) {
+  const auto& nodes = quadtree.nodes();
+  bh::compute_cells(quadtree, m_cells);
+  m_radii.resize(nodes.size());
+  for (Index idx = 0; idx < static_cast<Index>(nodes.size()); idx++) {
+    // Distance from the center of mass to the farthest corner of the cell
+    const Eigen::Vector2d& center_of_mass = nodes[idx].m_center_of_mass;
+    const Eigen::Vector2d farthest = (center_of_mass - m_cells[idx].min()).cwiseAbs().cwiseMax((m_cells[idx].max() - center_of_mass).cwiseAbs());
+    m_radii[idx] = farthest.norm();
+  }
+}
+
+void FmmSolver::upward_pass(const LinearQuadtree& quadtree) {
+  const auto& nodes = quadtree.nodes();
+  m_multipoles.resize(nodes.size() * m_n_coefficients);
+  std::fill(m_multipoles.begin(), m_multipoles.end(), 0);
+
+  double x_powers[MAX_ORDER + 1];
+  double y_powers[MAX_ORDER + 1];
+  // Visiting the nodes backwards, children are visited before their parents
+  for (auto idx = static_cast<Index>(nodes.size()); idx-- > 0;) {
+    const auto& node = nodes[idx];
+    double* multipole = m_multipoles.data() + idx * m_n_coefficients;
+    if (node.m_total_mass == 0) {
+      continue;
+    }
+
+    if (quadtree.is_leaf(idx)) {
+      // P2M
+      for (auto i = node.m_first_body; i < node.m_first_body + node.m_n_bodies; i++) {
+        const auto& body = quadtree.bodies()[i];
+        compute_powers(body.m_position - node.m_center_of_mass, m_order, x_powers, y_powers);
+        for (int n = 0; n <= m_order; n++) {
+          for (int ky = 0; ky <= n; ky++) {
+            multipole[coefficient_index(n - ky, ky)] += body.m_mass * x_powers[n - ky] * y_powers[ky];
+          }
+        }
+      }
+      continue;
+    }
+
+    // M2M: (d' + e)^k = sum over l <= k of C(k, l) d'^l e^(k - l), with e the displacement of the child's center
+    for (const auto child : quadtree.children(idx)) {
+      if (nodes[child].m_total_mass == 0) {
+        continue;
+      }
+      const double* child_multipole = m_multipoles.data() + child * m_n_coefficients;
+      compute_powers(nodes[child].m_center_of_mass - node.m_center_of_mass, m_order, x_powers, y_powers);
+      for (int n = 0; n <= m_order; n++) {
+        for (int ky = 0; ky <= n; ky++) {
+          const int kx = n - ky;
+          double sum = 0;
+          for (int lx = 0; lx <= kx; lx++) {
+            for (int ly = 0; ly <= ky; ly++) {
+              sum += m_binomials[kx][lx] * m_binomials[ky][ly] * child_multipole[coefficient_index(lx, ly)] *
+                     x_powers[kx - lx] * y_powers[ky - ly];
+            }
+          }
+          multipole[coefficient_index(kx, ky)] += sum;
+        }
+      }
+    }
+  }
+}
+
+void FmmSolver::interact(const LinearQuadtree& quadtree, double theta) {
+  const auto& nodes = quadtree.nodes();
+  m_m2l.clear();
+  m_p2p.clear();
+
+  const auto radius = [&](Index idx) { return m_radii[idx]; };
+  const auto is_well_separated = [&](Index a, Index b) {
+    return m_radii[a] + m_radii[b] < theta * (nodes[a].m_center_of_mass - nodes[b].m_center_of_mass).norm();
+  };
+  // The expansions of a pair of nodes are translated both ways, and so are the bodies of a pair of leaves
+  const auto interact_nodes = [&](Index a, Index b) {
+    m_m2l.emplace_back(a, b);
+    m_m2l.emplace_back(b, a);
+  };
+  const auto interact_leaves = [&](Index a, Index b) {
+    m_p2p.emplace_back(a, b);
+    if (a != b) {
+      m_p2p.emplace_back(b, a);
+    }
+  };
+  walk_dual_tree(quadtree, LinearQuadtree::ROOT, LinearQuadtree::ROOT, radius, is_well_separated, interact_nodes, interact_leaves);
+}
+
+void FmmSolver::downward_pass(const LinearQuadtree& quadtree, double G) {
+  const auto& nodes = quadtree.nodes();
+  m_locals.resize(nodes.size() * m_n_coefficients);
+  std::fill(m_locals.begin(), m_locals.end(), 0);
+
+  // M2L: with R the displacement of the target's center from the source's one, the potential of the source is
+  // -G sum over k of (-1)^|k| M_k b_k(R + h), expanded in powers of h, the displacement from the target's center
+  const auto translate_multipoles = [&](std::size_t target) {
+    double* local = m_locals.data() + target * m_n_coefficients;
+    double derivatives[(MAX_ORDER + 1) * (MAX_ORDER + 2) / 2];
+    for (auto pair = m_m2l_offsets[target]; pair < m_m2l_offsets[target + 1]; pair++) {
+      const Index source = m_m2l[pair].second;
+      const double* multipole = m_multipoles.data() + source * m_n_coefficients;
+      compute_derivatives(nodes[target].m_center_of_mass - nodes[source].m_center_of_mass, m_order, derivatives);
+
+      for (int n = 0; n <= m_order; n++) {
+        for (int ny = 0; ny <= n; ny++) {
+          const int nx = n - ny;
+          double sum = 0;
+          for (int k = 0; k <= m_order - n; k++) {
+            const double sign = k % 2 == 0 ? 1 : -1;
+            for (int ky = 0; ky <= k; ky++) {
+              const int kx = k - ky;
+              sum += sign * multipole[coefficient_index(kx, ky)] * m_binomials[kx + nx][nx] * m_binomials[ky + ny][ny] *
+                     derivatives[coefficient_index(kx + nx, ky + ny)];
+            }
+          }
+          local[coefficient_index(nx, ny)] -= G * sum;
+        }
+      }
+    }
+  };
+
+#ifdef WITH_TBB
+  m_indices.resize(nodes.size());
+  std::iota(m_indices.begin(), m_indices.end(), 0);
+  std::for_each(std::execution::par_unseq, m_indices.begin(), m_indices.end(), translate_multipoles);
+#else
+#pragma omp parallel for default(none) shared(nodes, translate_multipoles) schedule(dynamic, 64)
+  for (std::size_t target = 0; target < nodes.size(); target++) {
+    translate_multipoles(target);
+  }
+#endif
+
+  // L2L: the local expansion of a parent is complete before it is shifted to its children
+  double x_powers[MAX_ORDER + 1];
+  double y_powers[MAX_ORDER + 1];
+  push_down_dual_tree(quadtree, [&](Index parent, Index child) {
+    if (nodes[child].m_total_mass == 0) {
+      return;
+    }
+    const double* local = m_locals.data() + parent * m_n_coefficients;
+    double* child_local = m_locals.data() + child * m_n_coefficients;
+    compute_powers(nodes[child].m_center_of_mass - nodes[parent].m_center_of_mass, m_order, x_powers, y_powers);
+    for (int m = 0; m <= m_order; m++) {
+      for (int my = 0; my <= m; my++) {
+        const int mx = m - my;
+        double sum = 0;
+        for (int n = m; n <= m_order; n++) {
+          for (int ny = my; ny <= n - mx; ny++) {
+            const int nx = n - ny;
+            sum += m_binomials[nx][mx] * m_binomials[ny][my] * local[coefficient_index(nx, ny)] *
+                   x_powers[nx - mx] * y_powers[ny - my];
+          }
+        }
+        child_local[coefficient_index(mx, my)] += sum;
+      }
+    }
+  });
+}
+
+void FmmSolver::sort_by_target(std::vector<NodePair>& pairs, std::size_t n_nodes, std::vector<std::size_t>& offsets) {
+  sort_pairs_by_target(pairs, n_nodes, m_sorted_pairs, offsets);
+  std::swap(pairs, m_sorted_pairs);
+}
+
+}  // namespace bh
@@ -0,0 +1,119 @@
+#ifndef BARNES_HUT_FMM_H
+#define BARNES_HUT_FMM_H
+
+#include <Eigen/Eigen>
+#include <Eigen/Geometry>
+#include <cstddef>  // size_t
+#include <vector>
+
+#include "body.h"
+#include "dual_tree_walk.h"  // NodePair
+#include "linear_quadtree.h"
+
+namespace bh {
+
+/**
+ * Computes gravitational forces with the Fast Multipole Method, on the nodes of a linear quadtree.
+ * @details The force between two bodies decays as 1/r^2, i.e. the potential is the 3D one, 1/r, restricted to the
+ * plane: since it is not harmonic in 2D, the complex-series expansions of the 2D (logarithmic) potential do not apply.
+ * The potential is instead expanded in Cartesian Taylor series of total order p, around the centers of mass:
+ * - the multipole expansion of a node holds the moments sum m d^k of its bodies, d being their displacement
+ *   from the center of mass (P2M), and is obtained from the ones of its children (M2M);
+ * - a dual-tree walk pairs the nodes whose enclosing circles are well separated, and converts the multipole
+ *   expansion of the source into a local expansion of the target (M2L), using the derivatives of 1/r;
+ *   leaves that are not well separated interact body by body;
+ * - the local expansions are pushed down to the leaves (L2L), and differentiated at the position of the bodies (L2P).
+ * Translations are exact: the only error is the truncation at order p, which decreases as theta^p.
+ * The storage of the solver is reused by subsequent computations.
+ */
+class FmmSolver {
+ public:
+  static constexpr int DEFAULT_ORDER = 4;
+  static constexpr int MAX_ORDER = 16;
+
+  /**
+   * @param order of the expansions, in [1, MAX_ORDER]
+   * @throw invalid_argument if the order is out of range
+   */
+  explicit FmmSolver(int order = DEFAULT_ORDER);
+
+  /**
+   * Computes the net gravitational force that the bodies contained in a quadtree exert on each of some bodies.
+   * @param quadtree containing the bodies that exert a gravitational force
+   * @param bodies that are subject to the gravitational force of the bodies in the quadtree;
+   * must be contained in the bounding box of the quadtree
+   * @param theta two nodes are well separated if the sum of the radii of their enclosing circles,
+   * centered in their centers of mass, is less than theta times the distance between these
+   * @param forces vector in which to write the force acting on each body; it is resized to the number of bodies
+   * @throw invalid_argument if a body is located outside of the bounding box of the quadtree
+   */
+  void compute_net_forces(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G, double theta,
+                          std::vector<Eigen::Vector2d>& forces);
+
+  [[nodiscard]] int order() const;
+
+  /**
+   * @return number of multipole-to-local translations of the last computation
+   */
+  [[nodiscard]] std::size_t n_m2l() const;
+
+  /**
+   * @return number of pairs of leaves that interacted body by body in the last computation
+   */
+  [[nodiscard]] std::size_t n_p2p() const;
+
+ private:
+  using Index = LinearQuadtree::Index;
+
+  /**
+   * Computes the bounding box and the radius of the enclosing circle of each node.
+   */
+  void compute_cells(const LinearQuadtree& quadtree);
+
+  /**
+   * Computes the multipole expansions of the nodes, bottom-up (P2M, M2M).
+   */
+  void upward_pass(const LinearQuadtree& quadtree);
+
+  /**
+   * Collects the pairs of (target, source) nodes interacting through their expansions, and the pairs of leaves
+   * interacting body by body, walking the quadtree against itself (see walk_dual_tree).
+   */
+  void interact(const LinearQuadtree& quadtree, double theta);
+
+  /**
+   * Computes the local expansions of the nodes (M2L, L2L).
+   */
+  void downward_pass(const LinearQuadtree& quadtree, double G);
+
+  /**
+   * Sorts pairs of nodes by target, filling the offsets where the pairs of each target start.
+   */
+  void sort_by_target(std::vector<NodePair>& pairs, std::size_t n_nodes, std::vector<std::size_t>& offsets);
+
+  int m_order;
+  // Number of coefficients of an expansion: one per multi-index (kx, ky) with kx + ky <= order,
+  // stored by increasing kx + ky, then by increasing ky
+  std::size_t m_n_coefficients;
+  // m_binomials[n][k]: binomial coefficient n choose k
+  std::vector<std::vector<double>> m_binomials;
+
+  std::vector<Eigen::AlignedBox2d> m_cells;
+  std::vector<double> m_radii;
+  // Expansions of the nodes, m_n_coefficients per node
+  std::vector<double> m_multipoles;
+  std::vector<double> m_locals;
+  // (target, source) pairs, sorted by target, and where the pairs of each target start
+  std::vector<NodePair> m_m2l;
+  std::vector<std::size_t> m_m2l_offsets;
+  std::vector<NodePair> m_p2p;
+  std::vector<std::size_t> m_p2p_offsets;
+  // Scratch memory of sort_by_target, exchanged with the pairs sorted
+  std::vector<NodePair> m_sorted_pairs;
+  // Indices of the nodes or bodies, over which the expansions and forces are computed in parallel with TBB
+  std::vector<std::size_t> m_indices;
+};
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_FMM_H
@@ -11,7 +11,9 @@
         initializer(omp_priv = {0, 0})
 // clang-format on
 #endif
-#include <numeric>  // accumulate, transform_reduce
+#include <algorithm>  // min, max, max_element, partition_point
+#include <numeric>    // iota, transform_reduce
+#include <stdexcept>  // invalid_argument
 #include <variant>  // visit
 #ifdef DEBUG_COMPUTE_GRAVITATIONAL_FORCE
 #include <spdlog/spdlog.h>
@@ -19,6 +21,7 @@
 #include <cmath>
 
 #include "../quadtree/node.h"
+#include "force_kernel.h"
 
 // https://en.cppreference.com/w/cpp/utility/variant/visit
 template <class... Ts>
@@ -30,21 +33,21 @@ overloaded(Ts...) -> overloaded<Ts...>;
 
 namespace bh {
 
+// Number of bodies whose forces are summed by a single call of the SIMD kernel, when splitting them among threads
+constexpr std::size_t FORCE_CHUNK_SIZE = 1024;
+
 Eigen::Vector2d compute_gravitational_force(const Body& b1, const Body& b2, double G) {
   Eigen::Vector2d direction_v = b1.m_position - b2.m_position;
-  if (double distance = direction_v.norm(); distance > 0) {
-    double magnitude = (G * b1.m_mass * b2.m_mass) / std::pow(distance, 2.f);
-    double angle = std::atan2(direction_v.y(), direction_v.x());
-    double fx = std::cos(angle) * magnitude;
-    double fy = std::sin(angle) * magnitude;
+  if (double squared_distance = direction_v.squaredNorm(); squared_distance > 0) {
+    // G m1 m2 r / |r|^3: the direction is scaled by the magnitude divided by the distance, without trigonometry
+    double factor = (G * b1.m_mass * b2.m_mass) / (squared_distance * std::sqrt(squared_distance));
 #ifdef DEBUG_COMPUTE_GRAVITATIONAL_FORCE
-    spdlog::trace("distance: {}", distance);
-    spdlog::trace("magnitude: {}", magnitude);
-    spdlog::trace("angle: {}", angle);
-    spdlog::trace("fx: {}", fx);
-    spdlog::trace("fy: {}", fy);
+    spdlog::trace("squared distance: {}", squared_distance);
+    spdlog::trace("magnitude: {}", factor * std::sqrt(squared_distance));
+    spdlog::trace("fx: {}", factor * direction_v.x());
+    spdlog::trace("fy: {}", factor * direction_v.y());
 #endif
-    return {fx, fy};
+    return factor * direction_v;
   } else {
     return {0, 0};
   }
@@ -76,24 +79,296 @@ Eigen::Vector2d compute_approximate_net_force_on_body(const Node& node, const Bo
   return std::visit(overloaded{visit_fork, visit_leaf}, node.data());
 }
 
+/**
+ * Computes the correction that the quadrupole moment of a set of bodies adds to the force exerted on a body
+ * by their total mass, concentrated in their center of mass.
+ * @details With r the position of the body relative to the center of mass, the correction is
+ * G m (Q r / |r|^5 - 5/2 (r^T Q r) r / |r|^7), i.e. the gradient of the quadrupole term of the potential.
+ */
+Eigen::Vector2d compute_quadrupole_force(const LinearQuadtree::Quadrupole& quadrupole, const Eigen::Vector2d& center_of_mass,
+                                         const Body& body, double G) {
+  const Eigen::Vector2d r = body.m_position - center_of_mass;
+  const double squared_distance = r.squaredNorm();
+  if (squared_distance == 0) {
+    return {0, 0};
+  }
+  const Eigen::Vector2d q_r{quadrupole.m_xx * r.x() + quadrupole.m_xy * r.y(),
+                            quadrupole.m_xy * r.x() + quadrupole.m_yy * r.y()};
+  const double inv_distance_5 = 1 / (squared_distance * squared_distance * std::sqrt(squared_distance));
+  return G * body.m_mass * inv_distance_5 * (q_r - 2.5 * r.dot(q_r) / squared_distance * r);
+}
+
+/**
+ * Whether a node of a quadtree is far enough from a body, or from all the bodies of a group, to be approximated.
+ * @details Without opening radii, a node is approximated if its length is less than omega times its distance:
+ * squaring both sides, the test needs neither a square root nor a division.
+ * @param radius opening radius of the node, or nullptr if the opening radii of the quadtree have not been computed
+ * @param squared_distance between the center of mass of the node and the closest body
+ * @param squared_scale squared opening scale of the bodies
+ */
+inline bool is_far_enough_impl(const LinearQuadtree::Node& node, const LinearQuadtree::OpeningRadius* radius,
+                               double squared_distance, double squared_omega, double squared_scale) {
+  if (radius == nullptr) {
+    return node.m_length * node.m_length < squared_omega * squared_distance;
+  }
+  return squared_distance > squared_scale * radius->m_squared_radius && squared_distance > radius->m_squared_min_distance;
+}
+
+/**
+ * Walks a linear quadtree to compute the net force acting on a body (see compute_approximate_net_force_on_body).
+ * @param counts to which the interactions evaluated are added, or nullptr not to count them
+ */
+Eigen::Vector2d compute_approximate_net_force_on_body_impl(const LinearQuadtree& quadtree, const Body& body, double G,
+                                                           double omega, double opening_scale, InteractionCounts* counts) {
+  const auto& nodes = quadtree.nodes();
+  const auto& quadrupoles = quadtree.quadrupoles();
+  const double squared_omega = omega * omega;
+  // Opening radii, if computed
+  const auto* radii = quadtree.opening_radii().empty() ? nullptr : quadtree.opening_radii().data();
+  const double squared_scale = opening_scale * opening_scale;
+
+  Eigen::Vector2d net_force{0, 0};
+  // Depth-first visit without recursion nor stack: descending into a fork moves to the next node (its first child),
+  // while skipping a subtree moves past its last node
+  for (auto idx = LinearQuadtree::ROOT; idx < nodes.size();) {
+    const auto& node = nodes[idx];
+
+    if (node.m_n_nodes == 1 && node.m_n_bodies <= 1) {
+      if (node.m_n_bodies > 0) {
+        net_force += compute_gravitational_force(quadtree.bodies()[node.m_first_body], body, G);
+        if (counts != nullptr) {
+          counts->m_exact++;
+        }
+      }
+      idx++;
+      continue;
+    }
+
+    if (const double squared_distance = (body.m_position - node.m_center_of_mass).squaredNorm();
+        is_far_enough_impl(node, radii == nullptr ? nullptr : radii + idx, squared_distance, squared_omega, squared_scale)) {
+      // Approximation
+      net_force += compute_gravitational_force({node.m_center_of_mass, node.m_total_mass}, body, G);
+      if (!quadrupoles.empty()) {
+        net_force += compute_quadrupole_force(quadrupoles[idx], node.m_center_of_mass, body, G);
+      }
+      if (counts != nullptr) {
+        counts->m_approximated++;
+      }
+      idx += node.m_n_nodes;
+      continue;
+    }
+
+    if (node.m_n_nodes == 1) {
+      // A bucket that is too close to be approximated: sum the forces of its bodies, which are stored contiguously
+      const auto bucket_begin = quadtree.bodies().begin() + node.m_first_body;
+      net_force += compute_exact_net_force_on_body_serial(bucket_begin, bucket_begin + node.m_n_bodies, body, G);
+      if (counts != nullptr) {
+        counts->m_exact += node.m_n_bodies;
+      }
+    }
+    idx++;
+  }
+  return net_force;
+}
+
+Eigen::Vector2d compute_approximate_net_force_on_body(const LinearQuadtree& quadtree, const Body& body,
+                                                      double G, double omega, double opening_scale) {
+  return compute_approximate_net_force_on_body_impl(quadtree, body, G, omega, opening_scale, nullptr);
+}
+
+Eigen::Vector2d compute_approximate_net_force_on_body(const LinearQuadtree& quadtree, const Body& body, double G, double omega,
+                                                      InteractionCounts& counts) {
+  return compute_approximate_net_force_on_body_impl(quadtree, body, G, omega, 1, &counts);
+}
+
+InteractionCounts count_interactions(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double omega) {
+  InteractionCounts counts;
+  for (const auto& body : bodies) {
+    // The forces are discarded: the walk is shared, so that the interactions counted are the ones evaluated
+    compute_approximate_net_force_on_body_impl(quadtree, body, NEWTONIAN_G, omega, 1, &counts);
+  }
+  return counts;
+}
+
+double compute_relative_opening_scale(const Eigen::Vector2d& acceleration) {
+  // The node is opened if d^4 <= (G M l^2 / tolerance) / |a|, i.e. d^2 <= m_squared_radius / sqrt(|a|)
+  return 1 / std::sqrt(std::sqrt(acceleration.norm()));
+}
+
+/**
+ * Splits a range of bodies, sorted by Morton key and lying in the same cell at some level, into groups.
+ */
+void split_groups_impl(const std::vector<MortonKey>& keys, std::size_t from, std::size_t to, int level,
+                       std::size_t group_size, std::vector<std::pair<std::size_t, std::size_t>>& groups) {
+  if (to - from <= group_size || level == MORTON_KEY_DEPTH) {
+    groups.emplace_back(from, to);
+    return;
+  }
+  // The keys of the range share their first digits, hence they are sorted by their digit at this level
+  for (int subquadrant = Node::NW; subquadrant <= Node::SW; subquadrant++) {
+    const auto end = std::partition_point(keys.begin() + from, keys.begin() + to, [&](MortonKey key) {
+      return get_morton_subquadrant(key, level) <= subquadrant;
+    });
+    const auto subquadrant_to = static_cast<std::size_t>(end - keys.begin());
+    if (subquadrant_to > from) {
+      split_groups_impl(keys, from, subquadrant_to, level + 1, group_size, groups);
+    }
+    from = subquadrant_to;
+  }
+}
+
+/**
+ * Walks the quadtree on behalf of a group of bodies, collecting the nodes approximated for all of them
+ * and the bodies that have to be visited one by one.
+ */
+void collect_interactions(const LinearQuadtree& quadtree, const Eigen::AlignedBox2d& group_bbox, double omega,
+                          double opening_scale, std::vector<Body>& cells, std::vector<LinearQuadtree::Index>& cell_indices, std::vector<Body>& particles) {
+  const auto& nodes = quadtree.nodes();
+  const double squared_omega = omega * omega;
+  // Opening radii, if computed
+  const auto* radii = quadtree.opening_radii().empty() ? nullptr : quadtree.opening_radii().data();
+  const double squared_scale = opening_scale * opening_scale;
+
+  // Visited as in compute_approximate_net_force_on_body
+  for (auto idx = LinearQuadtree::ROOT; idx < nodes.size();) {
+    const auto& node = nodes[idx];
+
+    if (node.m_n_nodes == 1 && node.m_n_bodies <= 1) {
+      if (node.m_n_bodies > 0) {
+        particles.push_back(quadtree.bodies()[node.m_first_body]);
+      }
+      idx++;
+      continue;
+    }
+
+    // The closest point of the group to the center of mass is the one for which the criterion is the strictest
+    if (const double squared_distance = group_bbox.squaredExteriorDistance(node.m_center_of_mass);
+        is_far_enough_impl(node, radii == nullptr ? nullptr : radii + idx, squared_distance, squared_omega, squared_scale)) {
+      cells.emplace_back(node.m_center_of_mass, node.m_total_mass);
+      cell_indices.push_back(idx);
+      idx += node.m_n_nodes;
+      continue;
+    }
+
+    if (node.m_n_nodes == 1) {
+      const auto bucket_begin = quadtree.bodies().begin() + node.m_first_body;
+      particles.insert(particles.end(), bucket_begin, bucket_begin + node.m_n_bodies);
+    }
+    idx++;
+  }
+}
+
+/**
+ * Computes the net forces acting on the bodies of a group, writing them in the slots of the bodies.
+ * @param list_capacity capacity reserved for the interaction lists
+ * @return length of the longest interaction list of the group
+ */
+std::size_t compute_group_net_forces(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, const std::uint32_t* group_begin,
+                                     const std::uint32_t* group_end, double G, double omega, const std::vector<double>& opening_scales,
+                                     std::size_t list_capacity, std::vector<Eigen::Vector2d>& forces) {
+  // Interaction lists of the groups evaluated by this thread, which keep their capacity
+  thread_local std::vector<Body> cells;
+  thread_local std::vector<LinearQuadtree::Index> cell_indices;
+  thread_local std::vector<Body> particles;
+  cells.clear();
+  cell_indices.clear();
+  particles.clear();
+  cells.reserve(list_capacity);
+  cell_indices.reserve(list_capacity);
+  particles.reserve(list_capacity);
+
+  Eigen::AlignedBox2d group_bbox;
+  double opening_scale = opening_scales.empty() ? 1 : 0;
+  for (auto it = group_begin; it != group_end; ++it) {
+    group_bbox.extend(bodies[*it].m_position);
+    if (!opening_scales.empty()) {
+      opening_scale = std::max(opening_scale, opening_scales[*it]);
+    }
+  }
+  collect_interactions(quadtree, group_bbox, omega, opening_scale, cells, cell_indices, particles);
+
+  const auto& quadrupoles = quadtree.quadrupoles();
+  for (auto it = group_begin; it != group_end; ++it) {
+    const auto& body = bodies[*it];
+    Eigen::Vector2d force = compute_net_force_kernel(cells.data(), cells.size(), body, G) +
+                            compute_net_force_kernel(particles.data(), particles.size(), body, G);
+    if (!quadrupoles.empty()) {
+      for (std::size_t i = 0; i < cells.size(); i++) {
+        force += compute_quadrupole_force(quadrupoles[cell_indices[i]], cells[i].m_position, body, G);
+      }
+    }
+    forces[*it] = force;
+  }
+  return std::max(cells.size(), particles.size());
+}
+
+void compute_approximate_net_forces(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G, double omega,
+                                    int group_size, std::vector<Eigen::Vector2d>& forces, GroupWalkBuffers& buffers,
+                                    const std::vector<double>& opening_scales) {
+  if (group_size < 1) {
+    throw std::invalid_argument("The group size must be at least 1");
+  }
+
+  auto& keys = buffers.m_keys;
+  auto& order = buffers.m_order;
+  compute_morton_keys(bodies, quadtree.bbox(), keys);
+  order.resize(bodies.size());
+  std::iota(order.begin(), order.end(), 0);
+  radix_sort(keys, order, buffers.m_radix_sort_buffers);
+
+  auto& groups = buffers.m_groups;
+  groups.clear();
+  if (!bodies.empty()) {
+    split_groups_impl(keys, 0, bodies.size(), 0, group_size, groups);
+  }
+
+  forces.resize(bodies.size());
+  buffers.m_list_lengths.resize(groups.size());
+  const auto compute_group = [&](const std::pair<std::size_t, std::size_t>& group) {
+    // Each group writes the length of its lists in its own slot, since the groups are contiguous ranges of the order
+    buffers.m_list_lengths[&group - groups.data()] =
+        compute_group_net_forces(quadtree, bodies, order.data() + group.first, order.data() + group.second, G, omega,
+                                 opening_scales, buffers.m_list_capacity, forces);
+  };
+#ifdef WITH_TBB
+  std::for_each(std::execution::par_unseq, groups.begin(), groups.end(), compute_group);
+#else
+#pragma omp parallel for default(none) shared(groups, compute_group) schedule(dynamic)
+  for (std::size_t i = 0; i < groups.size(); i++) {
+    compute_group(groups[i]);
+  }
+#endif
+
+  const auto longest = groups.empty() ? 0 : *std::max_element(buffers.m_list_lengths.begin(), buffers.m_list_lengths.end());
+  while (buffers.m_list_capacity < 2 * longest) {
+    buffers.m_list_capacity = std::max<std::size_t>(2 * buffers.m_list_capacity, 1);
+  }
+}
+
 Eigen::Vector2d compute_exact_net_force_on_body_parallel(const std::vector<Body>& bodies, const Body& body,
                                                          double G) {
+  // Each chunk of bodies is summed by the SIMD kernel
+  const std::size_t n_chunks = (bodies.size() + FORCE_CHUNK_SIZE - 1) / FORCE_CHUNK_SIZE;
+  const auto compute_chunk_force = [&](std::size_t chunk) {
+    const std::size_t from = chunk * FORCE_CHUNK_SIZE;
+    return compute_net_force_kernel(bodies.data() + from, std::min(FORCE_CHUNK_SIZE, bodies.size() - from), body, G);
+  };
 #ifdef WITH_TBB
+  std::vector<std::size_t> chunks(n_chunks);
+  std::iota(chunks.begin(), chunks.end(), 0);
   return std::transform_reduce(
-      std::execution::par_unseq, bodies.begin(), bodies.end(), Eigen::Vector2d{0, 0},
+      std::execution::par_unseq, chunks.begin(), chunks.end(), Eigen::Vector2d{0, 0},
       [](const Eigen::Vector2d& total, const Eigen::Vector2d& curr) {
         return (total + curr).eval();
       },
-      [&](const Body& curr) {
-        return compute_gravitational_force(curr, body, G);
-      });
+      compute_chunk_force);
 #else
   Eigen::Vector2d net_force{0, 0};
 
 // clang-format off
-#pragma omp parallel for default(none) shared(bodies, body, G) reduction(+ : net_force)
-    for (const auto &curr : bodies) {
-      net_force += compute_gravitational_force(curr, body, G);
+#pragma omp parallel for default(none) shared(n_chunks, compute_chunk_force) reduction(+ : net_force)
+    for (std::size_t chunk = 0; chunk < n_chunks; chunk++) {
+      net_force += compute_chunk_force(chunk);
     }
 // clang-format off
 
@@ -103,14 +378,15 @@ Eigen::Vector2d compute_exact_net_force_on_body_parallel(const std::vector<Body>
 
 Eigen::Vector2d compute_exact_net_force_on_body_serial(const std::vector<Body>& bodies, const Body& body,
                                                 double G) {
-  return std::transform_reduce(bodies.begin(), bodies.end(),
-      Eigen::Vector2d{0, 0},
-      [](const Eigen::Vector2d& total, const Eigen::Vector2d& curr) {
-        return (total + curr).eval();
-      },
-      [&](const Body& curr) {
-        return compute_gravitational_force(curr, body, G);
-      });
+  return compute_exact_net_force_on_body_serial(bodies.begin(), bodies.end(), body, G);
+}
+
+Eigen::Vector2d compute_exact_net_force_on_body_serial(std::vector<Body>::const_iterator first, std::vector<Body>::const_iterator last,
+                                                       const Body& body, double G) {
+  if (first == last) {
+    return {0, 0};
+  }
+  return compute_net_force_kernel(&*first, static_cast<std::size_t>(last - first), body, G);
 }
 
 
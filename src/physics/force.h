@@ -2,8 +2,14 @@
 #define BARNES_HUT_FORCE_H
 
 #include <Eigen/Eigen>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t
+#include <utility>  // pair
+#include <vector>
 
 #include "body.h"
+#include "linear_quadtree.h"
+#include "morton.h"
 #include "node.h"
 
 namespace bh {
@@ -16,7 +22,33 @@ constexpr double NEWTONIAN_G = 0.000000000066743;
 constexpr double DEFAULT_OMEGA = 0.5;
 
 /**
- * Computes the gravitational force that body b1 exerts on body b2.
+ * Scratch memory of compute_approximate_net_forces, which can be reused by subsequent computations.
+ */
+struct GroupWalkBuffers {
+  // The bodies sorted by Morton key, and the ranges of them that make up each group
+  std::vector<MortonKey> m_keys;
+  std::vector<std::uint32_t> m_order;
+  RadixSortBuffers m_radix_sort_buffers;
+  std::vector<std::pair<std::size_t, std::size_t>> m_groups;
+  // Length of the interaction lists of each group, and the capacity that each thread reserves for its lists: since it
+  // is a power of two larger than the longest lists of the last computation, the lists of a thread do not grow
+  // when it walks for a group whose lists are longer than the ones it walked before
+  std::vector<std::size_t> m_list_lengths;
+  std::size_t m_list_capacity = 0;
+};
+
+/**
+ * Number of interactions evaluated to compute the forces acting on some bodies.
+ */
+struct InteractionCounts {
+  // Interactions with approximated nodes: body–node for the walks of a body, node–node for the dual-tree walk
+  std::size_t m_approximated = 0;
+  // Interactions between two bodies
+  std::size_t m_exact = 0;
+};
+
+/**
+ * Computes the gravitational force that body b1 exerts on body b2, as G m1 m2 r / |r|^3.
  * @details If the two bodies coincide, the components of the resulting force vector are (0, 0)
  * @param b1 exerts a gravitational force on b2
  * @param b2 is subject to the gravitational force of b1
@@ -35,6 +67,67 @@ Eigen::Vector2d compute_gravitational_force(const Body& b1, const Body& b2,
 Eigen::Vector2d compute_approximate_net_force_on_body(const Node& node, const Body& body,
                                                       double G = NEWTONIAN_G, double omega = DEFAULT_OMEGA);
 
+/**
+ * Computes the net gravitational force that the bodies contained in a linear quadtree exert on a body,
+ * using the Barnes–Hut approximation algorithm.
+ * @details The nodes are visited in their depth-first order, without recursion: the subtree of an approximated node
+ * is skipped thanks to its number of nodes. A node is approximated if its length is less than omega times
+ * its distance from the body, a test evaluated on squared distances; if the opening radii of the quadtree have been
+ * computed, they replace this test, implementing the chosen opening criterion (see compute_opening_radii).
+ * If the quadrupole moments of the quadtree have been computed, the force of each approximated node
+ * includes its quadrupole term, besides the monopole one.
+ * @param quadtree containing the bodies that exert a gravitational force on body
+ * @param body that is subject to the gravitational force of the bodies in the quadtree
+ * @param opening_scale of the body, which scales the opening radii (see LinearQuadtree::OpeningRadius)
+ * @return A force vector
+ */
+Eigen::Vector2d compute_approximate_net_force_on_body(const LinearQuadtree& quadtree, const Body& body,
+                                                      double G = NEWTONIAN_G, double omega = DEFAULT_OMEGA,
+                                                      double opening_scale = 1);
+
+/**
+ * Computes the net gravitational force that the bodies contained in a linear quadtree exert on a body,
+ * as the overload above does, and counts the interactions evaluated to compute it.
+ * @param counts to which the interactions of the body are added
+ */
+Eigen::Vector2d compute_approximate_net_force_on_body(const LinearQuadtree& quadtree, const Body& body, double G, double omega,
+                                                      InteractionCounts& counts);
+
+/**
+ * Computes the opening scale of a body for the relative force criterion (see LinearQuadtree::OpeningRadius).
+ * @param acceleration of the body at the previous step
+ */
+double compute_relative_opening_scale(const Eigen::Vector2d& acceleration);
+
+/**
+ * Counts the interactions that compute_approximate_net_force_on_body evaluates for each of some bodies.
+ * @param quadtree containing the bodies that exert a gravitational force
+ * @param bodies that are subject to the gravitational force of the bodies in the quadtree
+ * @return total number of interactions of the bodies
+ */
+InteractionCounts count_interactions(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double omega = DEFAULT_OMEGA);
+
+/**
+ * Computes the net gravitational force that the bodies contained in a linear quadtree exert on each of some bodies,
+ * using the Barnes–Hut approximation algorithm with one traversal of the quadtree per group of nearby bodies.
+ * @details The bodies are sorted by Morton key and split into groups of up to group_size bodies lying in the same cell.
+ * Each group walks the quadtree once: a node is approximated if the criterion holds for the closest point of the
+ * bounding box of the group, and hence for each of its bodies. The walk produces a list of approximated nodes and
+ * a list of bodies, whose forces are then computed for all the bodies of the group by the SIMD kernel.
+ * Quadrupole moments and opening radii are used if computed, as in compute_approximate_net_force_on_body;
+ * the opening radii of a group are scaled by the largest opening scale of its bodies.
+ * @param quadtree containing the bodies that exert a gravitational force
+ * @param bodies that are subject to the gravitational force of the bodies in the quadtree;
+ * must be contained in the bounding box of the quadtree
+ * @param forces vector in which to write the force acting on each body; it is resized to the number of bodies
+ * @param buffers scratch memory
+ * @param opening_scales opening scale of each body; if empty, the scale of every body is 1
+ * @throw invalid_argument if the group size is less than 1
+ */
+void compute_approximate_net_forces(const LinearQuadtree& quadtree, const std::vector<Body>& bodies, double G, double omega,
+                                    int group_size, std::vector<Eigen::Vector2d>& forces, GroupWalkBuffers& buffers,
+                                    const std::vector<double>& opening_scales = {});
+
 /**
  * Computes the exact gravitational force that a set of bodies exert on a body,
  * without any approximation.
@@ -48,6 +141,16 @@ Eigen::Vector2d compute_exact_net_force_on_body_parallel(const std::vector<Body>
 Eigen::Vector2d compute_exact_net_force_on_body_serial(const std::vector<Body>& bodies, const Body& body,
                                                          double G = NEWTONIAN_G);
 
+/**
+ * Computes the exact gravitational force that a range of bodies exert on a body, serially, with the SIMD kernel.
+ * @param first beginning of the range of bodies that exert a gravitational force on body
+ * @param last end of the range
+ * @param body that is subject to the gravitational force of the bodies in the range
+ * @return A force vector
+ */
+Eigen::Vector2d compute_exact_net_force_on_body_serial(std::vector<Body>::const_iterator first, std::vector<Body>::const_iterator last,
+                                                       const Body& body, double G = NEWTONIAN_G);
+
 }  // namespace bh
 
 #endif  // BARNES_HUT_FORCE_H
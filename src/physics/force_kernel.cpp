@@ -0,0 +1,323 @@
+#include "force_kernel.h"
+
+#include <cmath>  // sqrt
+
+// The SIMD kernels are compiled for their instruction sets regardless of the target of the build,
+// and chosen at run time according to the CPU
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BH_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace bh {
+
+/**
+ * Adds the force of the bodies in [from, n) to a partial sum, one interaction at a time.
+ */
+Eigen::Vector2d compute_net_force_scalar(const Body* bodies, std::size_t from, std::size_t n, const Body& body, double G,
+                                         Eigen::Vector2d net_force) {
+  const double gm = G * body.m_mass;
+  for (std::size_t i = from; i < n; i++) {
+    const Eigen::Vector2d r = bodies[i].m_position - body.m_position;
+    if (const double squared_distance = r.squaredNorm(); squared_distance > 0) {
+      net_force += gm * bodies[i].m_mass / (squared_distance * std::sqrt(squared_distance)) * r;
+    }
+  }
+  return net_force;
+}
+
+/**
+ * Computes the mutual forces between a body and the bodies in [from, n), one interaction at a time.
+ */
+Eigen::Vector2d compute_mutual_forces_scalar(double x, double y, double mass,
+                                             const double* xs, const double* ys, const double* masses, std::size_t from, std::size_t n,
+                                             double G, double* fx, double* fy, Eigen::Vector2d net_force) {
+  const double gm = G * mass;
+  for (std::size_t j = from; j < n; j++) {
+    const double rx = xs[j] - x;
+    const double ry = ys[j] - y;
+    if (const double squared_distance = rx * rx + ry * ry; squared_distance > 0) {
+      const double factor = gm * masses[j] / (squared_distance * std::sqrt(squared_distance));
+      net_force.x() += factor * rx;
+      net_force.y() += factor * ry;
+      fx[j] -= factor * rx;
+      fy[j] -= factor * ry;
+    }
+  }
+  return net_force;
+}
+
+#ifdef BH_X86_SIMD
+
+__attribute__((target("sse2")))
+Eigen::Vector2d compute_net_force_sse2(const Body* bodies, std::size_t n, const Body& body, double G) {
+  const __m128d x = _mm_set1_pd(body.m_position.x());
+  const __m128d y = _mm_set1_pd(body.m_position.y());
+  const __m128d gm = _mm_set1_pd(G * body.m_mass);
+  const __m128d zero = _mm_setzero_pd();
+  __m128d fx = zero;
+  __m128d fy = zero;
+
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    const Body* b = bodies + i;
+    const __m128d rx = _mm_sub_pd(_mm_set_pd(b[1].m_position.x(), b[0].m_position.x()), x);
+    const __m128d ry = _mm_sub_pd(_mm_set_pd(b[1].m_position.y(), b[0].m_position.y()), y);
+    const __m128d mass = _mm_set_pd(b[1].m_mass, b[0].m_mass);
+    const __m128d squared_distance = _mm_add_pd(_mm_mul_pd(rx, rx), _mm_mul_pd(ry, ry));
+    const __m128d inv_cube = _mm_div_pd(_mm_set1_pd(1), _mm_mul_pd(squared_distance, _mm_sqrt_pd(squared_distance)));
+    // Coinciding bodies give an infinite or NaN factor, which the mask zeroes
+    const __m128d factor = _mm_and_pd(_mm_mul_pd(_mm_mul_pd(gm, mass), inv_cube), _mm_cmpgt_pd(squared_distance, zero));
+    fx = _mm_add_pd(fx, _mm_mul_pd(factor, rx));
+    fy = _mm_add_pd(fy, _mm_mul_pd(factor, ry));
+  }
+
+  alignas(16) double sx[2];
+  alignas(16) double sy[2];
+  _mm_store_pd(sx, fx);
+  _mm_store_pd(sy, fy);
+  return compute_net_force_scalar(bodies, i, n, body, G, {sx[0] + sx[1], sy[0] + sy[1]});
+}
+
+__attribute__((target("avx2,fma")))
+Eigen::Vector2d compute_net_force_avx2(const Body* bodies, std::size_t n, const Body& body, double G) {
+  const __m256d x = _mm256_set1_pd(body.m_position.x());
+  const __m256d y = _mm256_set1_pd(body.m_position.y());
+  const __m256d gm = _mm256_set1_pd(G * body.m_mass);
+  const __m256d zero = _mm256_setzero_pd();
+  __m256d fx = zero;
+  __m256d fy = zero;
+
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const Body* b = bodies + i;
+    const __m256d rx = _mm256_sub_pd(_mm256_set_pd(b[3].m_position.x(), b[2].m_position.x(), b[1].m_position.x(), b[0].m_position.x()), x);
+    const __m256d ry = _mm256_sub_pd(_mm256_set_pd(b[3].m_position.y(), b[2].m_position.y(), b[1].m_position.y(), b[0].m_position.y()), y);
+    const __m256d mass = _mm256_set_pd(b[3].m_mass, b[2].m_mass, b[1].m_mass, b[0].m_mass);
+    const __m256d squared_distance = _mm256_fmadd_pd(rx, rx, _mm256_mul_pd(ry, ry));
+    const __m256d inv_cube = _mm256_div_pd(_mm256_set1_pd(1), _mm256_mul_pd(squared_distance, _mm256_sqrt_pd(squared_distance)));
+    const __m256d factor = _mm256_and_pd(_mm256_mul_pd(_mm256_mul_pd(gm, mass), inv_cube),
+                                         _mm256_cmp_pd(squared_distance, zero, _CMP_GT_OQ));
+    fx = _mm256_fmadd_pd(factor, rx, fx);
+    fy = _mm256_fmadd_pd(factor, ry, fy);
+  }
+
+  alignas(32) double sx[4];
+  alignas(32) double sy[4];
+  _mm256_store_pd(sx, fx);
+  _mm256_store_pd(sy, fy);
+  return compute_net_force_scalar(bodies, i, n, body, G, {(sx[0] + sx[1]) + (sx[2] + sx[3]), (sy[0] + sy[1]) + (sy[2] + sy[3])});
+}
+
+__attribute__((target("avx512f")))
+Eigen::Vector2d compute_net_force_avx512(const Body* bodies, std::size_t n, const Body& body, double G) {
+  const __m512d x = _mm512_set1_pd(body.m_position.x());
+  const __m512d y = _mm512_set1_pd(body.m_position.y());
+  const __m512d gm = _mm512_set1_pd(G * body.m_mass);
+  const __m512d half = _mm512_set1_pd(0.5);
+  const __m512d three_halves = _mm512_set1_pd(1.5);
+  const __m512d zero = _mm512_setzero_pd();
+  __m512d fx = zero;
+  __m512d fy = zero;
+
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const Body* b = bodies + i;
+    const __m512d rx = _mm512_sub_pd(_mm512_set_pd(b[7].m_position.x(), b[6].m_position.x(), b[5].m_position.x(), b[4].m_position.x(),
+                                                   b[3].m_position.x(), b[2].m_position.x(), b[1].m_position.x(), b[0].m_position.x()), x);
+    const __m512d ry = _mm512_sub_pd(_mm512_set_pd(b[7].m_position.y(), b[6].m_position.y(), b[5].m_position.y(), b[4].m_position.y(),
+                                                   b[3].m_position.y(), b[2].m_position.y(), b[1].m_position.y(), b[0].m_position.y()), y);
+    const __m512d mass = _mm512_set_pd(b[7].m_mass, b[6].m_mass, b[5].m_mass, b[4].m_mass,
+                                       b[3].m_mass, b[2].m_mass, b[1].m_mass, b[0].m_mass);
+    const __m512d squared_distance = _mm512_fmadd_pd(rx, rx, _mm512_mul_pd(ry, ry));
+    const __mmask8 apart = _mm512_cmp_pd_mask(squared_distance, zero, _CMP_GT_OQ);
+
+    // 14-bit reciprocal square root estimate, refined by two Newton–Raphson iterations to about full precision
+    __m512d inv_distance = _mm512_rsqrt14_pd(squared_distance);
+    const __m512d half_squared_distance = _mm512_mul_pd(half, squared_distance);
+    for (int iteration = 0; iteration < 2; iteration++) {
+      const __m512d error = _mm512_fnmadd_pd(half_squared_distance, _mm512_mul_pd(inv_distance, inv_distance), three_halves);
+      inv_distance = _mm512_mul_pd(inv_distance, error);
+    }
+    const __m512d inv_cube = _mm512_mul_pd(inv_distance, _mm512_mul_pd(inv_distance, inv_distance));
+    const __m512d factor = _mm512_maskz_mul_pd(apart, _mm512_mul_pd(gm, mass), inv_cube);
+    fx = _mm512_fmadd_pd(factor, rx, fx);
+    fy = _mm512_fmadd_pd(factor, ry, fy);
+  }
+
+  return compute_net_force_scalar(bodies, i, n, body, G, {_mm512_reduce_add_pd(fx), _mm512_reduce_add_pd(fy)});
+}
+
+__attribute__((target("sse2")))
+Eigen::Vector2d compute_mutual_forces_sse2(double x, double y, double mass,
+                                           const double* xs, const double* ys, const double* masses, std::size_t n,
+                                           double G, double* fx, double* fy) {
+  const __m128d x_v = _mm_set1_pd(x);
+  const __m128d y_v = _mm_set1_pd(y);
+  const __m128d gm = _mm_set1_pd(G * mass);
+  const __m128d zero = _mm_setzero_pd();
+  __m128d net_fx = zero;
+  __m128d net_fy = zero;
+
+  std::size_t j = 0;
+  for (; j + 2 <= n; j += 2) {
+    const __m128d rx = _mm_sub_pd(_mm_loadu_pd(xs + j), x_v);
+    const __m128d ry = _mm_sub_pd(_mm_loadu_pd(ys + j), y_v);
+    const __m128d squared_distance = _mm_add_pd(_mm_mul_pd(rx, rx), _mm_mul_pd(ry, ry));
+    const __m128d inv_cube = _mm_div_pd(_mm_set1_pd(1), _mm_mul_pd(squared_distance, _mm_sqrt_pd(squared_distance)));
+    const __m128d factor = _mm_and_pd(_mm_mul_pd(_mm_mul_pd(gm, _mm_loadu_pd(masses + j)), inv_cube),
+                                      _mm_cmpgt_pd(squared_distance, zero));
+    const __m128d force_x = _mm_mul_pd(factor, rx);
+    const __m128d force_y = _mm_mul_pd(factor, ry);
+    net_fx = _mm_add_pd(net_fx, force_x);
+    net_fy = _mm_add_pd(net_fy, force_y);
+    _mm_storeu_pd(fx + j, _mm_sub_pd(_mm_loadu_pd(fx + j), force_x));
+    _mm_storeu_pd(fy + j, _mm_sub_pd(_mm_loadu_pd(fy + j), force_y));
+  }
+
+  alignas(16) double sx[2];
+  alignas(16) double sy[2];
+  _mm_store_pd(sx, net_fx);
+  _mm_store_pd(sy, net_fy);
+  return compute_mutual_forces_scalar(x, y, mass, xs, ys, masses, j, n, G, fx, fy, {sx[0] + sx[1], sy[0] + sy[1]});
+}
+
+__attribute__((target("avx2,fma")))
+Eigen::Vector2d compute_mutual_forces_avx2(double x, double y, double mass,
+                                           const double* xs, const double* ys, const double* masses, std::size_t n,
+                                           double G, double* fx, double* fy) {
+  const __m256d x_v = _mm256_set1_pd(x);
+  const __m256d y_v = _mm256_set1_pd(y);
+  const __m256d gm = _mm256_set1_pd(G * mass);
+  const __m256d zero = _mm256_setzero_pd();
+  __m256d net_fx = zero;
+  __m256d net_fy = zero;
+
+  std::size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    const __m256d rx = _mm256_sub_pd(_mm256_loadu_pd(xs + j), x_v);
+    const __m256d ry = _mm256_sub_pd(_mm256_loadu_pd(ys + j), y_v);
+    const __m256d squared_distance = _mm256_fmadd_pd(rx, rx, _mm256_mul_pd(ry, ry));
+    const __m256d inv_cube = _mm256_div_pd(_mm256_set1_pd(1), _mm256_mul_pd(squared_distance, _mm256_sqrt_pd(squared_distance)));
+    const __m256d factor = _mm256_and_pd(_mm256_mul_pd(_mm256_mul_pd(gm, _mm256_loadu_pd(masses + j)), inv_cube),
+                                         _mm256_cmp_pd(squared_distance, zero, _CMP_GT_OQ));
+    net_fx = _mm256_fmadd_pd(factor, rx, net_fx);
+    net_fy = _mm256_fmadd_pd(factor, ry, net_fy);
+    _mm256_storeu_pd(fx + j, _mm256_fnmadd_pd(factor, rx, _mm256_loadu_pd(fx + j)));
+    _mm256_storeu_pd(fy + j, _mm256_fnmadd_pd(factor, ry, _mm256_loadu_pd(fy + j)));
+  }
+
+  alignas(32) double sx[4];
+  alignas(32) double sy[4];
+  _mm256_store_pd(sx, net_fx);
+  _mm256_store_pd(sy, net_fy);
+  return compute_mutual_forces_scalar(x, y, mass, xs, ys, masses, j, n, G, fx, fy,
+                                      {(sx[0] + sx[1]) + (sx[2] + sx[3]), (sy[0] + sy[1]) + (sy[2] + sy[3])});
+}
+
+__attribute__((target("avx512f")))
+Eigen::Vector2d compute_mutual_forces_avx512(double x, double y, double mass,
+                                             const double* xs, const double* ys, const double* masses, std::size_t n,
+                                             double G, double* fx, double* fy) {
+  const __m512d x_v = _mm512_set1_pd(x);
+  const __m512d y_v = _mm512_set1_pd(y);
+  const __m512d gm = _mm512_set1_pd(G * mass);
+  const __m512d half = _mm512_set1_pd(0.5);
+  const __m512d three_halves = _mm512_set1_pd(1.5);
+  const __m512d zero = _mm512_setzero_pd();
+  __m512d net_fx = zero;
+  __m512d net_fy = zero;
+
+  std::size_t j = 0;
+  for (; j + 8 <= n; j += 8) {
+    const __m512d rx = _mm512_sub_pd(_mm512_loadu_pd(xs + j), x_v);
+    const __m512d ry = _mm512_sub_pd(_mm512_loadu_pd(ys + j), y_v);
+    const __m512d squared_distance = _mm512_fmadd_pd(rx, rx, _mm512_mul_pd(ry, ry));
+    const __mmask8 apart = _mm512_cmp_pd_mask(squared_distance, zero, _CMP_GT_OQ);
+
+    __m512d inv_distance = _mm512_rsqrt14_pd(squared_distance);
+    const __m512d half_squared_distance = _mm512_mul_pd(half, squared_distance);
+    for (int iteration = 0; iteration < 2; iteration++) {
+      const __m512d error = _mm512_fnmadd_pd(half_squared_distance, _mm512_mul_pd(inv_distance, inv_distance), three_halves);
+      inv_distance = _mm512_mul_pd(inv_distance, error);
+    }
+    const __m512d inv_cube = _mm512_mul_pd(inv_distance, _mm512_mul_pd(inv_distance, inv_distance));
+    const __m512d factor = _mm512_maskz_mul_pd(apart, _mm512_mul_pd(gm, _mm512_loadu_pd(masses + j)), inv_cube);
+    net_fx = _mm512_fmadd_pd(factor, rx, net_fx);
+    net_fy = _mm512_fmadd_pd(factor, ry, net_fy);
+    _mm512_storeu_pd(fx + j, _mm512_fnmadd_pd(factor, rx, _mm512_loadu_pd(fx + j)));
+    _mm512_storeu_pd(fy + j, _mm512_fnmadd_pd(factor, ry, _mm512_loadu_pd(fy + j)));
+  }
+
+  return compute_mutual_forces_scalar(x, y, mass, xs, ys, masses, j, n, G, fx, fy,
+                                      {_mm512_reduce_add_pd(net_fx), _mm512_reduce_add_pd(net_fy)});
+}
+
+#endif
+
+bool is_simd_isa_supported(SimdIsa isa) {
+  switch (isa) {
+    case SimdIsa::SCALAR:
+      return true;
+#ifdef BH_X86_SIMD
+    case SimdIsa::SSE2:
+      return __builtin_cpu_supports("sse2");
+    case SimdIsa::AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SimdIsa::AVX512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+SimdIsa detect_simd_isa() {
+  static const SimdIsa isa = [] {
+    for (const auto candidate : {SimdIsa::AVX512, SimdIsa::AVX2, SimdIsa::SSE2}) {
+      if (is_simd_isa_supported(candidate)) {
+        return candidate;
+      }
+    }
+    return SimdIsa::SCALAR;
+  }();
+  return isa;
+}
+
+Eigen::Vector2d compute_net_force_kernel(const Body* bodies, std::size_t n, const Body& body, double G, SimdIsa isa) {
+  switch (isa) {
+#ifdef BH_X86_SIMD
+    case SimdIsa::SSE2:
+      return compute_net_force_sse2(bodies, n, body, G);
+    case SimdIsa::AVX2:
+      return compute_net_force_avx2(bodies, n, body, G);
+    case SimdIsa::AVX512:
+      return compute_net_force_avx512(bodies, n, body, G);
+#endif
+    default:
+      return compute_net_force_scalar(bodies, 0, n, body, G, {0, 0});
+  }
+}
+
+Eigen::Vector2d compute_net_force_kernel(const Body* bodies, std::size_t n, const Body& body, double G) {
+  return compute_net_force_kernel(bodies, n, body, G, detect_simd_isa());
+}
+
+Eigen::Vector2d compute_mutual_forces_kernel(double x, double y, double mass,
+                                             const double* xs, const double* ys, const double* masses, std::size_t n,
+                                             double G, double* fx, double* fy, SimdIsa isa) {
+  switch (isa) {
+#ifdef BH_X86_SIMD
+    case SimdIsa::SSE2:
+      return compute_mutual_forces_sse2(x, y, mass, xs, ys, masses, n, G, fx, fy);
+    case SimdIsa::AVX2:
+      return compute_mutual_forces_avx2(x, y, mass, xs, ys, masses, n, G, fx, fy);
+    case SimdIsa::AVX512:
+      return compute_mutual_forces_avx512(x, y, mass, xs, ys, masses, n, G, fx, fy);
+#endif
+    default:
+      return compute_mutual_forces_scalar(x, y, mass, xs, ys, masses, 0, n, G, fx, fy, {0, 0});
+  }
+}
+
+}  // namespace bh
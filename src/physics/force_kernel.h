@@ -0,0 +1,68 @@
+#ifndef BARNES_HUT_FORCE_KERNEL_H
+#define BARNES_HUT_FORCE_KERNEL_H
+
+#include <Eigen/Eigen>
+#include <cstddef>  // size_t
+
+#include "body.h"
+
+namespace bh {
+
+/**
+ * Instruction sets with which the force kernel can process several interactions at once.
+ */
+enum class SimdIsa {
+  // One interaction at a time
+  SCALAR,
+  // 2 interactions per instruction
+  SSE2,
+  // 4 interactions per instruction, with fused multiply-adds
+  AVX2,
+  // 8 interactions per instruction
+  AVX512
+};
+
+/**
+ * @return the widest instruction set supported both by the build and by the CPU running it, detected once
+ */
+SimdIsa detect_simd_isa();
+
+/**
+ * @return whether the force kernel can use an instruction set on the CPU running it
+ */
+bool is_simd_isa_supported(SimdIsa isa);
+
+/**
+ * Computes the net gravitational force that a range of bodies exert on a body,
+ * as the sum of G m1 m2 r / |r|^3 over the interactions, without trigonometric functions.
+ * @details Bodies coinciding with body do not exert any force on it, as in compute_gravitational_force.
+ * The interactions are summed in a different order depending on the instruction set,
+ * hence results may differ in the last bits.
+ * @param bodies first of the n bodies that exert a gravitational force on body
+ * @param n number of bodies
+ * @param body that is subject to the gravitational force of the bodies
+ * @param isa instruction set to use; must be supported (see is_simd_isa_supported)
+ * @return A force vector
+ */
+Eigen::Vector2d compute_net_force_kernel(const Body* bodies, std::size_t n, const Body& body, double G, SimdIsa isa);
+
+Eigen::Vector2d compute_net_force_kernel(const Body* bodies, std::size_t n, const Body& body, double G);
+
+/**
+ * Computes the gravitational forces between a body and a range of bodies stored as structure of arrays,
+ * evaluating each interaction once thanks to Newton's third law.
+ * @details The force that the range exerts on the body is returned, while the force that the body exerts
+ * on each body of the range is added to its entry of fx and fy.
+ * @param x,y,mass position and mass of the body
+ * @param xs,ys,masses positions and masses of the n bodies of the range
+ * @param fx,fy forces acting on the n bodies of the range, to which the forces of the body are added
+ * @param isa instruction set to use; must be supported (see is_simd_isa_supported)
+ * @return The force vector acting on the body
+ */
+Eigen::Vector2d compute_mutual_forces_kernel(double x, double y, double mass,
+                                             const double* xs, const double* ys, const double* masses, std::size_t n,
+                                             double G, double* fx, double* fy, SimdIsa isa);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_FORCE_KERNEL_H
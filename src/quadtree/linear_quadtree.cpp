@@ -0,0 +1,569 @@
+#include "linear_quadtree.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>  // all_of, partition_point, copy, fill, for_each, transform
+#include <cmath>      // sqrt
+#include <numeric>    // iota
+#include <stdexcept>  // invalid_argument
+#include <string>     // to_string
+#include <utility>    // move
+#include <variant>    // visit
+#ifdef WITH_TBB
+#include <execution>  // par, par_unseq
+#include <thread>     // hardware_concurrency
+#else
+#include <omp.h>  // omp_get_max_threads
+#endif
+
+#include "morton.h"
+#include "quadtree_arena.h"
+
+// https://en.cppreference.com/w/cpp/utility/variant/visit
+template <class... Ts>
+struct overloaded : Ts... {
+  using Ts::operator()...;
+};
+template <class... Ts>
+overloaded(Ts...) -> overloaded<Ts...>;
+
+namespace bh {
+
+LinearQuadtree::LinearQuadtree()
+    : m_box(Eigen::Vector2d{0, 0}, Eigen::Vector2d{0, 0}),
+      m_nodes{Node{{0, 0}, 0, 0, 1, 0, 0}} {}
+
+LinearQuadtree::LinearQuadtree(const Eigen::AlignedBox2d &bbox, std::vector<Node> nodes, std::vector<Body> bodies)
+    : m_box(bbox), m_nodes(std::move(nodes)), m_bodies(std::move(bodies)) {}
+
+const std::vector<LinearQuadtree::Node> &LinearQuadtree::nodes() const {
+  return m_nodes;
+}
+
+std::vector<LinearQuadtree::Node> &LinearQuadtree::nodes() {
+  return m_nodes;
+}
+
+const std::vector<Body> &LinearQuadtree::bodies() const {
+  return m_bodies;
+}
+
+std::vector<Body> &LinearQuadtree::bodies() {
+  return m_bodies;
+}
+
+const std::vector<LinearQuadtree::Quadrupole> &LinearQuadtree::quadrupoles() const {
+  return m_quadrupoles;
+}
+
+std::vector<LinearQuadtree::Quadrupole> &LinearQuadtree::quadrupoles() {
+  return m_quadrupoles;
+}
+
+const std::vector<LinearQuadtree::OpeningRadius> &LinearQuadtree::opening_radii() const {
+  return m_opening_radii;
+}
+
+std::vector<LinearQuadtree::OpeningRadius> &LinearQuadtree::opening_radii() {
+  return m_opening_radii;
+}
+
+void LinearQuadtree::clear(const Eigen::AlignedBox2d &bbox) {
+  m_box = bbox;
+  m_nodes.clear();
+  m_bodies.clear();
+  m_quadrupoles.clear();
+  m_opening_radii.clear();
+}
+
+const Eigen::AlignedBox2d &LinearQuadtree::bbox() const {
+  return m_box;
+}
+
+int LinearQuadtree::n_nodes() const {
+  return static_cast<int>(m_nodes.size());
+}
+
+bool LinearQuadtree::is_leaf(Index idx) const {
+  return m_nodes[idx].m_n_nodes == 1;
+}
+
+std::array<LinearQuadtree::Index, 4> LinearQuadtree::children(Index idx) const {
+  const Index nw = idx + 1;
+  const Index ne = nw + m_nodes[nw].m_n_nodes;
+  const Index se = ne + m_nodes[ne].m_n_nodes;
+  const Index sw = se + m_nodes[se].m_n_nodes;
+  return {nw, ne, se, sw};
+}
+
+constexpr std::array<Node::Subquadrant, 4> SUBQUADRANTS{Node::NW, Node::NE, Node::SE, Node::SW};
+// Below this number of bodies, the quadtree is built serially
+constexpr std::size_t MIN_PARALLEL_CONSTRUCTION_BODIES = 1 << 14;
+constexpr int PARALLEL_CONSTRUCTION_SUBTREES_PER_THREAD = 16;
+
+/**
+ * Emits the nodes of a quadtree in depth-first (pre-order) order, after sorting the bodies by their Morton keys.
+ * @details Once sorted, the bodies contained in any node form a contiguous range, and the ranges of its children
+ * are found by a binary search on the digit of the keys at the node's level: the bodies are never moved again.
+ * The aggregates of a fork are computed only once, from the ones of its children, as soon as these are emitted.
+ */
+class LinearQuadtreeBuilder {
+ public:
+  /**
+   * @param leaf_size maximum number of bodies in a leaf
+   * @param arena whose scratch memory the builder uses
+   */
+  LinearQuadtreeBuilder(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, int leaf_size, QuadtreeArena &arena)
+      : m_bodies(bodies), m_leaf_size(static_cast<std::size_t>(leaf_size)), m_arena(arena), m_keys(arena.m_keys), m_order(arena.m_order) {
+    compute_morton_keys(bodies, bbox, arena.m_keys);
+    arena.m_order.resize(bodies.size());
+    std::iota(arena.m_order.begin(), arena.m_order.end(), 0);
+    radix_sort(arena.m_keys, arena.m_order, arena.m_radix_sort_buffers);
+  }
+
+  /**
+   * Emits the subtree containing the bodies m_order[from, to), whose root has the given bounding box.
+   * @param nodes vector in which to append the nodes of the subtree
+   * @param leaf_bodies vector in which to append the bodies contained in the leaves of the subtree
+   * @param level depth of the subtree's root, relative to the bounding box that the keys were computed for
+   */
+  void build(std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &leaf_bodies,
+             std::size_t from, std::size_t to, const Eigen::AlignedBox2d &box, int level) {
+    const bool is_leaf = to - from <= m_leaf_size || coincide(from, to);
+    if (!is_leaf && level == MORTON_KEY_DEPTH) {
+      // The keys are exhausted, but the bodies are still to be separated: build this node from new keys, relative to it
+      std::vector<Body> bodies(to - from);
+      std::transform(m_order.begin() + from, m_order.begin() + to, bodies.begin(), [&](std::uint32_t i) {
+        return m_bodies[i];
+      });
+      QuadtreeArena arena;
+      LinearQuadtreeBuilder(bodies, box, static_cast<int>(m_leaf_size), arena).build(nodes, leaf_bodies, 0, bodies.size(), box, 0);
+      return;
+    }
+
+    const auto idx = static_cast<LinearQuadtree::Index>(nodes.size());
+    nodes.push_back({{0, 0}, 0, box.sizes().x(), 1, static_cast<LinearQuadtree::Index>(leaf_bodies.size()), 0});
+
+    if (from == to) {
+      return;  // empty leaf
+    }
+
+    if (is_leaf && to - from > 1 && to - from <= m_leaf_size) {
+      // A bucket: its bodies are stored as they are, one after the other
+      Eigen::Vector2d center_of_mass{0, 0};
+      double total_mass = 0;
+      for (std::size_t i = from; i < to; i++) {
+        const Body &body = m_bodies[m_order[i]];
+        leaf_bodies.push_back(body);
+        center_of_mass += body.m_position * body.m_mass;
+        total_mass += body.m_mass;
+      }
+      nodes[idx].m_center_of_mass = center_of_mass / total_mass;
+      nodes[idx].m_total_mass = total_mass;
+      nodes[idx].m_n_bodies = static_cast<LinearQuadtree::Index>(to - from);
+      return;
+    }
+
+    if (is_leaf) {
+      // If the bodies coincide (or there is just one), sum their masses.
+      Body body = m_bodies[m_order[from]];
+      for (std::size_t i = from + 1; i < to; i++) {
+        body.m_mass += m_bodies[m_order[i]].m_mass;
+      }
+      leaf_bodies.push_back(body);
+      nodes[idx].m_center_of_mass = body.m_position;
+      nodes[idx].m_total_mass = body.m_mass;
+      nodes[idx].m_n_bodies = 1;
+      return;
+    }
+
+    const auto bounds = partition(from, to, level);
+    for (int sq = 0; sq < 4; sq++) {
+      build(nodes, leaf_bodies, bounds[sq], bounds[sq + 1], Node::get_subquadrant_bbox(box, SUBQUADRANTS[sq]), level + 1);
+    }
+
+    nodes[idx].m_n_nodes = static_cast<LinearQuadtree::Index>(nodes.size()) - idx;
+    aggregate(nodes, idx);
+  }
+
+  /**
+   * Emits the whole quadtree, building in parallel the subtrees rooted at a given depth.
+   * @details The nodes above that depth are few, and are emitted serially; since the links between the nodes are
+   * relative, each subtree is then copied in place, only shifting the indices of the bodies contained in its leaves.
+   * The result is the same as the one of build.
+   * @param parallel_depth depth of the roots of the subtrees built in parallel; 0 builds the quadtree serially
+   */
+  void build_parallel(std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &leaf_bodies,
+                      const Eigen::AlignedBox2d &bbox, int parallel_depth) {
+    auto &subtrees = m_arena.m_subtrees;
+    m_arena.m_n_subtrees = 0;
+    collect_subtrees(0, m_bodies.size(), bbox, 0, parallel_depth);
+    const auto n_subtrees = m_arena.m_n_subtrees;
+
+#ifdef WITH_TBB
+    // Not par_unseq: building a subtree may allocate memory
+    std::for_each(std::execution::par,
+                  subtrees.begin(), subtrees.begin() + n_subtrees,
+                  [&](QuadtreeArena::Subtree &subtree) {
+                    build(subtree.m_nodes, subtree.m_leaf_bodies, subtree.m_from, subtree.m_to, subtree.m_box, subtree.m_level);
+                  });
+#else
+#pragma omp parallel for default(none) shared(subtrees, n_subtrees) schedule(dynamic)
+    for (std::size_t i = 0; i < n_subtrees; i++) {
+      auto &subtree = subtrees[i];
+      build(subtree.m_nodes, subtree.m_leaf_bodies, subtree.m_from, subtree.m_to, subtree.m_box, subtree.m_level);
+    }
+#endif
+
+    // Emit the forks above the subtrees, and reserve room for the subtrees
+    auto &forks = m_arena.m_forks;
+    forks.clear();
+    std::size_t next_subtree = 0;
+    std::size_t n_leaf_bodies = 0;
+    place_subtrees(nodes, n_leaf_bodies, next_subtree, 0, m_bodies.size(), bbox, 0, parallel_depth);
+    leaf_bodies.resize(n_leaf_bodies);
+
+#ifdef WITH_TBB
+    std::for_each(std::execution::par_unseq,
+                  subtrees.begin(), subtrees.begin() + n_subtrees,
+                  [&](const QuadtreeArena::Subtree &subtree) {
+                    copy_subtree(subtree, nodes, leaf_bodies);
+                  });
+#else
+#pragma omp parallel for default(none) shared(subtrees, n_subtrees, nodes, leaf_bodies)
+    for (std::size_t i = 0; i < n_subtrees; i++) {
+      copy_subtree(subtrees[i], nodes, leaf_bodies);
+    }
+#endif
+
+    // Forks were emitted in pre-order: visiting them backwards, children are aggregated before their parents
+    std::for_each(forks.rbegin(), forks.rend(), [&](LinearQuadtree::Index idx) {
+      aggregate(nodes, idx);
+    });
+  }
+
+ private:
+  /**
+   * Whether the node containing the bodies m_order[from, to) is built as a whole by build, when building in parallel:
+   * either it is deep enough, or it may be a leaf, or its children cannot be found from the keys.
+   */
+  [[nodiscard]] bool is_subtree(std::size_t from, std::size_t to, int level, int parallel_depth) const {
+    return level == parallel_depth || to - from <= m_leaf_size || m_keys[from] == m_keys[to - 1] || level == MORTON_KEY_DEPTH;
+  }
+
+  void collect_subtrees(std::size_t from, std::size_t to, const Eigen::AlignedBox2d &box, int level, int parallel_depth) {
+    if (is_subtree(from, to, level, parallel_depth)) {
+      auto &subtrees = m_arena.m_subtrees;
+      if (m_arena.m_n_subtrees == subtrees.size()) {
+        subtrees.emplace_back();
+      }
+      auto &subtree = subtrees[m_arena.m_n_subtrees++];
+      subtree.m_from = from;
+      subtree.m_to = to;
+      subtree.m_box = box;
+      subtree.m_level = level;
+      subtree.m_nodes.clear();
+      subtree.m_leaf_bodies.clear();
+      return;
+    }
+
+    const auto bounds = partition(from, to, level);
+    for (int sq = 0; sq < 4; sq++) {
+      collect_subtrees(bounds[sq], bounds[sq + 1], Node::get_subquadrant_bbox(box, SUBQUADRANTS[sq]), level + 1, parallel_depth);
+    }
+  }
+
+  /**
+   * Visits the nodes in the same order as collect_subtrees, emitting the forks and computing where each subtree goes.
+   */
+  void place_subtrees(std::vector<LinearQuadtree::Node> &nodes, std::size_t &n_leaf_bodies, std::size_t &next_subtree,
+                      std::size_t from, std::size_t to, const Eigen::AlignedBox2d &box, int level, int parallel_depth) {
+    if (is_subtree(from, to, level, parallel_depth)) {
+      auto &subtree = m_arena.m_subtrees[next_subtree++];
+      subtree.m_nodes_offset = static_cast<LinearQuadtree::Index>(nodes.size());
+      subtree.m_leaf_bodies_offset = static_cast<LinearQuadtree::Index>(n_leaf_bodies);
+      nodes.resize(nodes.size() + subtree.m_nodes.size());
+      n_leaf_bodies += subtree.m_leaf_bodies.size();
+      return;
+    }
+
+    const auto idx = static_cast<LinearQuadtree::Index>(nodes.size());
+    nodes.push_back({{0, 0}, 0, box.sizes().x(), 1, static_cast<LinearQuadtree::Index>(n_leaf_bodies), 0});
+    m_arena.m_forks.push_back(idx);
+
+    const auto bounds = partition(from, to, level);
+    for (int sq = 0; sq < 4; sq++) {
+      place_subtrees(nodes, n_leaf_bodies, next_subtree,
+                     bounds[sq], bounds[sq + 1], Node::get_subquadrant_bbox(box, SUBQUADRANTS[sq]), level + 1, parallel_depth);
+    }
+
+    nodes[idx].m_n_nodes = static_cast<LinearQuadtree::Index>(nodes.size()) - idx;
+  }
+
+  static void copy_subtree(const QuadtreeArena::Subtree &subtree, std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &leaf_bodies) {
+    std::transform(subtree.m_nodes.begin(), subtree.m_nodes.end(), nodes.begin() + subtree.m_nodes_offset,
+                   [&](LinearQuadtree::Node node) {
+                     node.m_first_body += subtree.m_leaf_bodies_offset;
+                     return node;
+                   });
+    std::copy(subtree.m_leaf_bodies.begin(), subtree.m_leaf_bodies.end(), leaf_bodies.begin() + subtree.m_leaf_bodies_offset);
+  }
+
+  /**
+   * Splits the bodies m_order[from, to) among the subquadrants of a node.
+   * @return the ranges of the NW, NE, SE and SW subquadrants, in this order: [bounds[sq], bounds[sq + 1])
+   */
+  [[nodiscard]] std::array<std::size_t, 5> partition(std::size_t from, std::size_t to, int level) const {
+    // The bodies are sorted by key, hence grouped by subquadrant in NW, NE, SE, SW order.
+    std::array<std::size_t, 5> bounds{from, 0, 0, 0, to};
+    for (int sq = 1; sq < 4; sq++) {
+      bounds[sq] = std::partition_point(m_keys.begin() + bounds[sq - 1], m_keys.begin() + to, [&](MortonKey key) {
+                     return get_morton_subquadrant(key, level) < sq;
+                   }) -
+                   m_keys.begin();
+    }
+    return bounds;
+  }
+
+  /**
+   * Computes the aggregates of a fork from the ones of its children, which must have already been emitted
+   * (as well as the number of nodes in the fork's subtree).
+   */
+  static void aggregate(std::vector<LinearQuadtree::Node> &nodes, LinearQuadtree::Index idx) {
+    const auto nw_idx = idx + 1;
+    const auto ne_idx = nw_idx + nodes[nw_idx].m_n_nodes;
+    const auto se_idx = ne_idx + nodes[ne_idx].m_n_nodes;
+    const auto sw_idx = se_idx + nodes[se_idx].m_n_nodes;
+
+    // Same operations, in the same order, as compute_aggregate_body.
+    const auto &nw = nodes[nw_idx];
+    const auto &ne = nodes[ne_idx];
+    const auto &se = nodes[se_idx];
+    const auto &sw = nodes[sw_idx];
+    Eigen::Vector2d center_of_mass = nw.m_center_of_mass * nw.m_total_mass +
+                                     ne.m_center_of_mass * ne.m_total_mass +
+                                     se.m_center_of_mass * se.m_total_mass +
+                                     sw.m_center_of_mass * sw.m_total_mass;
+    double total_mass = nw.m_total_mass + ne.m_total_mass + se.m_total_mass + sw.m_total_mass;
+
+    nodes[idx].m_center_of_mass = center_of_mass / total_mass;
+    nodes[idx].m_total_mass = total_mass;
+  }
+
+  /**
+   * Whether the bodies m_order[from, to) all coincide.
+   */
+  [[nodiscard]] bool coincide(std::size_t from, std::size_t to) const {
+    // Bodies with different keys lie in different cells, so only bodies with the same key may coincide
+    const Body &first = m_bodies[m_order[from]];
+    return m_keys[from] == m_keys[to - 1] &&
+           std::all_of(m_order.begin() + from + 1, m_order.begin() + to, [&](std::uint32_t i) {
+             return m_bodies[i].m_position == first.m_position;
+           });
+  }
+
+  const std::vector<Body> &m_bodies;
+  const std::size_t m_leaf_size;
+  QuadtreeArena &m_arena;
+  // keys of the bodies, sorted
+  const std::vector<MortonKey> &m_keys;
+  // permutation of the bodies that sorts them by key
+  const std::vector<std::uint32_t> &m_order;
+};
+
+void flatten_impl(const Node &node, std::vector<LinearQuadtree::Node> &nodes, std::vector<Body> &bodies) {
+  const auto idx = nodes.size();
+  nodes.push_back({node.center_of_mass(), node.total_mass(), node.bbox().sizes().x(), 1, static_cast<LinearQuadtree::Index>(bodies.size()), 0});
+
+  auto visit_fork = [&](const Node::Fork &fork) {
+    flatten_impl(*fork.m_nw, nodes, bodies);
+    flatten_impl(*fork.m_ne, nodes, bodies);
+    flatten_impl(*fork.m_se, nodes, bodies);
+    flatten_impl(*fork.m_sw, nodes, bodies);
+    nodes[idx].m_n_nodes = static_cast<LinearQuadtree::Index>(nodes.size() - idx);
+  };
+  auto visit_leaf = [&](const Node::Leaf &leaf) {
+    if (leaf.m_body.has_value()) {
+      bodies.push_back(*leaf.m_body);
+      nodes[idx].m_n_bodies = 1;
+    }
+  };
+
+  std::visit(overloaded{visit_fork, visit_leaf}, node.data());
+}
+
+void construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, int parallel_depth, int leaf_size,
+                               LinearQuadtree &quadtree, QuadtreeArena &arena) {
+  if (parallel_depth < 0 || parallel_depth > MORTON_KEY_DEPTH) {
+    throw std::invalid_argument("The depth of the subtrees built in parallel must be between 0 and " + std::to_string(MORTON_KEY_DEPTH));
+  }
+  if (leaf_size < 1) {
+    throw std::invalid_argument("The leaf size must be at least 1 (leaf size: " + std::to_string(leaf_size) + ")");
+  }
+  if (bbox.sizes().x() != bbox.sizes().y()) {
+#ifdef NO_SQUARE_BOUNDING_BOX_CHECK
+    spdlog::warn("Quadtree's bbox is not exactly squared due to a precision error. Size: ({} x {})", bbox.sizes().x(), bbox.sizes().y());
+#else
+    throw std::invalid_argument("Cannot create a non-square quadtree (length: " + std::to_string(bbox.sizes().x()) + ", height: " + std::to_string(bbox.sizes().y()) + ")");
+#endif
+  }
+  for (const auto &body : bodies) {
+    if (Node::get_subquadrant(bbox, body.m_position) == Node::OUTSIDE) {
+      throw std::invalid_argument("Attempted to insert a new body outside of the quadtree's bounding box");
+    }
+  }
+
+  quadtree.clear(bbox);
+  LinearQuadtreeBuilder builder(bodies, bbox, leaf_size, arena);
+  if (parallel_depth == 0) {
+    builder.build(quadtree.nodes(), quadtree.bodies(), 0, bodies.size(), bbox, 0);
+  } else {
+    builder.build_parallel(quadtree.nodes(), quadtree.bodies(), bbox, parallel_depth);
+  }
+}
+
+int compute_parallel_depth(std::size_t n_bodies) {
+  if (n_bodies < MIN_PARALLEL_CONSTRUCTION_BODIES) {
+    return 0;
+  }
+
+#ifdef WITH_TBB
+  const auto n_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+#else
+  const auto n_threads = omp_get_max_threads();
+#endif
+  // Enough subtrees to balance the load among the threads, even if the bodies are not uniformly distributed
+  int parallel_depth = 0;
+  for (int n_subtrees = 1; n_subtrees < PARALLEL_CONSTRUCTION_SUBTREES_PER_THREAD * n_threads; n_subtrees *= 4) {
+    parallel_depth++;
+  }
+  return parallel_depth;
+}
+
+LinearQuadtree construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, int parallel_depth, int leaf_size) {
+  LinearQuadtree quadtree;
+  QuadtreeArena arena;
+  construct_linear_quadtree(bodies, bbox, parallel_depth, leaf_size, quadtree, arena);
+  return quadtree;
+}
+
+LinearQuadtree construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox) {
+  return construct_linear_quadtree(bodies, bbox, compute_parallel_depth(bodies.size()));
+}
+
+std::shared_ptr<LinearQuadtree> construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, QuadtreeArena &arena, int leaf_size) {
+  auto quadtree = arena.allocate(bbox);
+  construct_linear_quadtree(bodies, bbox, compute_parallel_depth(bodies.size()), leaf_size, *quadtree, arena);
+  return quadtree;
+}
+
+/**
+ * Adds to a quadrupole moment the one of a mass at some displacement from the center of mass.
+ */
+void add_quadrupole(LinearQuadtree::Quadrupole &quadrupole, double mass, const Eigen::Vector2d &displacement) {
+  const double squared_norm = displacement.squaredNorm();
+  quadrupole.m_xx += mass * (3 * displacement.x() * displacement.x() - squared_norm);
+  quadrupole.m_xy += mass * (3 * displacement.x() * displacement.y());
+  quadrupole.m_yy += mass * (3 * displacement.y() * displacement.y() - squared_norm);
+}
+
+void compute_quadrupoles(LinearQuadtree &quadtree) {
+  const auto &nodes = quadtree.nodes();
+  auto &quadrupoles = quadtree.quadrupoles();
+  // Resized and filled rather than assigned, so that its capacity grows geometrically with the number of nodes
+  quadrupoles.resize(nodes.size());
+  std::fill(quadrupoles.begin(), quadrupoles.end(), LinearQuadtree::Quadrupole{0, 0, 0});
+
+  // Visiting the nodes backwards, children are visited before their parents
+  for (auto idx = static_cast<LinearQuadtree::Index>(nodes.size()); idx-- > 0;) {
+    const auto &node = nodes[idx];
+    auto &quadrupole = quadrupoles[idx];
+    if (quadtree.is_leaf(idx)) {
+      for (auto i = node.m_first_body; i < node.m_first_body + node.m_n_bodies; i++) {
+        const auto &body = quadtree.bodies()[i];
+        add_quadrupole(quadrupole, body.m_mass, body.m_position - node.m_center_of_mass);
+      }
+    } else {
+      for (const auto child : quadtree.children(idx)) {
+        quadrupole.m_xx += quadrupoles[child].m_xx;
+        quadrupole.m_xy += quadrupoles[child].m_xy;
+        quadrupole.m_yy += quadrupoles[child].m_yy;
+        add_quadrupole(quadrupole, nodes[child].m_total_mass, nodes[child].m_center_of_mass - node.m_center_of_mass);
+      }
+    }
+  }
+}
+
+void compute_opening_radii(LinearQuadtree &quadtree, OpeningCriterion criterion, double theta, double G, double tolerance) {
+  if (theta < 0) {
+    throw std::invalid_argument("Theta must not be negative (theta: " + std::to_string(theta) + ")");
+  }
+  if (tolerance <= 0) {
+    throw std::invalid_argument("The force tolerance must be positive (tolerance: " + std::to_string(tolerance) + ")");
+  }
+
+  const auto &nodes = quadtree.nodes();
+  auto &radii = quadtree.opening_radii();
+  radii.resize(nodes.size());
+  if (criterion == OpeningCriterion::GEOMETRIC) {
+    for (std::size_t idx = 0; idx < nodes.size(); idx++) {
+      const double radius = nodes[idx].m_length / theta;
+      radii[idx] = {radius * radius, 0};
+    }
+    return;
+  }
+
+  std::vector<Eigen::AlignedBox2d> cells;
+  compute_cells(quadtree, cells);
+  for (std::size_t idx = 0; idx < nodes.size(); idx++) {
+    const auto &node = nodes[idx];
+    const Eigen::Vector2d farthest_corner = (node.m_center_of_mass - cells[idx].min()).cwiseAbs().cwiseMax(
+        (cells[idx].max() - node.m_center_of_mass).cwiseAbs());
+    const double squared_bmax = farthest_corner.squaredNorm();
+    if (criterion == OpeningCriterion::BMAX) {
+      radii[idx] = {squared_bmax / (theta * theta), 0};
+    } else {
+      // G M l^2 / d^4 <= tolerance |a|  <=>  d^2 >= l sqrt(G M / tolerance) / sqrt(|a|)
+      radii[idx] = {node.m_length * std::sqrt(G * node.m_total_mass / tolerance), squared_bmax};
+    }
+  }
+}
+
+void compute_cells(const LinearQuadtree &quadtree, std::vector<Eigen::AlignedBox2d> &cells) {
+  cells.resize(quadtree.n_nodes());
+  cells[LinearQuadtree::ROOT] = quadtree.bbox();
+
+  // In depth-first order, parents come before their children
+  for (LinearQuadtree::Index idx = 0; idx < static_cast<LinearQuadtree::Index>(quadtree.n_nodes()); idx++) {
+    if (!quadtree.is_leaf(idx)) {
+      const auto [nw, ne, se, sw] = quadtree.children(idx);
+      cells[nw] = Node::get_subquadrant_bbox(cells[idx], Node::NW);
+      cells[ne] = Node::get_subquadrant_bbox(cells[idx], Node::NE);
+      cells[se] = Node::get_subquadrant_bbox(cells[idx], Node::SE);
+      cells[sw] = Node::get_subquadrant_bbox(cells[idx], Node::SW);
+    }
+  }
+}
+
+LinearQuadtree::Index find_leaf(const LinearQuadtree &quadtree, const std::vector<Eigen::AlignedBox2d> &cells,
+                                const Eigen::Vector2d &position) {
+  if (Node::get_subquadrant(cells[LinearQuadtree::ROOT], position) == Node::OUTSIDE) {
+    throw std::invalid_argument("Attempted to find the leaf of a position outside of the quadtree's bounding box");
+  }
+
+  LinearQuadtree::Index idx = LinearQuadtree::ROOT;
+  while (!quadtree.is_leaf(idx)) {
+    idx = quadtree.children(idx)[Node::get_subquadrant(cells[idx], position)];
+  }
+  return idx;
+}
+
+LinearQuadtree flatten_quadtree(const Node &node) {
+  std::vector<LinearQuadtree::Node> nodes;
+  nodes.reserve(node.n_nodes());
+  std::vector<Body> bodies;
+  flatten_impl(node, nodes, bodies);
+  return {node.bbox(), std::move(nodes), std::move(bodies)};
+}
+
+}  // namespace bh
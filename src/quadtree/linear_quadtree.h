@@ -0,0 +1,256 @@
+#ifndef BARNES_HUT_LINEAR_QUADTREE_H
+#define BARNES_HUT_LINEAR_QUADTREE_H
+
+#include <Eigen/Eigen>
+#include <Eigen/Geometry>
+#include <array>
+#include <cstdint>  // uint32_t
+#include <memory>   // shared_ptr
+#include <nlohmann/json.hpp>
+#include <vector>
+
+#include "body.h"
+#include "node.h"
+
+namespace bh {
+
+class QuadtreeArena;
+
+/**
+ * Criterion deciding whether a node of a quadtree is close enough to a body to be opened, rather than approximated.
+ */
+enum class OpeningCriterion {
+  // Opened if its length is at least theta times its distance from the body (Barnes–Hut)
+  GEOMETRIC,
+  // Opened if the distance from its center of mass to the farthest corner of its cell (bmax) is at least theta times
+  // its distance from the body (Salmon–Warren): unlike the length, bmax grows as the center of mass nears an edge.
+  // Since bmax is between l / sqrt(2) and l sqrt(2), it matches the geometric criterion at about theta / sqrt(2)
+  BMAX,
+  // Opened if the estimated error of its force, G M l^2 / d^4, exceeds a fraction of the acceleration of the body
+  // at the previous step, or if the body is within bmax from its center of mass
+  RELATIVE_FORCE
+};
+
+// Fraction of the acceleration of a body allowed as the error of the force of a node (relative force criterion)
+constexpr double DEFAULT_FORCE_TOLERANCE = 0.0025;
+
+/**
+ * A quadtree whose nodes are stored contiguously in a single array, in depth-first (pre-order) order.
+ * @details Children are not addressed by pointers, but by 32-bit indices:
+ * the NW child of a fork immediately follows the fork,
+ * and each of the following children (NE, SE, SW) starts where the subtree of its previous sibling ends.
+ * The geometry of the nodes is implicit: only the bounding box of the root is stored,
+ * and the bounding box of any other node is obtained by halving the one of its parent (see Node::get_subquadrant_bbox).
+ * The bodies contained in the leaves are stored contiguously in a separate array.
+ */
+class LinearQuadtree {
+ public:
+  using Index = std::uint32_t;
+
+  /**
+   * A node of the quadtree. Fields are laid out so that those read at every visit are packed together.
+   */
+  struct Node {
+    Eigen::Vector2d m_center_of_mass;
+    double m_total_mass;
+    // Length of the side of the node's bounding box
+    double m_length;
+    // Number of nodes in the subtree rooted in this node, including itself: 1 for leaves.
+    // The index of the node following the subtree (i.e., the next sibling of this node, or of one of its ancestors)
+    // is the index of this node plus m_n_nodes.
+    Index m_n_nodes;
+    // For leaves, the bodies they contain are those in the range [m_first_body, m_first_body + m_n_bodies)
+    // of the quadtree's bodies (a leaf holding more than one body is a bucket); for forks, m_n_bodies is 0.
+    Index m_first_body;
+    Index m_n_bodies;
+  };
+
+  /**
+   * Quadrupole moment of the bodies in a node, relative to their center of mass: the sum of m (3 d d^T - |d|^2 I),
+   * where d is the displacement of a body from the center of mass.
+   * @details Being symmetric, only three of its components are stored.
+   */
+  struct Quadrupole {
+    double m_xx;
+    double m_xy;
+    double m_yy;
+  };
+
+  /**
+   * Distances from the center of mass of a node within which the node is opened (see compute_opening_radii).
+   * @details The node is opened for a body at distance d if d^2 <= s^2 m_squared_radius or d^2 <= m_squared_min_distance,
+   * where s is the opening scale of the body: 1 for the geometric criteria, |a|^(-1/4) for the relative force one.
+   */
+  struct OpeningRadius {
+    double m_squared_radius;
+    double m_squared_min_distance;
+  };
+
+  static constexpr Index ROOT = 0;
+
+  // Maximum number of bodies in a leaf such that the quadtree has the same structure as a pointer-based one
+  static constexpr int DEFAULT_LEAF_SIZE = 1;
+
+  /**
+   * Creates a quadtree made of a single empty leaf with a dimensionless bounding box centered at the origin.
+   */
+  LinearQuadtree();
+
+  /**
+   * Creates a quadtree from its nodes and bodies.
+   * @param bbox square bounding box of the root node
+   * @param nodes in depth-first (pre-order) order
+   * @param bodies contained in the leaves
+   */
+  LinearQuadtree(const Eigen::AlignedBox2d &bbox, std::vector<Node> nodes, std::vector<Body> bodies);
+
+  [[nodiscard]] const std::vector<Node> &nodes() const;
+
+  /**
+   * Gives access to the storage of the nodes, so that the quadtree can be filled in place (e.g., after clear).
+   */
+  std::vector<Node> &nodes();
+
+  [[nodiscard]] const std::vector<Body> &bodies() const;
+
+  std::vector<Body> &bodies();
+
+  /**
+   * @return the quadrupole moment of each node, if computed (see compute_quadrupoles); otherwise, an empty vector
+   */
+  [[nodiscard]] const std::vector<Quadrupole> &quadrupoles() const;
+
+  std::vector<Quadrupole> &quadrupoles();
+
+  /**
+   * @return the opening radius of each node, if computed (see compute_opening_radii); otherwise, an empty vector
+   */
+  [[nodiscard]] const std::vector<OpeningRadius> &opening_radii() const;
+
+  std::vector<OpeningRadius> &opening_radii();
+
+  /**
+   * Removes all the nodes, bodies, moments and opening radii of the quadtree, keeping the capacity of their storage.
+   * @details The quadtree is left without nodes, hence invalid, until it is filled again.
+   * @param bbox square bounding box of the new root node
+   */
+  void clear(const Eigen::AlignedBox2d &bbox);
+
+  /**
+   * The axis-aligned square bounding box of the root node.
+   */
+  [[nodiscard]] const Eigen::AlignedBox2d &bbox() const;
+
+  /**
+   * @return number of nodes contained in the quadtree
+   */
+  [[nodiscard]] int n_nodes() const;
+
+  [[nodiscard]] bool is_leaf(Index idx) const;
+
+  /**
+   * Computes the indices of the children of a fork.
+   * @param idx index of a fork
+   * @return the indices of the NW, NE, SE and SW children, in this order
+   */
+  [[nodiscard]] std::array<Index, 4> children(Index idx) const;
+
+ private:
+  Eigen::AlignedBox2d m_box;
+  std::vector<Node> m_nodes;
+  std::vector<Body> m_bodies;
+  std::vector<Quadrupole> m_quadrupoles;
+  std::vector<OpeningRadius> m_opening_radii;
+};
+
+/**
+ * Constructs a linear quadtree containing some bodies.
+ * @details The resulting quadtree has the same structure as the one obtained by inserting the bodies,
+ * in order, in a Node with the same bounding box: in particular, bodies that coincide are merged in a single body.
+ * The bodies are sorted by their Morton keys, so that the ones stored in the leaves are in depth-first order too.
+ * Unless there are few bodies, the subtrees below the first levels are built in parallel.
+ * @param bodies to insert in the quadtree
+ * @param bbox square bounding box of the root node; must contain all the bodies
+ * @throw invalid_argument if a body is located outside of the bounding box
+ */
+LinearQuadtree construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox);
+
+/**
+ * Constructs a linear quadtree containing some bodies, building in parallel the subtrees rooted at a given depth.
+ * @details The resulting quadtree is the same, whatever the depth.
+ * A node is split only if it contains more than leaf_size bodies, not all coinciding; otherwise it is a leaf
+ * holding all of its bodies (or, if there are more than leaf_size, a single body with the sum of their masses).
+ * @param bodies to insert in the quadtree
+ * @param bbox square bounding box of the root node; must contain all the bodies
+ * @param parallel_depth depth of the roots of the subtrees built in parallel, up to MORTON_KEY_DEPTH;
+ * 0 builds the quadtree serially
+ * @param leaf_size maximum number of bodies in a leaf; must be at least 1
+ * @throw invalid_argument if a body is located outside of the bounding box, or if the depth or the leaf size are out of range
+ */
+LinearQuadtree construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, int parallel_depth,
+                                         int leaf_size = LinearQuadtree::DEFAULT_LEAF_SIZE);
+
+/**
+ * Constructs a linear quadtree containing some bodies, allocating it from an arena.
+ * @param bodies to insert in the quadtree
+ * @param bbox square bounding box of the root node; must contain all the bodies
+ * @param arena from which the quadtree and the scratch memory needed to build it are allocated
+ * @param leaf_size maximum number of bodies in a leaf; must be at least 1
+ * @throw invalid_argument if a body is located outside of the bounding box, or if the leaf size is out of range
+ */
+std::shared_ptr<LinearQuadtree> construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, QuadtreeArena &arena,
+                                                          int leaf_size = LinearQuadtree::DEFAULT_LEAF_SIZE);
+
+/**
+ * Fills a linear quadtree in place, reusing the storage of the quadtree and the scratch memory of an arena.
+ * @see construct_linear_quadtree(const std::vector<Body> &, const Eigen::AlignedBox2d &, int, int)
+ */
+void construct_linear_quadtree(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, int parallel_depth, int leaf_size,
+                               LinearQuadtree &quadtree, QuadtreeArena &arena);
+
+/**
+ * Computes the quadrupole moments of the nodes of a quadtree, bottom-up, from the bodies in the leaves.
+ * @details The moment of a fork is obtained by shifting the moments of its children to its center of mass
+ * (parallel axis theorem), so that each body is visited only once.
+ * @param quadtree whose nodes and bodies are already in place
+ */
+void compute_quadrupoles(LinearQuadtree &quadtree);
+
+/**
+ * Computes the opening radius of each node of a quadtree, i.e. what its opening criterion needs of it.
+ * @details Once computed, the walks of the quadtree use them instead of the length of the nodes (see OpeningRadius).
+ * @param quadtree whose nodes and bodies are already in place
+ * @param theta opening parameter of the geometric criteria
+ * @param G gravitational constant, used by the relative force criterion
+ * @param tolerance fraction of the acceleration of a body allowed as the error of a node (relative force criterion)
+ * @throw invalid_argument if theta is negative, or the tolerance is not positive
+ */
+void compute_opening_radii(LinearQuadtree &quadtree, OpeningCriterion criterion, double theta, double G,
+                           double tolerance = DEFAULT_FORCE_TOLERANCE);
+
+/**
+ * Computes the bounding box of each node of a quadtree, halving the one of its parent.
+ * @param cells vector in which to write the bounding box of each node; it is resized to the number of nodes
+ */
+void compute_cells(const LinearQuadtree &quadtree, std::vector<Eigen::AlignedBox2d> &cells);
+
+/**
+ * Finds the leaf of a quadtree whose cell contains a position, descending the quadtree from its root.
+ * @param cells bounding box of each node, as computed by compute_cells
+ * @param position contained in the bounding box of the quadtree
+ * @throw invalid_argument if the position is outside of the bounding box of the quadtree
+ */
+LinearQuadtree::Index find_leaf(const LinearQuadtree &quadtree, const std::vector<Eigen::AlignedBox2d> &cells,
+                                const Eigen::Vector2d &position);
+
+/**
+ * Converts a pointer-based quadtree into a linear quadtree.
+ * @param node root of the quadtree to convert
+ */
+LinearQuadtree flatten_quadtree(const Node &node);
+
+void to_json(nlohmann::json &j, const LinearQuadtree &quadtree);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_LINEAR_QUADTREE_H
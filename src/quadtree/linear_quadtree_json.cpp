@@ -0,0 +1,42 @@
+// Do not remove the #include below! It allows serializing Eigen datatypes.
+#include "../eigen_json.h"
+#include "linear_quadtree.h"
+
+namespace bh {
+
+/**
+ * Serializes the subtree rooted in a node in the same format as a Node.
+ */
+void to_json_impl(nlohmann::json &j, const LinearQuadtree &quadtree, LinearQuadtree::Index idx, const Eigen::AlignedBox2d &box) {
+  const auto &node = quadtree.nodes()[idx];
+  j = {{"boundingBox", box},
+       {"length", node.m_length},
+       {"centerOfMass", node.m_center_of_mass},
+       {"totalMass", node.m_total_mass},
+       {"nNodes", node.m_n_nodes}};
+
+  if (quadtree.is_leaf(idx)) {
+    if (node.m_n_bodies == 0) {
+      j["leaf"] = nlohmann::json{{"body", nullptr}};
+    } else if (node.m_n_bodies == 1) {
+      j["leaf"] = nlohmann::json{{"body", quadtree.bodies()[node.m_first_body]}};
+    } else {
+      const auto first_body = quadtree.bodies().begin() + node.m_first_body;
+      j["leaf"] = nlohmann::json{{"bodies", std::vector<Body>(first_body, first_body + node.m_n_bodies)}};
+    }
+  } else {
+    const auto [nw, ne, se, sw] = quadtree.children(idx);
+    nlohmann::json fork;
+    to_json_impl(fork["nw"], quadtree, nw, Node::get_subquadrant_bbox(box, Node::NW));
+    to_json_impl(fork["ne"], quadtree, ne, Node::get_subquadrant_bbox(box, Node::NE));
+    to_json_impl(fork["se"], quadtree, se, Node::get_subquadrant_bbox(box, Node::SE));
+    to_json_impl(fork["sw"], quadtree, sw, Node::get_subquadrant_bbox(box, Node::SW));
+    j["fork"] = std::move(fork);
+  }
+}
+
+void to_json(nlohmann::json &j, const LinearQuadtree &quadtree) {
+  to_json_impl(j, quadtree, LinearQuadtree::ROOT, quadtree.bbox());
+}
+
+}  // namespace bh
@@ -0,0 +1,185 @@
+#include "morton.h"
+
+#include <algorithm>  // transform, for_each, min
+#include <array>
+#include <numeric>  // iota
+#include <utility>  // swap
+#ifdef WITH_TBB
+#include <execution>  // par_unseq
+#include <thread>     // hardware_concurrency
+#else
+#include <omp.h>  // omp_get_max_threads
+#endif
+
+namespace bh {
+
+// Below this number of keys per chunk, splitting the radix sort among threads does not pay off
+constexpr std::size_t MIN_RADIX_SORT_CHUNK_SIZE = 1 << 14;
+
+MortonKey compute_morton_key(const Eigen::AlignedBox2d &bbox, const Eigen::Vector2d &point) {
+  // Subquadrant selected by whether the point is to the north and to the west of a box's center
+  constexpr std::array<MortonKey, 4> DIGITS{Node::SE, Node::SW, Node::NE, Node::NW};
+
+  // Same bounds, computed with the same operations, as the ones of Node::get_subquadrant_bbox:
+  // each bound of a subquadrant is either the same bound of its parent, or a coordinate of the parent's center.
+  double min_x = bbox.min().x();
+  double min_y = bbox.min().y();
+  double max_x = bbox.max().x();
+  double max_y = bbox.max().y();
+
+  MortonKey key = 0;
+  for (int level = 0; level < MORTON_KEY_DEPTH; level++) {
+    const double center_x = (min_x + max_x) / 2;
+    const double center_y = (min_y + max_y) / 2;
+    const bool west = point.x() < center_x;
+    const bool north = center_y <= point.y();
+    key = (key << 2) | DIGITS[2 * north + west];
+
+    (west ? max_x : min_x) = center_x;
+    (north ? min_y : max_y) = center_y;
+  }
+  return key;
+}
+
+MortonKey MortonCell::last_key() const {
+  if (m_level == 0) {
+    return ~MortonKey{0};
+  }
+  return m_first_key | ((MortonKey{1} << (2 * (MORTON_KEY_DEPTH - m_level))) - 1);
+}
+
+MortonCell MortonCell::child(Node::Subquadrant sq) const {
+  return {m_first_key | (static_cast<MortonKey>(sq) << (2 * (MORTON_KEY_DEPTH - 1 - m_level))), m_level + 1};
+}
+
+Eigen::AlignedBox2d compute_cell_bbox(const Eigen::AlignedBox2d &bbox, const MortonCell &cell) {
+  auto cell_bbox = bbox;
+  for (int level = 0; level < cell.m_level; level++) {
+    cell_bbox = Node::get_subquadrant_bbox(cell_bbox, get_morton_subquadrant(cell.m_first_key, level));
+  }
+  return cell_bbox;
+}
+
+void cover_key_range_impl(MortonKey first_key, MortonKey last_key, const MortonCell &cell, std::vector<MortonCell> &cells) {
+  if (cell.last_key() < first_key || last_key < cell.m_first_key) {
+    return;
+  }
+  if (first_key <= cell.m_first_key && cell.last_key() <= last_key) {
+    cells.push_back(cell);
+    return;
+  }
+  // A cell at the deepest level holds a single key, so it is either in the range or out of it
+  for (const auto sq : {Node::NW, Node::NE, Node::SE, Node::SW}) {
+    cover_key_range_impl(first_key, last_key, cell.child(sq), cells);
+  }
+}
+
+void cover_key_range(MortonKey first_key, MortonKey last_key, std::vector<MortonCell> &cells) {
+  cells.clear();
+  cover_key_range_impl(first_key, last_key, MortonCell{}, cells);
+}
+
+void compute_morton_keys(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, std::vector<MortonKey> &keys) {
+  keys.resize(bodies.size());
+#ifdef WITH_TBB
+  std::transform(std::execution::par_unseq,
+                 bodies.begin(), bodies.end(),
+                 keys.begin(),
+                 [&](const Body &body) {
+                   return compute_morton_key(bbox, body.m_position);
+                 });
+#else
+#pragma omp parallel for default(none) shared(bodies, bbox, keys)
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    keys[i] = compute_morton_key(bbox, bodies[i].m_position);
+  }
+#endif
+}
+
+/**
+ * Calls a function on each chunk index in [0, n_chunks), in parallel.
+ */
+template <typename F>
+void for_each_chunk(int n_chunks, F f) {
+#ifdef WITH_TBB
+  std::vector<int> chunks(n_chunks);
+  std::iota(chunks.begin(), chunks.end(), 0);
+  std::for_each(std::execution::par_unseq, chunks.begin(), chunks.end(), f);
+#else
+#pragma omp parallel for default(none) shared(n_chunks, f)
+  for (int chunk = 0; chunk < n_chunks; chunk++) {
+    f(chunk);
+  }
+#endif
+}
+
+void radix_sort(std::vector<MortonKey> &keys, std::vector<std::uint32_t> &values, RadixSortBuffers &buffers) {
+  const std::size_t n = keys.size();
+#ifdef WITH_TBB
+  const auto n_threads = static_cast<std::size_t>(std::max(1u, std::thread::hardware_concurrency()));
+#else
+  const auto n_threads = static_cast<std::size_t>(omp_get_max_threads());
+#endif
+  // Each chunk is a contiguous range of keys, sorted by a single thread.
+  // Since the chunks are scattered in order, the sort is stable.
+  const auto n_chunks = static_cast<int>(std::max<std::size_t>(1, std::min(n_threads, n / MIN_RADIX_SORT_CHUNK_SIZE)));
+  const std::size_t chunk_size = (n + n_chunks - 1) / n_chunks;
+
+  auto &keys_buffer = buffers.m_keys;
+  auto &values_buffer = buffers.m_values;
+  keys_buffer.resize(n);
+  values_buffer.resize(n);
+  // histograms[chunk][digit]: number of keys of the chunk having that digit; then, where the chunk scatters them
+  auto &histograms = buffers.m_histograms;
+  histograms.resize(n_chunks);
+
+  for (int shift = 0; shift < static_cast<int>(8 * sizeof(MortonKey)); shift += RADIX_BITS) {
+    for_each_chunk(n_chunks, [&](int chunk) {
+      auto &histogram = histograms[chunk];
+      histogram.fill(0);
+      for (std::size_t i = chunk * chunk_size; i < std::min(n, (chunk + 1) * chunk_size); i++) {
+        histogram[(keys[i] >> shift) & (RADIX - 1)]++;
+      }
+    });
+
+    // If all keys have the same digit, this pass would not move them
+    std::array<std::size_t, RADIX> totals{};
+    for (const auto &histogram : histograms) {
+      for (std::size_t digit = 0; digit < RADIX; digit++) {
+        totals[digit] += histogram[digit];
+      }
+    }
+    if (std::any_of(totals.begin(), totals.end(), [n](std::size_t total) { return total == n; })) {
+      continue;
+    }
+
+    // Offsets are assigned digit first, chunk second
+    std::size_t offset = 0;
+    for (std::size_t digit = 0; digit < RADIX; digit++) {
+      for (auto &histogram : histograms) {
+        const std::size_t count = histogram[digit];
+        histogram[digit] = offset;
+        offset += count;
+      }
+    }
+
+    for_each_chunk(n_chunks, [&](int chunk) {
+      auto &histogram = histograms[chunk];
+      for (std::size_t i = chunk * chunk_size; i < std::min(n, (chunk + 1) * chunk_size); i++) {
+        const std::size_t dst = histogram[(keys[i] >> shift) & (RADIX - 1)]++;
+        keys_buffer[dst] = keys[i];
+        values_buffer[dst] = values[i];
+      }
+    });
+
+    std::swap(keys, keys_buffer);
+    std::swap(values, values_buffer);
+  }
+}
+
+void radix_sort(std::vector<MortonKey> &keys, std::vector<std::uint32_t> &values) {
+  RadixSortBuffers buffers;
+  radix_sort(keys, values, buffers);
+}
+
+}  // namespace bh
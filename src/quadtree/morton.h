@@ -0,0 +1,114 @@
+#ifndef BARNES_HUT_MORTON_H
+#define BARNES_HUT_MORTON_H
+
+#include <Eigen/Eigen>
+#include <Eigen/Geometry>
+#include <array>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t, uint64_t
+#include <vector>
+
+#include "body.h"
+#include "node.h"
+
+namespace bh {
+
+/**
+ * A Morton (Z-order) key: the path from the root of a quadtree to the cell containing a point,
+ * encoded as one subquadrant (NW, NE, SE or SW, in this order) every two bits, starting from the most significant ones.
+ * @details Sorting points by their keys sorts them in the same order in which a depth-first visit of the quadtree
+ * reaches them.
+ */
+using MortonKey = std::uint64_t;
+
+// Number of quadtree levels encoded in a key
+constexpr int MORTON_KEY_DEPTH = 32;
+
+/**
+ * Computes the subquadrant that a key selects at some level.
+ * @param key Morton key of a point
+ * @param level depth of the node whose subquadrant is selected: 0 for the root, up to MORTON_KEY_DEPTH - 1
+ */
+inline Node::Subquadrant get_morton_subquadrant(MortonKey key, int level) {
+  return static_cast<Node::Subquadrant>((key >> (2 * (MORTON_KEY_DEPTH - 1 - level))) & 3);
+}
+
+/**
+ * Computes the Morton key of a point.
+ * @details The key is obtained by descending the quadtree as Node::get_subquadrant and Node::get_subquadrant_bbox do,
+ * rather than by quantizing the coordinates, so that the cells it describes are exactly the ones of the quadtree.
+ * @param bbox square bounding box of the root node; must contain the point
+ * @param point whose key is computed
+ */
+MortonKey compute_morton_key(const Eigen::AlignedBox2d &bbox, const Eigen::Vector2d &point);
+
+/**
+ * Computes, in parallel, the Morton keys of the positions of some bodies.
+ * @param bbox square bounding box of the root node; must contain all the bodies
+ * @param keys vector in which to write the keys; it is resized to the number of bodies
+ */
+void compute_morton_keys(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, std::vector<MortonKey> &keys);
+
+/**
+ * A cell of a quadtree, described by the range of the Morton keys of the points it contains.
+ */
+struct MortonCell {
+  // Key of the first point of the cell: its subquadrants below the level of the cell are all NW
+  MortonKey m_first_key = 0;
+  // Depth of the cell: 0 for the root, up to MORTON_KEY_DEPTH
+  int m_level = 0;
+
+  /**
+   * @return the key of the last point of the cell
+   */
+  [[nodiscard]] MortonKey last_key() const;
+
+  /**
+   * @param sq subquadrant of the cell; the cell must be above MORTON_KEY_DEPTH
+   * @return the cell of the subquadrant
+   */
+  [[nodiscard]] MortonCell child(Node::Subquadrant sq) const;
+};
+
+/**
+ * Computes the bounding box of a cell, descending the quadtree as Node::get_subquadrant_bbox does.
+ * @param bbox square bounding box of the root node
+ */
+Eigen::AlignedBox2d compute_cell_bbox(const Eigen::AlignedBox2d &bbox, const MortonCell &cell);
+
+/**
+ * Computes the largest cells containing only points whose keys are in a range, which together cover the range.
+ * @param first_key first key of the range
+ * @param last_key last key of the range, included; if it is less than first_key, the range is empty
+ * @param cells vector in which to write the cells, in Morton order; it is cleared first
+ */
+void cover_key_range(MortonKey first_key, MortonKey last_key, std::vector<MortonCell> &cells);
+
+// Number of bits sorted by each pass of the radix sort
+constexpr int RADIX_BITS = 8;
+constexpr std::size_t RADIX = 1 << RADIX_BITS;
+
+/**
+ * Scratch memory of radix_sort, which can be reused by subsequent sorts.
+ */
+struct RadixSortBuffers {
+  std::vector<MortonKey> m_keys;
+  std::vector<std::uint32_t> m_values;
+  // m_histograms[chunk][digit]
+  std::vector<std::array<std::size_t, RADIX>> m_histograms;
+};
+
+/**
+ * Sorts some keys in ascending order, using a parallel least-significant-digit radix sort.
+ * @details The sort is stable: values with equal keys keep their relative order.
+ * @param keys to sort
+ * @param values to permute along with the keys; must have the same size of keys
+ * @param buffers scratch memory; the sort may exchange it with the storage of keys and values
+ */
+void radix_sort(std::vector<MortonKey> &keys, std::vector<std::uint32_t> &values, RadixSortBuffers &buffers);
+
+void radix_sort(std::vector<MortonKey> &keys, std::vector<std::uint32_t> &values);
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_MORTON_H
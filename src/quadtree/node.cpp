@@ -74,10 +74,14 @@ void Node::insert(const Body &new_body) {
       // and the new body in the corresponding subquadrants, and apply
       // recurison.
       else {
-        auto nw = std::make_unique<Node>((m_box.corner(m_box.TopLeft) + m_box.corner(m_box.BottomLeft)) / 2, (m_box.corner(m_box.TopRight) + m_box.corner(m_box.TopLeft)) / 2);
-        auto ne = std::make_unique<Node>(m_box.center(), m_box.corner(m_box.TopRight));
-        auto se = std::make_unique<Node>((m_box.corner(m_box.BottomRight) + m_box.corner(m_box.BottomLeft)) / 2, (m_box.corner(m_box.TopRight) + m_box.corner(m_box.BottomRight)) / 2);
-        auto sw = std::make_unique<Node>(m_box.corner(m_box.BottomLeft), m_box.center());
+        const auto nw_box = get_subquadrant_bbox(m_box, NW);
+        const auto ne_box = get_subquadrant_bbox(m_box, NE);
+        const auto se_box = get_subquadrant_bbox(m_box, SE);
+        const auto sw_box = get_subquadrant_bbox(m_box, SW);
+        auto nw = std::make_unique<Node>(nw_box.min(), nw_box.max());
+        auto ne = std::make_unique<Node>(ne_box.min(), ne_box.max());
+        auto se = std::make_unique<Node>(se_box.min(), se_box.max());
+        auto sw = std::make_unique<Node>(sw_box.min(), sw_box.max());
 
         // keep track of how many new quadtree nodes are created as part of the insertion process
         int n_nodes = 4;
@@ -183,10 +187,14 @@ void Node::insert(const Body &new_body) {
 }
 
 Node::Subquadrant Node::get_subquadrant(const Eigen::Vector2d &point) {
-  bool west = m_box.min().x() <= point.x() && point.x() < m_box.center().x();
-  bool east = m_box.center().x() <= point.x() && point.x() <= m_box.max().x();
-  bool south = m_box.min().y() <= point.y() && point.y() < m_box.center().y();
-  bool north = m_box.center().y() <= point.y() && point.y() <= m_box.max().y();
+  return get_subquadrant(m_box, point);
+}
+
+Node::Subquadrant Node::get_subquadrant(const Eigen::AlignedBox2d &box, const Eigen::Vector2d &point) {
+  bool west = box.min().x() <= point.x() && point.x() < box.center().x();
+  bool east = box.center().x() <= point.x() && point.x() <= box.max().x();
+  bool south = box.min().y() <= point.y() && point.y() < box.center().y();
+  bool north = box.center().y() <= point.y() && point.y() <= box.max().y();
 
   if (north && west)
     return NW;
@@ -200,6 +208,21 @@ Node::Subquadrant Node::get_subquadrant(const Eigen::Vector2d &point) {
     return OUTSIDE;
 }
 
+Eigen::AlignedBox2d Node::get_subquadrant_bbox(const Eigen::AlignedBox2d &box, Subquadrant sq) {
+  switch (sq) {
+    case NW:
+      return {(box.corner(box.TopLeft) + box.corner(box.BottomLeft)) / 2, (box.corner(box.TopRight) + box.corner(box.TopLeft)) / 2};
+    case NE:
+      return {box.center(), box.corner(box.TopRight)};
+    case SE:
+      return {(box.corner(box.BottomRight) + box.corner(box.BottomLeft)) / 2, (box.corner(box.TopRight) + box.corner(box.BottomRight)) / 2};
+    case SW:
+      return {box.corner(box.BottomLeft), box.center()};
+    default:
+      throw std::invalid_argument("Cannot compute the bounding box of the OUTSIDE subquadrant");
+  }
+}
+
 Eigen::Vector2d Node::center_of_mass() const {
   auto visit_leaf = [&](const Node::Leaf &leaf) -> Eigen::Vector2d {
     if (leaf.m_body.has_value()) {
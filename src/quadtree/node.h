@@ -129,6 +129,22 @@ class Node {
    */
   Subquadrant get_subquadrant(const Eigen::Vector2d &point);
 
+  /**
+   * Computes in which of the subquadrants of a bounding box a given point is located.
+   * @param box square bounding box of a node
+   * @param point Coordinates of the point
+   * @return The subquadrant in which the point is located
+   */
+  static Subquadrant get_subquadrant(const Eigen::AlignedBox2d &box, const Eigen::Vector2d &point);
+
+  /**
+   * Computes the bounding box of one of the subquadrants of a bounding box.
+   * @param box square bounding box of a node
+   * @param sq subquadrant; must not be OUTSIDE
+   * @return the bounding box of the subquadrant
+   */
+  static Eigen::AlignedBox2d get_subquadrant_bbox(const Eigen::AlignedBox2d &box, Subquadrant sq);
+
   /**
    * The axis-aligned square bounding box of the node; not necessarily minimum.
    * x() and y() return its bottom-left and top-right corners.
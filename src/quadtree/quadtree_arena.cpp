@@ -0,0 +1,25 @@
+#include "quadtree_arena.h"
+
+#include <algorithm>  // find_if
+
+namespace bh {
+
+std::shared_ptr<LinearQuadtree> QuadtreeArena::allocate(const Eigen::AlignedBox2d &bbox) {
+  // A quadtree referenced only by the arena has been released by whoever it was handed out to
+  auto released = std::find_if(m_quadtrees.begin(), m_quadtrees.end(), [](const auto &quadtree) {
+    return quadtree.use_count() == 1;
+  });
+  if (released == m_quadtrees.end()) {
+    m_quadtrees.push_back(std::make_shared<LinearQuadtree>());
+    released = m_quadtrees.end() - 1;
+  }
+
+  (*released)->clear(bbox);
+  return *released;
+}
+
+int QuadtreeArena::n_quadtrees() const {
+  return static_cast<int>(m_quadtrees.size());
+}
+
+}  // namespace bh
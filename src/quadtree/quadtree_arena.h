@@ -0,0 +1,67 @@
+#ifndef BARNES_HUT_QUADTREE_ARENA_H
+#define BARNES_HUT_QUADTREE_ARENA_H
+
+#include <Eigen/Eigen>
+#include <Eigen/Geometry>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t
+#include <memory>   // shared_ptr
+#include <vector>
+
+#include "body.h"
+#include "linear_quadtree.h"
+#include "morton.h"
+
+namespace bh {
+
+/**
+ * Memory from which the quadtrees of a simulation are allocated, reused across simulation steps.
+ * @details The arena owns the quadtrees it allocates: once a quadtree is no longer referenced outside of the arena
+ * (i.e., the simulation step holding it has been replaced), its storage is emptied in O(1), keeping its capacity,
+ * and handed out again by the next allocation. The arena also keeps the scratch memory of the quadtree builders.
+ * Once the simulation reaches a steady state, building a quadtree does not allocate heap memory at all.
+ */
+class QuadtreeArena {
+ public:
+  /**
+   * A subtree built independently of the others, with bodies indices relative to its own leaves.
+   */
+  struct Subtree {
+    std::size_t m_from;
+    std::size_t m_to;
+    Eigen::AlignedBox2d m_box;
+    int m_level;
+    std::vector<LinearQuadtree::Node> m_nodes;
+    std::vector<Body> m_leaf_bodies;
+    // where the subtree is copied in the complete quadtree
+    LinearQuadtree::Index m_nodes_offset;
+    LinearQuadtree::Index m_leaf_bodies_offset;
+  };
+
+  /**
+   * Allocates an empty quadtree, reusing the storage of a quadtree that is no longer referenced, if any.
+   * @param bbox square bounding box of the root node
+   */
+  std::shared_ptr<LinearQuadtree> allocate(const Eigen::AlignedBox2d &bbox);
+
+  /**
+   * @return number of quadtrees whose storage is owned by the arena
+   */
+  [[nodiscard]] int n_quadtrees() const;
+
+  // Scratch memory of the quadtree builders
+  std::vector<MortonKey> m_keys;
+  std::vector<std::uint32_t> m_order;
+  RadixSortBuffers m_radix_sort_buffers;
+  // The first m_n_subtrees are in use; the others are kept for their capacity
+  std::vector<Subtree> m_subtrees;
+  std::size_t m_n_subtrees = 0;
+  std::vector<LinearQuadtree::Index> m_forks;
+
+ private:
+  std::vector<std::shared_ptr<LinearQuadtree>> m_quadtrees;
+};
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_QUADTREE_ARENA_H
@@ -0,0 +1,215 @@
+#include "quadtree_refit.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>  // all_of, fill
+#include <cmath>      // ceil, exp2, log2
+#include <numeric>    // partial_sum, iota
+#include <stdexcept>  // invalid_argument
+#include <string>     // to_string
+#include <utility>    // move, swap
+#ifdef WITH_TBB
+#include <execution>  // par_unseq
+#endif
+
+namespace bh {
+
+// Minimum fraction of the side of the bounding box added on each side of a quadtree that is going to be refitted
+constexpr double REFIT_BBOX_MARGIN = 0.125;
+
+/**
+ * Computes the bounding box of a quadtree that is going to be refitted: it is enlarged, so that the bodies on the
+ * boundary of the given bounding box do not leave it as soon as they move.
+ * @details The side of the box is a power of two, and its bounds are multiples of half of it: hence they are exactly
+ * representable, and the box is exactly square.
+ */
+Eigen::AlignedBox2d compute_refit_bbox(const Eigen::AlignedBox2d &bbox) {
+  const double extent = bbox.sizes().maxCoeff() > 0 ? bbox.sizes().maxCoeff() : 1;
+  const double margin = extent * REFIT_BBOX_MARGIN;
+  const double side = std::exp2(std::ceil(std::log2(2 * (extent + 2 * margin))));
+  const double half = side / 2;
+  const Eigen::Vector2d min = ((bbox.min().array() - margin) / half).floor() * half;
+  return {min, min + Eigen::Vector2d::Constant(side)};
+}
+
+std::shared_ptr<LinearQuadtree> QuadtreeRefitter::construct(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, QuadtreeArena &arena,
+                                                            int leaf_size, int rebuild_interval, double max_imbalance) {
+  if (rebuild_interval < 1) {
+    throw std::invalid_argument("The rebuild interval must be at least 1 (interval: " + std::to_string(rebuild_interval) + ")");
+  }
+  if (max_imbalance < 0) {
+    throw std::invalid_argument("The maximum imbalance cannot be negative (imbalance: " + std::to_string(max_imbalance) + ")");
+  }
+
+  m_refitted = false;
+  if (m_refittable && m_n_refits + 1 < rebuild_interval && m_leaves.size() == bodies.size() && leaf_size >= 1 &&
+      std::all_of(bodies.begin(), bodies.end(), [&](const Body &body) {
+        return Node::get_subquadrant(m_quadtree->bbox(), body.m_position) != Node::OUTSIDE;
+      })) {
+    rebin(bodies);
+
+    auto quadtree = arena.allocate(m_quadtree->bbox());
+    if (const double imbalance = refit(bodies, static_cast<std::size_t>(leaf_size), *quadtree); imbalance <= max_imbalance) {
+      m_quadtree = std::move(quadtree);
+      m_n_refits++;
+      m_refitted = true;
+      return m_quadtree;
+    } else {
+      spdlog::debug("Rebuilding the quadtree: {} of the bodies are in overfull leaves", imbalance);
+    }
+  }
+
+  m_n_refits = 0;
+  // Keeping track of the leaves of the bodies is only needed if the quadtree is going to be refitted
+  m_refittable = rebuild_interval > 1;
+  if (!m_refittable) {
+    // Not holding the quadtree lets the arena reuse its storage as soon as the simulation step releases it
+    m_quadtree.reset();
+    return construct_linear_quadtree(bodies, bbox, arena, leaf_size);
+  }
+
+  m_quadtree = construct_linear_quadtree(bodies, compute_refit_bbox(bbox), arena, leaf_size);
+  compute_cells();
+  assign_leaves(bodies, arena.m_order);
+  return m_quadtree;
+}
+
+bool QuadtreeRefitter::refitted() const {
+  return m_refitted;
+}
+
+void QuadtreeRefitter::permute(const std::vector<std::uint32_t> &order) {
+  if (!m_refittable) {
+    return;
+  }
+  if (order.size() != m_leaves.size()) {
+    throw std::invalid_argument("The permutation must have as many entries as the bodies (entries: " + std::to_string(order.size()) +
+                                ", bodies: " + std::to_string(m_leaves.size()) + ")");
+  }
+  m_permuted_leaves.resize(order.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    m_permuted_leaves[i] = m_leaves[order[i]];
+  }
+  std::swap(m_leaves, m_permuted_leaves);
+}
+
+bool QuadtreeRefitter::in_cell(LinearQuadtree::Index idx, const Eigen::Vector2d &position) const {
+  // Same bounds as the ones of Node::get_subquadrant: a cell does not contain its upper bounds,
+  // unless these are the ones of the root
+  const auto &cell = m_cells[idx];
+  const Eigen::Vector2d &root_max = m_quadtree->bbox().max();
+  return cell.min().x() <= position.x() && (position.x() < cell.max().x() || position.x() == root_max.x()) &&
+         cell.min().y() <= position.y() && (position.y() < cell.max().y() || position.y() == root_max.y());
+}
+
+LinearQuadtree::Index QuadtreeRefitter::find_leaf(const Eigen::Vector2d &position) const {
+  return bh::find_leaf(*m_quadtree, m_cells, position);
+}
+
+void QuadtreeRefitter::assign_leaves(const std::vector<Body> &bodies, const std::vector<std::uint32_t> &order) {
+  const auto &quadtree = *m_quadtree;
+  const auto n_nodes = static_cast<LinearQuadtree::Index>(quadtree.n_nodes());
+  m_leaves.resize(bodies.size());
+
+  // The bodies of a leaf follow the ones of the previous non-empty leaf
+  LinearQuadtree::Index leaf = LinearQuadtree::ROOT;
+  for (const auto i : order) {
+    const Eigen::Vector2d &position = bodies[i].m_position;
+    if (!quadtree.is_leaf(leaf) || !in_cell(leaf, position)) {
+      do {
+        leaf++;
+      } while (leaf < n_nodes && !(quadtree.is_leaf(leaf) && quadtree.nodes()[leaf].m_n_bodies > 0));
+
+      if (leaf == n_nodes || !in_cell(leaf, position)) {
+        // Below the depth of the Morton keys, the bodies may not be sorted: look for the leaf from the root
+        leaf = find_leaf(position);
+      }
+    }
+    m_leaves[i] = leaf;
+  }
+}
+
+void QuadtreeRefitter::rebin(const std::vector<Body> &bodies) {
+  const auto rebin_body = [&](std::size_t i) {
+    if (!in_cell(m_leaves[i], bodies[i].m_position)) {
+      m_leaves[i] = find_leaf(bodies[i].m_position);
+    }
+  };
+
+#ifdef WITH_TBB
+  std::vector<std::size_t> indices(bodies.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::for_each(std::execution::par_unseq, indices.begin(), indices.end(), rebin_body);
+#else
+#pragma omp parallel for default(none) shared(bodies, rebin_body)
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    rebin_body(i);
+  }
+#endif
+}
+
+double QuadtreeRefitter::refit(const std::vector<Body> &bodies, std::size_t leaf_size, LinearQuadtree &quadtree) {
+  auto &nodes = quadtree.nodes();
+  nodes = m_quadtree->nodes();
+
+  // Counting sort of the bodies by leaf: since the leaves are in depth-first order, so are the bodies
+  m_offsets.resize(nodes.size() + 1);
+  std::fill(m_offsets.begin(), m_offsets.end(), 0);
+  for (const auto leaf : m_leaves) {
+    m_offsets[leaf + 1]++;
+  }
+  std::size_t n_overfull = 0;
+  for (std::size_t idx = 0; idx < nodes.size(); idx++) {
+    if (m_offsets[idx + 1] > leaf_size) {
+      n_overfull += m_offsets[idx + 1];
+    }
+  }
+  std::partial_sum(m_offsets.begin(), m_offsets.end(), m_offsets.begin());
+
+  for (std::size_t idx = 0; idx < nodes.size(); idx++) {
+    nodes[idx].m_first_body = m_offsets[idx];
+    nodes[idx].m_n_bodies = m_offsets[idx + 1] - m_offsets[idx];
+  }
+  auto &leaf_bodies = quadtree.bodies();
+  leaf_bodies.resize(bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    leaf_bodies[m_offsets[m_leaves[i]]++] = bodies[i];
+  }
+
+  // Visiting the nodes backwards, children are aggregated before their parents
+  for (auto idx = static_cast<LinearQuadtree::Index>(nodes.size()); idx-- > 0;) {
+    auto &node = nodes[idx];
+    if (quadtree.is_leaf(idx) && node.m_n_bodies == 1) {
+      node.m_center_of_mass = leaf_bodies[node.m_first_body].m_position;
+      node.m_total_mass = leaf_bodies[node.m_first_body].m_mass;
+      continue;
+    }
+
+    Eigen::Vector2d center_of_mass{0, 0};
+    double total_mass = 0;
+    if (quadtree.is_leaf(idx)) {
+      for (auto i = node.m_first_body; i < node.m_first_body + node.m_n_bodies; i++) {
+        center_of_mass += leaf_bodies[i].m_position * leaf_bodies[i].m_mass;
+        total_mass += leaf_bodies[i].m_mass;
+      }
+    } else {
+      for (const auto child : quadtree.children(idx)) {
+        center_of_mass += nodes[child].m_center_of_mass * nodes[child].m_total_mass;
+        total_mass += nodes[child].m_total_mass;
+      }
+      node.m_first_body = nodes[idx + 1].m_first_body;
+      node.m_n_bodies = 0;
+    }
+    // A node that has been emptied has no center of mass: since it has no mass, it exerts no force anyway
+    node.m_center_of_mass = total_mass > 0 ? Eigen::Vector2d{center_of_mass / total_mass} : Eigen::Vector2d{0, 0};
+    node.m_total_mass = total_mass;
+  }
+
+  return bodies.empty() ? 0 : static_cast<double>(n_overfull) / static_cast<double>(bodies.size());
+}
+
+void QuadtreeRefitter::compute_cells() {
+  bh::compute_cells(*m_quadtree, m_cells);
+}
+
+}  // namespace bh
@@ -0,0 +1,111 @@
+#ifndef BARNES_HUT_QUADTREE_REFIT_H
+#define BARNES_HUT_QUADTREE_REFIT_H
+
+#include <Eigen/Eigen>
+#include <Eigen/Geometry>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t
+#include <memory>   // shared_ptr
+#include <vector>
+
+#include "body.h"
+#include "linear_quadtree.h"
+#include "quadtree_arena.h"
+
+namespace bh {
+
+/**
+ * Constructs the quadtrees of subsequent simulation steps, refitting the quadtree of the previous step when possible.
+ * @details Refitting keeps the nodes of the previous quadtree, and only re-bins the bodies that left the cell of their
+ * leaf: these are moved to the leaf whose cell now contains them, found by descending the quadtree.
+ * The aggregates are then recomputed bottom-up. Since the leaves are not split or merged, a refitted quadtree
+ * may have leaves holding more than leaf_size bodies, and empty forks: the quadtree is rebuilt from scratch every
+ * rebuild_interval steps, or as soon as too many bodies are in overfull leaves.
+ */
+class QuadtreeRefitter {
+ public:
+  // Fraction of the bodies in leaves holding more than leaf_size bodies above which the quadtree is rebuilt
+  static constexpr double DEFAULT_MAX_IMBALANCE = 0.1;
+
+  /**
+   * Constructs the quadtree containing some bodies, either refitting the last constructed quadtree or from scratch.
+   * @param bodies the same bodies, in the same order, of the last call, at their new positions;
+   * if their number differs, the quadtree is rebuilt
+   * @param bbox square bounding box containing all the bodies, used when the quadtree is rebuilt;
+   * if the quadtree is going to be refitted, it is rebuilt on a larger bounding box, leaving room for the bodies to move
+   * @param arena from which the quadtree is allocated
+   * @param leaf_size maximum number of bodies in a leaf of a rebuilt quadtree
+   * @param rebuild_interval number of steps between two full rebuilds of the quadtree; 1 rebuilds it at every step
+   * @param max_imbalance fraction of the bodies in overfull leaves above which a refitted quadtree is rebuilt
+   * @throw invalid_argument if a body is located outside of the bounding box,
+   * or if the leaf size, the interval or the fraction are out of range
+   */
+  std::shared_ptr<LinearQuadtree> construct(const std::vector<Body> &bodies, const Eigen::AlignedBox2d &bbox, QuadtreeArena &arena,
+                                            int leaf_size = LinearQuadtree::DEFAULT_LEAF_SIZE, int rebuild_interval = 1,
+                                            double max_imbalance = DEFAULT_MAX_IMBALANCE);
+
+  /**
+   * @return whether the last constructed quadtree has been refitted, rather than rebuilt
+   */
+  [[nodiscard]] bool refitted() const;
+
+  /**
+   * Reorders the bodies whose leaves are kept track of, so that the last quadtree can still be refitted
+   * once the bodies have been reordered.
+   * @param order permutation of the bodies: the i-th body is the order[i]-th one of the last call to construct
+   */
+  void permute(const std::vector<std::uint32_t> &order);
+
+ private:
+  /**
+   * Whether a position is in the cell of a node of the last quadtree.
+   */
+  [[nodiscard]] bool in_cell(LinearQuadtree::Index idx, const Eigen::Vector2d &position) const;
+
+  /**
+   * Finds the leaf of the last quadtree whose cell contains a position, descending the quadtree from its root.
+   */
+  [[nodiscard]] LinearQuadtree::Index find_leaf(const Eigen::Vector2d &position) const;
+
+  /**
+   * Finds the leaves of the bodies in the last quadtree, just rebuilt.
+   * @param order permutation of the bodies that sorts them by Morton key, as left by the quadtree builder
+   */
+  void assign_leaves(const std::vector<Body> &bodies, const std::vector<std::uint32_t> &order);
+
+  /**
+   * Re-bins the bodies into the leaves of the last quadtree, descending it only for the bodies that left their cell.
+   * @param bodies contained in the bounding box of the last quadtree
+   */
+  void rebin(const std::vector<Body> &bodies);
+
+  /**
+   * Fills a quadtree with the nodes of the last quadtree and the bodies in their new leaves, computing the aggregates.
+   * @return fraction of the bodies in leaves holding more than leaf_size bodies
+   */
+  double refit(const std::vector<Body> &bodies, std::size_t leaf_size, LinearQuadtree &quadtree);
+
+  /**
+   * Computes the bounding box of each node of the last quadtree.
+   */
+  void compute_cells();
+
+  // Last constructed quadtree, whose nodes are kept when refitting
+  std::shared_ptr<LinearQuadtree> m_quadtree;
+  // Number of times the last rebuilt quadtree has been refitted since then
+  int m_n_refits = 0;
+  bool m_refitted = false;
+  // Whether the leaves of the bodies are being kept track of, so that the last quadtree can be refitted
+  bool m_refittable = false;
+  // Leaf of the last quadtree that contains each body
+  std::vector<LinearQuadtree::Index> m_leaves;
+  std::vector<LinearQuadtree::Index> m_permuted_leaves;
+  // Bounding box of each node of the last quadtree
+  std::vector<Eigen::AlignedBox2d> m_cells;
+  // Scratch memory: where the bodies of each node start in the refitted quadtree
+  std::vector<LinearQuadtree::Index> m_offsets;
+};
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_QUADTREE_REFIT_H
@@ -10,15 +10,23 @@
 namespace bh {
 
 BarnesHutSimulationStep::BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox)
-    : SimulationStep(std::move(bodies), bbox), m_quadtree(std::make_unique<Node>(Eigen::Vector2d{0, 0}, Eigen::Vector2d{0, 0})) {}
+    : SimulationStep(std::move(bodies), bbox), m_quadtree(std::make_shared<LinearQuadtree>()) {}
 
-BarnesHutSimulationStep::BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::shared_ptr<const Node> quadtree)
+BarnesHutSimulationStep::BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::shared_ptr<const LinearQuadtree> quadtree)
     : SimulationStep(std::move(bodies), bbox), m_quadtree(std::move(quadtree)) {}
 
-const Node &BarnesHutSimulationStep::quadtree() const {
+BarnesHutSimulationStep::BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::shared_ptr<const LinearQuadtree> quadtree,
+                                                 std::vector<Eigen::Vector2d> accelerations)
+    : SimulationStep(std::move(bodies), bbox, std::move(accelerations)), m_quadtree(std::move(quadtree)) {}
+
+const LinearQuadtree &BarnesHutSimulationStep::quadtree() const {
   return *m_quadtree;
 }
 
+void BarnesHutSimulationStep::set_quadtree(std::shared_ptr<const LinearQuadtree> quadtree) {
+  m_quadtree = std::move(quadtree);
+}
+
 #ifdef DEBUG_CONSTRUCTOR_AND_ASSIGNMENT_OPERATORS
 
 BarnesHutSimulationStep::BarnesHutSimulationStep(const BarnesHutSimulationStep &other)
@@ -4,7 +4,7 @@
 #include <memory>  // shared_ptr
 #include <nlohmann/json.hpp>
 
-#include "node.h"
+#include "linear_quadtree.h"
 #include "simulation_step.h"
 
 namespace bh {
@@ -12,9 +12,16 @@ namespace bh {
 class BarnesHutSimulationStep final : public SimulationStep {
  public:
   BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox);
-  BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::shared_ptr<const Node> quadtree);
+  BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::shared_ptr<const LinearQuadtree> quadtree);
+  BarnesHutSimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::shared_ptr<const LinearQuadtree> quadtree,
+                          std::vector<Eigen::Vector2d> accelerations);
 
-  [[nodiscard]] const Node &quadtree() const;
+  [[nodiscard]] const LinearQuadtree &quadtree() const;
+
+  /**
+   * Replaces the quadtree of the step, releasing the previous one.
+   */
+  void set_quadtree(std::shared_ptr<const LinearQuadtree> quadtree);
 
 #ifdef DEBUG_CONSTRUCTOR_AND_ASSIGNMENT_OPERATORS
   BarnesHutSimulationStep(const BarnesHutSimulationStep &other);
@@ -24,7 +31,7 @@ class BarnesHutSimulationStep final : public SimulationStep {
 #endif
 
  protected:  // and not private, so that they can be moved
-  std::shared_ptr<const Node> m_quadtree;
+  std::shared_ptr<const LinearQuadtree> m_quadtree;
 };
 
 void to_json(nlohmann::json &j, const BarnesHutSimulationStep &step);
@@ -0,0 +1,53 @@
+#ifndef BARNES_HUT_SIMULATION_STATE_H
+#define BARNES_HUT_SIMULATION_STATE_H
+
+#include <Eigen/Geometry>  // AlignedBox2d
+#include <utility>         // move
+#include <vector>
+
+#include "body.h"
+
+namespace bh {
+
+/**
+ * The last step of a simulation, and the step before it, whose storage is reused to compute the next step.
+ * @details The two steps are double-buffered: the next step is computed in place of the step before the last,
+ * then the two are swapped, without moving nor copying them. Since the vectors of a step keep their capacity,
+ * once the number of bodies is stable computing a step does not allocate them anew.
+ * @tparam Step type of the steps, constructible from the bodies and their bounding box
+ */
+template <typename Step>
+class SimulationState {
+ public:
+  explicit SimulationState(Step initial_step)
+      : m_steps{std::move(initial_step), Step{std::vector<Body>{}, Eigen::AlignedBox2d{}}} {}
+
+  /**
+   * @return the last computed step
+   */
+  [[nodiscard]] const Step &last_step() const {
+    return m_steps[m_last];
+  }
+
+  /**
+   * @return the step before the last, in whose storage the next step is computed
+   */
+  Step &next_step() {
+    return m_steps[1 - m_last];
+  }
+
+  /**
+   * Makes the next step, once computed, the last one.
+   */
+  void advance() {
+    m_last = 1 - m_last;
+  }
+
+ private:
+  Step m_steps[2];
+  int m_last = 0;
+};
+
+}  // namespace bh
+
+#endif  // BARNES_HUT_SIMULATION_STATE_H
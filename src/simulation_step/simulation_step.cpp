@@ -11,6 +11,9 @@ namespace bh {
 SimulationStep::SimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox)
     : m_bodies(std::move(bodies)), m_bbox(bbox) {}
 
+SimulationStep::SimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::vector<Eigen::Vector2d> accelerations)
+    : m_bodies(std::move(bodies)), m_bbox(bbox), m_accelerations(std::move(accelerations)) {}
+
 const std::vector<Body> &SimulationStep::bodies() const {
   return m_bodies;
 }
@@ -19,15 +22,40 @@ const Eigen::AlignedBox2d &SimulationStep::bbox() const {
   return m_bbox;
 }
 
+const std::vector<Eigen::Vector2d> &SimulationStep::accelerations() const {
+  return m_accelerations;
+}
+
+const std::vector<std::uint32_t> &SimulationStep::ids() const {
+  return m_ids;
+}
+
+std::vector<Body> &SimulationStep::bodies() {
+  return m_bodies;
+}
+
+Eigen::AlignedBox2d &SimulationStep::bbox() {
+  return m_bbox;
+}
+
+std::vector<Eigen::Vector2d> &SimulationStep::accelerations() {
+  return m_accelerations;
+}
+
+std::vector<std::uint32_t> &SimulationStep::ids() {
+  return m_ids;
+}
+
 #ifdef DEBUG_CONSTRUCTOR_AND_ASSIGNMENT_OPERATORS
 
 SimulationStep::SimulationStep(const SimulationStep &other)
-    : m_bodies(other.m_bodies), m_bbox(other.m_bbox) {
+    : m_bodies(other.m_bodies), m_bbox(other.m_bbox), m_accelerations(other.m_accelerations), m_ids(other.m_ids) {
   spdlog::trace("SimulationStep copy constructor");
 }
 
 SimulationStep::SimulationStep(SimulationStep &&other) noexcept
-    : m_bodies(std::move(other.m_bodies)), m_bbox(other.m_bbox) {
+    : m_bodies(std::move(other.m_bodies)), m_bbox(other.m_bbox), m_accelerations(std::move(other.m_accelerations)),
+      m_ids(std::move(other.m_ids)) {
   spdlog::trace("SimulationStep move constructor");
 }
 
@@ -35,6 +63,8 @@ SimulationStep &SimulationStep::operator=(const SimulationStep &other) {
   spdlog::trace("SimulationStep copy assignment operator");
   m_bodies = other.m_bodies;
   m_bbox = other.m_bbox;
+  m_accelerations = other.m_accelerations;
+  m_ids = other.m_ids;
   return *this;
 }
 
@@ -42,6 +72,8 @@ SimulationStep &SimulationStep::operator=(SimulationStep &&other) noexcept {
   spdlog::trace("SimulationStep move assignment operator");
   m_bodies = std::move(other.m_bodies);
   m_bbox = other.m_bbox;
+  m_accelerations = std::move(other.m_accelerations);
+  m_ids = std::move(other.m_ids);
   return *this;
 }
 
@@ -1,7 +1,9 @@
 #ifndef BARNES_HUT_SIMULATION_STEP_H
 #define BARNES_HUT_SIMULATION_STEP_H
 
+#include <Eigen/Eigen>
 #include <Eigen/Geometry>  // AlignedBox2d
+#include <cstdint>         // uint32_t
 #include <nlohmann/json.hpp>
 #include <vector>
 
@@ -12,9 +14,29 @@ namespace bh {
 class SimulationStep {
  public:
   SimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox);
+  /**
+   * @param accelerations of the bodies at their positions, in the same order, carried to the next step
+   * by the leapfrog integrator
+   */
+  SimulationStep(std::vector<Body> bodies, const Eigen::AlignedBox2d &bbox, std::vector<Eigen::Vector2d> accelerations);
 
   [[nodiscard]] const std::vector<Body> &bodies() const;
   [[nodiscard]] const Eigen::AlignedBox2d &bbox() const;
+  /**
+   * @return the accelerations of the bodies, or an empty vector if they are not known
+   */
+  [[nodiscard]] const std::vector<Eigen::Vector2d> &accelerations() const;
+  /**
+   * @return the index of each body in the initial order of the simulation, if the simulation reorders its bodies
+   * (see StepOptions::reorder_interval), or an empty vector if they are in their initial order
+   */
+  [[nodiscard]] const std::vector<std::uint32_t> &ids() const;
+
+  // Mutable accessors, so that a step can be computed in the storage of another one (see SimulationState)
+  std::vector<Body> &bodies();
+  Eigen::AlignedBox2d &bbox();
+  std::vector<Eigen::Vector2d> &accelerations();
+  std::vector<std::uint32_t> &ids();
 
 #ifdef DEBUG_CONSTRUCTOR_AND_ASSIGNMENT_OPERATORS
   SimulationStep(const SimulationStep &other);
@@ -26,6 +48,8 @@ class SimulationStep {
  protected:  // and not private, so that they can be moved
   std::vector<Body> m_bodies;
   Eigen::AlignedBox2d m_bbox;
+  std::vector<Eigen::Vector2d> m_accelerations;
+  std::vector<std::uint32_t> m_ids;
 };
 
 void to_json(nlohmann::json &j, const SimulationStep &step);
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <algorithm>  // transform
 #include <iterator>   // back_inserter
+#include <utility>    // move
 
 #include "simulation_step.h"
 // Do not remove the #include below! It allows serializing Eigen datatypes.
@@ -13,6 +14,14 @@ void to_json(nlohmann::json &j, const SimulationStep &step) {
   std::transform(step.bodies().begin(), step.bodies().end(),
                  std::back_inserter(bodies),
                  [](const auto &step) { return step; });
+  // The bodies are written in their initial order, even if they have been reordered
+  if (!step.ids().empty()) {
+    nlohmann::json reordered = bodies;
+    for (std::size_t i = 0; i < step.ids().size(); i++) {
+      reordered[step.ids()[i]] = std::move(bodies[i]);
+    }
+    bodies = std::move(reordered);
+  }
 
   j = nlohmann::json{{"bodies", bodies},
                      {"boundingBox", step.bbox()}};
@@ -0,0 +1,151 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "barnes_hut_simulator.h"
+#include "bounding_box.h"
+#include "random_bodies.h"
+
+/**
+ * A tight binary of two equal bodies, orbiting each other much faster than some light outer bodies move.
+ */
+std::vector<bh::Body> make_binary_and_outer_bodies() {
+  const double separation = 0.01;
+  const double speed = std::sqrt(1 / (2 * separation));
+  std::vector<bh::Body> bodies{{{-separation / 2, 0}, 1, {0, -speed}}, {{separation / 2, 0}, 1, {0, speed}}};
+  for (int i = 0; i < 8; i++) {
+    const double angle = i * M_PI / 4;
+    const double radius = 5 + i;
+    // On circular orbits around the binary
+    const double outer_speed = std::sqrt(2 / radius);
+    bodies.push_back({{radius * std::cos(angle), radius * std::sin(angle)}, 0.001,
+                      {-outer_speed * std::sin(angle), outer_speed * std::cos(angle)}});
+  }
+  return bodies;
+}
+
+bh::BarnesHutSimulationStep simulate(const std::vector<bh::Body>& bodies, double dt, int n_steps, const bh::StepOptions& options) {
+  auto step = bh::BarnesHutSimulationStep(bodies, bh::compute_square_bounding_box(bodies));
+  for (int i = 0; i < n_steps; i++) {
+    step = bh::step(step, dt, 1, 0.5, options);
+  }
+  return step;
+}
+
+TEST_CASE("The block timesteps follow a tight binary as the global timestep of its bodies does") {
+  const auto bodies = make_binary_and_outer_bodies();
+
+  bh::StepOptions options;
+  options.integrator = bh::Integrator::LEAPFROG;
+  const auto global = simulate(bodies, 0.01 / 256, 10 * 256, options);
+
+  // The binary is moved at level 8, as the global timestep, and the outer bodies at level 0
+  options.max_timestep_level = 10;
+  options.timestep_accuracy = 0.0025;
+  const auto block = simulate(bodies, 0.01, 10, options);
+
+  REQUIRE(block.bodies().size() == bodies.size());
+  REQUIRE(block.accelerations().size() == bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    REQUIRE(block.bbox().contains(block.bodies()[i].m_position));
+    REQUIRE((block.bodies()[i].m_position - global.bodies()[i].m_position).norm() < 1e-3);
+  }
+  // The binary is still bound at its separation
+  const double separation = (block.bodies()[1].m_position - block.bodies()[0].m_position).norm();
+  REQUIRE(std::abs(separation - 0.01) < 1e-4);
+}
+
+TEST_CASE("The block timesteps of bodies at level 0 are the global leapfrog timestep") {
+  const auto bodies = make_binary_and_outer_bodies();
+
+  bh::StepOptions options;
+  options.integrator = bh::Integrator::LEAPFROG;
+  const auto global = simulate(bodies, 0.0001, 5, options);
+
+  // The timesteps allowed are longer than the global one
+  options.max_timestep_level = 10;
+  options.timestep_accuracy = 1;
+  const auto block = simulate(bodies, 0.0001, 5, options);
+
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    REQUIRE((block.bodies()[i].m_position - global.bodies()[i].m_position).norm() < 1e-12);
+    REQUIRE((block.bodies()[i].m_velocity - global.bodies()[i].m_velocity).norm() < 1e-12);
+  }
+}
+
+TEST_CASE("The block timesteps need the leapfrog integrator") {
+  const auto bodies = make_binary_and_outer_bodies();
+
+  bh::StepOptions options;
+  options.max_timestep_level = 10;
+  REQUIRE_THROWS_AS(simulate(bodies, 0.01, 1, options), std::invalid_argument);
+}
+
+TEST_CASE("Reordering the bodies does not change their trajectories") {
+  const auto bodies = make_random_bodies(500);
+
+  for (const auto integrator : {bh::Integrator::EULER, bh::Integrator::LEAPFROG}) {
+    bh::StepOptions options;
+    options.integrator = integrator;
+    const auto unordered = simulate(bodies, 0.001, 7, options);
+
+    options.reorder_interval = 3;
+    const auto reordered = simulate(bodies, 0.001, 7, options);
+
+    REQUIRE(reordered.ids().size() == bodies.size());
+    std::vector<bool> seen(bodies.size(), false);
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      const auto id = reordered.ids()[i];
+      REQUIRE(id < bodies.size());
+      REQUIRE(!seen[id]);
+      seen[id] = true;
+      // The bodies of a leaf may be summed in another order
+      REQUIRE((reordered.bodies()[i].m_position - unordered.bodies()[id].m_position).norm() < 1e-12);
+      REQUIRE((reordered.bodies()[i].m_velocity - unordered.bodies()[id].m_velocity).norm() < 1e-12);
+    }
+  }
+}
+
+TEST_CASE("Each simulation reorders its bodies at its own steps") {
+  const auto bodies = make_random_bodies(100);
+
+  bh::StepOptions options;
+  options.reorder_interval = 3;
+  // The first simulation ends a step after reordering its bodies, which must not bring forward the reordering of the second
+  simulate(bodies, 0.001, 4, options);
+  const auto second = simulate(bodies, 0.001, 2, options);
+
+  REQUIRE(second.ids().size() == bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    REQUIRE(second.ids()[i] == i);
+  }
+}
+
+TEST_CASE("The reordered bodies are written in their initial order") {
+  const auto bodies = make_random_bodies(100);
+
+  bh::StepOptions options;
+  options.reorder_interval = 1;
+  const auto reordered = simulate(bodies, 0.001, 2, options);
+  const auto unordered = simulate(bodies, 0.001, 2, bh::StepOptions{});
+
+  const nlohmann::json reordered_json = static_cast<const bh::SimulationStep&>(reordered);
+  const nlohmann::json unordered_json = static_cast<const bh::SimulationStep&>(unordered);
+  REQUIRE(reordered_json["bodies"].size() == bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    const auto reordered_position = reordered_json["bodies"][i]["position"];
+    const auto unordered_position = unordered_json["bodies"][i]["position"];
+    REQUIRE(std::abs(reordered_position["x"].get<double>() - unordered_position["x"].get<double>()) < 1e-12);
+    REQUIRE(std::abs(reordered_position["y"].get<double>() - unordered_position["y"].get<double>()) < 1e-12);
+  }
+}
+
+TEST_CASE("The reordering interval must be non-negative") {
+  const auto bodies = make_random_bodies(10);
+
+  bh::StepOptions options;
+  options.reorder_interval = -1;
+  REQUIRE_THROWS_AS(simulate(bodies, 0.01, 1, options), std::invalid_argument);
+}
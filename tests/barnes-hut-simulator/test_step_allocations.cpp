@@ -0,0 +1,107 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "barnes_hut_simulator.h"
+#include "bounding_box.h"
+#include "simulation_state.h"
+
+// Number of heap allocations through operator new, which every standard container uses
+std::atomic<std::size_t> n_allocations{0};
+
+void* operator new(std::size_t size) {
+  n_allocations++;
+  if (void* ptr = std::malloc(size > 0 ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+/**
+ * Bodies on a jittered grid, slowly rotating around the center.
+ */
+std::vector<bh::Body> make_rotating_grid(int side) {
+  std::vector<bh::Body> bodies;
+  for (int i = 0; i < side; i++) {
+    for (int j = 0; j < side; j++) {
+      const Eigen::Vector2d position{i + 0.3 * std::sin(7.0 * j), j + 0.3 * std::cos(5.0 * i)};
+      const Eigen::Vector2d center{side / 2.0, side / 2.0};
+      const Eigen::Vector2d offset = position - center;
+      bodies.push_back({position, 1, 0.01 * Eigen::Vector2d{-offset.y(), offset.x()}});
+    }
+  }
+  return bodies;
+}
+
+/**
+ * Counts the heap allocations of some steps of the simulation, after some steps to warm up.
+ * @details The warm-up lets the scratch buffers grow past the largest quadtree of the simulation, and each thread
+ * allocate its interaction lists the first time it walks a group.
+ */
+std::size_t count_step_allocations(const bh::StepOptions& options, int n_warm_up_steps, int n_steps) {
+  const auto bodies = make_rotating_grid(32);
+  bh::SimulationState state{bh::BarnesHutSimulationStep(bodies, bh::compute_square_bounding_box(bodies))};
+  for (int i = 0; i < n_warm_up_steps; i++) {
+    bh::step(state, 0.01, 1, 0.5, options);
+  }
+
+  const std::size_t n_allocations_before = n_allocations;
+  for (int i = 0; i < n_steps; i++) {
+    bh::step(state, 0.01, 1, 0.5, options);
+  }
+  return n_allocations - n_allocations_before;
+}
+
+// The parallel algorithms of the standard library allocate their tasks on the heap: only the OpenMP steps are checked
+#ifndef WITH_TBB
+TEST_CASE("After warming up, the Euler steps do not allocate heap memory") {
+  REQUIRE(count_step_allocations({}, 10, 10) == 0);
+}
+
+TEST_CASE("After warming up, the leapfrog steps do not allocate heap memory") {
+  bh::StepOptions options;
+  options.integrator = bh::Integrator::LEAPFROG;
+  options.leaf_size = 4;
+  REQUIRE(count_step_allocations(options, 10, 10) == 0);
+}
+
+TEST_CASE("After warming up, the block timesteps do not allocate heap memory") {
+  bh::StepOptions options;
+  options.integrator = bh::Integrator::LEAPFROG;
+  options.max_timestep_level = 4;
+  options.timestep_accuracy = 0.01;
+  REQUIRE(count_step_allocations(options, 10, 10) == 0);
+}
+#endif
+
+TEST_CASE("The steps computed in place are the steps computed anew") {
+  const auto bodies = make_rotating_grid(8);
+  bh::StepOptions options;
+  options.integrator = bh::Integrator::LEAPFROG;
+
+  bh::SimulationState state{bh::BarnesHutSimulationStep(bodies, bh::compute_square_bounding_box(bodies))};
+  auto step = bh::BarnesHutSimulationStep(bodies, bh::compute_square_bounding_box(bodies));
+  for (int i = 0; i < 5; i++) {
+    bh::step(state, 0.01, 1, 0.5, options);
+    step = bh::step(step, 0.01, 1, 0.5, options);
+  }
+
+  REQUIRE(state.last_step().bbox().isApprox(step.bbox()));
+  REQUIRE(state.last_step().quadtree().n_nodes() == step.quadtree().n_nodes());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    REQUIRE(state.last_step().bodies()[i].m_position == step.bodies()[i].m_position);
+    REQUIRE(state.last_step().bodies()[i].m_velocity == step.bodies()[i].m_velocity);
+  }
+}
@@ -0,0 +1,49 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>  // uintptr_t
+#include <vector>
+
+#include "bounding_box.h"
+#include "random_bodies.h"
+#include "soa_bodies.h"
+
+TEST_CASE("Bodies converted to structure of arrays and back are unchanged") {
+  const auto bodies = make_random_bodies(1001);
+
+  const auto soa_bodies = bh::to_soa(bodies);
+  REQUIRE(soa_bodies.size() == bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    REQUIRE(soa_bodies.m_x[i] == bodies[i].m_position.x());
+    REQUIRE(soa_bodies.m_y[i] == bodies[i].m_position.y());
+    REQUIRE(soa_bodies.m_mass[i] == bodies[i].m_mass);
+    REQUIRE(soa_bodies.m_vx[i] == bodies[i].m_velocity.x());
+    REQUIRE(soa_bodies.m_vy[i] == bodies[i].m_velocity.y());
+  }
+
+  const auto converted = bh::to_aos(soa_bodies);
+  REQUIRE(converted.size() == bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    REQUIRE(converted[i].m_position == bodies[i].m_position);
+    REQUIRE(converted[i].m_mass == bodies[i].m_mass);
+    REQUIRE(converted[i].m_velocity == bodies[i].m_velocity);
+  }
+}
+
+TEST_CASE("The arrays of the bodies are aligned to a cache line") {
+  const auto soa_bodies = bh::to_soa(make_random_bodies(13));
+
+  for (const auto* array : {&soa_bodies.m_x, &soa_bodies.m_y, &soa_bodies.m_mass, &soa_bodies.m_vx, &soa_bodies.m_vy}) {
+    REQUIRE(reinterpret_cast<std::uintptr_t>(array->data()) % bh::SOA_BODIES_ALIGNMENT == 0);
+  }
+}
+
+TEST_CASE("The bounding boxes of bodies stored as structure of arrays are the ones of the bodies") {
+  for (const std::size_t n : {std::size_t{0}, std::size_t{1}, std::size_t{1001}}) {
+    const auto bodies = make_random_bodies(n);
+    const auto soa_bodies = bh::to_soa(bodies);
+
+    REQUIRE(bh::compute_minimum_bounding_box(soa_bodies).min() == bh::compute_minimum_bounding_box(bodies).min());
+    REQUIRE(bh::compute_minimum_bounding_box(soa_bodies).max() == bh::compute_minimum_bounding_box(bodies).max());
+    REQUIRE(bh::compute_square_bounding_box(soa_bodies).min() == bh::compute_square_bounding_box(bodies).min());
+    REQUIRE(bh::compute_square_bounding_box(soa_bodies).max() == bh::compute_square_bounding_box(bodies).max());
+  }
+}
@@ -0,0 +1,13 @@
+#include <mpi.h>
+
+#include <catch2/catch_session.hpp>
+
+/**
+ * Runs the tests of code that communicates with MPI, on any number of processes (e.g. launched by mpirun).
+ */
+int main(int argc, char* argv[]) {
+  MPI_Init(&argc, &argv);
+  const int result = Catch::Session().run(argc, argv);
+  MPI_Finalize();
+  return result;
+}
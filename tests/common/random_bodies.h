@@ -0,0 +1,56 @@
+#ifndef BARNES_HUT_RANDOM_BODIES_H
+#define BARNES_HUT_RANDOM_BODIES_H
+
+#include <Eigen/Eigen>
+#include <algorithm>  // clamp
+#include <cstddef>    // size_t
+#include <random>
+#include <vector>
+
+#include "body.h"
+
+/**
+ * Generates some bodies at random, in no particular order. Their positions are normally distributed around the center
+ * of a bounding box and clamped to it, their masses are uniformly distributed in [0.1, 10), and their velocities are
+ * normally distributed around zero with unit standard deviation.
+ * @param n_bodies number of bodies to generate
+ * @param seed of the random number generator, the same seed generates the same bodies
+ * @param spread standard deviation of the coordinates of the positions
+ * @param bbox bounding box containing the positions
+ * @return the bodies generated
+ */
+inline std::vector<bh::Body> make_random_bodies(std::size_t n_bodies, unsigned seed = 42, double spread = 10,
+                                                const Eigen::AlignedBox2d &bbox = {Eigen::Vector2d{-100, -100},
+                                                                                   Eigen::Vector2d{100, 100}}) {
+  std::mt19937 gen(seed);
+  const Eigen::Vector2d center = bbox.center();
+  std::normal_distribution<double> x(center.x(), spread);
+  std::normal_distribution<double> y(center.y(), spread);
+  std::uniform_real_distribution<double> mass(0.1, 10);
+  std::normal_distribution<double> velocity(0, 1);
+
+  std::vector<bh::Body> bodies(n_bodies);
+  for (auto &body : bodies) {
+    body.m_position = {std::clamp(x(gen), bbox.min().x(), bbox.max().x()),
+                       std::clamp(y(gen), bbox.min().y(), bbox.max().y())};
+    body.m_mass = mass(gen);
+    body.m_velocity = {velocity(gen), velocity(gen)};
+  }
+  return bodies;
+}
+
+// Index of the body the last one is moved onto by make_last_body_coincide
+constexpr std::size_t COINCIDING_BODY = 10;
+
+/**
+ * Moves the last of some bodies onto the one at COINCIDING_BODY, if there are more bodies than that. Coinciding bodies
+ * do not exert any force on each other, which the force computations must handle without dividing by zero.
+ * @param bodies the bodies
+ */
+inline void make_last_body_coincide(std::vector<bh::Body> &bodies) {
+  if (bodies.size() > COINCIDING_BODY + 1) {
+    bodies.back().m_position = bodies[COINCIDING_BODY].m_position;
+  }
+}
+
+#endif  // BARNES_HUT_RANDOM_BODIES_H
@@ -1,6 +1,12 @@
 #include "quadtree_deserialization.h"
 
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>  // copy_if, sort
+#include <iterator>   // back_inserter
+#include <memory>     // make_shared, shared_ptr
+
+#include "quadtree_serialization.h"
+#include "random_bodies.h"
 
 SCENARIO("Deserialize a quadtree with a single node") {
   GIVEN("An empty quadtree") {
@@ -83,3 +89,155 @@ TEST_CASE("Deserialize a quadtree with a fork") {
   REQUIRE(deserialized_sw.total_mass() == 0.25);
   REQUIRE(std::holds_alternative<bh::Node::Leaf>(deserialized_sw.data()));
 }
+
+/**
+ * The bodies in the range of Morton keys of a process, and the quadtrees of the cells covering the range
+ */
+struct ProcessCells {
+  std::vector<bh::Body> m_bodies;
+  std::vector<std::shared_ptr<bh::LinearQuadtree>> m_quadtrees;
+};
+
+/**
+ * Splits some bodies in three ranges of Morton keys, one starting at the key of a body and one starting in the middle
+ * of a cell.
+ * @param bodies the bodies
+ * @param bbox bounding box of the bodies
+ * @return first key of the range of each process but the first
+ */
+std::vector<bh::MortonKey> split_bodies(const std::vector<bh::Body> &bodies, const Eigen::AlignedBox2d &bbox) {
+  std::vector<bh::MortonKey> keys;
+  bh::compute_morton_keys(bodies, bbox, keys);
+  std::sort(keys.begin(), keys.end());
+  return {keys[40], keys[200] >> 20 << 20};
+}
+
+/**
+ * Constructs the quadtrees of the cells covering the ranges of Morton keys of the processes, as each process does.
+ * @param bodies the bodies of all the processes
+ * @param bbox bounding box of the bodies
+ * @param splits first key of the range of each process but the first
+ * @return the bodies and the cell quadtrees of each process
+ */
+std::vector<ProcessCells> construct_cell_quadtrees(const std::vector<bh::Body> &bodies, const Eigen::AlignedBox2d &bbox,
+                                                   const std::vector<bh::MortonKey> &splits) {
+  std::vector<ProcessCells> procs(splits.size() + 1);
+  std::vector<bh::MortonCell> cells;
+  for (std::size_t proc = 0; proc <= splits.size(); proc++) {
+    const auto first_key = proc == 0 ? 0 : splits[proc - 1];
+    if (proc < splits.size() && splits[proc] == 0) {
+      continue;
+    }
+    const auto last_key = proc == splits.size() ? ~bh::MortonKey{0} : splits[proc] - 1;
+    bh::cover_key_range(first_key, last_key, cells);
+    for (const auto &cell : cells) {
+      std::vector<bh::Body> cell_bodies;
+      std::copy_if(bodies.begin(), bodies.end(), std::back_inserter(cell_bodies), [&](const bh::Body &body) {
+        const auto key = bh::compute_morton_key(bbox, body.m_position);
+        return cell.m_first_key <= key && key <= cell.last_key();
+      });
+      procs[proc].m_quadtrees.push_back(std::make_shared<bh::LinearQuadtree>(bh::construct_linear_quadtree(cell_bodies, bh::compute_cell_bbox(bbox, cell))));
+      procs[proc].m_bodies.insert(procs[proc].m_bodies.end(), cell_bodies.begin(), cell_bodies.end());
+    }
+  }
+  return procs;
+}
+
+/**
+ * Encodes compactly some quadtrees one after the other.
+ */
+void serialize_quadtrees(const std::vector<std::shared_ptr<bh::LinearQuadtree>> &quadtrees, std::vector<std::byte> &encoded) {
+  std::vector<std::byte> bytes;
+  for (const auto &quadtree : quadtrees) {
+    bh::serialize_quadtree(*quadtree, bh::mpi::Precision::DOUBLE, bytes);
+    encoded.insert(encoded.end(), bytes.begin(), bytes.end());
+  }
+}
+
+/**
+ * Checks that a merged quadtree has the same nodes as one constructed from all of its bodies.
+ */
+void require_same_nodes(const bh::LinearQuadtree &merged, const bh::LinearQuadtree &expected) {
+  REQUIRE(merged.bbox().min() == expected.bbox().min());
+  REQUIRE(merged.bbox().max() == expected.bbox().max());
+  REQUIRE(merged.n_nodes() == expected.n_nodes());
+  for (int i = 0; i < expected.n_nodes(); i++) {
+    REQUIRE(merged.nodes()[i].m_center_of_mass == expected.nodes()[i].m_center_of_mass);
+    REQUIRE(merged.nodes()[i].m_total_mass == expected.nodes()[i].m_total_mass);
+    REQUIRE(merged.nodes()[i].m_length == expected.nodes()[i].m_length);
+    REQUIRE(merged.nodes()[i].m_n_nodes == expected.nodes()[i].m_n_nodes);
+    REQUIRE(merged.nodes()[i].m_first_body == expected.nodes()[i].m_first_body);
+    REQUIRE(merged.nodes()[i].m_n_bodies == expected.nodes()[i].m_n_bodies);
+  }
+  REQUIRE(merged.bodies().size() == expected.bodies().size());
+}
+
+TEST_CASE("Deserialize and merge the compactly encoded quadtrees of the cells covering ranges of Morton keys") {
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+  auto bodies = make_random_bodies(300, 42, 1.5, bbox);
+  // Two coinciding bodies
+  bodies.push_back({{3, 3}, 1});
+  bodies.push_back({{3, 3}, 2});
+
+  std::vector<bh::MortonKey> keys;
+  bh::compute_morton_keys(bodies, bbox, keys);
+  std::sort(keys.begin(), keys.end());
+  // Ranges starting at some keys of the bodies, an empty one, and one starting in the middle of a cell
+  const std::vector<bh::MortonKey> splits{keys[40], keys[41] >> 20 << 20, keys[41] >> 20 << 20, keys[200], keys[250] + 1};
+
+  std::vector<std::byte> quadtrees;
+  for (const auto &proc : construct_cell_quadtrees(bodies, bbox, splits)) {
+    serialize_quadtrees(proc.m_quadtrees, quadtrees);
+  }
+
+  bh::LinearQuadtree merged;
+  bh::deserialize_quadtrees(quadtrees, splits, bbox, merged);
+
+  require_same_nodes(merged, bh::construct_linear_quadtree(bodies, bbox));
+}
+
+TEST_CASE("Deserialize and merge the compactly encoded quadtrees of the cells covering the range of Morton keys of a single process") {
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+  const auto bodies = make_random_bodies(300, 42, 1.5, bbox);
+  const auto splits = split_bodies(bodies, bbox);
+  const auto procs = construct_cell_quadtrees(bodies, bbox, splits);
+
+  for (int proc = 0; proc < static_cast<int>(procs.size()); proc++) {
+    std::vector<std::byte> quadtrees;
+    serialize_quadtrees(procs[proc].m_quadtrees, quadtrees);
+
+    bh::LinearQuadtree merged;
+    bh::deserialize_quadtrees(quadtrees.data(), splits, proc, bbox, merged);
+
+    require_same_nodes(merged, bh::construct_linear_quadtree(procs[proc].m_bodies, bbox));
+  }
+}
+
+TEST_CASE("Merge the quadtrees of the cells of a process as they are with the compactly encoded ones of the others") {
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+  const auto bodies = make_random_bodies(300, 42, 1.5, bbox);
+  const auto splits = split_bodies(bodies, bbox);
+  const auto procs = construct_cell_quadtrees(bodies, bbox, splits);
+  const int my_proc = 1;
+
+  SECTION("All the processes") {
+    std::vector<std::byte> quadtrees;
+    for (int proc = 0; proc < static_cast<int>(procs.size()); proc++) {
+      if (proc != my_proc) {
+        serialize_quadtrees(procs[proc].m_quadtrees, quadtrees);
+      }
+    }
+
+    bh::LinearQuadtree merged;
+    bh::deserialize_quadtrees(quadtrees, splits, my_proc, procs[my_proc].m_quadtrees, bbox, merged);
+
+    require_same_nodes(merged, bh::construct_linear_quadtree(bodies, bbox));
+  }
+
+  SECTION("The process alone") {
+    bh::LinearQuadtree merged;
+    bh::merge_cell_quadtrees(splits, my_proc, procs[my_proc].m_quadtrees, bbox, merged);
+
+    require_same_nodes(merged, bh::construct_linear_quadtree(procs[my_proc].m_bodies, bbox));
+  }
+}
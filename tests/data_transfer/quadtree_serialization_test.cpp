@@ -1,7 +1,12 @@
 #include "quadtree_serialization.h"
 
+#include <catch2/catch_approx.hpp>
 #include <catch2/catch_test_macros.hpp>
 
+#include "force.h"  // compute_approximate_net_force_on_body
+#include "quadtree_deserialization.h"
+#include "random_bodies.h"
+
 SCENARIO("Serialize a quadtree with a single node") {
   GIVEN("An empty quadtree") {
     auto quadtree = bh::Node({0, 0}, {10, 10});
@@ -85,3 +90,79 @@ TEST_CASE("Serialize a complex quadtree") {
   REQUIRE(serialized[16].data.fork.se_idx == 19);
   REQUIRE(serialized[16].data.fork.sw_idx == 20);
 }
+
+TEST_CASE("Encode a linear quadtree compactly") {
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+  const auto bodies = make_random_bodies(200, 42, 2.5, bbox);
+  const auto quadtree = bh::construct_linear_quadtree(bodies, bbox);
+  const double theta = 0.5;
+  std::vector<std::byte> encoded;
+
+  SECTION("The quadtree decoded in double precision is the same") {
+    bh::serialize_quadtree(quadtree, bh::mpi::Precision::DOUBLE, encoded);
+    const auto decoded = bh::deserialize_linear_quadtree(encoded, bbox);
+
+    REQUIRE(decoded.n_nodes() == quadtree.n_nodes());
+    for (int i = 0; i < quadtree.n_nodes(); i++) {
+      REQUIRE(decoded.nodes()[i].m_center_of_mass == quadtree.nodes()[i].m_center_of_mass);
+      REQUIRE(decoded.nodes()[i].m_total_mass == quadtree.nodes()[i].m_total_mass);
+      REQUIRE(decoded.nodes()[i].m_length == quadtree.nodes()[i].m_length);
+      REQUIRE(decoded.nodes()[i].m_n_nodes == quadtree.nodes()[i].m_n_nodes);
+      REQUIRE(decoded.nodes()[i].m_n_bodies == quadtree.nodes()[i].m_n_bodies);
+    }
+    // A byte per fork, and three doubles per body
+    REQUIRE(encoded.size() * 4 < quadtree.n_nodes() * sizeof(bh::mpi::Node));
+  }
+
+  SECTION("The quadtree decoded in single precision has its bodies rounded") {
+    std::vector<std::byte> double_encoded;
+    bh::serialize_quadtree(quadtree, bh::mpi::Precision::DOUBLE, double_encoded);
+    bh::serialize_quadtree(quadtree, bh::mpi::Precision::FLOAT, encoded);
+    const auto decoded = bh::deserialize_linear_quadtree(encoded, bbox);
+
+    REQUIRE(encoded.size() < double_encoded.size());
+    REQUIRE(decoded.n_nodes() == quadtree.n_nodes());
+    for (int i = 0; i < quadtree.n_nodes(); i++) {
+      REQUIRE((decoded.nodes()[i].m_center_of_mass - quadtree.nodes()[i].m_center_of_mass).norm() < 1e-5);
+      REQUIRE(decoded.nodes()[i].m_total_mass == Catch::Approx(quadtree.nodes()[i].m_total_mass).epsilon(1e-6));
+    }
+  }
+
+  SECTION("A domain overlapping the whole quadtree needs all of it") {
+    std::vector<std::byte> expected;
+    bh::serialize_quadtree(quadtree, bh::mpi::Precision::DOUBLE, expected);
+    bh::serialize_quadtree(quadtree, {bbox}, theta, bh::mpi::Precision::DOUBLE, encoded);
+
+    REQUIRE(encoded == expected);
+  }
+
+  SECTION("A domain without bodies only needs the aggregate body of the root") {
+    bh::serialize_quadtree(quadtree, {}, theta, bh::mpi::Precision::DOUBLE, encoded);
+
+    REQUIRE(encoded.size() == 1 + 3 * sizeof(double));
+    REQUIRE(encoded[0] == std::byte{bh::mpi::BodyLeafType});
+  }
+
+  SECTION("A far domain only needs the aggregate body of the root") {
+    bh::serialize_quadtree(quadtree, {Eigen::AlignedBox2d{Eigen::Vector2d{100, 100}, Eigen::Vector2d{110, 110}}}, theta,
+                           bh::mpi::Precision::DOUBLE, encoded);
+
+    REQUIRE(encoded.size() == 1 + 3 * sizeof(double));
+    REQUIRE(encoded[0] == std::byte{bh::mpi::BodyLeafType});
+  }
+
+  SECTION("The forces on the bodies of a domain are the same as with the whole quadtree") {
+    const std::vector<Eigen::AlignedBox2d> domain{Eigen::AlignedBox2d{Eigen::Vector2d{0, 0}, Eigen::Vector2d{2, 2}},
+                                                  Eigen::AlignedBox2d{Eigen::Vector2d{9, 9}, Eigen::Vector2d{10, 10}}};
+    bh::serialize_quadtree(quadtree, domain, theta, bh::mpi::Precision::DOUBLE, encoded);
+    const auto essential_quadtree = bh::deserialize_linear_quadtree(encoded, bbox);
+
+    REQUIRE(essential_quadtree.n_nodes() < quadtree.n_nodes());
+    for (const auto& body : bodies) {
+      if (domain[0].contains(body.m_position) || domain[1].contains(body.m_position)) {
+        REQUIRE(bh::compute_approximate_net_force_on_body(essential_quadtree, body, 1, theta) ==
+                bh::compute_approximate_net_force_on_body(quadtree, body, 1, theta));
+      }
+    }
+  }
+}
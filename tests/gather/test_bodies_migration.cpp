@@ -0,0 +1,94 @@
+#include <mpi.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "bodies_migration.h"
+
+// These tests run on any number of processes, e.g. mpirun -n 3 test-bodies-migration
+
+/**
+ * Number of bodies that a process sends to another in the tests: some pairs of processes exchange none.
+ */
+int count_migrating_bodies(int from_proc, int to_proc) {
+  return (from_proc + to_proc + 1) % 3;
+}
+
+TEST_CASE("Each process receives the bodies that the others migrate to it") {
+  int proc_id, n_procs;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+  MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+  // Each body is marked with the processes that send and receive it, and with its index among the bodies they exchange
+  std::vector<int> send_n_bodies(n_procs);
+  std::vector<bh::Body> bodies;
+  std::vector<std::uint32_t> ids;
+  for (int to_proc = 0; to_proc < n_procs; to_proc++) {
+    send_n_bodies[to_proc] = count_migrating_bodies(proc_id, to_proc);
+    for (int k = 0; k < send_n_bodies[to_proc]; k++) {
+      bodies.push_back({{proc_id, to_proc}, k + 1.0, {k, -k}});
+      ids.push_back(static_cast<std::uint32_t>(proc_id * n_procs + k));
+    }
+  }
+
+  std::vector<int> recv_n_bodies;
+  bh::exchange_n_bodies(n_procs, send_n_bodies, recv_n_bodies);
+  std::vector<bh::Body> received;
+  bh::migrate_bodies(n_procs, send_n_bodies, recv_n_bodies, bodies, received);
+  std::vector<std::uint32_t> received_ids;
+  bh::migrate_values(n_procs, send_n_bodies, recv_n_bodies, ids, received_ids);
+
+  REQUIRE(static_cast<int>(recv_n_bodies.size()) == n_procs);
+  REQUIRE(received_ids.size() == received.size());
+  // The bodies are received in the order of the processes that send them
+  std::size_t i = 0;
+  for (int from_proc = 0; from_proc < n_procs; from_proc++) {
+    REQUIRE(recv_n_bodies[from_proc] == count_migrating_bodies(from_proc, proc_id));
+    for (int k = 0; k < recv_n_bodies[from_proc]; k++, i++) {
+      REQUIRE(i < received.size());
+      REQUIRE(received[i].m_position == Eigen::Vector2d(from_proc, proc_id));
+      REQUIRE(received[i].m_velocity == Eigen::Vector2d(k, -k));
+      REQUIRE(received[i].m_mass == k + 1.0);
+      REQUIRE(received_ids[i] == static_cast<std::uint32_t>(from_proc * n_procs + k));
+    }
+  }
+  REQUIRE(i == received.size());
+}
+
+TEST_CASE("Processes without bodies to migrate receive none") {
+  int n_procs;
+  MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+  const std::vector<int> send_n_bodies(n_procs, 0);
+  std::vector<int> recv_n_bodies;
+  bh::exchange_n_bodies(n_procs, send_n_bodies, recv_n_bodies);
+  // The storage of the vectors is reused
+  std::vector<bh::Body> received{{{1, 2}, 5, {3, 4}}};
+  bh::migrate_bodies(n_procs, send_n_bodies, recv_n_bodies, {}, received);
+  std::vector<std::uint32_t> received_ids{1, 2, 3};
+  bh::migrate_values(n_procs, send_n_bodies, recv_n_bodies, {}, received_ids);
+
+  REQUIRE(recv_n_bodies == send_n_bodies);
+  REQUIRE(received.empty());
+  REQUIRE(received_ids.empty());
+}
+
+TEST_CASE("The reductions combine the values of all the processes") {
+  int proc_id, n_procs;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+  MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+  const Eigen::AlignedBox2d my_bbox{Eigen::Vector2d{proc_id, -proc_id}, Eigen::Vector2d{proc_id + 1, 1}};
+  const auto bbox = bh::reduce_bounding_box(my_bbox);
+  std::vector<std::uint64_t> values{static_cast<std::uint64_t>(proc_id), 1, std::uint64_t{1} << 40};
+  bh::reduce_sum(values);
+  const bool any_last = bh::reduce_any(proc_id == n_procs - 1);
+  const bool any_false = bh::reduce_any(false);
+
+  REQUIRE(bbox.isApprox(Eigen::AlignedBox2d{Eigen::Vector2d{0, 1 - n_procs}, Eigen::Vector2d{n_procs, 1}}));
+  const auto n = static_cast<std::uint64_t>(n_procs);
+  REQUIRE(values == std::vector<std::uint64_t>{n * (n - 1) / 2, n, n << 40});
+  REQUIRE(any_last);
+  REQUIRE_FALSE(any_false);
+}
@@ -1,163 +1,298 @@
-#include <catch2/catch_test_macros.hpp>
-
-#include "mpi_barnes_hut_simulator.h"
-
-TEST_CASE("compute bounding box for 16 processors; non-negative coordinates") {
-  const Eigen::AlignedBox2d outer{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
-
-  auto q0 = bh::compute_bounding_box_for_processor(outer, 0, 16);
-  auto q1 = bh::compute_bounding_box_for_processor(outer, 1, 16);
-  auto q2 = bh::compute_bounding_box_for_processor(outer, 2, 16);
-  auto q3 = bh::compute_bounding_box_for_processor(outer, 3, 16);
-  auto q4 = bh::compute_bounding_box_for_processor(outer, 4, 16);
-  auto q5 = bh::compute_bounding_box_for_processor(outer, 5, 16);
-  auto q6 = bh::compute_bounding_box_for_processor(outer, 6, 16);
-  auto q7 = bh::compute_bounding_box_for_processor(outer, 7, 16);
-  auto q8 = bh::compute_bounding_box_for_processor(outer, 8, 16);
-  auto q9 = bh::compute_bounding_box_for_processor(outer, 9, 16);
-  auto q10 = bh::compute_bounding_box_for_processor(outer, 10, 16);
-  auto q11 = bh::compute_bounding_box_for_processor(outer, 11, 16);
-  auto q12 = bh::compute_bounding_box_for_processor(outer, 12, 16);
-  auto q13 = bh::compute_bounding_box_for_processor(outer, 13, 16);
-  auto q14 = bh::compute_bounding_box_for_processor(outer, 14, 16);
-  auto q15 = bh::compute_bounding_box_for_processor(outer, 15, 16);
-
-  REQUIRE(q12.min() == Eigen::Vector2d{0, 0});
-  REQUIRE(q12.max() == Eigen::Vector2d{2.5, 2.5});
-
-  REQUIRE(q13.min() == Eigen::Vector2d{2.5, 0});
-  REQUIRE(q13.max() == Eigen::Vector2d{5, 2.5});
-
-  REQUIRE(q14.min() == Eigen::Vector2d{5, 0});
-  REQUIRE(q14.max() == Eigen::Vector2d{7.5, 2.5});
-
-  REQUIRE(q15.min() == Eigen::Vector2d{7.5, 0});
-  REQUIRE(q15.max() == Eigen::Vector2d{10, 2.5});
-
-  REQUIRE(q8.min() == Eigen::Vector2d{0, 2.5});
-  REQUIRE(q8.max() == Eigen::Vector2d{2.5, 5});
-
-  REQUIRE(q9.min() == Eigen::Vector2d{2.5, 2.5});
-  REQUIRE(q9.max() == Eigen::Vector2d{5, 5});
-
-  REQUIRE(q10.min() == Eigen::Vector2d{5, 2.5});
-  REQUIRE(q10.max() == Eigen::Vector2d{7.5, 5});
-
-  REQUIRE(q11.min() == Eigen::Vector2d{7.5, 2.5});
-  REQUIRE(q11.max() == Eigen::Vector2d{10, 5});
-
-  REQUIRE(q4.min() == Eigen::Vector2d{0, 5});
-  REQUIRE(q4.max() == Eigen::Vector2d{2.5, 7.5});
-
-  REQUIRE(q5.min() == Eigen::Vector2d{2.5, 5});
-  REQUIRE(q5.max() == Eigen::Vector2d{5, 7.5});
-
-  REQUIRE(q6.min() == Eigen::Vector2d{5, 5});
-  REQUIRE(q6.max() == Eigen::Vector2d{7.5, 7.5});
-
-  REQUIRE(q7.min() == Eigen::Vector2d{7.5, 5});
-  REQUIRE(q7.max() == Eigen::Vector2d{10, 7.5});
-
-  REQUIRE(q0.min() == Eigen::Vector2d{0, 7.5});
-  REQUIRE(q0.max() == Eigen::Vector2d{2.5, 10});
+#include <mpi.h>
 
-  REQUIRE(q1.min() == Eigen::Vector2d{2.5, 7.5});
-  REQUIRE(q1.max() == Eigen::Vector2d{5, 10});
+#include <algorithm>
+#include <cmath>  // sqrt
+#include <numeric>  // iota
+#include <utility>  // pair, swap
 
-  REQUIRE(q2.min() == Eigen::Vector2d{5, 7.5});
-  REQUIRE(q2.max() == Eigen::Vector2d{7.5, 10});
+#include <catch2/catch_test_macros.hpp>
 
-  REQUIRE(q3.min() == Eigen::Vector2d{7.5, 7.5});
-  REQUIRE(q3.max() == Eigen::Vector2d{10, 10});
+#include "body_update.h"
+#include "bounding_box.h"
+#include "linear_quadtree.h"
+#include "mpi_barnes_hut_simulator.h"
+#include "random_bodies.h"
+
+/**
+ * Keys of some bodies, each one in its own cell of bh::COSTZONES_LEVEL.
+ */
+std::vector<bh::MortonKey> make_costzones_keys(std::size_t n) {
+  std::vector<bh::MortonKey> keys(n);
+  for (std::size_t i = 0; i < n; i++) {
+    keys[i] = static_cast<bh::MortonKey>(i + 1) << (2 * (bh::MORTON_KEY_DEPTH - bh::COSTZONES_LEVEL));
+  }
+  return keys;
 }
 
-TEST_CASE("compute bounding box for 4 processors; positive and negative coordinates") {
-  const Eigen::AlignedBox2d outer{Eigen::Vector2d{-2, -2}, Eigen::Vector2d{2, 2}};
-
-  auto q0 = bh::compute_bounding_box_for_processor(outer, 0, 4);
-  auto q1 = bh::compute_bounding_box_for_processor(outer, 1, 4);
-  auto q2 = bh::compute_bounding_box_for_processor(outer, 2, 4);
-  auto q3 = bh::compute_bounding_box_for_processor(outer, 3, 4);
-
-  REQUIRE(q2.min() == Eigen::Vector2d{-2, -2});
-  REQUIRE(q2.max() == Eigen::Vector2d{0, 0});
-
-  REQUIRE(q3.min() == Eigen::Vector2d{0, -2});
-  REQUIRE(q3.max() == Eigen::Vector2d{2, 0});
+TEST_CASE("costzones of bodies of equal costs have the same number of bodies") {
+  const auto keys = make_costzones_keys(100);
+  std::vector<bh::MortonKey> splits;
+  bh::compute_costzones(keys, {}, 4, splits);
 
-  REQUIRE(q0.min() == Eigen::Vector2d{-2, 0});
-  REQUIRE(q0.max() == Eigen::Vector2d{0, 2});
-
-  REQUIRE(q1.min() == Eigen::Vector2d{0, 0});
-  REQUIRE(q1.max() == Eigen::Vector2d{2, 2});
+  REQUIRE(splits == std::vector<bh::MortonKey>{keys[25], keys[50], keys[75]});
 }
 
-TEST_CASE("compute bounding box for 4 processors; negative coordinates only") {
-  const Eigen::AlignedBox2d outer{Eigen::Vector2d{-4, -4}, Eigen::Vector2d{-2, -2}};
-
-  auto q0 = bh::compute_bounding_box_for_processor(outer, 0, 4);
-  auto q1 = bh::compute_bounding_box_for_processor(outer, 1, 4);
-  auto q2 = bh::compute_bounding_box_for_processor(outer, 2, 4);
-  auto q3 = bh::compute_bounding_box_for_processor(outer, 3, 4);
+TEST_CASE("costzones follow the costs of the bodies") {
+  const auto keys = make_costzones_keys(100);
+  // The first 10 bodies cost as much as the other 90
+  std::vector<std::uint32_t> costs(100, 1);
+  std::fill(costs.begin(), costs.begin() + 10, 9);
+  std::vector<bh::MortonKey> splits;
+  bh::compute_costzones(keys, costs, 2, splits);
 
-  REQUIRE(q2.min() == Eigen::Vector2d{-4, -4});
-  REQUIRE(q2.max() == Eigen::Vector2d{-3, -3});
+  REQUIRE(splits == std::vector<bh::MortonKey>{keys[10]});
+}
 
-  REQUIRE(q3.min() == Eigen::Vector2d{-3, -4});
-  REQUIRE(q3.max() == Eigen::Vector2d{-2, -3});
+TEST_CASE("costzones start at cells of the costzones level") {
+  // Pairs of bodies in the same cell
+  auto keys = make_costzones_keys(50);
+  for (std::size_t i = 0; i < 50; i++) {
+    keys.push_back(keys[i] + 1);
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<bh::MortonKey> splits;
+  bh::compute_costzones(keys, {}, 3, splits);
+
+  REQUIRE(splits.size() == 2);
+  for (const auto split : splits) {
+    REQUIRE(std::find(keys.begin(), keys.end(), split) != keys.end());
+    REQUIRE(split % (bh::MortonKey{1} << (2 * (bh::MORTON_KEY_DEPTH - bh::COSTZONES_LEVEL))) == 0);
+  }
+  REQUIRE(splits[0] <= splits[1]);
+}
 
-  REQUIRE(q0.min() == Eigen::Vector2d{-4, -3});
-  REQUIRE(q0.max() == Eigen::Vector2d{-3, -2});
+TEST_CASE("costzones of fewer bodies than processes") {
+  std::vector<bh::MortonKey> splits;
+  bh::compute_costzones({}, {}, 4, splits);
+  REQUIRE(splits == std::vector<bh::MortonKey>(3, 0));
 
-  REQUIRE(q1.min() == Eigen::Vector2d{-3, -3});
-  REQUIRE(q1.max() == Eigen::Vector2d{-2, -2});
+  const auto keys = make_costzones_keys(2);
+  bh::compute_costzones(keys, {}, 4, splits);
+  REQUIRE(splits.size() == 3);
+  REQUIRE(std::is_sorted(splits.begin(), splits.end()));
+  REQUIRE(splits.back() <= keys.back());
 }
 
-// https://www.desmos.com/calculator/3b3drqark3?lang=it
-TEST_CASE("filter bodies by subquadrant") {
-  auto p1 = Eigen::Vector2d{0, 0};
-  auto p2 = Eigen::Vector2d{5, 0};
-  auto p3 = Eigen::Vector2d{10, 0};
-  auto p4 = Eigen::Vector2d{0, 5};
-  auto p5 = Eigen::Vector2d{5, 5};
-  auto p6 = Eigen::Vector2d{10, 5};
-  auto p7 = Eigen::Vector2d{0, 10};
-  auto p8 = Eigen::Vector2d{5, 10};
-  auto p9 = Eigen::Vector2d{10, 10};
+TEST_CASE("distributed costzones of the bodies of all the processes are their costzones") {
+  int proc_id, n_procs;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+  MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+  const auto keys = make_costzones_keys(100);
+  // The first 10 bodies cost as much as the other 90
+  std::vector<std::uint32_t> costs(100, 1);
+  std::fill(costs.begin(), costs.begin() + 10, 9);
+
+  // The bodies are dealt to the processes in turn
+  std::vector<bh::MortonKey> my_keys;
+  std::vector<std::uint32_t> my_costs;
+  for (std::size_t i = proc_id; i < keys.size(); i += n_procs) {
+    my_keys.push_back(keys[i]);
+    my_costs.push_back(costs[i]);
+  }
+
+  for (const bool equal_costs : {true, false}) {
+    for (const int n_zones : {1, 2, 3, 4, 7}) {
+      std::vector<bh::MortonKey> expected;
+      bh::compute_costzones(keys, equal_costs ? std::vector<std::uint32_t>{} : costs, n_zones, expected);
+      std::vector<bh::MortonKey> splits;
+      bh::compute_distributed_costzones(my_keys, equal_costs ? std::vector<std::uint32_t>{} : my_costs, n_zones, splits);
+
+      REQUIRE(splits == expected);
+    }
+  }
+}
 
-  std::vector<bh::Body> bodies{bh::Body{p1, 0.25}, bh::Body{p2, 0.25}, bh::Body{p3, 0.25},
-                               bh::Body{p4, 0.25}, bh::Body{p5, 0.25}, bh::Body{p6, 0.25},
-                               bh::Body{p7, 0.25}, bh::Body{p8, 0.25}, bh::Body{p9, 0.25}};
+TEST_CASE("distributed costzones of fewer bodies than processes") {
+  int proc_id;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
 
-  auto bbox1 = Eigen::AlignedBox2d{Eigen::Vector2d{0, 0}, Eigen::Vector2d{5, 5}};
-  auto bbox2 = Eigen::AlignedBox2d{Eigen::Vector2d{5, 0}, Eigen::Vector2d{10, 5}};
-  auto bbox3 = Eigen::AlignedBox2d{Eigen::Vector2d{0, 5}, Eigen::Vector2d{5, 10}};
-  auto bbox4 = Eigen::AlignedBox2d{Eigen::Vector2d{5, 5}, Eigen::Vector2d{10, 10}};
+  std::vector<bh::MortonKey> no_bodies_splits;
+  bh::compute_distributed_costzones({}, {}, 4, no_bodies_splits);
 
-  auto outer_bbox = Eigen::AlignedBox2d{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+  // The first process holds all the bodies
+  const auto keys = make_costzones_keys(2);
+  std::vector<bh::MortonKey> splits;
+  bh::compute_distributed_costzones(proc_id == 0 ? keys : std::vector<bh::MortonKey>{}, {}, 4, splits);
 
-  // blue bodies in the Desmos graph
-  auto bodies_inside_bbox1 = bh::filter_bodies_by_subquadrant(bodies, outer_bbox, bbox1);
+  REQUIRE(no_bodies_splits == std::vector<bh::MortonKey>(3, 0));
+  // Unlike compute_costzones, the last zone may start after the last body, and be empty
+  const bh::MortonKey cell_after_last_key = bh::MortonKey{3} << (2 * (bh::MORTON_KEY_DEPTH - bh::COSTZONES_LEVEL));
+  REQUIRE(splits == std::vector<bh::MortonKey>{keys[1], keys[1], cell_after_last_key});
+}
 
-  // green bodies in the Desmos graph
-  auto bodies_inside_bbox2 = bh::filter_bodies_by_subquadrant(bodies, outer_bbox, bbox2);
+TEST_CASE("distribute the bodies of a step among processes") {
+  std::vector<bh::Body> bodies;
+  for (int i = 0; i < 10; i++) {
+    bodies.push_back({{i, i}, 1});
+  }
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+
+  std::vector<std::uint32_t> all_ids;
+  for (int proc_id = 0; proc_id < 3; proc_id++) {
+    bh::BarnesHutSimulationStep step{bodies, bbox};
+    bh::distribute_bodies(step, proc_id, 3);
+
+    // 10 bodies: the first process holds one more
+    REQUIRE(step.bodies().size() == (proc_id == 0 ? 4 : 3));
+    REQUIRE(step.ids().size() == step.bodies().size());
+    REQUIRE(step.bbox().isApprox(bbox));
+    for (std::size_t i = 0; i < step.bodies().size(); i++) {
+      REQUIRE(step.bodies()[i].m_position == bodies[step.ids()[i]].m_position);
+    }
+    all_ids.insert(all_ids.end(), step.ids().begin(), step.ids().end());
+  }
+
+  std::vector<std::uint32_t> expected_ids(10);
+  std::iota(expected_ids.begin(), expected_ids.end(), 0);
+  REQUIRE(all_ids == expected_ids);
+}
 
-  // orange bodies in the Desmos graph
-  auto bodies_inside_bbox3 = bh::filter_bodies_by_subquadrant(bodies, outer_bbox, bbox3);
+/**
+ * Simulates some bodies for some steps on all the processes, as the MPI simulator does.
+ * @return the bodies of the last step in their initial order, on process 0 only
+ */
+std::vector<bh::Body> simulate(const std::vector<bh::Body>& bodies, int n_steps, bh::Integrator integrator,
+                               bh::Distribution distribution, bh::Exchange exchange = bh::Exchange::BLOCKING) {
+  int proc_id, n_procs;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+  MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+  const auto bbox = bh::compute_square_bounding_box(bodies);
+  bh::BarnesHutSimulationStep step{bodies, bbox};
+  if (distribution == bh::Distribution::DISTRIBUTED) {
+    bh::distribute_bodies(step, proc_id, n_procs);
+  }
+  for (int i = 0; i < n_steps; i++) {
+    step = bh::step(step, 0.01, 1, 0.5, proc_id, n_procs, integrator, distribution, exchange);
+  }
+
+  bh::BarnesHutSimulationStep gathered{std::vector<bh::Body>{}, bbox};
+  if (distribution == bh::Distribution::DISTRIBUTED) {
+    bh::gather_step(step, proc_id, n_procs, gathered);
+  } else {
+    gathered = step;
+  }
+  if (proc_id != 0) {
+    return {};
+  }
+
+  std::vector<bh::Body> last_bodies(gathered.bodies().size());
+  for (std::size_t i = 0; i < gathered.bodies().size(); i++) {
+    last_bodies[gathered.ids()[i]] = gathered.bodies()[i];
+  }
+  return last_bodies;
+}
 
-  // red bodies in the Desmos graph
-  auto bodies_inside_bbox4 = bh::filter_bodies_by_subquadrant(bodies, outer_bbox, bbox4);
+/**
+ * Simulates some bodies for some steps with the Euler integrator on this process only, as the shared-memory
+ * Barnes–Hut simulator does.
+ * @return the bodies of the last step
+ */
+std::vector<bh::Body> simulate_shared_memory(const std::vector<bh::Body>& bodies, int n_steps) {
+  auto last_bodies = bodies;
+  auto bbox = bh::compute_square_bounding_box(bodies);
+  std::vector<bh::Body> new_bodies(bodies.size());
+  for (int i = 0; i < n_steps; i++) {
+    const auto quadtree = bh::construct_linear_quadtree(last_bodies, bbox);
+    for (std::size_t j = 0; j < last_bodies.size(); j++) {
+      new_bodies[j] = bh::update_body(last_bodies[j], quadtree, 0.01, 1, 0.5);
+    }
+    bbox = bh::compute_square_bounding_box(new_bodies);
+    std::swap(last_bodies, new_bodies);
+  }
+  return last_bodies;
+}
 
-  REQUIRE(bodies_inside_bbox1[0].m_position == p1);
+TEST_CASE("The distributed steps are the replicated steps") {
+  int proc_id;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+
+  const auto bodies = make_random_bodies(300);
+  // All the steps are computed before any check, which would leave the other processes waiting if it failed
+  const auto replicated_euler = simulate(bodies, 5, bh::Integrator::EULER, bh::Distribution::REPLICATED);
+  const auto distributed_euler = simulate(bodies, 5, bh::Integrator::EULER, bh::Distribution::DISTRIBUTED);
+  const auto replicated_leapfrog = simulate(bodies, 5, bh::Integrator::LEAPFROG, bh::Distribution::REPLICATED);
+  const auto distributed_leapfrog = simulate(bodies, 5, bh::Integrator::LEAPFROG, bh::Distribution::DISTRIBUTED);
+
+  if (proc_id == 0) {
+    for (const auto& [replicated, distributed] : {std::pair{&replicated_euler, &distributed_euler},
+                                                  std::pair{&replicated_leapfrog, &distributed_leapfrog}}) {
+      REQUIRE(replicated->size() == bodies.size());
+      REQUIRE(distributed->size() == bodies.size());
+      for (std::size_t i = 0; i < bodies.size(); i++) {
+        REQUIRE((*distributed)[i].m_position == (*replicated)[i].m_position);
+        REQUIRE((*distributed)[i].m_velocity == (*replicated)[i].m_velocity);
+        REQUIRE((*distributed)[i].m_mass == (*replicated)[i].m_mass);
+      }
+    }
+  }
+}
 
-  REQUIRE(bodies_inside_bbox2[0].m_position == p2);
-  REQUIRE(bodies_inside_bbox2[1].m_position == p3);
+TEST_CASE("The blocking steps on any number of processes are the shared-memory steps") {
+  int proc_id;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+
+  const auto bodies = make_random_bodies(300);
+  const auto blocking = simulate(bodies, 5, bh::Integrator::EULER, bh::Distribution::REPLICATED);
+
+  if (proc_id == 0) {
+    // The far branches that exchange_quadtree prunes do not change any force
+    const auto shared_memory = simulate_shared_memory(bodies, 5);
+    REQUIRE(blocking.size() == bodies.size());
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      REQUIRE(blocking[i].m_position == shared_memory[i].m_position);
+      REQUIRE(blocking[i].m_velocity == shared_memory[i].m_velocity);
+    }
+  }
+}
 
-  REQUIRE(bodies_inside_bbox3[0].m_position == p4);
-  REQUIRE(bodies_inside_bbox3[1].m_position == p7);
+/**
+ * Relative difference between the changes of some bodies in two simulations.
+ * @param member of the bodies that changed, e.g. their velocity
+ * @return the root mean square of the differences between the bodies of the two simulations, over the one of the
+ * changes of the bodies of the expected simulation
+ */
+double relative_difference(const std::vector<bh::Body>& initial, const std::vector<bh::Body>& expected,
+                           const std::vector<bh::Body>& actual, Eigen::Vector2d bh::Body::*member) {
+  double squared_difference = 0;
+  double squared_change = 0;
+  for (std::size_t i = 0; i < initial.size(); i++) {
+    squared_difference += (actual[i].*member - expected[i].*member).squaredNorm();
+    squared_change += (expected[i].*member - initial[i].*member).squaredNorm();
+  }
+  return std::sqrt(squared_difference / squared_change);
+}
 
-  REQUIRE(bodies_inside_bbox4[0].m_position == p5);
-  REQUIRE(bodies_inside_bbox4[1].m_position == p6);
-  REQUIRE(bodies_inside_bbox4[2].m_position == p8);
-  REQUIRE(bodies_inside_bbox4[3].m_position == p9);
+TEST_CASE("The overlapped steps approximate the blocking steps") {
+  int proc_id, n_procs;
+  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+  MPI_Comm_size(MPI_COMM_WORLD, &n_procs);
+
+  const auto bodies = make_random_bodies(300);
+  const auto blocking_euler = simulate(bodies, 5, bh::Integrator::EULER, bh::Distribution::REPLICATED);
+  const auto overlapped_euler =
+      simulate(bodies, 5, bh::Integrator::EULER, bh::Distribution::REPLICATED, bh::Exchange::OVERLAPPED);
+  const auto blocking_leapfrog = simulate(bodies, 5, bh::Integrator::LEAPFROG, bh::Distribution::DISTRIBUTED);
+  const auto overlapped_leapfrog =
+      simulate(bodies, 5, bh::Integrator::LEAPFROG, bh::Distribution::DISTRIBUTED, bh::Exchange::OVERLAPPED);
+
+  if (proc_id == 0) {
+    for (const auto& [blocking, overlapped] : {std::pair{&blocking_euler, &overlapped_euler},
+                                               std::pair{&blocking_leapfrog, &overlapped_leapfrog}}) {
+      REQUIRE(overlapped->size() == bodies.size());
+      const double velocity_difference = relative_difference(bodies, *blocking, *overlapped, &bh::Body::m_velocity);
+      const double position_difference = relative_difference(bodies, *blocking, *overlapped, &bh::Body::m_position);
+      if (n_procs == 1) {
+        // A single process has a single tree, whose forces are the blocking ones
+        REQUIRE(velocity_difference == 0);
+        REQUIRE(position_difference == 0);
+      } else {
+        // The tree of each process aggregates its own bodies above its cells, which are opened unlike the ones of
+        // the blocking tree: the forces differ by about the error of the approximation, not only by rounding
+        REQUIRE(velocity_difference < 1e-3);
+        REQUIRE(position_difference < 1e-3);
+      }
+    }
+  }
 }
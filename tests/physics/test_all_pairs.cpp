@@ -0,0 +1,33 @@
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+#include "all_pairs.h"
+#include "force.h"
+#include "random_bodies.h"
+
+TEST_CASE("The symmetric all-pairs forces agree with the per-body exact forces") {
+  bh::AllPairsBuffers buffers;
+  std::vector<Eigen::Vector2d> forces;
+
+  // Within a single tile, with an even and an odd number of tiles, with a partial last tile
+  for (const std::size_t n : {std::size_t{0}, std::size_t{1}, std::size_t{2}, bh::ALL_PAIRS_TILE_SIZE,
+                              bh::ALL_PAIRS_TILE_SIZE + 1, 3 * bh::ALL_PAIRS_TILE_SIZE + 5, 4 * bh::ALL_PAIRS_TILE_SIZE}) {
+    auto bodies = make_random_bodies(n);
+    make_last_body_coincide(bodies);
+
+    bh::compute_exact_net_forces(bodies, 1, forces, buffers);
+
+    REQUIRE(forces.size() == n);
+    Eigen::Vector2d total{0, 0};
+    for (std::size_t i = 0; i < n; i++) {
+      const auto expected = bh::compute_exact_net_force_on_body_serial(bodies, bodies[i], 1);
+      const double scale = expected.norm() + 1;
+      REQUIRE(forces[i].x() == Catch::Approx(expected.x()).margin(1e-12 * scale));
+      REQUIRE(forces[i].y() == Catch::Approx(expected.y()).margin(1e-12 * scale));
+      total += forces[i];
+    }
+    // Newton's third law: the internal forces cancel out
+    REQUIRE(total.norm() == Catch::Approx(0).margin(1e-9));
+  }
+}
@@ -0,0 +1,110 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "body_update.h"
+#include "force.h"
+
+/**
+ * Total energy of a set of bodies, kinetic plus potential.
+ */
+double compute_energy(const std::vector<bh::Body>& bodies, double G) {
+  double energy = 0;
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    energy += bodies[i].m_mass * bodies[i].m_velocity.squaredNorm() / 2;
+    for (std::size_t j = i + 1; j < bodies.size(); j++) {
+      energy -= G * bodies[i].m_mass * bodies[j].m_mass / (bodies[i].m_position - bodies[j].m_position).norm();
+    }
+  }
+  return energy;
+}
+
+/**
+ * Integrates the motion of some bodies for a number of steps, with either integrator.
+ */
+std::vector<bh::Body> integrate(std::vector<bh::Body> bodies, double dt, int n_steps, double G, bh::Integrator integrator) {
+  const auto compute_accelerations = [&](const std::vector<bh::Body>& bodies) {
+    std::vector<Eigen::Vector2d> accelerations;
+    for (const auto& body : bodies) {
+      accelerations.emplace_back(bh::compute_exact_net_force_on_body_serial(bodies, body, G) / body.m_mass);
+    }
+    return accelerations;
+  };
+
+  auto accelerations = compute_accelerations(bodies);
+  for (int step = 0; step < n_steps; step++) {
+    if (integrator == bh::Integrator::EULER) {
+      for (std::size_t i = 0; i < bodies.size(); i++) {
+        bodies[i] = bh::update_body(bodies[i], accelerations[i] * bodies[i].m_mass, dt);
+      }
+    } else {
+      for (std::size_t i = 0; i < bodies.size(); i++) {
+        bodies[i] = bh::kick_and_drift(bodies[i], accelerations[i], dt);
+      }
+    }
+    accelerations = compute_accelerations(bodies);
+    if (integrator == bh::Integrator::LEAPFROG) {
+      for (std::size_t i = 0; i < bodies.size(); i++) {
+        bodies[i] = bh::kick(bodies[i], accelerations[i], dt);
+      }
+    }
+  }
+  return bodies;
+}
+
+TEST_CASE("The leapfrog integrator keeps a circular orbit with 10 times larger timesteps than Euler") {
+  const double G = 1;
+  // Two equal bodies at distance 1, orbiting their center of mass
+  const double speed = std::sqrt(G / 2);
+  const std::vector<bh::Body> bodies{{{-0.5, 0}, 1, {0, -speed}}, {{0.5, 0}, 1, {0, speed}}};
+  const double period = M_PI * 0.5 / speed * 2;
+  const double energy = compute_energy(bodies, G);
+
+  const auto euler = integrate(bodies, period / 1000, 1000, G, bh::Integrator::EULER);
+  const auto leapfrog = integrate(bodies, period / 100, 100, G, bh::Integrator::LEAPFROG);
+
+  // After a whole period, the bodies are back at their initial positions
+  const double euler_error = (euler[1].m_position - bodies[1].m_position).norm();
+  const double leapfrog_error = (leapfrog[1].m_position - bodies[1].m_position).norm();
+  REQUIRE(leapfrog_error < euler_error);
+  REQUIRE(leapfrog_error < 0.01);
+
+  const double euler_energy_error = std::abs(compute_energy(euler, G) / energy - 1);
+  const double leapfrog_energy_error = std::abs(compute_energy(leapfrog, G) / energy - 1);
+  REQUIRE(leapfrog_energy_error < euler_energy_error);
+  REQUIRE(leapfrog_energy_error < 1e-3);
+}
+
+TEST_CASE("The leapfrog integrator is time-reversible") {
+  const double G = 1;
+  const std::vector<bh::Body> bodies{{{-0.5, 0}, 1, {0, -0.5}}, {{0.5, 0}, 2, {0.1, 0.3}}, {{0, 1}, 0.5, {-0.2, 0}}};
+
+  auto backwards = integrate(bodies, 0.01, 100, G, bh::Integrator::LEAPFROG);
+  for (auto& body : backwards) {
+    body.m_velocity = -body.m_velocity;
+  }
+  backwards = integrate(backwards, 0.01, 100, G, bh::Integrator::LEAPFROG);
+
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    REQUIRE((backwards[i].m_position - bodies[i].m_position).norm() < 1e-9);
+    REQUIRE((backwards[i].m_velocity + bodies[i].m_velocity).norm() < 1e-9);
+  }
+}
+
+TEST_CASE("The block timestep levels halve the timesteps until they are short enough for the acceleration") {
+  // The timestep allowed is 0.1 * sqrt(1 / 4) = 0.05
+  REQUIRE(bh::compute_timestep_level({0, 4}, 0.05, 1, 0.1, 10) == 0);
+  REQUIRE(bh::compute_timestep_level({0, 4}, 0.1, 1, 0.1, 10) == 1);
+  REQUIRE(bh::compute_timestep_level({0, 4}, 0.11, 1, 0.1, 10) == 2);
+  REQUIRE(bh::compute_timestep_level({0, 4}, 0.75, 1, 0.1, 10) == 4);
+  REQUIRE(bh::compute_timestep_level({0, 4}, 0.75, 1, 0.1, 3) == 3);
+  // Four times the acceleration halves the timestep
+  REQUIRE(bh::compute_timestep_level({16, 0}, 0.75, 1, 0.1, 10) == 5);
+  REQUIRE(bh::compute_timestep_level({0, 0}, 0.75, 1, 0.1, 10) == 0);
+
+  REQUIRE_THROWS_AS(bh::compute_timestep_level({0, 4}, 0.1, 0, 0.1, 10), std::invalid_argument);
+  REQUIRE_THROWS_AS(bh::compute_timestep_level({0, 4}, 0.1, 1, 0, 10), std::invalid_argument);
+  REQUIRE_THROWS_AS(bh::compute_timestep_level({0, 4}, 0.1, 1, 0.1, -1), std::invalid_argument);
+  REQUIRE_THROWS_AS(bh::compute_timestep_level({0, 4}, 0.1, 1, 0.1, bh::MAX_TIMESTEP_LEVEL + 1), std::invalid_argument);
+}
@@ -0,0 +1,59 @@
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <vector>
+
+#include "all_pairs.h"
+#include "dual_tree.h"
+#include "force.h"
+#include "linear_quadtree.h"
+#include "random_bodies.h"
+
+TEST_CASE("The dual-tree forces are as accurate as the per-body walk ones, with fewer approximated interactions") {
+  auto bodies = make_random_bodies(5000);
+  make_last_body_coincide(bodies);
+
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  std::vector<Eigen::Vector2d> exact_forces;
+  bh::compute_exact_net_forces(bodies, 1, exact_forces);
+
+  bh::DualTreeBuffers buffers;
+  std::vector<Eigen::Vector2d> forces;
+  for (const int leaf_size : {1, 8}) {
+    const auto quadtree = bh::construct_linear_quadtree(bodies, bbox, 0, leaf_size);
+
+    const auto counts = bh::compute_dual_tree_net_forces(quadtree, bodies, 1, 0.5, forces, buffers);
+    REQUIRE(forces.size() == bodies.size());
+    double dual_tree_error = 0;
+    double walk_error = 0;
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      const double scale = exact_forces[i].norm();
+      dual_tree_error += (forces[i] - exact_forces[i]).norm() / scale;
+      walk_error += (bh::compute_approximate_net_force_on_body(quadtree, bodies[i], 1, 0.5) - exact_forces[i]).norm() / scale;
+    }
+    REQUIRE(dual_tree_error / bodies.size() < 0.01);
+    REQUIRE(dual_tree_error < 2 * walk_error);
+
+    const auto walk_counts = bh::count_interactions(quadtree, bodies, 0.5);
+    REQUIRE(counts.m_approximated > 0);
+    REQUIRE(counts.m_approximated < walk_counts.m_approximated);
+
+    // With omega = 0 no pair of nodes is well separated: all the forces are summed body by body
+    const auto exact_counts = bh::compute_dual_tree_net_forces(quadtree, bodies, 1, 0, forces, buffers);
+    REQUIRE(exact_counts.m_approximated == 0);
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      const double scale = exact_forces[i].norm() + 1;
+      REQUIRE(forces[i].x() == Catch::Approx(exact_forces[i].x()).margin(1e-12 * scale));
+      REQUIRE(forces[i].y() == Catch::Approx(exact_forces[i].y()).margin(1e-12 * scale));
+    }
+  }
+}
+
+TEST_CASE("The dual-tree forces cannot be computed on bodies outside of the quadtree") {
+  const std::vector<bh::Body> bodies{{{1, 1}, 1}, {{7, 7}, 1}, {{3, 8}, 1}};
+  const auto quadtree = bh::construct_linear_quadtree(bodies, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}});
+  bh::DualTreeBuffers buffers;
+  std::vector<Eigen::Vector2d> forces;
+
+  REQUIRE_THROWS_AS(bh::compute_dual_tree_net_forces(quadtree, {{{1, 1}, 1}, {{5, -1}, 1}}, 1, 0.5, forces, buffers), std::invalid_argument);
+}
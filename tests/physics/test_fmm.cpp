@@ -0,0 +1,69 @@
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <vector>
+
+#include "all_pairs.h"
+#include "fmm.h"
+#include "linear_quadtree.h"
+#include "random_bodies.h"
+
+/**
+ * Computes the largest error of some forces, relative to the largest exact force.
+ */
+double compute_max_relative_error(const std::vector<Eigen::Vector2d>& forces, const std::vector<Eigen::Vector2d>& exact_forces) {
+  double max_error = 0;
+  double max_force = 0;
+  for (std::size_t i = 0; i < forces.size(); i++) {
+    max_error = std::max(max_error, (forces[i] - exact_forces[i]).norm());
+    max_force = std::max(max_force, exact_forces[i].norm());
+  }
+  return max_error / max_force;
+}
+
+TEST_CASE("The order of the FMM expansions must be in range") {
+  REQUIRE_THROWS_AS(bh::FmmSolver(0), std::invalid_argument);
+  REQUIRE_THROWS_AS(bh::FmmSolver(bh::FmmSolver::MAX_ORDER + 1), std::invalid_argument);
+  REQUIRE(bh::FmmSolver().order() == bh::FmmSolver::DEFAULT_ORDER);
+}
+
+TEST_CASE("The FMM forces cannot be computed on bodies outside of the quadtree") {
+  const std::vector<bh::Body> bodies{{{1, 1}, 1}, {{7, 7}, 1}, {{3, 8}, 1}};
+  const auto quadtree = bh::construct_linear_quadtree(bodies, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}});
+  std::vector<Eigen::Vector2d> forces;
+
+  bh::FmmSolver solver;
+  REQUIRE_THROWS_AS(solver.compute_net_forces(quadtree, {{{1, 1}, 1}, {{11, 5}, 1}}, 1, 0.5, forces), std::invalid_argument);
+}
+
+TEST_CASE("The FMM forces converge to the exact ones as the order increases") {
+  auto bodies = make_random_bodies(2000);
+  make_last_body_coincide(bodies);
+
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  std::vector<Eigen::Vector2d> exact_forces;
+  bh::compute_exact_net_forces(bodies, 1, exact_forces);
+
+  for (const int leaf_size : {1, 8}) {
+    const auto quadtree = bh::construct_linear_quadtree(bodies, bbox, 0, leaf_size);
+    std::vector<Eigen::Vector2d> forces;
+
+    double last_error = 1;
+    for (const int order : {2, 4, 8}) {
+      bh::FmmSolver solver{order};
+      solver.compute_net_forces(quadtree, bodies, 1, 0.5, forces);
+      REQUIRE(forces.size() == bodies.size());
+      REQUIRE(solver.n_m2l() > 0);
+      const double error = compute_max_relative_error(forces, exact_forces);
+      REQUIRE(error < last_error);
+      last_error = error;
+    }
+    REQUIRE(last_error < 1e-6);
+
+    // With theta = 0 no node is well separated: all the forces are summed body by body
+    bh::FmmSolver solver;
+    solver.compute_net_forces(quadtree, bodies, 1, 0, forces);
+    REQUIRE(solver.n_m2l() == 0);
+    REQUIRE(compute_max_relative_error(forces, exact_forces) == Catch::Approx(0).margin(1e-12));
+  }
+}
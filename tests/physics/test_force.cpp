@@ -1,8 +1,13 @@
 #include <catch2/catch_approx.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>
 #include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include "force.h"
+#include "random_bodies.h"
 
 SCENARIO("Compute gravitational force, uncommon cases") {
   GIVEN("A single body") {
@@ -101,3 +106,171 @@ SCENARIO("Compute gravitational force, common cases") {
     }
   }
 }
+
+TEST_CASE("Compute approximate net force with a linear quadtree") {
+  const std::vector<bh::Body> bodies{{{0, 0}, 0.25}, {{2, 2}, 0.5}, {{4, 1}, 0.75}, {{6, 6}, 1}, {{8, 3}, 1.25}, {{10, 10}, 1.5}, {{1, 9}, 1.75}};
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+
+  bh::Node node{bbox.min(), bbox.max()};
+  for (const auto& body : bodies) {
+    node.insert(body);
+  }
+  const auto quadtree = bh::construct_linear_quadtree(bodies, bbox);
+
+  for (const double omega : {0.0, 0.5, 1.0, 2.0}) {
+    for (const auto& body : bodies) {
+      const auto expected = bh::compute_approximate_net_force_on_body(node, body, 1, omega);
+      const auto force = bh::compute_approximate_net_force_on_body(quadtree, body, 1, omega);
+
+      // The same nodes are approximated, but their forces are summed in a different order
+      REQUIRE(force.x() == Catch::Approx(expected.x()));
+      REQUIRE(force.y() == Catch::Approx(expected.y()));
+    }
+  }
+}
+
+TEST_CASE("Compute approximate net force with a bucketed linear quadtree") {
+  const std::vector<bh::Body> bodies{{{0, 0}, 0.25}, {{2, 2}, 0.5}, {{4, 1}, 0.75}, {{6, 6}, 1}, {{8, 3}, 1.25}, {{10, 10}, 1.5}, {{1, 9}, 1.75}};
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+
+  for (const int leaf_size : {2, 4, 8}) {
+    const auto quadtree = bh::construct_linear_quadtree(bodies, bbox, 0, leaf_size);
+
+    // Without approximations, the buckets are visited body by body
+    for (const auto& body : bodies) {
+      const auto expected = bh::compute_exact_net_force_on_body_serial(bodies, body, 1);
+      const auto force = bh::compute_approximate_net_force_on_body(quadtree, body, 1, 0);
+
+      REQUIRE(force.x() == Catch::Approx(expected.x()));
+      REQUIRE(force.y() == Catch::Approx(expected.y()));
+    }
+  }
+}
+
+TEST_CASE("Quadrupole moments reduce the error of the approximate net force") {
+  const auto bodies = make_random_bodies(1000);
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  auto quadtree = bh::construct_linear_quadtree(bodies, bbox);
+
+  const auto relative_error = [&](const bh::LinearQuadtree& quadtree) {
+    double error = 0;
+    for (const auto& body : bodies) {
+      const auto expected = bh::compute_exact_net_force_on_body_serial(bodies, body, 1);
+      const auto force = bh::compute_approximate_net_force_on_body(quadtree, body, 1, 0.7);
+      error += (force - expected).norm() / expected.norm();
+    }
+    return error / static_cast<double>(bodies.size());
+  };
+
+  const double monopole_error = relative_error(quadtree);
+  bh::compute_quadrupoles(quadtree);
+  const double quadrupole_error = relative_error(quadtree);
+
+  REQUIRE(quadrupole_error < monopole_error / 2);
+}
+
+TEST_CASE("Compute approximate net forces by groups of bodies") {
+  const auto bodies = make_random_bodies(2000);
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  auto quadtree = bh::construct_linear_quadtree(bodies, bbox, 0, 4);
+
+  bh::GroupWalkBuffers buffers;
+  std::vector<Eigen::Vector2d> forces;
+
+  SECTION("Without approximations, the forces are exact") {
+    for (const int group_size : {1, 7, 32}) {
+      bh::compute_approximate_net_forces(quadtree, bodies, 1, 0, group_size, forces, buffers);
+      REQUIRE(forces.size() == bodies.size());
+      for (std::size_t i = 0; i < bodies.size(); i++) {
+        const auto expected = bh::compute_exact_net_force_on_body_serial(bodies, bodies[i], 1);
+        REQUIRE(forces[i].x() == Catch::Approx(expected.x()));
+        REQUIRE(forces[i].y() == Catch::Approx(expected.y()));
+      }
+    }
+  }
+
+  SECTION("A group approximates a node only if each of its bodies would") {
+    for (const bool quadrupoles : {false, true}) {
+      if (quadrupoles) {
+        bh::compute_quadrupoles(quadtree);
+      }
+      bh::compute_approximate_net_forces(quadtree, bodies, 1, 0.7, 32, forces, buffers);
+
+      double group_error = 0;
+      double body_error = 0;
+      for (std::size_t i = 0; i < bodies.size(); i++) {
+        const auto expected = bh::compute_exact_net_force_on_body_serial(bodies, bodies[i], 1);
+        const auto force = bh::compute_approximate_net_force_on_body(quadtree, bodies[i], 1, 0.7);
+        group_error += (forces[i] - expected).norm() / expected.norm();
+        body_error += (force - expected).norm() / expected.norm();
+      }
+      REQUIRE(group_error <= body_error);
+      REQUIRE(group_error / static_cast<double>(bodies.size()) < 0.05);
+    }
+  }
+
+  REQUIRE_THROWS(bh::compute_approximate_net_forces(quadtree, bodies, 1, 0.5, 0, forces, buffers));
+}
+
+TEST_CASE("Opening criteria") {
+  const auto bodies = make_random_bodies(2000);
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  auto quadtree = bh::construct_linear_quadtree(bodies, bbox, 0, 4);
+
+  std::vector<Eigen::Vector2d> exact_forces(bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    exact_forces[i] = bh::compute_exact_net_force_on_body_serial(bodies, bodies[i], 1);
+  }
+  // Mean and largest error relative to the exact forces
+  const auto errors = [&](const std::vector<double>& opening_scales) {
+    double mean = 0;
+    double max = 0;
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      const double scale = opening_scales.empty() ? 1 : opening_scales[i];
+      const auto force = bh::compute_approximate_net_force_on_body(quadtree, bodies[i], 1, 0.5, scale);
+      const double error = (force - exact_forces[i]).norm() / exact_forces[i].norm();
+      mean += error / static_cast<double>(bodies.size());
+      max = std::max(max, error);
+    }
+    return std::make_pair(mean, max);
+  };
+
+  const auto [length_mean, length_max] = errors({});
+
+  SECTION("The geometric criterion is the default test on the length of the nodes") {
+    bh::compute_opening_radii(quadtree, bh::OpeningCriterion::GEOMETRIC, 0.5, 1);
+    const auto [mean, max] = errors({});
+    REQUIRE(mean == Catch::Approx(length_mean));
+    REQUIRE(max == Catch::Approx(length_max));
+  }
+
+  SECTION("The bmax criterion opens the nodes whose center of mass is off-center") {
+    // Since bmax is at least l / sqrt(2), at theta / sqrt(2) every node opened by the geometric criterion is opened,
+    // and so are the ones whose center of mass is far from the center of their cell
+    bh::compute_opening_radii(quadtree, bh::OpeningCriterion::BMAX, 0.5 / std::sqrt(2), 1);
+    REQUIRE(errors({}).first < length_mean);
+  }
+
+  SECTION("The relative force criterion bounds the errors relative to the accelerations") {
+    std::vector<double> opening_scales(bodies.size());
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      opening_scales[i] = bh::compute_relative_opening_scale(exact_forces[i] / bodies[i].m_mass);
+    }
+    bh::compute_opening_radii(quadtree, bh::OpeningCriterion::RELATIVE_FORCE, 0.5, 1, 0.001);
+    const double mean = errors(opening_scales).first;
+    REQUIRE(mean < 0.01);
+
+    // The groups use the largest opening scale of their bodies, i.e. the strictest criterion
+    bh::GroupWalkBuffers buffers;
+    std::vector<Eigen::Vector2d> forces;
+    bh::compute_approximate_net_forces(quadtree, bodies, 1, 0.5, 16, forces, buffers, opening_scales);
+    double group_mean = 0;
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      group_mean += (forces[i] - exact_forces[i]).norm() / exact_forces[i].norm() / static_cast<double>(bodies.size());
+    }
+    REQUIRE(group_mean <= mean);
+  }
+
+  REQUIRE_THROWS_AS(bh::compute_opening_radii(quadtree, bh::OpeningCriterion::BMAX, -1, 1), std::invalid_argument);
+  REQUIRE_THROWS_AS(bh::compute_opening_radii(quadtree, bh::OpeningCriterion::RELATIVE_FORCE, 0.5, 1, 0), std::invalid_argument);
+}
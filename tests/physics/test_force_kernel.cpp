@@ -0,0 +1,78 @@
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+#include "force.h"
+#include "force_kernel.h"
+#include "random_bodies.h"
+#include "soa_bodies.h"
+
+TEST_CASE("The SIMD force kernels agree with the scalar one") {
+  auto bodies = make_random_bodies(1003);
+  make_last_body_coincide(bodies);
+
+  REQUIRE(bh::is_simd_isa_supported(bh::detect_simd_isa()));
+
+  for (const auto isa : {bh::SimdIsa::SCALAR, bh::SimdIsa::SSE2, bh::SimdIsa::AVX2, bh::SimdIsa::AVX512}) {
+    if (!bh::is_simd_isa_supported(isa)) {
+      continue;
+    }
+    // Sizes that leave every possible remainder to the scalar loop
+    for (const std::size_t n : {std::size_t{0}, std::size_t{1}, std::size_t{7}, std::size_t{8}, std::size_t{9}, bodies.size()}) {
+      for (const auto& body : {bodies[0], bodies[COINCIDING_BODY], bodies[500]}) {
+        Eigen::Vector2d expected{0, 0};
+        for (std::size_t i = 0; i < n; i++) {
+          expected += bh::compute_gravitational_force(bodies[i], body, 1);
+        }
+        const auto force = bh::compute_net_force_kernel(bodies.data(), n, body, 1, isa);
+
+        const double scale = expected.norm() + 1;
+        REQUIRE(force.x() == Catch::Approx(expected.x()).margin(1e-12 * scale));
+        REQUIRE(force.y() == Catch::Approx(expected.y()).margin(1e-12 * scale));
+      }
+    }
+  }
+}
+
+TEST_CASE("The parallel and serial exact net forces use the same kernel") {
+  const auto bodies = make_random_bodies(5000, 42, 30);
+
+  for (const auto& body : {bodies[0], bodies[4999]}) {
+    const auto serial = bh::compute_exact_net_force_on_body_serial(bodies, body, 1);
+    const auto parallel = bh::compute_exact_net_force_on_body_parallel(bodies, body, 1);
+
+    REQUIRE(parallel.x() == Catch::Approx(serial.x()));
+    REQUIRE(parallel.y() == Catch::Approx(serial.y()));
+  }
+}
+
+TEST_CASE("The SIMD mutual force kernels agree with the scalar one") {
+  const std::size_t n = 19;
+  const auto soa_bodies = bh::to_soa(make_random_bodies(n));
+  const auto& xs = soa_bodies.m_x;
+  const auto& ys = soa_bodies.m_y;
+  const auto& masses = soa_bodies.m_mass;
+  const bh::Body body{{xs[3], ys[3]}, 2};
+
+  const std::vector<double> initial_forces(n, 1);
+  for (const auto isa : {bh::SimdIsa::SCALAR, bh::SimdIsa::SSE2, bh::SimdIsa::AVX2, bh::SimdIsa::AVX512}) {
+    if (!bh::is_simd_isa_supported(isa)) {
+      continue;
+    }
+    auto fx = initial_forces;
+    auto fy = initial_forces;
+    const auto force = bh::compute_mutual_forces_kernel(body.m_position.x(), body.m_position.y(), body.m_mass,
+                                                        xs.data(), ys.data(), masses.data(), n, 1, fx.data(), fy.data(), isa);
+
+    Eigen::Vector2d expected{0, 0};
+    for (std::size_t j = 0; j < n; j++) {
+      const auto pair_force = bh::compute_gravitational_force({{xs[j], ys[j]}, masses[j]}, body, 1);
+      expected += pair_force;
+      // The body exerts the opposite force on each body of the range
+      REQUIRE(fx[j] == Catch::Approx(1 - pair_force.x()));
+      REQUIRE(fy[j] == Catch::Approx(1 - pair_force.y()));
+    }
+    REQUIRE(force.x() == Catch::Approx(expected.x()));
+    REQUIRE(force.y() == Catch::Approx(expected.y()));
+  }
+}
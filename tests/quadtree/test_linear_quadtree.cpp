@@ -0,0 +1,233 @@
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <vector>
+
+#include "linear_quadtree.h"
+#include "random_bodies.h"
+
+/**
+ * Checks that a linear quadtree has the same structure and aggregates of a pointer-based quadtree.
+ */
+void require_same_quadtree(const bh::LinearQuadtree& quadtree, bh::LinearQuadtree::Index idx, const bh::Node& node) {
+  const auto& linear_node = quadtree.nodes()[idx];
+
+  REQUIRE(static_cast<int>(linear_node.m_n_nodes) == node.n_nodes());
+  REQUIRE(linear_node.m_center_of_mass == node.center_of_mass());
+  REQUIRE(linear_node.m_total_mass == node.total_mass());
+  REQUIRE(linear_node.m_length == node.bbox().sizes().x());
+
+  if (const auto* leaf = std::get_if<bh::Node::Leaf>(&node.data())) {
+    REQUIRE(quadtree.is_leaf(idx));
+    REQUIRE(linear_node.m_n_bodies == (leaf->m_body.has_value() ? 1 : 0));
+    if (leaf->m_body.has_value()) {
+      REQUIRE(quadtree.bodies()[linear_node.m_first_body].m_position == leaf->m_body->m_position);
+      REQUIRE(quadtree.bodies()[linear_node.m_first_body].m_mass == leaf->m_body->m_mass);
+    }
+  } else {
+    const auto& fork = std::get<bh::Node::Fork>(node.data());
+    REQUIRE_FALSE(quadtree.is_leaf(idx));
+    const auto [nw, ne, se, sw] = quadtree.children(idx);
+    require_same_quadtree(quadtree, nw, *fork.m_nw);
+    require_same_quadtree(quadtree, ne, *fork.m_ne);
+    require_same_quadtree(quadtree, se, *fork.m_se);
+    require_same_quadtree(quadtree, sw, *fork.m_sw);
+  }
+}
+
+SCENARIO("Construct a linear quadtree") {
+  GIVEN("No bodies") {
+    const auto quadtree = bh::construct_linear_quadtree({}, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}});
+
+    THEN("The quadtree is made of an empty leaf") {
+      REQUIRE(quadtree.n_nodes() == 1);
+      REQUIRE(quadtree.is_leaf(bh::LinearQuadtree::ROOT));
+      REQUIRE(quadtree.nodes()[bh::LinearQuadtree::ROOT].m_n_bodies == 0);
+      REQUIRE(quadtree.nodes()[bh::LinearQuadtree::ROOT].m_total_mass == 0);
+      REQUIRE(quadtree.bodies().empty());
+    }
+  }
+
+  GIVEN("A body outside of the bounding box") {
+    const std::vector<bh::Body> bodies{{{1, 1}, 1}, {{-2, 12}, 1}};
+
+    THEN("An error is thrown") {
+      REQUIRE_THROWS(bh::construct_linear_quadtree(bodies, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}}));
+    }
+  }
+
+  // https://www.desmos.com/calculator/wpyi6tikb2?lang=it
+  GIVEN("Some bodies on the diagonal of the bounding box") {
+    const std::vector<bh::Body> bodies{{{0, 0}, 0.25}, {{2, 2}, 0.25}, {{4, 4}, 0.25}, {{6, 6}, 0.25}, {{8, 8}, 0.25}, {{10, 10}, 0.25}};
+    const auto quadtree = bh::construct_linear_quadtree(bodies, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}});
+
+    THEN("The nodes are stored in depth-first order") {
+      REQUIRE(quadtree.n_nodes() == 21);
+      REQUIRE(quadtree.children(0) == std::array<bh::LinearQuadtree::Index, 4>{1, 2, 11, 12});
+      REQUIRE(quadtree.children(2) == std::array<bh::LinearQuadtree::Index, 4>{3, 4, 9, 10});
+      REQUIRE(quadtree.children(4) == std::array<bh::LinearQuadtree::Index, 4>{5, 6, 7, 8});
+      REQUIRE(quadtree.children(12) == std::array<bh::LinearQuadtree::Index, 4>{13, 14, 15, 16});
+      REQUIRE(quadtree.children(16) == std::array<bh::LinearQuadtree::Index, 4>{17, 18, 19, 20});
+      REQUIRE(quadtree.bodies().size() == bodies.size());
+    }
+  }
+
+  GIVEN("Some bodies that coincide") {
+    const std::vector<bh::Body> bodies{{{1, 1}, 0.5}, {{7, 7}, 1}, {{1, 1}, 1.5}};
+    const auto quadtree = bh::construct_linear_quadtree(bodies, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}});
+
+    THEN("They are merged in a single body") {
+      REQUIRE(quadtree.n_nodes() == 5);
+      REQUIRE(quadtree.bodies().size() == 2);
+      const auto sw = quadtree.children(bh::LinearQuadtree::ROOT)[3];
+      REQUIRE(quadtree.bodies()[quadtree.nodes()[sw].m_first_body].m_mass == 2);
+    }
+  }
+}
+
+TEST_CASE("A linear quadtree has the same structure of a pointer-based quadtree") {
+  auto bodies = make_random_bodies(500, 42, 30);
+  // also some coinciding bodies
+  bodies.push_back({bodies[10].m_position, 2});
+  bodies.push_back({bodies[10].m_position, 3});
+  // and some bodies closer than the resolution of a Morton key
+  bodies.push_back({bodies[20].m_position + Eigen::Vector2d{1e-12, 0}, 1});
+  bodies.push_back({bodies[20].m_position - Eigen::Vector2d{0, 1e-12}, 1});
+
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  bh::Node node{bbox.min(), bbox.max()};
+  for (const auto& body : bodies) {
+    node.insert(body);
+  }
+
+  const auto quadtree = bh::construct_linear_quadtree(bodies, bbox);
+  REQUIRE(quadtree.n_nodes() == node.n_nodes());
+  require_same_quadtree(quadtree, bh::LinearQuadtree::ROOT, node);
+
+  const auto flattened = bh::flatten_quadtree(node);
+  REQUIRE(flattened.n_nodes() == node.n_nodes());
+  require_same_quadtree(flattened, bh::LinearQuadtree::ROOT, node);
+}
+
+TEST_CASE("Building a linear quadtree in parallel produces the same quadtree") {
+  auto bodies = make_random_bodies(20000);
+  bodies.push_back({bodies[10].m_position, 2});
+  bodies.push_back({bodies[20].m_position + Eigen::Vector2d{1e-12, 0}, 1});
+
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  const auto serial = bh::construct_linear_quadtree(bodies, bbox, 0);
+
+  for (const int parallel_depth : {1, 2, 3, 5, 12}) {
+    const auto parallel = bh::construct_linear_quadtree(bodies, bbox, parallel_depth);
+
+    REQUIRE(parallel.n_nodes() == serial.n_nodes());
+    for (int i = 0; i < serial.n_nodes(); i++) {
+      REQUIRE(parallel.nodes()[i].m_center_of_mass == serial.nodes()[i].m_center_of_mass);
+      REQUIRE(parallel.nodes()[i].m_total_mass == serial.nodes()[i].m_total_mass);
+      REQUIRE(parallel.nodes()[i].m_length == serial.nodes()[i].m_length);
+      REQUIRE(parallel.nodes()[i].m_n_nodes == serial.nodes()[i].m_n_nodes);
+      REQUIRE(parallel.nodes()[i].m_first_body == serial.nodes()[i].m_first_body);
+      REQUIRE(parallel.nodes()[i].m_n_bodies == serial.nodes()[i].m_n_bodies);
+    }
+    REQUIRE(parallel.bodies().size() == serial.bodies().size());
+    for (std::size_t i = 0; i < serial.bodies().size(); i++) {
+      REQUIRE(parallel.bodies()[i].m_position == serial.bodies()[i].m_position);
+      REQUIRE(parallel.bodies()[i].m_mass == serial.bodies()[i].m_mass);
+    }
+  }
+
+  REQUIRE_THROWS(bh::construct_linear_quadtree(bodies, bbox, -1));
+}
+
+TEST_CASE("Construct a linear quadtree with bucketed leaves") {
+  const auto bodies = make_random_bodies(20000);
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  const auto unbucketed = bh::construct_linear_quadtree(bodies, bbox, 0);
+
+  for (const int leaf_size : {2, 8, 32}) {
+    const auto quadtree = bh::construct_linear_quadtree(bodies, bbox, 0, leaf_size);
+
+    REQUIRE(quadtree.n_nodes() < unbucketed.n_nodes());
+    REQUIRE(quadtree.bodies().size() == bodies.size());
+    REQUIRE(quadtree.nodes()[bh::LinearQuadtree::ROOT].m_total_mass == Catch::Approx(unbucketed.nodes()[bh::LinearQuadtree::ROOT].m_total_mass));
+    for (int i = 0; i < quadtree.n_nodes(); i++) {
+      const auto& node = quadtree.nodes()[i];
+      if (quadtree.is_leaf(i)) {
+        REQUIRE(node.m_n_bodies <= static_cast<bh::LinearQuadtree::Index>(leaf_size));
+      } else {
+        // a fork would have been a leaf, had it contained fewer bodies
+        const auto n_bodies = quadtree.nodes()[i + node.m_n_nodes - 1].m_first_body + quadtree.nodes()[i + node.m_n_nodes - 1].m_n_bodies - node.m_first_body;
+        REQUIRE(n_bodies > static_cast<bh::LinearQuadtree::Index>(leaf_size));
+      }
+    }
+
+    for (const int parallel_depth : {2, 5}) {
+      const auto parallel = bh::construct_linear_quadtree(bodies, bbox, parallel_depth, leaf_size);
+      REQUIRE(parallel.n_nodes() == quadtree.n_nodes());
+      for (int i = 0; i < quadtree.n_nodes(); i++) {
+        REQUIRE(parallel.nodes()[i].m_center_of_mass == quadtree.nodes()[i].m_center_of_mass);
+        REQUIRE(parallel.nodes()[i].m_n_bodies == quadtree.nodes()[i].m_n_bodies);
+      }
+    }
+  }
+
+  SECTION("More coinciding bodies than the leaf size are merged in a single body") {
+    const std::vector<bh::Body> coinciding{{{1, 1}, 1}, {{1, 1}, 1}, {{1, 1}, 1}, {{7, 7}, 1}};
+    const auto quadtree = bh::construct_linear_quadtree(coinciding, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}}, 0, 2);
+    REQUIRE(quadtree.n_nodes() == 5);
+    REQUIRE(quadtree.bodies().size() == 2);
+  }
+
+  REQUIRE_THROWS(bh::construct_linear_quadtree(bodies, bbox, 0, 0));
+}
+
+TEST_CASE("Find the leaf of a position in a linear quadtree") {
+  const std::vector<bh::Body> bodies{{{1, 1}, 1}, {{7, 7}, 1}, {{3, 8}, 1}};
+  const auto quadtree = bh::construct_linear_quadtree(bodies, {Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}});
+  std::vector<Eigen::AlignedBox2d> cells;
+  bh::compute_cells(quadtree, cells);
+
+  const auto [nw, ne, se, sw] = quadtree.children(bh::LinearQuadtree::ROOT);
+  REQUIRE(bh::find_leaf(quadtree, cells, {2, 9}) == nw);
+  REQUIRE(bh::find_leaf(quadtree, cells, {9, 9}) == ne);
+  REQUIRE(bh::find_leaf(quadtree, cells, {9, 1}) == se);
+  REQUIRE(bh::find_leaf(quadtree, cells, {1, 1}) == sw);
+  REQUIRE_THROWS_AS(bh::find_leaf(quadtree, cells, {-1, 5}), std::invalid_argument);
+  REQUIRE_THROWS_AS(bh::find_leaf(quadtree, cells, {5, 11}), std::invalid_argument);
+}
+
+TEST_CASE("Compute the quadrupole moments of a linear quadtree") {
+  const auto bodies = make_random_bodies(2000);
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+
+  for (const int leaf_size : {1, 8}) {
+    auto quadtree = bh::construct_linear_quadtree(bodies, bbox, 0, leaf_size);
+    REQUIRE(quadtree.quadrupoles().empty());
+
+    bh::compute_quadrupoles(quadtree);
+    REQUIRE(quadtree.quadrupoles().size() == quadtree.nodes().size());
+
+    // The bodies of a node are the ones of its leaves, stored contiguously
+    for (int i = 0; i < quadtree.n_nodes(); i++) {
+      const auto& node = quadtree.nodes()[i];
+      const auto& last = quadtree.nodes()[i + node.m_n_nodes - 1];
+      bh::LinearQuadtree::Quadrupole expected{0, 0, 0};
+      for (auto j = node.m_first_body; j < last.m_first_body + last.m_n_bodies; j++) {
+        const auto& body = quadtree.bodies()[j];
+        const Eigen::Vector2d d = body.m_position - node.m_center_of_mass;
+        expected.m_xx += body.m_mass * (3 * d.x() * d.x() - d.squaredNorm());
+        expected.m_xy += body.m_mass * (3 * d.x() * d.y());
+        expected.m_yy += body.m_mass * (3 * d.y() * d.y() - d.squaredNorm());
+      }
+
+      const auto& quadrupole = quadtree.quadrupoles()[i];
+      const double scale = node.m_total_mass * node.m_length * node.m_length;
+      REQUIRE(quadrupole.m_xx == Catch::Approx(expected.m_xx).margin(1e-9 * scale));
+      REQUIRE(quadrupole.m_xy == Catch::Approx(expected.m_xy).margin(1e-9 * scale));
+      REQUIRE(quadrupole.m_yy == Catch::Approx(expected.m_yy).margin(1e-9 * scale));
+    }
+
+    quadtree.clear(bbox);
+    REQUIRE(quadtree.quadrupoles().empty());
+  }
+}
@@ -0,0 +1,144 @@
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "morton.h"
+
+SCENARIO("Compute Morton keys") {
+  GIVEN("A bounding box") {
+    const Eigen::AlignedBox2d bbox{Eigen::Vector2d{0, 0}, Eigen::Vector2d{10, 10}};
+
+    THEN("The first digits of a key are the subquadrants containing the point") {
+      const auto key = bh::compute_morton_key(bbox, {2, 8});
+
+      REQUIRE(bh::get_morton_subquadrant(key, 0) == bh::Node::NW);
+      REQUIRE(bh::get_morton_subquadrant(key, 1) == bh::Node::NW);
+      REQUIRE(bh::get_morton_subquadrant(key, 2) == bh::Node::SE);
+    }
+
+    THEN("Keys are ordered as the subquadrants are visited") {
+      const auto nw = bh::compute_morton_key(bbox, {1, 9});
+      const auto ne = bh::compute_morton_key(bbox, {9, 9});
+      const auto se = bh::compute_morton_key(bbox, {9, 1});
+      const auto sw = bh::compute_morton_key(bbox, {1, 1});
+
+      REQUIRE(nw < ne);
+      REQUIRE(ne < se);
+      REQUIRE(se < sw);
+    }
+
+    THEN("Points on the center belong to the NE subquadrant") {
+      const auto key = bh::compute_morton_key(bbox, {5, 5});
+
+      REQUIRE(bh::get_morton_subquadrant(key, 0) == bh::Node::NE);
+    }
+  }
+}
+
+TEST_CASE("Radix sort is a stable sort") {
+  std::mt19937_64 gen(42);
+  for (const std::size_t n : {0, 1, 1000, 100000}) {
+    std::vector<bh::MortonKey> keys(n);
+    // few distinct keys spanning all the digits, so that many keys are equal
+    std::uniform_int_distribution<int> pick(0, 63);
+    std::vector<bh::MortonKey> distinct(64);
+    std::generate(distinct.begin(), distinct.end(), gen);
+    std::generate(keys.begin(), keys.end(), [&] { return distinct[pick(gen)]; });
+
+    std::vector<std::uint32_t> values(n);
+    std::iota(values.begin(), values.end(), 0);
+
+    std::vector<std::pair<bh::MortonKey, std::uint32_t>> expected(n);
+    for (std::size_t i = 0; i < n; i++) {
+      expected[i] = {keys[i], values[i]};
+    }
+    std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    bh::radix_sort(keys, values);
+
+    for (std::size_t i = 0; i < n; i++) {
+      REQUIRE(keys[i] == expected[i].first);
+      REQUIRE(values[i] == expected[i].second);
+    }
+  }
+}
+
+TEST_CASE("Morton keys select the same subquadrants of a quadtree") {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> position(-3.7, 12.1);
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-3.7, -3.7}, Eigen::Vector2d{12.1, 12.1}};
+
+  for (int i = 0; i < 1000; i++) {
+    const Eigen::Vector2d point{position(gen), position(gen)};
+    const auto key = bh::compute_morton_key(bbox, point);
+
+    auto box = bbox;
+    for (int level = 0; level < bh::MORTON_KEY_DEPTH; level++) {
+      const auto sq = bh::Node::get_subquadrant(box, point);
+      REQUIRE(bh::get_morton_subquadrant(key, level) == sq);
+      box = bh::Node::get_subquadrant_bbox(box, sq);
+    }
+  }
+}
+
+TEST_CASE("The cells covering a range of Morton keys are the largest ones in it") {
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<bh::MortonKey> key;
+
+  for (int i = 0; i < 100; i++) {
+    auto first_key = key(gen);
+    auto last_key = key(gen);
+    if (last_key < first_key) {
+      std::swap(first_key, last_key);
+    }
+
+    std::vector<bh::MortonCell> cells;
+    bh::cover_key_range(first_key, last_key, cells);
+
+    // Consecutive cells tile the range
+    REQUIRE(!cells.empty());
+    REQUIRE(cells.front().m_first_key == first_key);
+    REQUIRE(cells.back().last_key() == last_key);
+    for (std::size_t j = 0; j + 1 < cells.size(); j++) {
+      REQUIRE(cells[j].last_key() + 1 == cells[j + 1].m_first_key);
+    }
+    // The parent of each cell is not in the range
+    for (const auto& cell : cells) {
+      REQUIRE(cell.m_level > 0);
+      const bh::MortonCell parent{cell.m_first_key & ~(((bh::MortonKey{1} << (2 * (bh::MORTON_KEY_DEPTH - cell.m_level + 1))) - 1)),
+                                  cell.m_level - 1};
+      REQUIRE((parent.m_first_key < first_key || last_key < parent.last_key()));
+    }
+  }
+}
+
+TEST_CASE("The whole range of Morton keys is covered by the root, and an empty range by no cell") {
+  std::vector<bh::MortonCell> cells;
+  bh::cover_key_range(0, ~bh::MortonKey{0}, cells);
+  REQUIRE(cells.size() == 1);
+  REQUIRE(cells[0].m_level == 0);
+
+  bh::cover_key_range(5, 4, cells);
+  REQUIRE(cells.empty());
+}
+
+TEST_CASE("The bounding box of a cell contains the points whose keys are in it") {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> position(-3.7, 12.1);
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-3.7, -3.7}, Eigen::Vector2d{12.1, 12.1}};
+
+  for (int i = 0; i < 1000; i++) {
+    const Eigen::Vector2d point{position(gen), position(gen)};
+    const auto key = bh::compute_morton_key(bbox, point);
+    for (int level = 0; level <= 8; level++) {
+      const auto shift = 2 * (bh::MORTON_KEY_DEPTH - level);
+      const bh::MortonCell cell{level == 0 ? 0 : (key >> shift) << shift, level};
+      REQUIRE(cell.m_first_key <= key);
+      REQUIRE(key <= cell.last_key());
+      REQUIRE(bh::compute_cell_bbox(bbox, cell).contains(point));
+    }
+  }
+}
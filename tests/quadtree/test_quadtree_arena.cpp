@@ -0,0 +1,50 @@
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+#include "linear_quadtree.h"
+#include "quadtree_arena.h"
+#include "random_bodies.h"
+
+SCENARIO("Allocate quadtrees from an arena") {
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  bh::QuadtreeArena arena;
+
+  GIVEN("A quadtree allocated from the arena") {
+    const auto bodies = make_random_bodies(1000, 42, 30);
+    auto quadtree = bh::construct_linear_quadtree(bodies, bbox, arena);
+
+    THEN("It is the same quadtree constructed without the arena") {
+      const auto expected = bh::construct_linear_quadtree(bodies, bbox);
+      REQUIRE(quadtree->n_nodes() == expected.n_nodes());
+      for (int i = 0; i < expected.n_nodes(); i++) {
+        REQUIRE(quadtree->nodes()[i].m_center_of_mass == expected.nodes()[i].m_center_of_mass);
+        REQUIRE(quadtree->nodes()[i].m_total_mass == expected.nodes()[i].m_total_mass);
+        REQUIRE(quadtree->nodes()[i].m_n_nodes == expected.nodes()[i].m_n_nodes);
+      }
+      REQUIRE(quadtree->bodies().size() == expected.bodies().size());
+    }
+
+    WHEN("It is released and another quadtree is allocated") {
+      const auto* nodes = quadtree->nodes().data();
+      quadtree.reset();
+      const auto other_bodies = make_random_bodies(500, 43, 30);
+      const auto other = bh::construct_linear_quadtree(other_bodies, bbox, arena);
+
+      THEN("The storage of the first quadtree is reused") {
+        REQUIRE(arena.n_quadtrees() == 1);
+        REQUIRE(other->nodes().data() == nodes);
+        REQUIRE(other->n_nodes() == bh::construct_linear_quadtree(other_bodies, bbox).n_nodes());
+      }
+    }
+
+    WHEN("It is still in use and another quadtree is allocated") {
+      const auto other = bh::construct_linear_quadtree(make_random_bodies(500, 43, 30), bbox, arena);
+
+      THEN("The first quadtree is left untouched") {
+        REQUIRE(arena.n_quadtrees() == 2);
+        REQUIRE(other.get() != quadtree.get());
+        REQUIRE(quadtree->bodies().size() == bodies.size());
+      }
+    }
+  }
+}
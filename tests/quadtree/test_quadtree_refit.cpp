@@ -0,0 +1,109 @@
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <vector>
+
+#include "linear_quadtree.h"
+#include "quadtree_arena.h"
+#include "quadtree_refit.h"
+#include "random_bodies.h"
+
+/**
+ * Checks that each body of a quadtree is contained in the cell of its leaf, and that the aggregates are consistent.
+ */
+void require_valid_quadtree(const bh::LinearQuadtree& quadtree, bh::LinearQuadtree::Index idx, const Eigen::AlignedBox2d& box) {
+  const auto& node = quadtree.nodes()[idx];
+  if (quadtree.is_leaf(idx)) {
+    double total_mass = 0;
+    for (auto i = node.m_first_body; i < node.m_first_body + node.m_n_bodies; i++) {
+      REQUIRE(bh::Node::get_subquadrant(box, quadtree.bodies()[i].m_position) != bh::Node::OUTSIDE);
+      total_mass += quadtree.bodies()[i].m_mass;
+    }
+    REQUIRE(node.m_total_mass == Catch::Approx(total_mass));
+    return;
+  }
+
+  const auto children = quadtree.children(idx);
+  const std::array<bh::Node::Subquadrant, 4> subquadrants{bh::Node::NW, bh::Node::NE, bh::Node::SE, bh::Node::SW};
+  double total_mass = 0;
+  for (int sq = 0; sq < 4; sq++) {
+    require_valid_quadtree(quadtree, children[sq], bh::Node::get_subquadrant_bbox(box, subquadrants[sq]));
+    total_mass += quadtree.nodes()[children[sq]].m_total_mass;
+  }
+  REQUIRE(node.m_total_mass == Catch::Approx(total_mass));
+}
+
+SCENARIO("Refit a quadtree to bodies that moved") {
+  auto bodies = make_random_bodies(5000, 42, 20);
+  std::mt19937 gen(43);
+  std::normal_distribution<double> displacement(0, 0.5);
+  // also some coinciding bodies, and some closer than the resolution of a Morton key
+  bodies.push_back({bodies[10].m_position, 2});
+  bodies.push_back({bodies[20].m_position + Eigen::Vector2d{1e-12, 0}, 1});
+  bodies.push_back({bodies[20].m_position - Eigen::Vector2d{0, 1e-12}, 1});
+  const Eigen::AlignedBox2d bbox{Eigen::Vector2d{-100, -100}, Eigen::Vector2d{100, 100}};
+  const auto move_bodies = [&]() {
+    for (auto& body : bodies) {
+      body.m_position += Eigen::Vector2d{displacement(gen), displacement(gen)};
+    }
+  };
+
+  bh::QuadtreeArena arena;
+  bh::QuadtreeRefitter refitter;
+
+  GIVEN("A rebuild interval of some steps") {
+    const auto first = refitter.construct(bodies, bbox, arena, 1, 4, 1);
+    REQUIRE_FALSE(refitter.refitted());
+    // leaving room for the bodies to move
+    REQUIRE(first->bbox().contains(bbox));
+    REQUIRE(first->bbox().sizes().x() == first->bbox().sizes().y());
+
+    THEN("The quadtrees in between are refitted, keeping the nodes of the rebuilt one") {
+      for (int step = 1; step < 4; step++) {
+        move_bodies();
+        const auto refitted = refitter.construct(bodies, bbox, arena, 1, 4, 1);
+
+        REQUIRE(refitter.refitted());
+        REQUIRE(refitted->n_nodes() == first->n_nodes());
+        REQUIRE(refitted->bodies().size() == bodies.size());
+        require_valid_quadtree(*refitted, bh::LinearQuadtree::ROOT, refitted->bbox());
+
+        const auto rebuilt = bh::construct_linear_quadtree(bodies, bbox);
+        const auto& root = refitted->nodes()[bh::LinearQuadtree::ROOT];
+        const auto& expected_root = rebuilt.nodes()[bh::LinearQuadtree::ROOT];
+        REQUIRE(root.m_total_mass == Catch::Approx(expected_root.m_total_mass));
+        REQUIRE(root.m_center_of_mass.x() == Catch::Approx(expected_root.m_center_of_mass.x()));
+        REQUIRE(root.m_center_of_mass.y() == Catch::Approx(expected_root.m_center_of_mass.y()));
+      }
+
+      move_bodies();
+      refitter.construct(bodies, bbox, arena, 1, 4, 1);
+      REQUIRE_FALSE(refitter.refitted());
+    }
+  }
+
+  GIVEN("A maximum imbalance of zero") {
+    refitter.construct(bodies, bbox, arena, 1, 10, 0);
+
+    THEN("The quadtree is rebuilt as soon as a leaf overflows") {
+      move_bodies();
+      const auto quadtree = refitter.construct(bodies, bbox, arena, 1, 10, 0);
+      REQUIRE_FALSE(refitter.refitted());
+      REQUIRE(quadtree->n_nodes() == bh::construct_linear_quadtree(bodies, quadtree->bbox()).n_nodes());
+    }
+  }
+
+  GIVEN("A body that leaves the bounding box of the last quadtree") {
+    refitter.construct(bodies, bbox, arena, 1, 10, 1);
+    bodies[0].m_position = {900, 900};
+
+    THEN("The quadtree is rebuilt") {
+      const Eigen::AlignedBox2d larger_bbox{Eigen::Vector2d{-1000, -1000}, Eigen::Vector2d{1000, 1000}};
+      const auto quadtree = refitter.construct(bodies, larger_bbox, arena, 1, 10, 1);
+      REQUIRE_FALSE(refitter.refitted());
+      REQUIRE(quadtree->bbox().contains(larger_bbox));
+    }
+  }
+
+  REQUIRE_THROWS(refitter.construct(bodies, bbox, arena, 1, 0));
+}
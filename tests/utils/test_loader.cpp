@@ -28,3 +28,18 @@ TEST_CASE("Read a body with negative mass throws exception") {
   // 2.5 3.2 -0.25 4.1 5.2
   REQUIRE_THROWS(bh::load_bodies(BODY_BAD));
 }
+
+TEST_CASE("Read a file with two bodies as structure of arrays") {
+  const auto bodies = bh::load_soa_bodies(BODY_TWO);
+  REQUIRE(bodies.size() == 2);
+
+  REQUIRE(bodies.m_x[0] == 2.5);
+  REQUIRE(bodies.m_y[0] == 3.2);
+  REQUIRE(bodies.m_mass[0] == 0.25);
+  REQUIRE(bodies.m_vx[0] == 4.1);
+  REQUIRE(bodies.m_vy[0] == 5.2);
+
+  REQUIRE(bodies.body(1).m_position == Eigen::Vector2d{7.3, 8});
+  REQUIRE(bodies.body(1).m_mass == 1.4);
+  REQUIRE(bodies.body(1).m_velocity == Eigen::Vector2d{6.5, 3});
+}
@@ -91,14 +91,17 @@ function quadtreeToSvg(quadtree) {
 
         if (node.fork) {
             nodes_to_process.push(node.fork.nw, node.fork.ne, node.fork.se, node.fork.sw);
-        } else if (node.leaf.body) {
-            body = node.leaf.body;
-            const CIRCLE_RADIUS = rootW / 300;//(ROOT_Width / 100) * body.mass;
-            svg.append("circle")
-                .style("vector-effect", "non-scaling-stroke")
-                .attr("cx", body.position.x)
-                .attr("cy", body.position.y)
-                .attr("r", CIRCLE_RADIUS);
+        } else {
+            // a bucket leaf holds several bodies
+            const bodies = node.leaf.bodies ?? (node.leaf.body ? [node.leaf.body] : []);
+            for (const body of bodies) {
+                const CIRCLE_RADIUS = rootW / 300;//(ROOT_Width / 100) * body.mass;
+                svg.append("circle")
+                    .style("vector-effect", "non-scaling-stroke")
+                    .attr("cx", body.position.x)
+                    .attr("cy", body.position.y)
+                    .attr("r", CIRCLE_RADIUS);
+            }
         }
     }
 